@@ -0,0 +1,223 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Registry capacity (set in menuconfig, "Device monitoring")
+#ifdef CONFIG_DEVICE_REGISTRY_MAX_DEVICES
+#define DEVICE_REGISTRY_MAX_DEVICES CONFIG_DEVICE_REGISTRY_MAX_DEVICES
+#else
+#define DEVICE_REGISTRY_MAX_DEVICES 256
+#endif
+
+#define DEVICE_NAME_SIZE            32
+#define DEVICE_IP_SIZE              16
+#define DEVICE_DESCRIPTION_SIZE     64
+
+// Handle of a registered device: slot index in the low 16 bits, slot
+// generation above. A handle stays valid until the device is removed, and a
+// stale handle never matches a device that later reuses the slot.
+typedef int32_t device_handle_t;
+
+#define DEVICE_HANDLE_INVALID       (-1)
+#define DEVICE_HANDLE_SLOT(handle)  ((int)((handle) & 0xFFFF))
+
+// Subsystems holding a reference to a device; a device is removed when
+// the last of them releases it
+#define DEVICE_OWNER_WOL            (1 << 0)
+#define DEVICE_OWNER_PING           (1 << 1)
+
+// Copy of a registered device, filled by device_registry_get()
+typedef struct {
+    char name[DEVICE_NAME_SIZE];     // Unique device name
+    char ip_address[DEVICE_IP_SIZE]; // Dotted-quad form of ipv4
+    uint32_t ipv4;                   // IPv4 address, network byte order
+    uint8_t mac_address[6];          // MAC address, all zero if unknown
+    uint8_t owners;                  // DEVICE_OWNER_* bits
+    char description[DEVICE_DESCRIPTION_SIZE]; // Free-form description, may be empty
+} device_registry_entry_t;
+
+// One change for device_registry_apply()
+typedef struct {
+    const char* name;                // Device name
+    uint32_t ipv4;                   // IPv4 address in network byte order (adds only)
+    const uint8_t* mac_address;      // MAC address, NULL to leave it unchanged (adds only)
+    const char* description;         // Description, NULL to leave it unchanged (adds only)
+    bool remove;                     // Drop the owners' references instead of adding
+} device_registry_change_t;
+
+// Outcome of one change, reported by device_registry_apply()
+typedef enum {
+    DEVICE_REGISTRY_ADDED = 0,       // New device
+    DEVICE_REGISTRY_UPDATED,         // Existing device, address, MAC, description or owners changed
+    DEVICE_REGISTRY_UNCHANGED,       // Existing device, nothing changed
+    DEVICE_REGISTRY_REMOVED,         // References dropped (the device may live on for other owners)
+    DEVICE_REGISTRY_MISSING          // Removal of a device that is not registered
+} device_registry_outcome_t;
+
+/**
+ * @brief Initialize the device registry
+ *
+ * Addresses, MACs and hash indices are kept in dense internal-RAM arrays.
+ * Names and descriptions are only read on lookups and reports, so they are
+ * allocated separately, in PSRAM when CONFIG_DEVICE_REGISTRY_STRINGS_IN_PSRAM
+ * is set and PSRAM is available.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the mutex or string store cannot be allocated
+ */
+esp_err_t device_registry_init(void);
+
+/**
+ * @brief Register a device, or take another reference to an existing one
+ *
+ * A device that is already registered under this name keeps its handle;
+ * its address is updated, and so is its MAC when one is given.
+ *
+ * @param name Unique device name
+ * @param ip_address IPv4 address in dotted-quad form
+ * @param mac_address MAC address (6 bytes), NULL to leave it unchanged
+ * @param owner DEVICE_OWNER_* bit of the calling subsystem
+ * @param handle_out Receives the device handle
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a bad name or address,
+ *         ESP_ERR_NO_MEM if the registry is full
+ */
+esp_err_t device_registry_add(const char* name, const char* ip_address, const uint8_t* mac_address,
+                              uint8_t owner, device_handle_t* handle_out);
+
+/**
+ * @brief Apply a batch of adds and removals as one transaction
+ *
+ * Every change is checked first; if any is invalid (bad name, zero address)
+ * or the new names do not fit, nothing is applied. The registry lock is taken
+ * once and the hash indices are rebuilt at most once for the whole batch.
+ *
+ * @param changes Changes, applied in order
+ * @param count Number of changes
+ * @param owners DEVICE_OWNER_* bits added or dropped by every change
+ * @param handles_out Receives one handle per change (for removals, the handle
+ *        the device had, DEVICE_HANDLE_INVALID if it was not registered)
+ * @param outcomes_out Receives one device_registry_outcome_t per change, can be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an invalid change,
+ *         ESP_ERR_NO_MEM if the new devices do not fit
+ */
+esp_err_t device_registry_apply(const device_registry_change_t* changes, int count, uint8_t owners,
+                                device_handle_t* handles_out, uint8_t* outcomes_out);
+
+/**
+ * @brief Set the description of a device
+ * @param handle Device handle
+ * @param description Description, truncated to DEVICE_DESCRIPTION_SIZE - 1 bytes
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for a stale handle
+ */
+esp_err_t device_registry_set_description(device_handle_t handle, const char* description);
+
+/**
+ * @brief Drop a subsystem's reference to a device
+ *
+ * The device is removed and its handle invalidated once no owner is left.
+ *
+ * @param handle Device handle
+ * @param owner DEVICE_OWNER_* bit of the calling subsystem
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for a stale handle
+ */
+esp_err_t device_registry_release(device_handle_t handle, uint8_t owner);
+
+/**
+ * @brief Look up a device by name
+ * @param name Device name
+ * @return Device handle, DEVICE_HANDLE_INVALID if not registered
+ */
+device_handle_t device_registry_find(const char* name);
+
+/**
+ * @brief Look up a device by a name that is not NUL terminated
+ *
+ * Meant for names sliced out of MQTT topics, which need no copy.
+ *
+ * @param name Start of the name
+ * @param len Name length in bytes
+ * @return Device handle, DEVICE_HANDLE_INVALID if not registered
+ */
+device_handle_t device_registry_find_n(const char* name, int len);
+
+/**
+ * @brief Look up a device by IPv4 address
+ * @param ipv4 Address in network byte order
+ * @return Handle of the first device with this address, DEVICE_HANDLE_INVALID if none
+ */
+device_handle_t device_registry_find_by_ip(uint32_t ipv4);
+
+/**
+ * @brief Look up a device by MAC address
+ * @param mac_address MAC address (6 bytes)
+ * @return Handle of the first device with this MAC, DEVICE_HANDLE_INVALID if none
+ */
+device_handle_t device_registry_find_by_mac(const uint8_t* mac_address);
+
+/**
+ * @brief Get the slot of a device, for indexing per-subsystem tables
+ * @param handle Device handle
+ * @return Slot in [0, DEVICE_REGISTRY_MAX_DEVICES), -1 for a stale handle
+ */
+int device_registry_slot(device_handle_t handle);
+
+/**
+ * @brief Copy the name of a device
+ * @param handle Device handle
+ * @param buf Output buffer, set to an empty string on error
+ * @param size Buffer size, DEVICE_NAME_SIZE fits any name
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for a stale handle,
+ *         ESP_ERR_TIMEOUT if the registry is busy
+ */
+esp_err_t device_registry_copy_name(device_handle_t handle, char* buf, size_t size);
+
+/**
+ * @brief Get the IPv4 address of a device without locking
+ * @param handle Device handle
+ * @return Address in network byte order, 0 for a stale handle
+ */
+uint32_t device_registry_ipv4(device_handle_t handle);
+
+/**
+ * @brief Format an IPv4 address in dotted-quad form
+ * @param ipv4 Address in network byte order
+ * @param buf Output buffer
+ * @param size Buffer size, DEVICE_IP_SIZE fits any address
+ */
+void device_registry_format_ip(uint32_t ipv4, char* buf, size_t size);
+
+/**
+ * @brief Copy everything known about a device
+ * @param handle Device handle
+ * @param entry_out Receives a copy of the entry
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND for a stale handle
+ */
+esp_err_t device_registry_get(device_handle_t handle, device_registry_entry_t* entry_out);
+
+/**
+ * @brief Iterate over registered devices in slot order
+ * @param after Previous handle, DEVICE_HANDLE_INVALID to start
+ * @param owner Only return devices with this DEVICE_OWNER_* bit, 0 for all
+ * @return Next handle, DEVICE_HANDLE_INVALID when done
+ */
+device_handle_t device_registry_next(device_handle_t after, uint8_t owner);
+
+/**
+ * @brief Get the number of registered devices
+ * @return Device count
+ */
+int device_registry_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_REGISTRY_H
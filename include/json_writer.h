@@ -0,0 +1,92 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming JSON writer state; output goes straight into the caller's buffer
+typedef struct {
+    char* buffer;                    // Output buffer (caller owned)
+    size_t size;                     // Buffer size including the terminator
+    size_t length;                   // Bytes written so far, excluding the terminator
+    bool need_comma;                 // Next key or value needs a separator
+    bool overflow;                   // Output did not fit, buffer holds a truncated document
+} json_writer_t;
+
+/**
+ * @brief Start writing a document into a buffer
+ *
+ * The writer never allocates. Output is compact (no whitespace) and always
+ * NUL terminated. Once the buffer is full further writes are dropped and
+ * json_writer_finish() reports the overflow.
+ *
+ * @param writer Writer state to initialize
+ * @param buffer Output buffer
+ * @param size Size of the output buffer in bytes
+ */
+void json_writer_init(json_writer_t* writer, char* buffer, size_t size);
+
+/**
+ * @brief Finish the document
+ * @param writer Writer state
+ * @return Length of the document, or -1 if it did not fit in the buffer
+ */
+int json_writer_finish(json_writer_t* writer);
+
+/**
+ * @brief Open and close objects and arrays
+ * @param writer Writer state
+ */
+void json_writer_object_begin(json_writer_t* writer);
+void json_writer_object_end(json_writer_t* writer);
+void json_writer_array_begin(json_writer_t* writer);
+void json_writer_array_end(json_writer_t* writer);
+
+/**
+ * @brief Write an object key; the next call writes its value
+ * @param writer Writer state
+ * @param key Key name, escaped like a string value
+ */
+void json_writer_key(json_writer_t* writer, const char* key);
+
+/**
+ * @brief Write scalar values (array elements or the value after a key)
+ * @param writer Writer state
+ * @param value Value to write; NULL strings are written as null
+ */
+void json_writer_string(json_writer_t* writer, const char* value);
+void json_writer_int(json_writer_t* writer, int64_t value);
+void json_writer_uint(json_writer_t* writer, uint64_t value);
+void json_writer_bool(json_writer_t* writer, bool value);
+
+/**
+ * @brief Write a fixed-point number, e.g. (1834, 3) is written as 1.834
+ * @param writer Writer state
+ * @param value Scaled integer value
+ * @param decimals Number of decimal digits in value (0-9)
+ */
+void json_writer_fixed(json_writer_t* writer, int64_t value, int decimals);
+
+/**
+ * @brief Write a MAC address as a "aa:bb:cc:dd:ee:ff" string
+ * @param writer Writer state
+ * @param mac MAC address (6 bytes)
+ */
+void json_writer_mac(json_writer_t* writer, const uint8_t* mac);
+
+// Key/value shorthands
+void json_writer_kv_string(json_writer_t* writer, const char* key, const char* value);
+void json_writer_kv_int(json_writer_t* writer, const char* key, int64_t value);
+void json_writer_kv_uint(json_writer_t* writer, const char* key, uint64_t value);
+void json_writer_kv_bool(json_writer_t* writer, const char* key, bool value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,91 @@
+#ifndef MQTT_CONNECT_STATS_H
+#define MQTT_CONNECT_STATS_H
+
+#include "json_writer.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "secrets.h"  // Include secrets for configuration
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Histogram settings (can be overridden in secrets.h)
+#ifndef MQTT_CONNECT_STATS_WINDOW
+#define MQTT_CONNECT_STATS_WINDOW   32     // Samples per stage before older samples are aged out
+#endif
+
+#define MQTT_CONNECT_HIST_BUCKETS   8      // Bucket upper bounds: 50, 100, 250, 500, 1000, 2500, 5000 ms, more
+
+// Connection setup stages, each timed from the end of the previous one
+typedef enum {
+    MQTT_CONNECT_STAGE_DNS = 0,      // Broker host name lookup
+    MQTT_CONNECT_STAGE_CONNACK,      // TCP connect, TLS handshake and MQTT CONNECT until CONNACK
+    MQTT_CONNECT_STAGE_SUBACK,       // CONNACK until the SUBACK for the routed topics
+    MQTT_CONNECT_STAGE_TOTAL,        // Whole attempt, start until the client is ready
+    MQTT_CONNECT_STAGE_COUNT
+} mqtt_connect_stage_t;
+
+// Rolling statistics for one stage, in milliseconds
+typedef struct {
+    uint32_t samples;                // Samples in the histogram (aged)
+    uint32_t last_ms;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint64_t sum_ms;                 // Sum over the aged samples, for the average
+    uint32_t buckets[MQTT_CONNECT_HIST_BUCKETS];
+} mqtt_connect_stage_stats_t;
+
+/**
+ * @brief Start timing a connect attempt
+ *
+ * All mqtt_connect_stats functions are meant to be called from the MQTT
+ * task (its event handler and route handlers) and do no locking.
+ */
+void mqtt_connect_stats_begin(void);
+
+/**
+ * @brief Record a stage of the current attempt
+ *
+ * The stage is timed from the previous mark, or from the start of the
+ * attempt. Ignored when no attempt is in progress.
+ *
+ * @param stage Stage that just finished (not MQTT_CONNECT_STAGE_TOTAL)
+ */
+void mqtt_connect_stats_mark(mqtt_connect_stage_t stage);
+
+/**
+ * @brief Finish the current attempt successfully and record its total time
+ * @return true if an attempt was in progress
+ */
+bool mqtt_connect_stats_complete(void);
+
+/**
+ * @brief Count the current attempt as failed
+ */
+void mqtt_connect_stats_fail(void);
+
+/**
+ * @brief Check whether the current attempt is still waiting for a stage
+ * @return true between begin and complete/fail
+ */
+bool mqtt_connect_stats_in_progress(void);
+
+/**
+ * @brief Get the statistics for a stage
+ * @param stage Stage
+ * @return Statistics, NULL for an invalid stage
+ */
+const mqtt_connect_stage_stats_t* mqtt_connect_stats_get(mqtt_connect_stage_t stage);
+
+/**
+ * @brief Write all statistics as a JSON object
+ * @param json Writer positioned where a value may be written
+ */
+void mqtt_connect_stats_write_json(json_writer_t* json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_CONNECT_STATS_H
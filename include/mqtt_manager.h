@@ -3,12 +3,77 @@
 
 #include "esp_err.h"
 #include "mqtt_client.h"
+#include "mqtt_router.h"
+#include "device_registry.h"
 #include "secrets.h"  // Include secrets for configuration
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Ping result batching (can be overridden in secrets.h)
+#ifndef MQTT_PING_BATCH_SIZE
+#define MQTT_PING_BATCH_SIZE       20     // Publish as soon as this many results are queued
+#endif
+#ifndef MQTT_PING_BATCH_WINDOW_MS
+#define MQTT_PING_BATCH_WINDOW_MS  500    // Publish at most this long after the first queued result
+#endif
+
+// Delta publication (can be overridden in secrets.h)
+#ifndef MQTT_PING_DELTA_MODE
+#define MQTT_PING_DELTA_MODE       1      // Only publish ping results that change something
+#endif
+#ifndef MQTT_PING_DELTA_RTT_US
+#define MQTT_PING_DELTA_RTT_US     20000  // RTT change that counts as a change, in microseconds
+#endif
+
+// Devices summary paging (can be overridden in secrets.h)
+#ifndef MQTT_SUMMARY_PAGE_SIZE
+#define MQTT_SUMMARY_PAGE_SIZE     6      // Devices per esp32/system/devices/page/<seq> message
+#endif
+
+// Ping latency summary (can be overridden in secrets.h)
+#ifndef MQTT_TOPIC_LATENCY
+#define MQTT_TOPIC_LATENCY         MQTT_TOPIC_PREFIX "/ping/latency"
+#endif
+#ifndef MQTT_LATENCY_PAGE_SIZE
+#define MQTT_LATENCY_PAGE_SIZE     3      // Targets per MQTT_TOPIC_LATENCY/page/<seq> message
+#endif
+
+// Inbound reassembly (can be overridden in secrets.h)
+#ifndef MQTT_RX_MAX_MESSAGE
+#define MQTT_RX_MAX_MESSAGE        8192   // Largest fragmented inbound payload accepted, in bytes
+#endif
+
+// Offline queue draining after a reconnect (can be overridden in secrets.h)
+#ifndef MQTT_OFFLINE_DRAIN_BATCH
+#define MQTT_OFFLINE_DRAIN_BATCH       4      // Queued messages handed to the client per drain tick
+#endif
+#ifndef MQTT_OFFLINE_DRAIN_INTERVAL_MS
+#define MQTT_OFFLINE_DRAIN_INTERVAL_MS 100    // Time between drain ticks
+#endif
+
+// Session handling (can be overridden in secrets.h)
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION        1      // Keep the broker session (and subscriptions) across reconnects
+#endif
+
+// Connection setup diagnostics (can be overridden in secrets.h)
+#ifndef MQTT_TOPIC_CONNECT_STATS
+#define MQTT_TOPIC_CONNECT_STATS       MQTT_TOPIC_PREFIX "/diagnostics/connect"
+#endif
+
+// Runtime metrics (can be overridden in secrets.h)
+#ifndef MQTT_TOPIC_METRICS
+#define MQTT_TOPIC_METRICS             MQTT_TOPIC_PREFIX "/metrics"
+#endif
+#ifndef MQTT_METRICS_INTERVAL_MS
+#define MQTT_METRICS_INTERVAL_MS       60000  // Periodic publish while connected, 0 to only publish on request
+#endif
+#ifndef MQTT_METRICS_MIN_INTERVAL_MS
+#define MQTT_METRICS_MIN_INTERVAL_MS   5000   // Requests closer than this to the last publish are dropped
+#endif
+
 // MQTT Quality of Service levels
 typedef enum {
     MQTT_QOS_0 = 0,  // At most once
@@ -16,12 +81,21 @@ typedef enum {
     MQTT_QOS_2 = 2   // Exactly once
 } mqtt_qos_t;
 
-// MQTT Message callback type
-typedef void (*mqtt_message_callback_t)(const char* topic, const char* data, int data_len);
+// Callback for messages no route matched (topic and data are not NUL terminated)
+typedef void (*mqtt_message_callback_t)(const char* topic, int topic_len, const char* data, int data_len);
+
+// Called from the MQTT task after the connect setup is done, and on disconnect
+typedef void (*mqtt_connection_callback_t)(bool connected);
+
+/**
+ * @brief Set the callback for broker connection changes
+ * @param callback Callback, NULL to remove
+ */
+void mqtt_manager_set_connection_callback(mqtt_connection_callback_t callback);
 
 /**
  * @brief Initialize MQTT manager
- * @param message_callback Callback function for received messages (can be NULL)
+ * @param message_callback Callback for messages that match no registered route (can be NULL)
  * @return ESP_OK on success, ESP_FAIL on error
  */
 esp_err_t mqtt_manager_init(mqtt_message_callback_t message_callback);
@@ -60,10 +134,76 @@ esp_err_t mqtt_manager_send_device_info(void);
  * @brief Send ping result
  * @param ip_address Target IP address
  * @param success Ping success status
- * @param response_time Response time in milliseconds
+ * @param response_time_us Round-trip time in microseconds
+ * @return ESP_OK on success, ESP_FAIL on error
+ */
+esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, uint32_t response_time_us);
+
+/**
+ * @brief Queue a ping result for batched publishing
+ *
+ * Queued results are published together as one compact JSON array on
+ * MQTT_TOPIC_PING_RESULTS, as soon as MQTT_PING_BATCH_SIZE results are queued
+ * or MQTT_PING_BATCH_WINDOW_MS after the first one, whichever comes first.
+ * In low-power mode the window ends with the probe wake instead.
+ *
+ * In delta mode a result is only queued when the target's online state
+ * flipped or its RTT moved by more than the threshold since the last
+ * published result. While disconnected results are dropped; the retained,
+ * debounced esp32/device/<name>/status topic is published by the WoL manager.
+ *
+ * @param handle Target device handle, keys the delta state
+ * @param name Target name
+ * @param ip_address Target IP address
+ * @param success Ping success status
+ * @param response_time_us Round-trip time in microseconds
  * @return ESP_OK on success, ESP_FAIL on error
  */
-esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, uint32_t response_time);
+esp_err_t mqtt_manager_queue_ping_result(device_handle_t handle, const char* name, const char* ip_address,
+                                         bool success, uint32_t response_time_us);
+
+/**
+ * @brief Configure delta publication of ping results
+ * @param enabled True to publish only changes, false to publish every result
+ * @param rtt_threshold_us RTT change in microseconds that is published as a change
+ */
+void mqtt_manager_set_delta_mode(bool enabled, uint32_t rtt_threshold_us);
+
+/**
+ * @brief Check whether delta publication is enabled
+ * @return true if only changes are published
+ */
+bool mqtt_manager_is_delta_mode(void);
+
+/**
+ * @brief Publish all queued ping results now
+ * @return ESP_OK on success (or nothing queued), ESP_FAIL on error
+ */
+esp_err_t mqtt_manager_flush_ping_results(void);
+
+/**
+ * @brief Send the output held back for the current wake
+ *
+ * Flushes the queued ping results and, in low-power mode, publishes the
+ * metrics once MQTT_METRICS_INTERVAL_MS has passed since the last publish.
+ * Meant for the ping manager's wake done callback.
+ *
+ * @return Result of mqtt_manager_flush_ping_results()
+ */
+esp_err_t mqtt_manager_flush_window(void);
+
+/**
+ * @brief Hold output back until the end of each probe wake
+ *
+ * Queued ping results are no longer flushed MQTT_PING_BATCH_WINDOW_MS after
+ * the first one, and the periodic metrics timer is not run; both go out from
+ * mqtt_manager_flush_window() instead, so the radio is only busy while the
+ * device is awake for probing anyway. State changes and commands are not
+ * delayed.
+ *
+ * @param enabled true to enable
+ */
+void mqtt_manager_set_low_power(bool enabled);
 
 /**
  * @brief Publish a message to a topic
@@ -71,7 +211,10 @@ esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, ui
  * @param data Message data
  * @param qos Quality of Service level
  * @param retain Retain message flag
- * @return ESP_OK on success, ESP_FAIL on error
+ * @return ESP_OK on success or when queued for later, ESP_FAIL on error
+ * @note While disconnected the message goes to the offline queue; retained
+ *       messages replace a queued message on the same topic, and keep going
+ *       through the queue after a reconnect until it has drained.
  */
 esp_err_t mqtt_manager_publish(const char* topic, const char* data, mqtt_qos_t qos, bool retain);
 
@@ -83,43 +226,106 @@ esp_err_t mqtt_manager_publish(const char* topic, const char* data, mqtt_qos_t q
  */
 esp_err_t mqtt_manager_subscribe(const char* topic, mqtt_qos_t qos);
 
+/**
+ * @brief Publish connection setup timings on MQTT_TOPIC_CONNECT_STATS
+ *
+ * Also published (retained) after every successful connect. Reports the
+ * DNS, CONNACK and SUBACK stage times of recent attempts as histograms.
+ *
+ * @return ESP_OK on success, ESP_FAIL if not connected or on error
+ */
+esp_err_t mqtt_manager_publish_connect_stats(void);
+
+/**
+ * @brief Publish runtime metrics on MQTT_TOPIC_METRICS
+ *
+ * Published every MQTT_METRICS_INTERVAL_MS while connected (at the end of
+ * the first probe wake after that in low-power mode), and on the "metrics"
+ * system command. Carries CPU load per core and per task, stack high-water
+ * marks, heap use and fragmentation per capability, lwIP socket and pool use,
+ * the MQTT outbox and offline queue depth, and the probe wakes and the share
+ * of the interval spent awake for them. Calls less than
+ * MQTT_METRICS_MIN_INTERVAL_MS after the previous publish are dropped.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE when rate limited,
+ *         ESP_FAIL if not connected or on error
+ */
+esp_err_t mqtt_manager_publish_metrics(void);
+
+/**
+ * @brief Get the number of messages waiting for the broker to come back
+ * @return Queued messages
+ */
+int mqtt_manager_get_offline_count(void);
+
 /**
  * @brief Publish MQTT message to a topic
  * @param topic MQTT topic
  * @param message Message to publish
- * @return ESP_OK on success, ESP_FAIL on error
+ * @return ESP_OK on success or when queued for later, ESP_FAIL on error
+ * @note While disconnected the message goes to the offline queue
  */
 esp_err_t mqtt_publish(const char* topic, const char* message);
 
 /**
- * @brief Subscribe to WoL command topics
+ * @brief Register a handler for a topic filter and subscribe to it
+ *
+ * Inbound messages are dispatched through the topic router without copying;
+ * '+' levels of the filter are passed to the handler as slices. Routes can
+ * be registered before mqtt_manager_init(); they are subscribed on every
+ * connect, and immediately if the client is already connected.
+ *
+ * @param filter Topic filter, e.g. "esp32/wol/+/command"
+ * @param qos Subscription QoS
+ * @param handler Handler called from the MQTT task
+ * @param user_data Passed to the handler
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t mqtt_manager_register_route(const char* filter, mqtt_qos_t qos, mqtt_route_handler_t handler,
+                                      void* user_data);
+
+/**
+ * @brief Subscribe to the topic filters of all registered routes
+ *        (WoL commands, device control and system commands included)
+ *
+ * All filters go out in a single SUBSCRIBE packet.
+ *
  * @return ESP_OK on success, ESP_FAIL on error
  */
 esp_err_t mqtt_subscribe_wol_commands(void);
 
 /**
- * @brief Handle WoL MQTT commands
- * @param topic MQTT topic
+ * @brief Dispatch a message as if it had been received
+ * @param topic MQTT topic (NUL terminated)
  * @param data Message data
  * @param data_len Length of message data
- * @return ESP_OK on success, ESP_FAIL on error
+ * @return Handler result, ESP_ERR_NOT_FOUND if no route matched
  */
 esp_err_t mqtt_handle_wol_command(const char* topic, const char* data, int data_len);
 
 /**
- * @brief Publish device status to MQTT
- * @param device_name Device name
- * @param is_online Online status
- * @param ip_address Device IP address
+ * @brief Publish all devices status summary
+ *
+ * The summary is split into pages of MQTT_SUMMARY_PAGE_SIZE devices, each
+ * published to esp32/system/devices/page/<seq> with "id", "seq" (1-based) and
+ * "seq_total" so consumers can reassemble it. Stack use is one page,
+ * whatever the number of devices.
+ *
  * @return ESP_OK on success, ESP_FAIL on error
  */
-esp_err_t mqtt_publish_device_status(const char* device_name, bool is_online, const char* ip_address);
+esp_err_t mqtt_publish_devices_summary(void);
 
 /**
- * @brief Publish all devices status summary
+ * @brief Publish the rolling latency statistics of all ping targets
+ *
+ * Per target the RTT percentiles, jitter and 1 min / 15 min / 1 h success
+ * rates from ping_manager_get_latency_stats(), paged like the devices
+ * summary: MQTT_LATENCY_PAGE_SIZE targets per MQTT_TOPIC_LATENCY/page/<seq>
+ * message with "id", "seq" and "seq_total".
+ *
  * @return ESP_OK on success, ESP_FAIL on error
  */
-esp_err_t mqtt_publish_devices_summary(void);
+esp_err_t mqtt_publish_latency_summary(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,96 @@
+#ifndef MQTT_OFFLINE_QUEUE_H
+#define MQTT_OFFLINE_QUEUE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "secrets.h"  // Include secrets for configuration
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Queue limits (can be overridden in secrets.h)
+#ifndef MQTT_OFFLINE_QUEUE_SIZE
+#define MQTT_OFFLINE_QUEUE_SIZE         32     // Messages held while the broker is unreachable
+#endif
+#ifndef MQTT_OFFLINE_PAYLOAD_SIZE
+#define MQTT_OFFLINE_PAYLOAD_SIZE       192    // Largest payload that can be queued, in bytes
+#endif
+
+#define MQTT_OFFLINE_TOPIC_SIZE         64
+
+// Message waiting for the broker
+typedef struct {
+    char topic[MQTT_OFFLINE_TOPIC_SIZE];
+    char payload[MQTT_OFFLINE_PAYLOAD_SIZE];
+    uint16_t payload_len;
+    uint8_t qos;
+    bool retain;
+    bool coalesce;                   // Replaced in place by a newer message on the same topic
+    int64_t queued_ms;               // esp_timer time of the latest push
+} mqtt_offline_msg_t;
+
+/**
+ * @brief Send callback used while draining
+ * @param msg Oldest queued message; only valid during the call
+ * @return ESP_OK when the message was handed to the client, anything else
+ *         leaves it at the head of the queue
+ */
+typedef esp_err_t (*mqtt_offline_send_t)(const mqtt_offline_msg_t* msg);
+
+/**
+ * @brief Initialize the offline queue
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the mutex cannot be created
+ */
+esp_err_t mqtt_offline_queue_init(void);
+
+/**
+ * @brief Queue a message for publishing once the broker is back
+ *
+ * With coalesce set, a queued message on the same topic is overwritten
+ * and keeps its place in the queue, so only the latest state per topic is
+ * sent. Otherwise the message is appended; when the queue is full the
+ * oldest message is dropped to make room.
+ *
+ * @param topic Topic (shorter than MQTT_OFFLINE_TOPIC_SIZE)
+ * @param payload Payload bytes
+ * @param len Payload length (at most MQTT_OFFLINE_PAYLOAD_SIZE)
+ * @param qos QoS to publish with
+ * @param retain Retain flag to publish with
+ * @param coalesce Keep only the latest message for this topic
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the message does not fit,
+ *         ESP_ERR_TIMEOUT if the queue is busy
+ */
+esp_err_t mqtt_offline_queue_push(const char* topic, const char* payload, int len, int qos, bool retain,
+                                  bool coalesce);
+
+/**
+ * @brief Send up to max_count messages, oldest first
+ *
+ * Stops at the first message the callback does not accept, which stays
+ * queued for the next attempt.
+ *
+ * @param max_count Maximum number of messages to send
+ * @param send Callback that hands one message to the MQTT client
+ * @return Number of messages sent
+ */
+int mqtt_offline_queue_drain(int max_count, mqtt_offline_send_t send);
+
+/**
+ * @brief Get the number of queued messages
+ * @return Queued messages
+ */
+int mqtt_offline_queue_count(void);
+
+/**
+ * @brief Get the number of messages dropped because the queue was full
+ * @return Dropped messages since boot
+ */
+uint32_t mqtt_offline_queue_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_OFFLINE_QUEUE_H
@@ -0,0 +1,108 @@
+#ifndef MQTT_ROUTER_H
+#define MQTT_ROUTER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define MQTT_ROUTER_MAX_ROUTES     12     // Registered topic filters
+#define MQTT_ROUTER_FILTER_LEN     64     // Longest topic filter, including the terminator
+#define MQTT_ROUTER_MAX_LEVELS     8      // Topic levels per filter
+#define MQTT_ROUTER_MAX_CAPTURES   4      // Wildcards per filter
+
+// Non-owning view into a topic or payload; not NUL terminated
+typedef struct {
+    const char* ptr;
+    int len;
+} mqtt_slice_t;
+
+/**
+ * @brief Route handler
+ *
+ * Called from the MQTT task with pointers into the received message; the
+ * slices are only valid for the duration of the call.
+ *
+ * @param captures One slice per '+' (and a trailing '#') in the filter, in order
+ * @param capture_count Number of captures
+ * @param data Message payload (not NUL terminated)
+ * @param data_len Payload length
+ * @param user_data User data given at registration
+ * @return ESP_OK on success, error code on failure
+ */
+typedef esp_err_t (*mqtt_route_handler_t)(const mqtt_slice_t* captures, int capture_count,
+                                          const char* data, int data_len, void* user_data);
+
+// Compiled topic filter
+typedef struct {
+    char filter[MQTT_ROUTER_FILTER_LEN];          // Filter as subscribed
+    uint8_t level_offset[MQTT_ROUTER_MAX_LEVELS]; // Start of each level in filter
+    uint8_t level_len[MQTT_ROUTER_MAX_LEVELS];    // Length of each level
+    uint8_t level_count;                          // Levels before a trailing '#'
+    bool multi_level;                             // Filter ends with '#'
+    int qos;                                      // Subscription QoS
+    mqtt_route_handler_t handler;
+    void* user_data;
+} mqtt_route_t;
+
+/**
+ * @brief Compile and register a topic filter
+ *
+ * Filters follow MQTT syntax: '+' matches one level and '#' (last level
+ * only) matches the rest of the topic. Both are captured. Routes are
+ * matched in registration order and the first match wins.
+ *
+ * @param filter Topic filter, e.g. "esp32/wol/+/command"
+ * @param qos Subscription QoS for the filter
+ * @param handler Function called for matching messages
+ * @param user_data Passed to the handler
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a malformed filter,
+ *         ESP_ERR_NO_MEM when the route table is full
+ */
+esp_err_t mqtt_router_add(const char* filter, int qos, mqtt_route_handler_t handler, void* user_data);
+
+/**
+ * @brief Dispatch a message to the first matching route, without copying
+ * @param topic Topic pointer (need not be NUL terminated)
+ * @param topic_len Topic length
+ * @param data Payload pointer
+ * @param data_len Payload length
+ * @return Handler result, or ESP_ERR_NOT_FOUND if no route matched
+ */
+esp_err_t mqtt_router_dispatch(const char* topic, int topic_len, const char* data, int data_len);
+
+/**
+ * @brief Get a registered route, e.g. to subscribe to its filter
+ * @param index Route index, 0 to mqtt_router_get_route_count() - 1
+ * @return Route, NULL if the index is out of range
+ */
+const mqtt_route_t* mqtt_router_get_route(int index);
+
+/**
+ * @brief Get the number of registered routes
+ * @return Number of routes
+ */
+int mqtt_router_get_route_count(void);
+
+/**
+ * @brief Compare a slice with a NUL terminated string
+ * @return true if both hold the same bytes
+ */
+bool mqtt_slice_equals(const mqtt_slice_t* slice, const char* text);
+
+/**
+ * @brief Copy a slice into a NUL terminated buffer
+ * @return true if the slice fit, false if it was empty or too long (buffer left empty)
+ */
+bool mqtt_slice_copy(const mqtt_slice_t* slice, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_ROUTER_H
@@ -2,6 +2,9 @@
 #define PING_MANAGER_H
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#include "device_registry.h"
+#include "probe_stats.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,33 +13,119 @@ extern "C" {
 #endif
 
 // Constants
-#define PING_MAX_TARGETS        20
+#define PING_MAX_TARGETS        DEVICE_REGISTRY_MAX_DEVICES  // One target per registry slot
 #define PING_DEFAULT_INTERVAL   10000  // 10 seconds
+#define PING_MIN_INTERVAL       100    // Shortest per-target interval
+#define PING_DEFAULT_MAX_INTERVAL 120000 // Backoff ceiling for targets whose state does not change
+#define PING_FAST_INTERVAL      1000   // Interval while a woken target is expected to come up
+#define PING_FAST_WINDOW        180000 // How long fast probing lasts after a wake
 #define PING_DEFAULT_TIMEOUT    3000   // 3 seconds  
-#define PING_DEFAULT_COUNT      1      // 1 ping per cycle
+#define PING_MAX_PORTS          4      // Ports raced per TCP/UDP target
 
-// Ping target structure
+// Probes in flight at once (set in menuconfig, "Device monitoring")
+#ifdef CONFIG_PING_SWEEP_MAX
+#define PING_SWEEP_MAX          CONFIG_PING_SWEEP_MAX
+#else
+#define PING_SWEEP_MAX          32
+#endif
+
+// Task layout: ping_task probes on PING_TASK_CORE, results are handed over
+// through a lock-free ring to ping_results on the other core, next to
+// mqtt_task and its TLS writes (set in menuconfig, "Device monitoring")
+#if CONFIG_FREERTOS_UNICORE
+#define PING_TASK_CORE          0
+#define PING_RESULT_TASK_CORE   0
+#else
+#ifdef CONFIG_PING_TASK_CORE
+#define PING_TASK_CORE          CONFIG_PING_TASK_CORE
+#else
+#define PING_TASK_CORE          0
+#endif
+#define PING_RESULT_TASK_CORE   (1 - PING_TASK_CORE)
+#endif
+#define PING_TASK_PRIORITY      5
+#define PING_RESULT_TASK_PRIORITY 5
+#define PING_RESULT_TASK_STACK  4096   // The callback publishes, which may write to the TLS socket
+
+// Probe strategy per target
+typedef enum {
+    PING_STRATEGY_TCP = 0,           // TCP connect, listed ports raced in parallel
+    PING_STRATEGY_ICMP,              // ICMP echo request over a shared raw socket
+    PING_STRATEGY_UDP,               // UDP datagram, online when any listed port replies
+    PING_STRATEGY_ARP                // ARP request and cache lookup, same subnet only
+} ping_strategy_t;
+
+// Probe configuration for ping_manager_add_device_ex()
+typedef struct {
+    ping_strategy_t strategy;        // How the target is probed
+    uint16_t ports[PING_MAX_PORTS];  // TCP/UDP ports to race (ignored for ICMP)
+    uint8_t port_count;              // Number of valid entries in ports
+    uint32_t interval_ms;            // Probe interval, 0 for PING_DEFAULT_INTERVAL
+    uint32_t max_interval_ms;        // Backoff ceiling, 0 for PING_DEFAULT_MAX_INTERVAL
+    uint32_t timeout_ms;             // Probe timeout, 0 for PING_DEFAULT_TIMEOUT
+    uint8_t mac_address[6];          // Expected MAC for ARP presence, all zero to accept any
+} ping_probe_config_t;
+
+// Snapshot of a ping target, filled by ping_manager_get_device()
 typedef struct {
-    char name[32];                   // Device name for identification
-    char ip_address[16];             // IP address to ping
-    uint32_t interval_ms;            // Ping interval in milliseconds
+    device_handle_t handle;          // Registry handle, the name lives in the registry
+    uint32_t ipv4;                   // Address probed, network byte order
+    uint32_t interval_ms;            // Base (shortest) ping interval in milliseconds
+    uint32_t max_interval_ms;        // Longest interval reached by backoff
+    uint32_t current_interval_ms;    // Interval in effect, doubles while the state is unchanged
+    uint32_t fast_interval_ms;       // Interval during the fast probing window
     uint32_t timeout_ms;             // Ping timeout in milliseconds
-    uint32_t count;                  // Number of pings per cycle
+    ping_strategy_t strategy;        // How the target is probed
+    uint16_t ports[PING_MAX_PORTS];  // TCP/UDP ports raced per probe
+    uint8_t port_count;              // Number of valid entries in ports
+    uint8_t mac_address[6];          // Expected MAC for ARP presence (all zero: not checked)
     bool enabled;                    // Whether this target is active
     bool is_online;                  // Current online status
     uint32_t success_count;          // Total successful pings
     uint32_t fail_count;             // Total failed pings
-    uint64_t last_ping_time;         // Last ping timestamp
-    uint64_t last_success_time;      // Last successful ping timestamp
+    uint32_t last_rtt_us;            // Round-trip time of the last successful ping
+    uint64_t last_ping_time;         // Last ping timestamp (monotonic ms since boot, 0 if none)
+    uint64_t last_success_time;      // Last successful ping timestamp (monotonic ms since boot, 1 s resolution)
+    int64_t next_probe_us;           // Next scheduled probe (esp_timer time)
+    int64_t fast_until_us;           // End of the fast probing window (esp_timer time, 0 if none)
 } ping_target_t;
 
-// Ping result callback function type
-typedef void (*ping_result_callback_t)(const char* name, const char* ip_address, bool success, uint32_t response_time, void* user_data);
+// Ping result callback function type, called on the ping_results task
+typedef void (*ping_result_callback_t)(device_handle_t handle, const char* name, const char* ip_address,
+                                       bool success, uint32_t response_time_us, void* user_data);
+
+// Counters of the handoff between ping_task and ping_results
+typedef struct {
+    uint32_t queued;                 // Results waiting for the callback now
+    uint32_t peak;                   // Most results waiting at once
+    uint32_t dropped;                // Results lost because the ring was full
+} ping_result_queue_stats_t;
+
+// Wake accounting, see ping_manager_set_wake_slot()
+typedef struct {
+    uint32_t slot_ms;                // Shared wake slot, 0 if deadlines are not aligned
+    uint32_t wakes;                  // Times ping_task woke to probe
+    uint32_t awake_ms;               // Time spent probing or in the wake done callback (wraps)
+} ping_wake_stats_t;
+
+// Called on ping_results once the results of a wake have been reported
+typedef void (*ping_wake_done_callback_t)(void* user_data);
+
+// Called after a setter changed a target's interval bounds or strategy
+typedef void (*ping_config_callback_t)(device_handle_t handle, void* user_data);
 
 // Function prototypes
 
 /**
  * @brief Initialize the ping manager
+ *
+ * Starts ping_task on PING_TASK_CORE and ping_results on
+ * PING_RESULT_TASK_CORE. ping_task only probes and queues the results;
+ * ping_results calls the callback for them in probe order, so a slow
+ * callback delays reporting but never the next probe. When more than
+ * PING_RESULT_RING_SIZE results are waiting, new ones are dropped and
+ * counted (see ping_manager_get_result_queue_stats()).
+ *
  * @param callback Optional callback function for ping results
  * @param user_data Optional user data for callback
  * @return ESP_OK on success, error code on failure
@@ -52,9 +141,18 @@ void ping_manager_deinit(void);
  * @brief Add a device for monitoring
  * @param name Device name for identification
  * @param ip_address IP address to ping
- * @return Target index on success, -1 on failure
+ * @return Device handle on success, DEVICE_HANDLE_INVALID on failure
  */
-int ping_manager_add_device(const char* name, const char* ip_address);
+device_handle_t ping_manager_add_device(const char* name, const char* ip_address);
+
+/**
+ * @brief Add a device for monitoring with an explicit probe configuration
+ * @param name Device name for identification
+ * @param ip_address IP address to ping
+ * @param config Probe strategy, ports and timing (NULL for TCP on ports 80 and 22)
+ * @return Device handle on success, DEVICE_HANDLE_INVALID on failure
+ */
+device_handle_t ping_manager_add_device_ex(const char* name, const char* ip_address, const ping_probe_config_t* config);
 
 /**
  * @brief Remove a ping target by name
@@ -63,6 +161,35 @@ int ping_manager_add_device(const char* name, const char* ip_address);
  */
 esp_err_t ping_manager_remove_device(const char* name);
 
+/**
+ * @brief Start or update monitoring of many devices at once
+ *
+ * The devices must already be registered with the DEVICE_OWNER_PING bit
+ * (see device_registry_apply()). The target table is locked once and the
+ * scheduler rebuilt once for the whole batch.
+ *
+ * @param handles Device handles, DEVICE_HANDLE_INVALID entries are skipped
+ * @param configs Probe configuration per handle, NULL for the defaults
+ * @param count Number of handles
+ * @param changed_out Set per handle when a target was added or its probe
+ *        settings changed, can be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if any configuration is invalid (nothing is applied)
+ */
+esp_err_t ping_manager_attach_devices(const device_handle_t* handles, const ping_probe_config_t* configs,
+                                      int count, bool* changed_out);
+
+/**
+ * @brief Stop monitoring many devices at once
+ *
+ * Counterpart of ping_manager_attach_devices(): the caller has already
+ * dropped the DEVICE_OWNER_PING references, so the registry is not touched.
+ *
+ * @param handles Handles the devices had, unknown handles are skipped
+ * @param count Number of handles
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the target table could not be locked
+ */
+esp_err_t ping_manager_detach_devices(const device_handle_t* handles, int count);
+
 /**
  * @brief Enable or disable a ping target by name
  * @param name Device name to modify
@@ -71,12 +198,85 @@ esp_err_t ping_manager_remove_device(const char* name);
  */
 esp_err_t ping_manager_set_device_enabled(const char* name, bool enabled);
 
+/**
+ * @brief Change the base probe interval of a ping target
+ *
+ * The adaptive interval restarts from the new base. The backoff ceiling is
+ * raised to the base if it was lower.
+ *
+ * @param name Device name to modify
+ * @param interval_ms New interval in milliseconds (at least PING_MIN_INTERVAL)
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t ping_manager_set_device_interval(const char* name, uint32_t interval_ms);
+
+/**
+ * @brief Set the adaptive interval bounds of a ping target
+ *
+ * The interval doubles after every probe that leaves the online state
+ * unchanged, up to max_interval_ms, and drops back to min_interval_ms as
+ * soon as the state changes. Equal bounds disable backoff.
+ *
+ * @param name Device name to modify
+ * @param min_interval_ms Base interval (at least PING_MIN_INTERVAL)
+ * @param max_interval_ms Backoff ceiling (at least min_interval_ms)
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t ping_manager_set_device_interval_bounds(const char* name, uint32_t min_interval_ms,
+                                                  uint32_t max_interval_ms);
+
+/**
+ * @brief Probe a ping target at a fast rate for a limited time
+ *
+ * Meant for targets that were just woken: the fast interval overrides the
+ * adaptive one until the target changes state or the window expires. Probes
+ * in the window time out after at most the fast interval, so a target that
+ * does not answer yet is still probed at the fast rate.
+ *
+ * @param name Device name to modify
+ * @param interval_ms Fast interval in milliseconds (at least PING_MIN_INTERVAL)
+ * @param duration_ms Length of the fast probing window in milliseconds
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t ping_manager_expedite_device(const char* name, uint32_t interval_ms, uint32_t duration_ms);
+
+/**
+ * @brief Select how a ping target is probed
+ * @param name Device name to modify
+ * @param strategy Probe strategy; TCP and UDP use the target's port list,
+ *                 ARP falls back to ICMP for targets outside the local subnet
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t ping_manager_set_device_strategy(const char* name, ping_strategy_t strategy);
+
 /**
  * @brief Get ping target information by name
  * @param name Device name to query
- * @return Pointer to target structure, NULL on failure
+ * @param target_out Receives a consistent copy of the target's settings and statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not monitored
+ */
+esp_err_t ping_manager_get_device(const char* name, ping_target_t* target_out);
+
+/**
+ * @brief Get ping target information by registry handle
+ * @param handle Device handle
+ * @param target_out Receives a consistent copy of the target's settings and statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not monitored
  */
-const ping_target_t* ping_manager_get_device(const char* name);
+esp_err_t ping_manager_get_device_by_handle(device_handle_t handle, ping_target_t* target_out);
+
+/**
+ * @brief Get the rolling latency statistics of a ping target
+ *
+ * RTT percentiles and jitter cover the last PROBE_STATS_WINDOW or so
+ * successful probes, success rates decay over 1 min, 15 min and 1 h (see
+ * probe_stats_record()). They start over when a removed target is added again.
+ *
+ * @param handle Device handle
+ * @param summary_out Receives the percentiles, jitter and success rates
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not monitored
+ */
+esp_err_t ping_manager_get_latency_stats(device_handle_t handle, probe_stats_summary_t* summary_out);
 
 /**
  * @brief Get total number of ping targets
@@ -90,6 +290,77 @@ int ping_manager_get_target_count(void);
  */
 bool ping_manager_is_running(void);
 
+/**
+ * @brief Align every probe deadline to a shared wake slot
+ *
+ * With a slot, deadlines are moved to the nearest multiple of slot_ms on the
+ * esp_timer clock (never before the next one from now), so all targets due
+ * around the same boundary are probed in one wake and the station can sleep
+ * in between. Intervals are rounded to a multiple of the slot, at least one
+ * slot; a target in its fast window after a wake is not aligned.
+ *
+ * @param slot_ms Slot length in milliseconds, 0 to probe at exact deadlines
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a slot below PING_MIN_INTERVAL,
+ *         ESP_ERR_TIMEOUT if the target table is busy
+ */
+esp_err_t ping_manager_set_wake_slot(uint32_t slot_ms);
+
+/**
+ * @brief Set the callback run after the last result of each wake
+ *
+ * Runs on ping_results right after the result callbacks of the wake, so
+ * output batched over the wake can be sent before the station sleeps again.
+ * If ping_results falls behind by more than a wake, it runs once for all of
+ * them.
+ *
+ * @param callback Callback, NULL for none
+ * @param user_data Passed to the callback
+ */
+void ping_manager_set_wake_done_callback(ping_wake_done_callback_t callback, void* user_data);
+
+/**
+ * @brief Set the callback run when a target's saved settings change
+ *
+ * Runs on the caller's task, without the target table locked, after
+ * ping_manager_set_device_interval(), ping_manager_set_device_interval_bounds()
+ * or ping_manager_set_device_strategy() changed a target, so the owner of the
+ * saved configuration can schedule a save.
+ *
+ * @param callback Callback, NULL for none
+ * @param user_data Passed to the callback
+ */
+void ping_manager_set_config_callback(ping_config_callback_t callback, void* user_data);
+
+/**
+ * @brief Read the wake counters, from any task
+ *
+ * A wake runs from ping_task's first probe after sleeping until it sleeps
+ * again. awake_ms is the time spent in wakes or in the wake done callback,
+ * as that queues the output; where the two overlap it is counted once, and
+ * a wake or callback in progress counts up to the call. The MQTT task's
+ * writes are not included.
+ *
+ * @param stats_out Receives the counters since ping_manager_init()
+ */
+void ping_manager_get_wake_stats(ping_wake_stats_t* stats_out);
+
+/**
+ * @brief Read the result handoff counters, from any task
+ * @param stats_out Receives the counters since ping_manager_init()
+ */
+void ping_manager_get_result_queue_stats(ping_result_queue_stats_t* stats_out);
+
+/**
+ * @brief Pause or resume probing, e.g. while the station has no IP
+ *
+ * Targets stay configured while paused, but none are probed and no
+ * results are reported, so a network outage does not show up as every
+ * device going offline. On resume every target is probed right away.
+ *
+ * @param paused True to stop probing, false to resume
+ */
+void ping_manager_set_paused(bool paused);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,88 @@
+#ifndef PING_PROBE_H
+#define PING_PROBE_H
+
+#include "ping_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define PING_PROBE_MAX_SOCKETS  6      // Concurrent TCP/UDP sockets (keep below CONFIG_LWIP_MAX_SOCKETS)
+#define PING_PROBE_ICMP_SIZE    32     // ICMP echo request size including header
+#define PING_PROBE_ARP_POLL_MS  20     // ARP cache polling period while requests are outstanding
+#define PING_PROBE_REFILL_MS    100    // Longest wait between refills while probes are in flight
+
+// Life of a probe slot: the refill hook fills FREE slots (QUEUED) and empties
+// DONE ones (FREE), the engine runs the probes in between
+typedef enum {
+    PING_PROBE_FREE = 0,
+    PING_PROBE_QUEUED,               // Waiting to be started
+    PING_PROBE_RUNNING,              // Requests out, waiting for replies or the timeout
+    PING_PROBE_DONE                  // Result ready
+} ping_probe_state_t;
+
+// Single probe request and result
+typedef struct {
+    uint8_t state;                   // ping_probe_state_t
+    uint32_t ipv4;                   // Target IPv4 address, network byte order (input)
+    uint32_t timeout_ms;             // Probe deadline (input)
+    ping_strategy_t strategy;        // How to probe the target (input)
+    uint16_t ports[PING_MAX_PORTS];  // TCP/UDP ports to race (input)
+    uint8_t port_count;              // Number of valid ports (input)
+    uint8_t mac_address[6];          // Expected MAC for ARP, all zero to accept any (input)
+    bool success;                    // Host answered (output)
+    uint32_t response_time_us;       // Round-trip time in microseconds, 0 for ARP (output)
+    int64_t start_us;                // Engine bookkeeping: probe start time
+    int64_t deadline_us;             // Engine bookkeeping: ICMP/ARP reply deadline
+    uint16_t icmp_seq;               // Engine bookkeeping: echo sequence number
+    uint8_t pending;                 // Engine bookkeeping: sockets or echo requests outstanding
+} ping_probe_t;
+
+/**
+ * @brief Refill hook of ping_probe_run()
+ *
+ * Called before every wait. Takes the results out of PING_PROBE_DONE slots
+ * and sets them PING_PROBE_FREE, then fills free slots with the probes that
+ * are due and sets them PING_PROBE_QUEUED.
+ *
+ * @param probes The probe slots passed to ping_probe_run()
+ * @param capacity Number of slots
+ * @param ctx Context passed to ping_probe_run()
+ * @return esp_timer time the next probe falls due, INT64_MAX if none or no slot is free
+ */
+typedef int64_t (*ping_probe_refill_t)(ping_probe_t* probes, int capacity, void* ctx);
+
+/**
+ * @brief Probe hosts concurrently as they fall due
+ *
+ * ICMP targets get one burst of echo requests over a shared raw socket and
+ * replies are matched back by identifier and sequence number. ARP targets have
+ * their cache entry dropped and get one ARP request each, then the lwIP ARP
+ * cache is polled until the reply refills it, without opening any socket; the
+ * poll period hides the round trip, so no RTT is reported. TCP and UDP
+ * targets get one non-blocking socket per listed port and the first port to
+ * answer wins. Everything is waited on with a single select(), each probe
+ * having its own deadline. When the socket budget is exhausted, new probes
+ * are started as soon as earlier ones finish.
+ *
+ * The slots are not a closed batch: every finished probe is handed back and
+ * probes falling due meanwhile are started through the refill hook, which
+ * runs at the latest when the next one is due (and every
+ * PING_PROBE_REFILL_MS), so a slow probe never holds up the others. Returns
+ * once every slot is free.
+ *
+ * @param probes Probe slots, all PING_PROBE_FREE on entry and return
+ * @param capacity Number of slots
+ * @param refill Hook that collects results and queues due probes
+ * @param ctx Passed to the hook
+ */
+void ping_probe_run(ping_probe_t* probes, int capacity, ping_probe_refill_t refill, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PING_PROBE_H
@@ -0,0 +1,83 @@
+#ifndef PING_RESULT_RING_H
+#define PING_RESULT_RING_H
+
+#include "device_registry.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Results in flight between ping_task and the result task (set in menuconfig,
+// "Device monitoring")
+#ifdef CONFIG_PING_RESULT_QUEUE_SIZE
+#define PING_RESULT_RING_SIZE       CONFIG_PING_RESULT_QUEUE_SIZE
+#else
+#define PING_RESULT_RING_SIZE       64
+#endif
+
+#if PING_RESULT_RING_SIZE < 2 || (PING_RESULT_RING_SIZE & (PING_RESULT_RING_SIZE - 1)) != 0
+#error "PING_RESULT_QUEUE_SIZE must be a power of two"
+#endif
+
+// One probe result as reported to the ping result callback
+typedef struct {
+    char name[DEVICE_NAME_SIZE];     // Target name when it was probed
+    device_handle_t handle;          // Registry handle when it was probed
+    uint32_t ipv4;                   // Address probed, network byte order
+    uint32_t response_time_us;       // Round-trip time, 0 on failure or for ARP
+    bool success;                    // Host answered
+    bool status_changed;             // Online state differs from the previous probe
+} ping_result_t;
+
+// Single-producer single-consumer ring. Push and pop never block and take no
+// lock: each index is written by one side only and published with release
+// ordering, so the two sides may run on different cores.
+typedef struct {
+    ping_result_t entries[PING_RESULT_RING_SIZE];
+    atomic_uint head;                // Next entry to pop, written by the consumer
+    atomic_uint tail;                // Next entry to push, written by the producer
+    atomic_uint peak;                // Most entries queued at once, written by the producer
+    atomic_uint dropped;             // Results pushed while full, written by the producer
+} ping_result_ring_t;
+
+/**
+ * @brief Empty the ring and clear its counters
+ *
+ * Only call while neither side is running.
+ *
+ * @param ring Ring to reset
+ */
+void ping_result_ring_reset(ping_result_ring_t* ring);
+
+/**
+ * @brief Append a result, producer side
+ * @param ring Ring
+ * @param result Result to copy in
+ * @return true if queued, false if the ring was full and the result dropped
+ */
+bool ping_result_ring_push(ping_result_ring_t* ring, const ping_result_t* result);
+
+/**
+ * @brief Take the oldest result, consumer side
+ * @param ring Ring
+ * @param result_out Receives the result
+ * @return true if a result was taken, false if the ring was empty
+ */
+bool ping_result_ring_pop(ping_result_ring_t* ring, ping_result_t* result_out);
+
+/**
+ * @brief Number of results queued, from any task
+ * @param ring Ring
+ * @return Results pushed and not yet popped
+ */
+uint32_t ping_result_ring_count(const ping_result_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PING_RESULT_RING_H
@@ -0,0 +1,116 @@
+#ifndef PROBE_STATS_H
+#define PROBE_STATS_H
+
+#include "json_writer.h"
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Successful probes in the RTT histogram before older samples are aged out
+// (set in menuconfig, "Device monitoring")
+#ifdef CONFIG_PING_LATENCY_WINDOW
+#define PROBE_STATS_WINDOW          CONFIG_PING_LATENCY_WINDOW
+#else
+#define PROBE_STATS_WINDOW          256
+#endif
+
+#define PROBE_STATS_BUCKETS         16     // Bucket upper bounds: 0.5, 1, 2, 3, 5, 7.5, 10, 15, 20, 30, 50, 75, 100, 250, 500 ms, more
+#define PROBE_STATS_RTT_MAX_US      500000 // Lower bound of the last bucket, percentiles landing there are capped to it
+
+// Success rate windows: 1 min, 15 min and 1 h
+typedef enum {
+    PROBE_STATS_WINDOW_1M = 0,
+    PROBE_STATS_WINDOW_15M,
+    PROBE_STATS_WINDOW_1H,
+    PROBE_STATS_WINDOW_COUNT
+} probe_stats_window_t;
+
+// Rolling probe statistics for one target, fixed size and updated in O(1)
+typedef struct {
+    uint16_t buckets[PROBE_STATS_BUCKETS]; // RTT histogram of successful probes (aged)
+    uint16_t samples;                // Samples in the histogram
+    uint16_t success_rate[PROBE_STATS_WINDOW_COUNT]; // Decaying success rates, 65535 = 100%
+    uint32_t jitter_x16;             // RFC 3550 interarrival jitter in microseconds, times 16
+    uint32_t last_rtt_us;            // RTT of the previous success, 0 if none
+    uint32_t last_sample_ms;         // Time of the previous probe, low 32 bits of ms since boot
+    uint32_t probes;                 // Probes recorded, saturating
+} probe_stats_t;
+
+// Figures derived from probe_stats_t by probe_stats_summarize()
+typedef struct {
+    uint32_t probes;                 // Probes recorded
+    uint32_t samples;                // Successful probes in the histogram (aged)
+    uint32_t p50_us;                 // RTT percentiles, 0 without samples
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t jitter_us;              // Smoothed RTT variation between consecutive successes
+    uint16_t success_permille[PROBE_STATS_WINDOW_COUNT]; // Success rate per window, tenths of a percent
+} probe_stats_summary_t;
+
+/**
+ * @brief Clear the statistics of a target
+ *
+ * The probe_stats functions do no locking; the caller serializes access to
+ * each probe_stats_t.
+ *
+ * @param stats Statistics to clear
+ */
+void probe_stats_reset(probe_stats_t* stats);
+
+/**
+ * @brief Record the outcome of one probe
+ *
+ * Successes go into the RTT histogram, which halves all buckets once it
+ * holds PROBE_STATS_WINDOW samples so old latencies fade out. Every probe
+ * updates the success rates, each an exponentially decaying average over
+ * the time since the previous probe with a time constant of 1 min, 15 min
+ * or 1 h, so irregular probe intervals are weighted correctly.
+ *
+ * @param stats Statistics of the probed target
+ * @param success Whether the probe succeeded
+ * @param rtt_us Round-trip time of a successful probe in microseconds, 0 if
+ *               the probe measures none (kept out of the histogram)
+ * @param now_ms Current time in ms since boot (may wrap)
+ */
+void probe_stats_record(probe_stats_t* stats, bool success, uint32_t rtt_us, uint32_t now_ms);
+
+/**
+ * @brief Estimate an RTT percentile from the histogram
+ *
+ * Interpolates linearly inside the bucket holding the requested rank, so
+ * the error is bounded by the bucket width.
+ *
+ * @param stats Statistics
+ * @param permille Percentile in tenths of a percent, e.g. 950 for p95
+ * @return RTT in microseconds, at most PROBE_STATS_RTT_MAX_US, 0 without samples
+ */
+uint32_t probe_stats_percentile(const probe_stats_t* stats, uint32_t permille);
+
+/**
+ * @brief Derive percentiles, jitter and success rates
+ * @param stats Statistics
+ * @param summary_out Receives the summary
+ */
+void probe_stats_summarize(const probe_stats_t* stats, probe_stats_summary_t* summary_out);
+
+/**
+ * @brief Write a summary as members of the object being written
+ *
+ * Adds "probes", "n", "p50_us", "p95_us", "p99_us" and "jitter_us", the
+ * percentiles and jitter only once there are samples, and "success", the
+ * 1 min, 15 min and 1 h success rates in percent.
+ *
+ * @param json Writer positioned inside an object, where a key may be written
+ * @param summary Summary
+ */
+void probe_stats_write_json(json_writer_t* json, const probe_stats_summary_t* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROBE_STATS_H
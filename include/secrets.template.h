@@ -57,7 +57,13 @@ extern "C" {
 // ============================================================================
 #define MQTT_KEEPALIVE     60       // MQTT keepalive interval in seconds
 #define MQTT_TIMEOUT_MS    10000    // MQTT operation timeout in milliseconds
-#define WIFI_RETRY_COUNT   10       // Number of WiFi connection retries
+#define WIFI_RETRY_COUNT   10       // Failed attempts before a blocking connect gives up (retries continue)
+
+// Optional static IP instead of DHCP
+// #define WIFI_STATIC_IP      "192.168.1.50"
+// #define WIFI_STATIC_GATEWAY "192.168.1.1"
+// #define WIFI_STATIC_NETMASK "255.255.255.0"
+// #define WIFI_STATIC_DNS     "192.168.1.1"
 
 // ============================================================================
 // Build complete MQTT broker URI
@@ -0,0 +1,38 @@
+#ifndef SYSTEM_METRICS_H
+#define SYSTEM_METRICS_H
+
+#include "json_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Write the runtime metrics as members of the object being written
+ *
+ * Adds:
+ * - "cpu": load per core in percent since the previous call
+ * - "tasks": per tracked task (main, ping_task, mqtt_task, wol_wake, tiT,
+ *   esp_timer, wifi), "cpu" in percent of one core since the previous call
+ *   and "stack", the fewest free stack bytes seen so far (high-water mark)
+ * - "heap": per capability (internal, dma, spiram), free, minimum free and
+ *   largest free block in bytes, and "frag", the percentage of free memory
+ *   outside the largest block
+ * - "lwip": sockets in use out of CONFIG_LWIP_MAX_SOCKETS, and with
+ *   CONFIG_LWIP_STATS the pbuf and PCB pools (used, peak, failed allocations).
+ *   ESP-IDF allocates data pbufs from the internal heap, so "pbuf" only
+ *   counts the reference pbufs taken from the pool.
+ *
+ * The CPU figures need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS and are left
+ * out without it. Not thread safe: the percentages are deltas against state
+ * kept from the previous call, so calls must be serialized by the caller.
+ *
+ * @param json Writer positioned inside an object, where a key may be written
+ */
+void system_metrics_write_json(json_writer_t* json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYSTEM_METRICS_H
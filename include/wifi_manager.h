@@ -4,14 +4,88 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "freertos/event_groups.h"
+#include "sdkconfig.h"
 #include "secrets.h"  // Include secrets for WiFi configuration
 
 // Event bits
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+#define WIFI_FAIL_BIT      BIT1     // WIFI_RETRY_COUNT attempts failed; retrying continues
+
+// Reconnect behaviour (can be overridden in secrets.h)
+#ifndef WIFI_RECONNECT_MIN_MS
+#define WIFI_RECONNECT_MIN_MS      250     // First retry delay, doubled per failed attempt
+#endif
+#ifndef WIFI_RECONNECT_MAX_MS
+#define WIFI_RECONNECT_MAX_MS      30000   // Upper bound for the retry delay
+#endif
+#ifndef WIFI_FAST_CONNECT_TRIES
+#define WIFI_FAST_CONNECT_TRIES    2       // Attempts on the cached BSSID/channel before a full scan
+#endif
+
+// Optional static IP, skips DHCP (define WIFI_STATIC_IP in secrets.h to enable)
+#ifdef WIFI_STATIC_IP
+#ifndef WIFI_STATIC_GATEWAY
+#error "WIFI_STATIC_IP needs WIFI_STATIC_GATEWAY"
+#endif
+#ifndef WIFI_STATIC_NETMASK
+#define WIFI_STATIC_NETMASK        "255.255.255.0"
+#endif
+#ifndef WIFI_STATIC_DNS
+#define WIFI_STATIC_DNS            WIFI_STATIC_GATEWAY
+#endif
+#endif
+
+// Modem sleep (set in menuconfig, "Device monitoring"). Maximum modem sleep
+// wakes the radio every WIFI_LISTEN_INTERVAL beacons instead of every DTIM.
+#if CONFIG_POWER_SAVE_MODE
+#define WIFI_POWER_SAVE            WIFI_PS_MAX_MODEM
+#define WIFI_LISTEN_INTERVAL       CONFIG_POWER_SAVE_LISTEN_INTERVAL
+#else
+#define WIFI_POWER_SAVE            WIFI_PS_MIN_MODEM
+#define WIFI_LISTEN_INTERVAL       0       // Only used with WIFI_PS_MAX_MODEM, 0 is the driver default
+#endif
+
+// Connection timing
+typedef struct {
+    uint32_t initial_connect_ms;     // WiFi start until the first IP
+    uint32_t reconnect_count;        // Connections regained after a loss
+    uint32_t last_reconnect_ms;      // Link loss until IP, last reconnect
+    uint32_t max_reconnect_ms;       // Slowest reconnect since boot
+    uint32_t retry_attempts;         // Failed connect attempts since boot
+    bool fast_connect;               // Current connection used the cached BSSID/channel
+} wifi_manager_stats_t;
+
+// Called from the event loop task when the station gets or loses its IP
+typedef void (*wifi_connection_callback_t)(bool connected);
+
+/**
+ * @brief Set the callback for connection changes
+ *
+ * Set it before wifi_manager_start() to also see the first connect.
+ *
+ * @param callback Callback, NULL to remove
+ */
+void wifi_manager_set_connection_callback(wifi_connection_callback_t callback);
+
+/**
+ * @brief Start WiFi in station mode and begin connecting to the AP
+ *
+ * Returns as soon as the driver is started; the connection callback
+ * reports when an IP is assigned. The BSSID and channel of the last AP
+ * are cached in NVS, so later boots and reconnects associate without a
+ * full scan. Lost connections are retried forever with jittered
+ * exponential backoff.
+ *
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t wifi_manager_start(void);
 
 /**
  * @brief Initialize WiFi in station mode and connect to AP
+ *
+ * Blocking variant of wifi_manager_start(): waits until the station has
+ * an IP or the retries are used up.
+ *
  * @return ESP_OK on success, error code on failure
  */
 esp_err_t wifi_manager_init(void);
@@ -22,6 +96,18 @@ esp_err_t wifi_manager_init(void);
  */
 bool wifi_manager_is_connected(void);
 
+/**
+ * @brief Get the subnet-directed broadcast address of the station
+ * @return Broadcast address in network byte order, 0 while not connected
+ */
+uint32_t wifi_manager_get_broadcast_ipv4(void);
+
+/**
+ * @brief Get connect and reconnect timings
+ * @param stats Filled with the current statistics
+ */
+void wifi_manager_get_stats(wifi_manager_stats_t* stats);
+
 /**
  * @brief Deinitialize WiFi manager
  */
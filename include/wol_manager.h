@@ -2,6 +2,7 @@
 #define WOL_MANAGER_H
 
 #include "esp_err.h"
+#include "device_registry.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,7 +11,57 @@ extern "C" {
 #endif
 
 // Maximum number of devices that can be managed
-#define MAX_DEVICES 20
+#define MAX_DEVICES DEVICE_REGISTRY_MAX_DEVICES
+
+// Status hysteresis (set in menuconfig, "Device monitoring"): the status only
+// changes once enough of the last WOL_STATUS_WINDOW probe results agree
+#ifdef CONFIG_WOL_STATUS_WINDOW
+#define WOL_STATUS_WINDOW               CONFIG_WOL_STATUS_WINDOW
+#define WOL_STATUS_OFFLINE_THRESHOLD    CONFIG_WOL_STATUS_OFFLINE_THRESHOLD
+#define WOL_STATUS_ONLINE_THRESHOLD     CONFIG_WOL_STATUS_ONLINE_THRESHOLD
+#else
+#define WOL_STATUS_WINDOW               5   // Probe results remembered per device
+#define WOL_STATUS_OFFLINE_THRESHOLD    3   // Failures in the window before going offline
+#define WOL_STATUS_ONLINE_THRESHOLD     2   // Successes in the window before going online
+#endif
+
+// Wake pipeline (set in menuconfig, "Device monitoring")
+#ifdef CONFIG_WOL_BURST_COUNT
+#define WOL_BURST_COUNT                 CONFIG_WOL_BURST_COUNT
+#define WOL_BURST_INTERVAL_MS           CONFIG_WOL_BURST_INTERVAL_MS
+#define WOL_WAKE_TIMEOUT_MS             CONFIG_WOL_WAKE_TIMEOUT_MS
+#else
+#define WOL_BURST_COUNT                 3       // Magic packet rounds per wake
+#define WOL_BURST_INTERVAL_MS           50      // Delay between rounds
+#define WOL_WAKE_TIMEOUT_MS             180000  // How long a woken device may take to answer
+#endif
+
+#define WOL_PACKET_SIZE                 102     // 6 x 0xFF, then the MAC 16 times
+
+// Device groups, woken together with one command
+#ifdef CONFIG_WOL_GROUP_STAGGER_MS
+#define WOL_GROUP_STAGGER_MS            CONFIG_WOL_GROUP_STAGGER_MS
+#else
+#define WOL_GROUP_STAGGER_MS            2000    // Minimum spacing between two member wakes
+#endif
+#define WOL_MAX_GROUPS                  16      // Membership is a bitmask per device
+#define WOL_GROUP_INVALID               (-1)
+
+// Device table persistence: one blob in NVS, written once edits settle
+#ifdef CONFIG_WOL_CONFIG_SAVE_DELAY_MS
+#define WOL_CONFIG_SAVE_DELAY_MS        CONFIG_WOL_CONFIG_SAVE_DELAY_MS
+#else
+#define WOL_CONFIG_SAVE_DELAY_MS        5000    // Quiet time after the last edit before writing
+#endif
+#define WOL_CONFIG_SAVE_MAX_DELAY_MS    60000   // Upper bound while edits keep coming
+#define WOL_CONFIG_NVS_NAMESPACE        "wol"
+#define WOL_CONFIG_NVS_KEY              "devices"
+#define WOL_CONFIG_MAGIC                0x444C4F57  // "WOLD"
+#define WOL_CONFIG_VERSION              3       // 3 adds the probe intervals, 2 the strategy and ports
+
+// Bulk provisioning over MQTT, see wol_provision_devices()
+#define WOL_PROVISION_ACK_TOPIC         "esp32/system/devices/ack"
+#define WOL_PROVISION_MAX_ERRORS        8       // Errors listed when a message is rejected
 
 // Device status definitions
 typedef enum {
@@ -20,16 +71,33 @@ typedef enum {
     DEVICE_STATUS_WAKING
 } device_status_t;
 
-// Device information structure
+// Outcome of a device's part in a group wake
+typedef enum {
+    WOL_WAKE_RESULT_NONE = 0,       // Not part of a group wake
+    WOL_WAKE_RESULT_QUEUED,         // Waiting for its turn in the stagger
+    WOL_WAKE_RESULT_SENT,           // Packets sent, waiting for the device to answer
+    WOL_WAKE_RESULT_WOKE,           // Answered, wake_elapsed_ms is the latency
+    WOL_WAKE_RESULT_TIMEOUT,        // No answer within WOL_WAKE_TIMEOUT_MS
+    WOL_WAKE_RESULT_FAILED,         // No packet could be sent
+    WOL_WAKE_RESULT_SKIPPED         // Disabled or removed
+} wol_wake_result_t;
+
+// Device information structure, stored in the slot of its registry entry.
+// Only per-device state lives here; name, IP, MAC and description are kept
+// by the registry.
 typedef struct {
-    char name[32];              // Device name (e.g., "server1", "desktop1")
-    char ip_address[16];        // IP address (e.g., "192.168.0.111")
-    uint8_t mac_address[6];     // MAC address for WoL
-    char description[64];       // Device description
-    device_status_t status;     // Current device status
+    device_handle_t handle;     // Registry handle
     uint32_t last_ping_time;    // Last successful ping timestamp
-    bool enabled;               // Whether device monitoring is enabled
+    uint32_t wake_time_ms;      // When the last wake was sent (low 32 bits of ms since boot)
+    uint32_t wake_elapsed_ms;   // Wake latency or time waited, for the group wake result
     uint16_t wol_port;          // WoL port (usually 9)
+    uint16_t groups;            // Bit n set: member of group n
+    int8_t wake_group;          // Group wake the device is part of, WOL_GROUP_INVALID if none
+    uint8_t wake_result;        // wol_wake_result_t within that group wake
+    uint16_t history;           // Recent probe results, newest in bit 0 (1 = success)
+    uint8_t history_len;        // Valid bits in history, up to WOL_STATUS_WINDOW
+    uint8_t status;             // Current device status (device_status_t)
+    bool enabled;               // Whether device monitoring is enabled
 } wol_device_t;
 
 /**
@@ -45,7 +113,7 @@ esp_err_t wol_manager_init(void);
  * @param name Device name (unique identifier)
  * @param ip_address IP address string
  * @param mac_address MAC address (6 bytes)
- * @param description Device description
+ * @param description Device description, stored in the registry (can be NULL)
  * @return esp_err_t ESP_OK on success, ESP_ERR_NO_MEM if list is full
  */
 esp_err_t wol_add_device(const char* name, const char* ip_address, 
@@ -60,15 +128,22 @@ esp_err_t wol_add_device(const char* name, const char* ip_address,
 esp_err_t wol_remove_device(const char* name);
 
 /**
- * @brief Send Wake-on-LAN packet to a specific device
+ * @brief Wake a device and verify that it comes up
+ * 
+ * Sends WOL_BURST_COUNT rounds of the magic packet, each to the subnet-directed
+ * broadcast and to 255.255.255.255 on the device's wol_port, over one socket
+ * kept open across wakes. The device is then marked waking and probed at
+ * PING_FAST_INTERVAL; esp32/wol/<name>/status reports "woke" with the
+ * wake-to-online latency once it answers, or "wake_timeout" if it stays
+ * silent for WOL_WAKE_TIMEOUT_MS.
  * 
  * @param name Device name to wake up
- * @return esp_err_t ESP_OK on success
+ * @return esp_err_t ESP_OK if at least one packet was sent
  */
 esp_err_t wol_wake_device(const char* name);
 
 /**
- * @brief Send Wake-on-LAN packet using MAC address directly
+ * @brief Send one Wake-on-LAN packet to port 9 using MAC address directly
  * 
  * @param mac_address MAC address (6 bytes)
  * @param broadcast_ip Broadcast IP address (can be NULL for default)
@@ -77,13 +152,25 @@ esp_err_t wol_wake_device(const char* name);
 esp_err_t wol_send_packet(const uint8_t* mac_address, const char* broadcast_ip);
 
 /**
- * @brief Update device status (called by ping manager)
+ * @brief Feed a probe result into the device status (called by ping manager)
  * 
- * @param name Device name
+ * The result is added to the device's probe history; the status only flips
+ * once WOL_STATUS_OFFLINE_THRESHOLD failures (or WOL_STATUS_ONLINE_THRESHOLD
+ * successes) are in the last WOL_STATUS_WINDOW results, so a single dropped
+ * probe does not cause an offline/online pair. An unknown or waking device
+ * goes online on its first success; a waking device only goes offline once
+ * WOL_WAKE_TIMEOUT_MS have passed since the wake.
+ * 
+ * The history is updated under device_mutex, since wakes reset it from
+ * other tasks. A status change is published retained on
+ * esp32/device/<name>/status after the mutex is released.
+ * 
+ * @param handle Device handle
  * @param is_online Whether device responded to ping
- * @return esp_err_t ESP_OK on success
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not managed,
+ *         ESP_ERR_TIMEOUT if device_mutex could not be taken (the result is dropped)
  */
-esp_err_t wol_update_device_status(const char* name, bool is_online);
+esp_err_t wol_update_device_status(device_handle_t handle, bool is_online);
 
 /**
  * @brief Get device information by name
@@ -94,12 +181,27 @@ esp_err_t wol_update_device_status(const char* name, bool is_online);
 const wol_device_t* wol_get_device(const char* name);
 
 /**
- * @brief Get all devices list
+ * @brief Get device information by registry handle
  * 
- * @param device_count Pointer to store the number of devices
- * @return const wol_device_t* Pointer to devices array
+ * @param handle Device handle
+ * @return wol_device_t* Pointer to device info, NULL if not found
  */
-const wol_device_t* wol_get_all_devices(int* device_count);
+const wol_device_t* wol_get_device_by_handle(device_handle_t handle);
+
+/**
+ * @brief Iterate over managed devices
+ * 
+ * @param after Previous handle, DEVICE_HANDLE_INVALID to start
+ * @return device_handle_t Next device handle, DEVICE_HANDLE_INVALID when done
+ */
+device_handle_t wol_next_device(device_handle_t after);
+
+/**
+ * @brief Get the number of managed devices
+ * 
+ * @return int Device count
+ */
+int wol_get_device_count(void);
 
 /**
  * @brief Enable/disable device monitoring
@@ -118,28 +220,119 @@ esp_err_t wol_set_device_enabled(const char* name, bool enabled);
  */
 const char* wol_get_status_string(device_status_t status);
 
+/**
+ * @brief Add a device to a group, creating the group on first use
+ * 
+ * @param name Device name
+ * @param group Group name, at most DEVICE_NAME_SIZE - 1 characters
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND for an unknown device,
+ *         ESP_ERR_NO_MEM if WOL_MAX_GROUPS groups exist already
+ */
+esp_err_t wol_add_device_to_group(const char* name, const char* group);
+
+/**
+ * @brief Remove a device from a group; the group goes away with its last member
+ * 
+ * @param name Device name
+ * @param group Group name
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not a member
+ */
+esp_err_t wol_remove_device_from_group(const char* name, const char* group);
+
+/**
+ * @brief Look up a group by a name that is not NUL terminated
+ * 
+ * @param group Start of the group name (e.g. sliced out of an MQTT topic)
+ * @param len Name length in bytes
+ * @return int Group index, WOL_GROUP_INVALID if there is no such group
+ */
+int wol_find_group(const char* group, int len);
+
+/**
+ * @brief Wake all enabled members of a group, one every WOL_GROUP_STAGGER_MS
+ * 
+ * Members are queued for a scheduler task that spaces all wakes, so a rack
+ * does not power on in the same second. Each member gets the full wake
+ * pipeline of wol_wake_device() without its per-device messages; instead
+ * esp32/wol/group/<group>/status gets "wake_started" once all members are
+ * queued and "wake_complete" with every member's result (latency, timeout,
+ * failure) once the last one is resolved.
+ * 
+ * @param group Group index from wol_find_group()
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if a wake of the
+ *         group is still in progress, ESP_ERR_NOT_FOUND for an unknown group
+ */
+esp_err_t wol_wake_group(int group);
+
+/**
+ * @brief Process MQTT group command
+ * 
+ * @param group Group index, looked up from the name in the MQTT topic
+ * @param command Command string ("on", "wake", "status")
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t wol_handle_group_command(int group, const char* command);
+
 /**
  * @brief Load device list from configuration
  * 
+ * Reads the device table saved in NVS with a single blob read and fills the
+ * tables directly. The blob carries a magic, a format version and a CRC32;
+ * if it is missing or does not check out, the built-in default devices are
+ * added instead and saved.
+ * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t wol_load_device_config(void);
 
 /**
- * @brief Save device list to configuration
+ * @brief Save device list to configuration now
+ * 
+ * Edits (devices added or removed, enabled/disabled, group changes) already
+ * schedule a save: it is written once no edit came for
+ * WOL_CONFIG_SAVE_DELAY_MS, or at the latest WOL_CONFIG_SAVE_MAX_DELAY_MS
+ * after the first one, so a burst of edits costs one flash write. This call
+ * writes immediately, e.g. before a restart. Nothing is written when the
+ * table is unchanged since the last save.
  * 
  * @return esp_err_t ESP_OK on success
  */
 esp_err_t wol_save_device_config(void);
 
+/**
+ * @brief Add, update and remove many devices from one message
+ *
+ * Each line of the payload is one record:
+ *
+ *     name,ip,mac[,port[,strategy[,description]]]
+ *     -name
+ *
+ * The port defaults to 9. The strategy is "icmp" (default), "arp",
+ * "tcp[:port/port...]" (80/22 if none are given) or "udp:port[/port...]";
+ * the description is the rest of the line. A line starting with '-' removes
+ * the device; blank lines and lines starting with '#' are skipped.
+ *
+ * Every line is checked before anything is applied, and one bad line rejects
+ * the whole message. The batch then goes through the registry, the device
+ * table and the ping targets as one transaction each, the device table is
+ * saved once, and a single acknowledgement listing what was added, updated,
+ * removed, unchanged or not found is published on WOL_PROVISION_ACK_TOPIC.
+ *
+ * @param data Payload, not NUL terminated
+ * @param len Payload length
+ * @return esp_err_t ESP_OK when applied, ESP_ERR_INVALID_ARG when rejected,
+ *         ESP_ERR_NO_MEM if the devices do not fit
+ */
+esp_err_t wol_provision_devices(const char* data, int len);
+
 /**
  * @brief Process MQTT WoL command
  * 
- * @param device_name Device name from MQTT message
- * @param command Command string ("on", "wake", "status")
- * @return esp_err_t ESP_OK on success
+ * @param handle Device handle, looked up from the name in the MQTT topic
+ * @param command Command string ("on", "wake", "status", "enable", "disable")
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if the device is not managed
  */
-esp_err_t wol_handle_mqtt_command(const char* device_name, const char* command);
+esp_err_t wol_handle_mqtt_command(device_handle_t handle, const char* command);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,539 @@
+#include "device_registry.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "device_registry";
+
+// Open-addressed indices with linear probing, kept at most half full.
+// Each bucket holds a slot number or INDEX_EMPTY.
+#define INDEX_SIZE   (DEVICE_REGISTRY_MAX_DEVICES * 2)
+#define INDEX_EMPTY  (-1)
+
+// Hot fields as a struct of arrays indexed by slot; a slot is in use while
+// its owners bits are non-zero. Everything is guarded by registry_mutex,
+// except that generation, owners and ipv4 are read unlocked by the handle
+// accessors (single aligned loads).
+static uint32_t slot_ipv4[DEVICE_REGISTRY_MAX_DEVICES];
+static uint32_t slot_name_hash[DEVICE_REGISTRY_MAX_DEVICES];
+static uint16_t slot_generation[DEVICE_REGISTRY_MAX_DEVICES];
+static uint8_t slot_owners[DEVICE_REGISTRY_MAX_DEVICES];
+static uint8_t slot_mac[DEVICE_REGISTRY_MAX_DEVICES][6];
+static int16_t name_index[INDEX_SIZE];
+static int16_t ip_index[INDEX_SIZE];
+static int16_t mac_index[INDEX_SIZE];
+static int entry_count = 0;
+static SemaphoreHandle_t registry_mutex = NULL;
+
+// Cold strings, allocated once at init and never freed
+typedef struct {
+    char name[DEVICE_NAME_SIZE];
+    char description[DEVICE_DESCRIPTION_SIZE];
+} device_strings_t;
+
+static device_strings_t* strings = NULL;
+
+static const uint8_t zero_mac[6] = {0};
+
+// Forward declarations
+static uint32_t hash_bytes(const void* data, int len);
+static uint32_t hash_ipv4(uint32_t ipv4);
+static void index_insert(int16_t* index, uint32_t hash, int slot);
+static void index_rebuild(void);
+static int find_name_locked(const char* name, int len);
+static device_handle_t make_handle(int slot);
+static int handle_slot(device_handle_t handle);
+
+esp_err_t device_registry_init(void) {
+    if (registry_mutex) {
+        return ESP_OK;
+    }
+
+#if CONFIG_DEVICE_REGISTRY_STRINGS_IN_PSRAM
+    strings = heap_caps_calloc(DEVICE_REGISTRY_MAX_DEVICES, sizeof(*strings), MALLOC_CAP_SPIRAM);
+#endif
+    if (!strings) {
+        strings = heap_caps_calloc(DEVICE_REGISTRY_MAX_DEVICES, sizeof(*strings), MALLOC_CAP_8BIT);
+    }
+    if (!strings) {
+        ESP_LOGE(TAG, "Failed to allocate device strings");
+        return ESP_ERR_NO_MEM;
+    }
+
+    registry_mutex = xSemaphoreCreateMutex();
+    if (!registry_mutex) {
+        ESP_LOGE(TAG, "Failed to create registry mutex");
+        heap_caps_free(strings);
+        strings = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(slot_ipv4, 0, sizeof(slot_ipv4));
+    memset(slot_name_hash, 0, sizeof(slot_name_hash));
+    memset(slot_owners, 0, sizeof(slot_owners));
+    memset(slot_mac, 0, sizeof(slot_mac));
+    for (int i = 0; i < DEVICE_REGISTRY_MAX_DEVICES; i++) {
+        // Generation 0 is never handed out, so a zeroed handle is never valid
+        slot_generation[i] = 1;
+    }
+    entry_count = 0;
+    index_rebuild();
+
+    ESP_LOGI(TAG, "Device registry initialized (%d slots, %u bytes of strings)",
+             DEVICE_REGISTRY_MAX_DEVICES, (unsigned)(DEVICE_REGISTRY_MAX_DEVICES * sizeof(*strings)));
+    return ESP_OK;
+}
+
+esp_err_t device_registry_add(const char* name, const char* ip_address, const uint8_t* mac_address,
+                              uint8_t owner, device_handle_t* handle_out) {
+    if (!name || !ip_address || owner == 0 || !handle_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int name_len = strlen(name);
+    if (name_len == 0 || name_len >= DEVICE_NAME_SIZE) {
+        ESP_LOGE(TAG, "Invalid device name: %s", name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t ipv4 = 0;
+    if (inet_pton(AF_INET, ip_address, &ipv4) <= 0 || ipv4 == 0) {
+        ESP_LOGE(TAG, "Invalid IPv4 address for %s: %s", name, ip_address);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int slot = find_name_locked(name, name_len);
+    if (slot >= 0) {
+        bool reindex = (slot_ipv4[slot] != ipv4);
+        slot_ipv4[slot] = ipv4;
+        if (mac_address && memcmp(slot_mac[slot], mac_address, 6) != 0) {
+            memcpy(slot_mac[slot], mac_address, 6);
+            reindex = true;
+        }
+        slot_owners[slot] |= owner;
+        if (reindex) {
+            index_rebuild();
+        }
+        *handle_out = make_handle(slot);
+        xSemaphoreGive(registry_mutex);
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < DEVICE_REGISTRY_MAX_DEVICES; i++) {
+        if (slot_owners[i] == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        xSemaphoreGive(registry_mutex);
+        ESP_LOGE(TAG, "Registry full, cannot add %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&strings[slot], 0, sizeof(strings[slot]));
+    strcpy(strings[slot].name, name);
+    slot_name_hash[slot] = hash_bytes(name, name_len);
+    slot_ipv4[slot] = ipv4;
+    if (mac_address) {
+        memcpy(slot_mac[slot], mac_address, 6);
+    } else {
+        memset(slot_mac[slot], 0, 6);
+    }
+    slot_owners[slot] = owner;
+    entry_count++;
+
+    index_insert(name_index, slot_name_hash[slot], slot);
+    index_insert(ip_index, hash_ipv4(ipv4), slot);
+    if (memcmp(slot_mac[slot], zero_mac, 6) != 0) {
+        index_insert(mac_index, hash_bytes(slot_mac[slot], 6), slot);
+    }
+
+    *handle_out = make_handle(slot);
+    xSemaphoreGive(registry_mutex);
+
+    ESP_LOGD(TAG, "Registered %s in slot %d", name, slot);
+    return ESP_OK;
+}
+
+esp_err_t device_registry_apply(const device_registry_change_t* changes, int count, uint8_t owners,
+                                device_handle_t* handles_out, uint8_t* outcomes_out) {
+    if (!changes || count < 0 || owners == 0 || !handles_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Check everything before the first change; slots freed by removals in
+    // the batch are not counted as free
+    int new_names = 0;
+    for (int i = 0; i < count; i++) {
+        const device_registry_change_t* change = &changes[i];
+        int name_len = change->name ? strlen(change->name) : 0;
+        if (name_len == 0 || name_len >= DEVICE_NAME_SIZE || (!change->remove && change->ipv4 == 0)) {
+            xSemaphoreGive(registry_mutex);
+            ESP_LOGE(TAG, "Invalid change %d in batch", i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (!change->remove && find_name_locked(change->name, name_len) < 0) {
+            new_names++;
+        }
+    }
+    if (new_names > DEVICE_REGISTRY_MAX_DEVICES - entry_count) {
+        xSemaphoreGive(registry_mutex);
+        ESP_LOGE(TAG, "Batch needs %d new slots, %d free", new_names, DEVICE_REGISTRY_MAX_DEVICES - entry_count);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // New names go straight into the name index so later changes in the
+    // batch find them; everything else waits for the single rebuild
+    bool reindex = false;
+    for (int i = 0; i < count; i++) {
+        const device_registry_change_t* change = &changes[i];
+        int name_len = strlen(change->name);
+        int slot = find_name_locked(change->name, name_len);
+        uint8_t outcome;
+
+        if (change->remove) {
+            if (slot < 0) {
+                handles_out[i] = DEVICE_HANDLE_INVALID;
+                outcome = DEVICE_REGISTRY_MISSING;
+            } else {
+                handles_out[i] = make_handle(slot);
+                outcome = DEVICE_REGISTRY_REMOVED;
+                slot_owners[slot] &= ~owners;
+                if (slot_owners[slot] == 0) {
+                    slot_ipv4[slot] = 0;
+                    memset(slot_mac[slot], 0, 6);
+                    slot_generation[slot] = (slot_generation[slot] + 1) & 0x7FFF;
+                    if (slot_generation[slot] == 0) {
+                        slot_generation[slot] = 1;
+                    }
+                    entry_count--;
+                    reindex = true;
+                }
+            }
+        } else {
+            if (slot < 0) {
+                for (int s = 0; s < DEVICE_REGISTRY_MAX_DEVICES; s++) {
+                    if (slot_owners[s] == 0) {
+                        slot = s;
+                        break;
+                    }
+                }
+                memset(&strings[slot], 0, sizeof(strings[slot]));
+                strcpy(strings[slot].name, change->name);
+                slot_name_hash[slot] = hash_bytes(change->name, name_len);
+                slot_ipv4[slot] = 0;
+                memset(slot_mac[slot], 0, 6);
+                slot_owners[slot] = 0;
+                entry_count++;
+                index_insert(name_index, slot_name_hash[slot], slot);
+                outcome = DEVICE_REGISTRY_ADDED;
+            } else {
+                outcome = DEVICE_REGISTRY_UNCHANGED;
+            }
+
+            if (slot_ipv4[slot] != change->ipv4) {
+                slot_ipv4[slot] = change->ipv4;
+                reindex = true;
+                outcome = outcome == DEVICE_REGISTRY_ADDED ? outcome : DEVICE_REGISTRY_UPDATED;
+            }
+            if (change->mac_address && memcmp(slot_mac[slot], change->mac_address, 6) != 0) {
+                memcpy(slot_mac[slot], change->mac_address, 6);
+                reindex = true;
+                outcome = outcome == DEVICE_REGISTRY_ADDED ? outcome : DEVICE_REGISTRY_UPDATED;
+            }
+            if (change->description && strncmp(strings[slot].description, change->description,
+                                               sizeof(strings[slot].description) - 1) != 0) {
+                memset(strings[slot].description, 0, sizeof(strings[slot].description));
+                strncpy(strings[slot].description, change->description, sizeof(strings[slot].description) - 1);
+                outcome = outcome == DEVICE_REGISTRY_ADDED ? outcome : DEVICE_REGISTRY_UPDATED;
+            }
+            if ((slot_owners[slot] & owners) != owners) {
+                slot_owners[slot] |= owners;
+                outcome = outcome == DEVICE_REGISTRY_ADDED ? outcome : DEVICE_REGISTRY_UPDATED;
+            }
+            handles_out[i] = make_handle(slot);
+        }
+
+        if (outcomes_out) {
+            outcomes_out[i] = outcome;
+        }
+    }
+
+    if (reindex) {
+        index_rebuild();
+    }
+
+    xSemaphoreGive(registry_mutex);
+    ESP_LOGD(TAG, "Applied %d changes, %d devices registered", count, entry_count);
+    return ESP_OK;
+}
+
+esp_err_t device_registry_set_description(device_handle_t handle, const char* description) {
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int slot = handle_slot(handle);
+    if (slot >= 0) {
+        memset(strings[slot].description, 0, sizeof(strings[slot].description));
+        if (description) {
+            strncpy(strings[slot].description, description, sizeof(strings[slot].description) - 1);
+        }
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return slot >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t device_registry_release(device_handle_t handle, uint8_t owner) {
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int slot = handle_slot(handle);
+    if (slot < 0) {
+        xSemaphoreGive(registry_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    slot_owners[slot] &= ~owner;
+    if (slot_owners[slot] == 0) {
+        ESP_LOGD(TAG, "Released %s from slot %d", strings[slot].name, slot);
+        slot_ipv4[slot] = 0;
+        memset(slot_mac[slot], 0, 6);
+        slot_generation[slot] = (slot_generation[slot] + 1) & 0x7FFF;
+        if (slot_generation[slot] == 0) {
+            slot_generation[slot] = 1;
+        }
+        entry_count--;
+        // Removal is rare, rebuilding keeps the probe chains free of tombstones
+        index_rebuild();
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return ESP_OK;
+}
+
+device_handle_t device_registry_find(const char* name) {
+    if (!name) {
+        return DEVICE_HANDLE_INVALID;
+    }
+    return device_registry_find_n(name, strlen(name));
+}
+
+device_handle_t device_registry_find_n(const char* name, int len) {
+    if (!name || len <= 0 || len >= DEVICE_NAME_SIZE) {
+        return DEVICE_HANDLE_INVALID;
+    }
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return DEVICE_HANDLE_INVALID;
+    }
+
+    int slot = find_name_locked(name, len);
+    device_handle_t handle = slot >= 0 ? make_handle(slot) : DEVICE_HANDLE_INVALID;
+
+    xSemaphoreGive(registry_mutex);
+    return handle;
+}
+
+device_handle_t device_registry_find_by_ip(uint32_t ipv4) {
+    if (ipv4 == 0 || !registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return DEVICE_HANDLE_INVALID;
+    }
+
+    device_handle_t handle = DEVICE_HANDLE_INVALID;
+    for (uint32_t pos = hash_ipv4(ipv4) % INDEX_SIZE; ip_index[pos] != INDEX_EMPTY; pos = (pos + 1) % INDEX_SIZE) {
+        if (slot_ipv4[ip_index[pos]] == ipv4) {
+            handle = make_handle(ip_index[pos]);
+            break;
+        }
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return handle;
+}
+
+device_handle_t device_registry_find_by_mac(const uint8_t* mac_address) {
+    if (!mac_address || memcmp(mac_address, zero_mac, 6) == 0) {
+        return DEVICE_HANDLE_INVALID;
+    }
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return DEVICE_HANDLE_INVALID;
+    }
+
+    device_handle_t handle = DEVICE_HANDLE_INVALID;
+    for (uint32_t pos = hash_bytes(mac_address, 6) % INDEX_SIZE; mac_index[pos] != INDEX_EMPTY;
+         pos = (pos + 1) % INDEX_SIZE) {
+        if (memcmp(slot_mac[mac_index[pos]], mac_address, 6) == 0) {
+            handle = make_handle(mac_index[pos]);
+            break;
+        }
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return handle;
+}
+
+int device_registry_slot(device_handle_t handle) {
+    return handle_slot(handle);
+}
+
+esp_err_t device_registry_copy_name(device_handle_t handle, char* buf, size_t size) {
+    if (!buf || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    buf[0] = '\0';
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Checked under the lock, so the slot cannot be released and reused mid-copy
+    int slot = handle_slot(handle);
+    if (slot >= 0) {
+        strncpy(buf, strings[slot].name, size - 1);
+        buf[size - 1] = '\0';
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return slot >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+uint32_t device_registry_ipv4(device_handle_t handle) {
+    int slot = handle_slot(handle);
+    return slot >= 0 ? __atomic_load_n(&slot_ipv4[slot], __ATOMIC_RELAXED) : 0;
+}
+
+void device_registry_format_ip(uint32_t ipv4, char* buf, size_t size) {
+    const uint8_t* octets = (const uint8_t*)&ipv4;
+    snprintf(buf, size, "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+}
+
+esp_err_t device_registry_get(device_handle_t handle, device_registry_entry_t* entry_out) {
+    if (!entry_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!registry_mutex || xSemaphoreTake(registry_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int slot = handle_slot(handle);
+    if (slot >= 0) {
+        memcpy(entry_out->name, strings[slot].name, sizeof(entry_out->name));
+        memcpy(entry_out->description, strings[slot].description, sizeof(entry_out->description));
+        entry_out->ipv4 = slot_ipv4[slot];
+        device_registry_format_ip(slot_ipv4[slot], entry_out->ip_address, sizeof(entry_out->ip_address));
+        memcpy(entry_out->mac_address, slot_mac[slot], 6);
+        entry_out->owners = slot_owners[slot];
+    }
+
+    xSemaphoreGive(registry_mutex);
+    return slot >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+device_handle_t device_registry_next(device_handle_t after, uint8_t owner) {
+    int start = (after == DEVICE_HANDLE_INVALID) ? 0 : DEVICE_HANDLE_SLOT(after) + 1;
+    for (int slot = start; slot < DEVICE_REGISTRY_MAX_DEVICES; slot++) {
+        uint8_t owners = __atomic_load_n(&slot_owners[slot], __ATOMIC_RELAXED);
+        if (owners != 0 && (owner == 0 || (owners & owner))) {
+            return make_handle(slot);
+        }
+    }
+    return DEVICE_HANDLE_INVALID;
+}
+
+int device_registry_count(void) {
+    return __atomic_load_n(&entry_count, __ATOMIC_RELAXED);
+}
+
+// Private functions
+
+// FNV-1a
+static uint32_t hash_bytes(const void* data, int len) {
+    const uint8_t* bytes = data;
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Hosts on one subnet differ only in the last octet, mix it into every bit
+static uint32_t hash_ipv4(uint32_t ipv4) {
+    uint32_t hash = ipv4 * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+// Called with registry_mutex held
+static void index_insert(int16_t* index, uint32_t hash, int slot) {
+    uint32_t pos = hash % INDEX_SIZE;
+    while (index[pos] != INDEX_EMPTY) {
+        pos = (pos + 1) % INDEX_SIZE;
+    }
+    index[pos] = (int16_t)slot;
+}
+
+// Called with registry_mutex held, only touches the hot arrays
+static void index_rebuild(void) {
+    for (int i = 0; i < INDEX_SIZE; i++) {
+        name_index[i] = INDEX_EMPTY;
+        ip_index[i] = INDEX_EMPTY;
+        mac_index[i] = INDEX_EMPTY;
+    }
+    for (int slot = 0; slot < DEVICE_REGISTRY_MAX_DEVICES; slot++) {
+        if (slot_owners[slot] == 0) {
+            continue;
+        }
+        index_insert(name_index, slot_name_hash[slot], slot);
+        index_insert(ip_index, hash_ipv4(slot_ipv4[slot]), slot);
+        if (memcmp(slot_mac[slot], zero_mac, 6) != 0) {
+            index_insert(mac_index, hash_bytes(slot_mac[slot], 6), slot);
+        }
+    }
+}
+
+// Called with registry_mutex held; the stored hash filters out almost every
+// bucket before the name in the string store is compared
+static int find_name_locked(const char* name, int len) {
+    uint32_t hash = hash_bytes(name, len);
+    for (uint32_t pos = hash % INDEX_SIZE; name_index[pos] != INDEX_EMPTY; pos = (pos + 1) % INDEX_SIZE) {
+        int slot = name_index[pos];
+        // Released slots stay in the index until the next rebuild
+        if (slot_name_hash[slot] != hash || slot_owners[slot] == 0) {
+            continue;
+        }
+        const char* candidate = strings[slot].name;
+        if (strncmp(candidate, name, len) == 0 && candidate[len] == '\0') {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static device_handle_t make_handle(int slot) {
+    return ((device_handle_t)slot_generation[slot] << 16) | slot;
+}
+
+static int handle_slot(device_handle_t handle) {
+    if (handle < 0) {
+        return -1;
+    }
+    int slot = DEVICE_HANDLE_SLOT(handle);
+    if (slot >= DEVICE_REGISTRY_MAX_DEVICES) {
+        return -1;
+    }
+    uint16_t generation = __atomic_load_n(&slot_generation[slot], __ATOMIC_RELAXED);
+    if ((handle >> 16) != generation || __atomic_load_n(&slot_owners[slot], __ATOMIC_RELAXED) == 0) {
+        return -1;
+    }
+    return slot;
+}
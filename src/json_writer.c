@@ -0,0 +1,232 @@
+#include "json_writer.h"
+#include <string.h>
+
+// Forward declarations
+static void put_char(json_writer_t* writer, char c);
+static void put_raw(json_writer_t* writer, const char* text, size_t length);
+static void put_escaped(json_writer_t* writer, const char* text);
+static void put_uint(json_writer_t* writer, uint64_t value, int min_digits);
+static void begin_value(json_writer_t* writer);
+
+void json_writer_init(json_writer_t* writer, char* buffer, size_t size) {
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->need_comma = false;
+    writer->overflow = (buffer == NULL || size == 0);
+    if (!writer->overflow) {
+        buffer[0] = '\0';
+    }
+}
+
+int json_writer_finish(json_writer_t* writer) {
+    if (writer->overflow) {
+        return -1;
+    }
+    writer->buffer[writer->length] = '\0';
+    return (int)writer->length;
+}
+
+void json_writer_object_begin(json_writer_t* writer) {
+    begin_value(writer);
+    put_char(writer, '{');
+    writer->need_comma = false;
+}
+
+void json_writer_object_end(json_writer_t* writer) {
+    put_char(writer, '}');
+    writer->need_comma = true;
+}
+
+void json_writer_array_begin(json_writer_t* writer) {
+    begin_value(writer);
+    put_char(writer, '[');
+    writer->need_comma = false;
+}
+
+void json_writer_array_end(json_writer_t* writer) {
+    put_char(writer, ']');
+    writer->need_comma = true;
+}
+
+void json_writer_key(json_writer_t* writer, const char* key) {
+    begin_value(writer);
+    put_char(writer, '"');
+    put_escaped(writer, key);
+    put_raw(writer, "\":", 2);
+    // The value follows the colon directly
+    writer->need_comma = false;
+}
+
+void json_writer_string(json_writer_t* writer, const char* value) {
+    begin_value(writer);
+    if (value == NULL) {
+        put_raw(writer, "null", 4);
+    } else {
+        put_char(writer, '"');
+        put_escaped(writer, value);
+        put_char(writer, '"');
+    }
+    writer->need_comma = true;
+}
+
+void json_writer_int(json_writer_t* writer, int64_t value) {
+    begin_value(writer);
+    if (value < 0) {
+        put_char(writer, '-');
+        put_uint(writer, (uint64_t)(-(value + 1)) + 1, 1);
+    } else {
+        put_uint(writer, (uint64_t)value, 1);
+    }
+    writer->need_comma = true;
+}
+
+void json_writer_uint(json_writer_t* writer, uint64_t value) {
+    begin_value(writer);
+    put_uint(writer, value, 1);
+    writer->need_comma = true;
+}
+
+void json_writer_bool(json_writer_t* writer, bool value) {
+    begin_value(writer);
+    if (value) {
+        put_raw(writer, "true", 4);
+    } else {
+        put_raw(writer, "false", 5);
+    }
+    writer->need_comma = true;
+}
+
+void json_writer_fixed(json_writer_t* writer, int64_t value, int decimals) {
+    static const uint32_t scales[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    if (decimals <= 0 || decimals > 9) {
+        json_writer_int(writer, value);
+        return;
+    }
+
+    begin_value(writer);
+    uint64_t magnitude = value < 0 ? (uint64_t)(-(value + 1)) + 1 : (uint64_t)value;
+    if (value < 0) {
+        put_char(writer, '-');
+    }
+    put_uint(writer, magnitude / scales[decimals], 1);
+    put_char(writer, '.');
+    put_uint(writer, magnitude % scales[decimals], decimals);
+    writer->need_comma = true;
+}
+
+void json_writer_mac(json_writer_t* writer, const uint8_t* mac) {
+    static const char hex[] = "0123456789abcdef";
+    char text[17];
+
+    for (int i = 0; i < 6; i++) {
+        text[i * 3] = hex[mac[i] >> 4];
+        text[i * 3 + 1] = hex[mac[i] & 0x0F];
+        if (i < 5) {
+            text[i * 3 + 2] = ':';
+        }
+    }
+
+    begin_value(writer);
+    put_char(writer, '"');
+    put_raw(writer, text, sizeof(text));
+    put_char(writer, '"');
+    writer->need_comma = true;
+}
+
+void json_writer_kv_string(json_writer_t* writer, const char* key, const char* value) {
+    json_writer_key(writer, key);
+    json_writer_string(writer, value);
+}
+
+void json_writer_kv_int(json_writer_t* writer, const char* key, int64_t value) {
+    json_writer_key(writer, key);
+    json_writer_int(writer, value);
+}
+
+void json_writer_kv_uint(json_writer_t* writer, const char* key, uint64_t value) {
+    json_writer_key(writer, key);
+    json_writer_uint(writer, value);
+}
+
+void json_writer_kv_bool(json_writer_t* writer, const char* key, bool value) {
+    json_writer_key(writer, key);
+    json_writer_bool(writer, value);
+}
+
+// Private functions
+static void begin_value(json_writer_t* writer) {
+    if (writer->need_comma) {
+        put_char(writer, ',');
+    }
+}
+
+static void put_char(json_writer_t* writer, char c) {
+    put_raw(writer, &c, 1);
+}
+
+static void put_raw(json_writer_t* writer, const char* text, size_t length) {
+    if (writer->overflow) {
+        return;
+    }
+
+    // Keep one byte for the terminator
+    if (writer->length + length >= writer->size) {
+        writer->overflow = true;
+        writer->buffer[writer->length] = '\0';
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+    writer->buffer[writer->length] = '\0';
+}
+
+static void put_escaped(json_writer_t* writer, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    const char* run = text;
+
+    for (const char* p = text; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Flush the plain run before the character that needs escaping
+        put_raw(writer, run, p - run);
+        run = p + 1;
+
+        switch (c) {
+            case '"':  put_raw(writer, "\\\"", 2); break;
+            case '\\': put_raw(writer, "\\\\", 2); break;
+            case '\n': put_raw(writer, "\\n", 2); break;
+            case '\r': put_raw(writer, "\\r", 2); break;
+            case '\t': put_raw(writer, "\\t", 2); break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+                put_raw(writer, escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+
+    put_raw(writer, run, strlen(run));
+}
+
+static void put_uint(json_writer_t* writer, uint64_t value, int min_digits) {
+    char digits[20];
+    int count = 0;
+
+    do {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && count < (int)sizeof(digits));
+
+    while (count < min_digits && count < (int)sizeof(digits)) {
+        digits[sizeof(digits) - 1 - count++] = '0';
+    }
+
+    put_raw(writer, digits + sizeof(digits) - count, count);
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 
@@ -10,35 +11,134 @@
 #include "device_info.h"
 #include "mqtt_manager.h"
 #include "wol_manager.h"
+#include "device_registry.h"
 
 static const char *TAG = "MAIN";
 
-// Ping result callback function
-void ping_result_handler(const char* name, const char* ip_address, bool success, uint32_t response_time, void* user_data)
+// Ping result callback, runs on ping_results next to the MQTT client, not on ping_task
+void ping_result_handler(device_handle_t handle, const char* name, const char* ip_address, bool success,
+                         uint32_t response_time_us, void* user_data)
 {
     if (success) {
-        ESP_LOGI(TAG, "✓ Ping to %s (%s) successful: %" PRIu32 " ms", name, ip_address, response_time);
+        ESP_LOGI(TAG, "✓ Ping to %s (%s) successful: %" PRIu32 ".%03" PRIu32 " ms", name, ip_address,
+                 response_time_us / 1000, response_time_us % 1000);
     } else {
         ESP_LOGW(TAG, "✗ Ping to %s (%s) failed", name, ip_address);
     }
     
-    // Send ping result via MQTT if connected
-    mqtt_manager_send_ping_result(ip_address, success, response_time);
+    // Debounced device status, published by the WoL manager when it changes
+    wol_update_device_status(handle, success);
+    
+    // Queue the result, MQTT publishes the results in batches
+    mqtt_manager_queue_ping_result(handle, name, ip_address, success, response_time_us);
+}
+
+#if CONFIG_POWER_SAVE_MODE
+// Wake done callback: send what the wake produced before the station sleeps again
+static void wake_done_handler(void* user_data)
+{
+    mqtt_manager_flush_window();
+}
+#endif
+
+// Handler for MQTT_TOPIC_COMMANDS, payload is the command name
+static esp_err_t command_handler(const mqtt_slice_t* captures, int capture_count,
+                                 const char* data, int data_len, void* user_data)
+{
+    mqtt_slice_t command = { data, data_len };
+    
+    if (mqtt_slice_equals(&command, "device_info")) {
+        ESP_LOGI(TAG, "Executing device_info command");
+        return mqtt_manager_send_device_info();
+    } else if (mqtt_slice_equals(&command, "hello")) {
+        ESP_LOGI(TAG, "Executing hello command");
+        return mqtt_manager_send_hello();
+    }
+    
+    ESP_LOGW(TAG, "Unknown command: %.*s", data_len, data);
+    return ESP_ERR_INVALID_ARG;
+}
+
+// Messages on topics without a route
+static void mqtt_message_handler(const char* topic, int topic_len, const char* data, int data_len)
+{
+    ESP_LOGI(TAG, "Unhandled MQTT message on topic '%.*s': %.*s", topic_len, topic, data_len, data);
+}
+
+// Startup and connectivity events, set by the WiFi and MQTT callbacks
+#define APP_WIFI_CHANGED_BIT   BIT0
+#define APP_MQTT_UP_BIT        BIT1
+#define APP_REPORT_INTERVAL_MS 120000
+
+static EventGroupHandle_t app_events = NULL;
+
+static void wifi_connection_handler(bool connected)
+{
+    xEventGroupSetBits(app_events, APP_WIFI_CHANGED_BIT);
+}
+
+static void mqtt_connection_handler(bool connected)
+{
+    if (connected) {
+        xEventGroupSetBits(app_events, APP_MQTT_UP_BIT);
+    }
 }
 
-// MQTT message callback function
-void mqtt_message_handler(const char* topic, const char* data, int data_len)
+// Periodic monitoring report, every APP_REPORT_INTERVAL_MS
+static void report_status(int loop_count)
 {
-    ESP_LOGI(TAG, "MQTT message received on topic '%s': %.*s", topic, data_len, data);
-      // Handle different command topics
-    if (strstr(topic, "commands") != NULL) {
-        if (strncmp(data, "device_info", data_len) == 0) {
-            ESP_LOGI(TAG, "Executing device_info command");
-            mqtt_manager_send_device_info();
-        } else if (strncmp(data, "hello", data_len) == 0) {
-            ESP_LOGI(TAG, "Executing hello command");
-            mqtt_manager_send_hello();
+    ESP_LOGI(TAG, "=== Main Loop %d ===", loop_count);
+    if (wifi_manager_is_connected() && mqtt_manager_is_connected()) {
+        // Display device monitoring statistics every 2 minutes
+        ESP_LOGI(TAG, "Device Monitoring Status:");
+        if (wol_get_device_count() > 0) {
+            for (device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID); handle != DEVICE_HANDLE_INVALID;
+                 handle = wol_next_device(handle)) {
+                const wol_device_t* device = wol_get_device_by_handle(handle);
+                device_registry_entry_t entry;
+                if (!device || device_registry_get(handle, &entry) != ESP_OK) {
+                    continue;
+                }
+                ping_target_t ping_info;
+                probe_stats_summary_t latency;
+                if (ping_manager_get_device_by_handle(handle, &ping_info) == ESP_OK &&
+                    ping_manager_get_latency_stats(handle, &latency) == ESP_OK) {
+                    ESP_LOGI(TAG, "  %s (%s): %s - Success=%" PRIu32 ", Fail=%" PRIu32 
+                            ", Success Rate 1m/15m/1h=%.1f/%.1f/%.1f%%, RTT p50/p95/p99=%.1f/%.1f/%.1f ms, Jitter=%.1f ms", 
+                            entry.name, entry.ip_address,
+                            wol_get_status_string(device->status),
+                            ping_info.success_count,
+                            ping_info.fail_count,
+                            latency.success_permille[PROBE_STATS_WINDOW_1M] / 10.0,
+                            latency.success_permille[PROBE_STATS_WINDOW_15M] / 10.0,
+                            latency.success_permille[PROBE_STATS_WINDOW_1H] / 10.0,
+                            latency.p50_us / 1000.0, latency.p95_us / 1000.0, latency.p99_us / 1000.0,
+                            latency.jitter_us / 1000.0);
+                } else {
+                    ESP_LOGI(TAG, "  %s (%s): %s - No ping data", 
+                            entry.name, entry.ip_address, wol_get_status_string(device->status));
+                }
+            }
+        } else {
+            ESP_LOGW(TAG, "No devices configured for monitoring");
         }
+        
+        // Latency aggregates replace the raw ping stream for SLO tracking
+        if (ping_manager_get_target_count() > 0) {
+            mqtt_publish_latency_summary();
+        }
+        
+        // Send status update every 5 loops (10 minutes); in delta mode device
+        // state lives in retained topics and needs no periodic re-broadcast
+        if (loop_count % 5 == 0) {
+            mqtt_manager_send_status("System running - Device monitoring active");
+            if (!mqtt_manager_is_delta_mode()) {
+                mqtt_publish_devices_summary();
+            }
+        }
+    } else {
+        ESP_LOGW(TAG, "WiFi or MQTT disconnected - %d state updates queued for the broker",
+                 mqtt_manager_get_offline_count());
     }
 }
 
@@ -53,104 +153,107 @@ void app_main(void)
     ESP_ERROR_CHECK(ret);    // Print device information first
     device_info_print_all();
     
-    // Initialize ping manager with callback
+    app_events = xEventGroupCreate();
+    if (app_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create event group");
+        return;
+    }
+    
+    // Device registry shared by the ping and WoL managers
+    ret = device_registry_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize device registry");
+        return;
+    }
+    
+    // Initialize ping manager with callback; probing waits for an IP
     ret = ping_manager_init(ping_result_handler, NULL);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize ping manager");
         return;
     }
+    ping_manager_set_paused(true);
+    
+#if CONFIG_POWER_SAVE_MODE
+    // Duty-cycled monitoring: probe in shared wakes, publish at the end of each
+    ping_manager_set_wake_slot(CONFIG_POWER_SAVE_WAKE_SLOT_MS);
+    ping_manager_set_wake_done_callback(wake_done_handler, NULL);
+    mqtt_manager_set_low_power(true);
+#endif
     
-    // Initialize and connect to WiFi
+    // Initialize Wake-on-LAN manager (which automatically adds devices to ping monitoring).
+    // The device table is local, it does not need the network.
+    ESP_LOGI(TAG, "Initializing Wake-on-LAN manager...");
+    ret = wol_manager_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize WoL manager");
+    }
+    
+    // Routes and callbacks are in place before any connection can come up
+    mqtt_manager_register_route(MQTT_TOPIC_COMMANDS, MQTT_QOS_1, command_handler, NULL);
+    mqtt_manager_set_connection_callback(mqtt_connection_handler);
+    wifi_manager_set_connection_callback(wifi_connection_handler);
+    
+    // Start WiFi, the connection is reported through wifi_connection_handler
     ESP_LOGI(TAG, "Starting WiFi connection...");
-    ret = wifi_manager_init();
+    ret = wifi_manager_start();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize WiFi manager");
         ping_manager_deinit();
         return;
     }
     
-    // Wait a moment for WiFi to fully connect
-    vTaskDelay(pdMS_TO_TICKS(2000));
+    // Main application loop: react to connectivity events as they happen,
+    // report every APP_REPORT_INTERVAL_MS
+    bool mqtt_started = false;
+    bool announced = false;
+    int loop_count = 0;
+    TickType_t next_report = xTaskGetTickCount() + pdMS_TO_TICKS(APP_REPORT_INTERVAL_MS);
     
-    // Initialize MQTT manager after WiFi is connected
-    if (wifi_manager_is_connected()) {
-        ESP_LOGI(TAG, "WiFi connected, initializing MQTT...");
-        ret = mqtt_manager_init(mqtt_message_handler);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to initialize MQTT manager");
-        } else {
-            ESP_LOGI(TAG, "MQTT manager initialized successfully");
-        }
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (int32_t)(next_report - now) > 0 ? next_report - now : 0;
+        EventBits_t bits = xEventGroupWaitBits(app_events, APP_WIFI_CHANGED_BIT | APP_MQTT_UP_BIT,
+                                               pdTRUE, pdFALSE, wait);
         
-        // Wait for MQTT to connect
-        int mqtt_wait_count = 0;
-        while (!mqtt_manager_is_connected() && mqtt_wait_count < 30) {
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            mqtt_wait_count++;
-            ESP_LOGI(TAG, "Waiting for MQTT connection... (%d/30)", mqtt_wait_count);
-        }
-          if (mqtt_manager_is_connected()) {
-            ESP_LOGI(TAG, "MQTT connected successfully!");
+        if (bits & APP_WIFI_CHANGED_BIT) {
+            // Several changes may have piled up, act on the current state
+            bool wifi_up = wifi_manager_is_connected();
             
-            // Initialize Wake-on-LAN manager (which automatically adds devices to ping monitoring)
-            ESP_LOGI(TAG, "Initializing Wake-on-LAN manager...");
-            ret = wol_manager_init();
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to initialize WoL manager");
-            } else {
-                ESP_LOGI(TAG, "WoL manager initialized successfully - Device monitoring active");
-                
-                // Publish initial devices summary
-                mqtt_publish_devices_summary();
+            // The client reconnects by itself once started. Started before
+            // probing resumes, so the first results already have somewhere to go.
+            if (wifi_up && !mqtt_started) {
+                ESP_LOGI(TAG, "WiFi connected, initializing MQTT...");
+                ret = mqtt_manager_init(mqtt_message_handler);
+                if (ret != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to initialize MQTT manager, retrying at the next report");
+                } else {
+                    mqtt_started = true;
+                }
             }
             
-            // Send initial hello message
-            mqtt_manager_send_hello();
+            ping_manager_set_paused(!wifi_up);
+        }
+        
+        if ((bits & APP_MQTT_UP_BIT) && !announced) {
+            ESP_LOGI(TAG, "MQTT connected successfully!");
+            
+            // Publish initial devices summary
+            mqtt_publish_devices_summary();
             
             // Send status update
             mqtt_manager_send_status("ESP32 device online and ready");
-        }    }
-    
-    // Main application loop
-    int loop_count = 0;
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(120000)); // Wait 2 minutes
-        loop_count++;
+            announced = true;
+        }
         
-        ESP_LOGI(TAG, "=== Main Loop %d ===", loop_count);
-          if (wifi_manager_is_connected() && mqtt_manager_is_connected()) {
-            // Display device monitoring statistics every 2 minutes
-            ESP_LOGI(TAG, "Device Monitoring Status:");
-            int device_count;
-            const wol_device_t* devices = wol_get_all_devices(&device_count);
-            
-            if (devices) {
-                for (int i = 0; i < device_count; i++) {
-                    const ping_target_t* ping_info = ping_manager_get_device(devices[i].name);
-                    if (ping_info) {
-                        ESP_LOGI(TAG, "  %s (%s): %s - Success=%" PRIu32 ", Fail=%" PRIu32 ", Success Rate=%.1f%%", 
-                                devices[i].name, devices[i].ip_address,
-                                wol_get_status_string(devices[i].status),
-                                ping_info->success_count,
-                                ping_info->fail_count,
-                                ping_info->success_count + ping_info->fail_count > 0 ? 
-                                    (100.0 * ping_info->success_count) / (ping_info->success_count + ping_info->fail_count) : 0.0);
-                    } else {
-                        ESP_LOGI(TAG, "  %s (%s): %s - No ping data", 
-                                devices[i].name, devices[i].ip_address, wol_get_status_string(devices[i].status));
-                    }
-                }
-            } else {
-                ESP_LOGW(TAG, "No devices configured for monitoring");
-            }
+        if ((int32_t)(xTaskGetTickCount() - next_report) >= 0) {
+            next_report += pdMS_TO_TICKS(APP_REPORT_INTERVAL_MS);
+            loop_count++;
             
-            // Send status update every 5 loops (10 minutes)
-            if (loop_count % 5 == 0) {
-                mqtt_manager_send_status("System running - Device monitoring active");
-                mqtt_publish_devices_summary();
+            if (!mqtt_started && wifi_manager_is_connected()) {
+                xEventGroupSetBits(app_events, APP_WIFI_CHANGED_BIT);
             }
-        } else {
-            ESP_LOGW(TAG, "WiFi or MQTT disconnected - device monitoring paused");
+            report_status(loop_count);
         }
     }
-}
\ No newline at end of file
+}
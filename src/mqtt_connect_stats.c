@@ -0,0 +1,135 @@
+#include "mqtt_connect_stats.h"
+#include "esp_timer.h"
+
+static const uint32_t bucket_limits_ms[MQTT_CONNECT_HIST_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2500, 5000
+};
+
+static const char* const stage_names[MQTT_CONNECT_STAGE_COUNT] = {
+    "dns", "connack", "suback", "total"
+};
+
+static mqtt_connect_stage_stats_t stages[MQTT_CONNECT_STAGE_COUNT];
+static uint32_t attempts = 0;
+static uint32_t failures = 0;
+static bool in_progress = false;
+static int64_t attempt_start_us = 0;
+static int64_t last_mark_us = 0;
+
+// Forward declarations
+static void record(mqtt_connect_stage_t stage, int64_t elapsed_us);
+
+void mqtt_connect_stats_begin(void) {
+    // A new attempt while the last one never finished means it failed silently
+    if (in_progress) {
+        failures++;
+    }
+    attempts++;
+    in_progress = true;
+    attempt_start_us = esp_timer_get_time();
+    last_mark_us = attempt_start_us;
+}
+
+void mqtt_connect_stats_mark(mqtt_connect_stage_t stage) {
+    if (!in_progress || stage >= MQTT_CONNECT_STAGE_TOTAL) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    record(stage, now - last_mark_us);
+    last_mark_us = now;
+}
+
+bool mqtt_connect_stats_complete(void) {
+    if (!in_progress) {
+        return false;
+    }
+    record(MQTT_CONNECT_STAGE_TOTAL, esp_timer_get_time() - attempt_start_us);
+    in_progress = false;
+    return true;
+}
+
+void mqtt_connect_stats_fail(void) {
+    if (in_progress) {
+        failures++;
+        in_progress = false;
+    }
+}
+
+bool mqtt_connect_stats_in_progress(void) {
+    return in_progress;
+}
+
+const mqtt_connect_stage_stats_t* mqtt_connect_stats_get(mqtt_connect_stage_t stage) {
+    if (stage >= MQTT_CONNECT_STAGE_COUNT) {
+        return NULL;
+    }
+    return &stages[stage];
+}
+
+void mqtt_connect_stats_write_json(json_writer_t* json) {
+    json_writer_object_begin(json);
+    json_writer_kv_uint(json, "attempts", attempts);
+    json_writer_kv_uint(json, "failures", failures);
+
+    json_writer_key(json, "bucket_ms");
+    json_writer_array_begin(json);
+    for (int b = 0; b < MQTT_CONNECT_HIST_BUCKETS - 1; b++) {
+        json_writer_uint(json, bucket_limits_ms[b]);
+    }
+    json_writer_array_end(json);
+
+    for (int s = 0; s < MQTT_CONNECT_STAGE_COUNT; s++) {
+        const mqtt_connect_stage_stats_t* stats = &stages[s];
+        json_writer_key(json, stage_names[s]);
+        json_writer_object_begin(json);
+        json_writer_kv_uint(json, "n", stats->samples);
+        if (stats->samples > 0) {
+            json_writer_kv_uint(json, "last", stats->last_ms);
+            json_writer_kv_uint(json, "min", stats->min_ms);
+            json_writer_kv_uint(json, "max", stats->max_ms);
+            json_writer_kv_uint(json, "avg", stats->sum_ms / stats->samples);
+        }
+        json_writer_key(json, "hist");
+        json_writer_array_begin(json);
+        for (int b = 0; b < MQTT_CONNECT_HIST_BUCKETS; b++) {
+            json_writer_uint(json, stats->buckets[b]);
+        }
+        json_writer_array_end(json);
+        json_writer_object_end(json);
+    }
+
+    json_writer_object_end(json);
+}
+
+// Private functions
+static void record(mqtt_connect_stage_t stage, int64_t elapsed_us) {
+    mqtt_connect_stage_stats_t* stats = &stages[stage];
+    uint32_t ms = elapsed_us > 0 ? (uint32_t)(elapsed_us / 1000) : 0;
+
+    // Halve everything once the window is full so old configurations fade out
+    if (stats->samples >= MQTT_CONNECT_STATS_WINDOW) {
+        uint32_t kept = 0;
+        for (int b = 0; b < MQTT_CONNECT_HIST_BUCKETS; b++) {
+            stats->buckets[b] /= 2;
+            kept += stats->buckets[b];
+        }
+        stats->sum_ms = stats->samples > 0 ? stats->sum_ms * kept / stats->samples : 0;
+        stats->samples = kept;
+    }
+
+    int bucket = 0;
+    while (bucket < MQTT_CONNECT_HIST_BUCKETS - 1 && ms > bucket_limits_ms[bucket]) {
+        bucket++;
+    }
+
+    if (stats->samples == 0 || ms < stats->min_ms) {
+        stats->min_ms = ms;
+    }
+    if (stats->samples == 0 || ms > stats->max_ms) {
+        stats->max_ms = ms;
+    }
+    stats->buckets[bucket]++;
+    stats->samples++;
+    stats->sum_ms += ms;
+    stats->last_ms = ms;
+}
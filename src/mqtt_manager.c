@@ -1,35 +1,159 @@
 #include "mqtt_manager.h"
 #include "wol_manager.h"
+#include "ping_manager.h"
+#include "wifi_manager.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_chip_info.h"
 #include "esp_mac.h"
 #include "esp_timer.h"
 #include "esp_crt_bundle.h"
-#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "json_writer.h"
+#include "mqtt_offline_queue.h"
+#include "mqtt_connect_stats.h"
+#include "system_metrics.h"
+#include <stdlib.h>
+#include "lwip/netdb.h"
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
 
 static const char *TAG = "MQTT_MANAGER";
 
+// Payload buffer sizes for the JSON writer
+#define MQTT_SMALL_PAYLOAD_SIZE    256    // Hello, status and single-record messages (stack)
+#define MQTT_LARGE_PAYLOAD_SIZE    768    // Device info and summary (stack)
+#define MQTT_PING_RECORD_SIZE      128    // Upper bound for one batched ping record
+#define MQTT_DIAG_PAYLOAD_SIZE     1024   // Connect and WiFi diagnostics (stack)
+#define MQTT_METRICS_PAYLOAD_SIZE  1536   // Runtime metrics (heap, built on the esp_timer task)
+
 // MQTT client handle
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool mqtt_connected = false;
+static bool session_established = false;   // Subscribed and announced since boot
+static bool awaiting_suback = false;       // Connect attempt still waits for its SUBACK
 static mqtt_message_callback_t user_message_callback = NULL;
+static mqtt_connection_callback_t connection_callback = NULL;
+
+// Ping result batch, filled by the ping result task and drained by size or by timer
+typedef struct {
+    char name[32];
+    char ip_address[16];
+    bool success;
+    uint32_t response_time_us;
+    int64_t timestamp_ms;
+} ping_batch_entry_t;
+
+static ping_batch_entry_t ping_batch[MQTT_PING_BATCH_SIZE];
+static char ping_batch_payload[MQTT_PING_BATCH_SIZE * MQTT_PING_RECORD_SIZE + 64];
+static int ping_batch_count = 0;
+static SemaphoreHandle_t ping_batch_mutex = NULL;
+static esp_timer_handle_t ping_batch_timer = NULL;
+
+// Last published state per target for delta mode, indexed by registry slot
+// and guarded by ping_batch_mutex
+typedef struct {
+    device_handle_t handle;          // Device the entry belongs to, a new handle resets it
+    bool published;                  // State below has been published since the last connect
+    bool is_online;
+    uint32_t response_time_us;
+} ping_delta_entry_t;
+
+static ping_delta_entry_t ping_delta[PING_MAX_TARGETS];
+static bool delta_mode = MQTT_PING_DELTA_MODE;
+static uint32_t delta_rtt_threshold_us = MQTT_PING_DELTA_RTT_US;
+
+// Reassembly of payloads esp-mqtt delivers in several MQTT_EVENT_DATA events.
+// Only touched by the MQTT task, which delivers fragments strictly in order.
+typedef enum {
+    RX_IDLE = 0,                     // No fragmented message in progress
+    RX_ASSEMBLING,                   // Copying fragments into rx_pool
+    RX_DISCARDING                    // Rejected message, dropping its remaining fragments
+} rx_state_t;
+
+static char rx_pool[MQTT_RX_MAX_MESSAGE];
+static char rx_topic[128];
+static int rx_topic_len = 0;
+static int rx_total_len = 0;
+static int rx_received_len = 0;
+static rx_state_t rx_state = RX_IDLE;
+
+// Drains the offline queue at a bounded rate after a reconnect
+static esp_timer_handle_t offline_drain_timer = NULL;
+
+// Periodic metrics; metrics_mutex serializes the timer and on-request publishes
+static esp_timer_handle_t metrics_timer = NULL;
+static SemaphoreHandle_t metrics_mutex = NULL;
+static int64_t metrics_last_us = 0;
+static ping_wake_stats_t metrics_last_wake;    // Wake counters at the last publish
+
+// Low-power mode: output waits for the end of each probe wake
+static bool low_power = false;
 
 // Function prototypes
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
-static char* create_device_info_json(void);
-static char* create_ping_result_json(const char* ip_address, bool success, uint32_t response_time);
+static int create_device_info_json(char* buffer, size_t size);
+static int create_ping_result_json(char* buffer, size_t size, const char* ip_address, bool success,
+                                   uint32_t response_time_us);
+static void ping_batch_timer_callback(void* arg);
+static void metrics_timer_callback(void* arg);
+static ping_delta_entry_t* ping_delta_lookup(device_handle_t handle);
+static void ping_delta_reset(void);
+static esp_err_t register_builtin_routes(void);
+static bool offline_pending(bool coalesce, int len);
+static esp_err_t queue_offline(const char* topic, const char* payload, int len, int qos, bool retain,
+                               bool coalesce);
+static esp_err_t offline_send(const mqtt_offline_msg_t* msg);
+static void offline_drain_timer_callback(void* arg);
+static void resolve_broker(void);
+static void connect_attempt_ready(void);
+static void handle_data_event(esp_mqtt_event_handle_t event);
+static void dispatch_message(const char* topic, int topic_len, const char* data, int data_len);
+static esp_err_t wol_command_route(const mqtt_slice_t* captures, int capture_count,
+                                   const char* data, int data_len, void* user_data);
+static esp_err_t wol_group_command_route(const mqtt_slice_t* captures, int capture_count,
+                                         const char* data, int data_len, void* user_data);
+static esp_err_t system_command_route(const mqtt_slice_t* captures, int capture_count,
+                                      const char* data, int data_len, void* user_data);
+static esp_err_t system_devices_route(const mqtt_slice_t* captures, int capture_count,
+                                      const char* data, int data_len, void* user_data);
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
       switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "MQTT connected to broker");
+        {
+            // The broker kept our session: subscriptions are still in place and
+            // subscribers already have hello and device info from this boot.
+            // The first connect after boot always does the full setup, since
+            // routes may have changed since the stored session was created.
+            bool resumed = MQTT_PERSISTENT_SESSION && event->session_present && session_established;
+            ESP_LOGI(TAG, "MQTT connected to broker (%s)", resumed ? "session resumed" : "new session");
             mqtt_connected = true;
+            mqtt_connect_stats_mark(MQTT_CONNECT_STAGE_CONNACK);
+            if (MQTT_METRICS_INTERVAL_MS > 0 && !low_power) {
+                esp_timer_start_periodic(metrics_timer, (uint64_t)MQTT_METRICS_INTERVAL_MS * 1000);
+            }
+            
+            // Replay what happened while disconnected, oldest first
+            if (mqtt_offline_queue_count() > 0) {
+                ESP_LOGI(TAG, "Publishing %d queued messages", mqtt_offline_queue_count());
+                esp_timer_start_periodic(offline_drain_timer, (uint64_t)MQTT_OFFLINE_DRAIN_INTERVAL_MS * 1000);
+            }
+            
+            if (resumed) {
+                connect_attempt_ready();
+                if (connection_callback) {
+                    connection_callback(true);
+                }
+                break;
+            }
+            
+            // Retained state may be stale, publish it again
+            ping_delta_reset();
             
             // Send initial hello message
             mqtt_manager_send_hello();
@@ -37,20 +161,44 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             // Send device info
             mqtt_manager_send_device_info();
             
-            // Subscribe to command topics
-            mqtt_manager_subscribe("esp32/commands", MQTT_QOS_1);
+            // Subscribe to every routed topic filter
+            if (mqtt_subscribe_wol_commands() == ESP_OK) {
+                session_established = true;
+            }
             
-            // Subscribe to WoL command topics
-            mqtt_subscribe_wol_commands();
+            // The attempt counts as done once the broker confirms the subscriptions
+            awaiting_suback = mqtt_router_get_route_count() > 0 && session_established;
+            if (!awaiting_suback) {
+                connect_attempt_ready();
+            }
+            if (connection_callback) {
+                connection_callback(true);
+            }
             break;
+        }
             
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "MQTT disconnected from broker");
             mqtt_connected = false;
+            
+            // A message cut off by the disconnect is never completed
+            rx_state = RX_IDLE;
+            esp_timer_stop(offline_drain_timer);
+            esp_timer_stop(metrics_timer);
+            awaiting_suback = false;
+            mqtt_connect_stats_fail();
+            if (connection_callback) {
+                connection_callback(false);
+            }
             break;
             
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG, "MQTT subscribed to topic, msg_id=%d", event->msg_id);
+            if (awaiting_suback) {
+                awaiting_suback = false;
+                mqtt_connect_stats_mark(MQTT_CONNECT_STAGE_SUBACK);
+                connect_attempt_ready();
+            }
             break;
             
         case MQTT_EVENT_UNSUBSCRIBED:
@@ -62,33 +210,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             break;
             
         case MQTT_EVENT_DATA:
-        {
-            ESP_LOGI(TAG, "MQTT message received:");
-            ESP_LOGI(TAG, "  Topic: %.*s", event->topic_len, event->topic);
-            ESP_LOGI(TAG, "  Data: %.*s", event->data_len, event->data);
-            
-            // Handle WoL commands
-            char topic[event->topic_len + 1];
-            char data[event->data_len + 1];
-            
-            memcpy(topic, event->topic, event->topic_len);
-            topic[event->topic_len] = '\0';
-            
-            memcpy(data, event->data, event->data_len);
-            data[event->data_len] = '\0';
-            
-            // Check if it's a WoL command
-            mqtt_handle_wol_command(topic, data, event->data_len);
-            
-            // Call user callback if provided
-            if (user_message_callback) {
-                user_message_callback(topic, data, event->data_len);
-            }
+            handle_data_event(event);
             break;
-        }
         
         case MQTT_EVENT_ERROR:
             ESP_LOGE(TAG, "MQTT error occurred");
+            mqtt_connect_stats_fail();
             if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
                 ESP_LOGE(TAG, "Last error code reported from esp-tls: 0x%x", event->error_handle->esp_tls_last_esp_err);
                 ESP_LOGE(TAG, "Last tls stack error number: 0x%x", event->error_handle->esp_tls_stack_err);
@@ -102,6 +229,11 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             break;
             
         case MQTT_EVENT_BEFORE_CONNECT:
+            mqtt_connect_stats_begin();
+            resolve_broker();
+            mqtt_connect_stats_mark(MQTT_CONNECT_STAGE_DNS);
+            break;
+            
         case MQTT_EVENT_DELETED:
         case MQTT_EVENT_ANY:
         case MQTT_USER_EVENT:
@@ -111,6 +243,73 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
+static void handle_data_event(esp_mqtt_event_handle_t event)
+{
+    // Complete in one event: dispatch straight from the client's receive buffer
+    if (event->current_data_offset == 0 && event->data_len == event->total_data_len) {
+        rx_state = RX_IDLE;
+        dispatch_message(event->topic, event->topic_len, event->data, event->data_len);
+        return;
+    }
+    
+    // Only the first fragment carries the topic
+    if (event->current_data_offset == 0) {
+        if (event->total_data_len > MQTT_RX_MAX_MESSAGE || event->topic_len <= 0 ||
+            event->topic_len > (int)sizeof(rx_topic)) {
+            ESP_LOGW(TAG, "Rejecting %d byte message on %.*s (limit %d)",
+                     event->total_data_len, event->topic_len, event->topic, MQTT_RX_MAX_MESSAGE);
+            rx_state = RX_DISCARDING;
+            return;
+        }
+        
+        memcpy(rx_topic, event->topic, event->topic_len);
+        rx_topic_len = event->topic_len;
+        rx_total_len = event->total_data_len;
+        rx_received_len = 0;
+        rx_state = RX_ASSEMBLING;
+    }
+    
+    if (rx_state != RX_ASSEMBLING) {
+        return;
+    }
+    
+    if (event->current_data_offset != rx_received_len ||
+        event->data_len > rx_total_len - rx_received_len) {
+        ESP_LOGW(TAG, "Out of order fragment on %.*s, message dropped", rx_topic_len, rx_topic);
+        rx_state = RX_IDLE;
+        return;
+    }
+    
+    memcpy(rx_pool + rx_received_len, event->data, event->data_len);
+    rx_received_len += event->data_len;
+    
+    if (rx_received_len == rx_total_len) {
+        rx_state = RX_IDLE;
+        dispatch_message(rx_topic, rx_topic_len, rx_pool, rx_total_len);
+    }
+}
+
+static void dispatch_message(const char* topic, int topic_len, const char* data, int data_len)
+{
+    ESP_LOGI(TAG, "MQTT message received:");
+    ESP_LOGI(TAG, "  Topic: %.*s", topic_len, topic);
+    ESP_LOGI(TAG, "  Data (%d bytes): %.*s", data_len, data_len > 128 ? 128 : data_len, data);
+    
+    esp_err_t result = mqtt_router_dispatch(topic, topic_len, data, data_len);
+    
+    // Call user callback for anything no route claimed
+    if (result == ESP_ERR_NOT_FOUND && user_message_callback) {
+        user_message_callback(topic, topic_len, data, data_len);
+    } else if (result != ESP_OK && result != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Command on %.*s failed: %s", topic_len, topic, esp_err_to_name(result));
+    }
+}
+
+void mqtt_manager_set_connection_callback(mqtt_connection_callback_t callback)
+{
+    connection_callback = callback;
+}
+
 esp_err_t mqtt_manager_init(mqtt_message_callback_t message_callback)
 {
     if (mqtt_client != NULL) {
@@ -118,7 +317,73 @@ esp_err_t mqtt_manager_init(mqtt_message_callback_t message_callback)
         return ESP_OK;
     }
     
-    user_message_callback = message_callback;    // MQTT client configuration
+    user_message_callback = message_callback;
+    
+    esp_err_t ret = register_builtin_routes();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register command routes");
+        return ret;
+    }
+    
+    // Ping result batching, kept across a failed client start
+    if (ping_batch_mutex == NULL) {
+        ping_batch_mutex = xSemaphoreCreateMutex();
+        if (ping_batch_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create ping batch mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    if (ping_batch_timer == NULL) {
+        const esp_timer_create_args_t batch_timer_args = {
+            .callback = ping_batch_timer_callback,
+            .name = "ping_batch",
+        };
+        if (esp_timer_create(&batch_timer_args, &ping_batch_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create ping batch timer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ping_batch_count = 0;
+    
+    // Offline queue, also kept across a failed client start
+    ret = mqtt_offline_queue_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (offline_drain_timer == NULL) {
+        const esp_timer_create_args_t drain_timer_args = {
+            .callback = offline_drain_timer_callback,
+            .name = "mqtt_offline",
+        };
+        if (esp_timer_create(&drain_timer_args, &offline_drain_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create offline drain timer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    // Metrics, also kept across a failed client start
+    if (metrics_mutex == NULL) {
+        metrics_mutex = xSemaphoreCreateMutex();
+        if (metrics_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create metrics mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    if (metrics_timer == NULL) {
+        const esp_timer_create_args_t metrics_timer_args = {
+            .callback = metrics_timer_callback,
+            .name = "mqtt_metrics",
+        };
+        if (esp_timer_create(&metrics_timer_args, &metrics_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create metrics timer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    // MQTT client configuration
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker = {
             .address.uri = MQTT_BROKER_URI,
@@ -131,11 +396,10 @@ esp_err_t mqtt_manager_init(mqtt_message_callback_t message_callback)
         },
         .network = {
             .timeout_ms = 10000,
-            .refresh_connection_after_ms = 20000,
         },
         .session = {
             .keepalive = 60,
-            .disable_clean_session = false,
+            .disable_clean_session = MQTT_PERSISTENT_SESSION,
         },
     };
     
@@ -151,7 +415,7 @@ esp_err_t mqtt_manager_init(mqtt_message_callback_t message_callback)
     }
     
     // Register event handler
-    esp_err_t ret = esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    ret = esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register MQTT event handler");
         esp_mqtt_client_destroy(mqtt_client);
@@ -179,6 +443,19 @@ void mqtt_manager_deinit(void)
         esp_mqtt_client_destroy(mqtt_client);
         mqtt_client = NULL;
         mqtt_connected = false;
+        
+        esp_timer_stop(ping_batch_timer);
+        esp_timer_delete(ping_batch_timer);
+        ping_batch_timer = NULL;
+        esp_timer_stop(offline_drain_timer);
+        esp_timer_delete(offline_drain_timer);
+        offline_drain_timer = NULL;
+        esp_timer_stop(metrics_timer);
+        esp_timer_delete(metrics_timer);
+        metrics_timer = NULL;
+        vSemaphoreDelete(ping_batch_mutex);
+        ping_batch_mutex = NULL;
+        ping_batch_count = 0;
         ESP_LOGI(TAG, "MQTT manager deinitialized");
     }
 }
@@ -196,36 +473,31 @@ esp_err_t mqtt_manager_send_hello(void)
     }
     
     // Create hello message with device info
-    cJSON *json = cJSON_CreateObject();
-    cJSON *message = cJSON_CreateString("Hello from ESP32 IoT Device!");
-    cJSON *timestamp = cJSON_CreateNumber(esp_timer_get_time() / 1000); // milliseconds
+    char payload[MQTT_SMALL_PAYLOAD_SIZE];
+    json_writer_t json;
+    json_writer_init(&json, payload, sizeof(payload));
+    json_writer_object_begin(&json);
     
     // Add device MAC address
     uint8_t mac[6];
-    char mac_str[18];
     if (esp_read_mac(mac, ESP_MAC_WIFI_STA) == ESP_OK) {
-        snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-        cJSON *device_mac = cJSON_CreateString(mac_str);
-        cJSON_AddItemToObject(json, "device_mac", device_mac);
+        json_writer_key(&json, "device_mac");
+        json_writer_mac(&json, mac);
     }
     
-    cJSON_AddItemToObject(json, "message", message);
-    cJSON_AddItemToObject(json, "timestamp", timestamp);
+    json_writer_kv_string(&json, "message", "Hello from ESP32 IoT Device!");
+    json_writer_kv_int(&json, "timestamp", esp_timer_get_time() / 1000); // milliseconds
+    json_writer_object_end(&json);
     
-    char *json_string = cJSON_Print(json);
-    if (json_string == NULL) {
+    int len = json_writer_finish(&json);
+    if (len < 0) {
         ESP_LOGE(TAG, "Failed to create hello JSON");
-        cJSON_Delete(json);
         return ESP_FAIL;
     }
     
-    ESP_LOGI(TAG, "Sending hello message: %s", json_string);
+    ESP_LOGI(TAG, "Sending hello message: %s", payload);
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_HELLO, json_string, 0, MQTT_QOS_1, 0);
-    
-    free(json_string);
-    cJSON_Delete(json);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_HELLO, payload, len, MQTT_QOS_1, 0);
     
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish hello message");
@@ -248,24 +520,21 @@ esp_err_t mqtt_manager_send_status(const char* status)
         return ESP_ERR_INVALID_ARG;
     }
     
-    cJSON *json = cJSON_CreateObject();
-    cJSON *status_msg = cJSON_CreateString(status);
-    cJSON *timestamp = cJSON_CreateNumber(esp_timer_get_time() / 1000);
-    
-    cJSON_AddItemToObject(json, "status", status_msg);
-    cJSON_AddItemToObject(json, "timestamp", timestamp);
+    char payload[MQTT_SMALL_PAYLOAD_SIZE];
+    json_writer_t json;
+    json_writer_init(&json, payload, sizeof(payload));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "status", status);
+    json_writer_kv_int(&json, "timestamp", esp_timer_get_time() / 1000);
+    json_writer_object_end(&json);
     
-    char *json_string = cJSON_Print(json);
-    if (json_string == NULL) {
+    int len = json_writer_finish(&json);
+    if (len < 0) {
         ESP_LOGE(TAG, "Failed to create status JSON");
-        cJSON_Delete(json);
         return ESP_FAIL;
     }
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATUS, json_string, 0, MQTT_QOS_1, 0);
-    
-    free(json_string);
-    cJSON_Delete(json);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_STATUS, payload, len, MQTT_QOS_1, 0);
     
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish status message");
@@ -275,56 +544,59 @@ esp_err_t mqtt_manager_send_status(const char* status)
     return ESP_OK;
 }
 
-static char* create_device_info_json(void)
+static int create_device_info_json(char* buffer, size_t size)
 {
-    cJSON *json = cJSON_CreateObject();
+    json_writer_t json;
+    json_writer_init(&json, buffer, size);
+    json_writer_object_begin(&json);
     
     // Chip information
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
     
-    cJSON *chip = cJSON_CreateObject();
-    cJSON_AddStringToObject(chip, "model", CONFIG_IDF_TARGET);
-    cJSON_AddNumberToObject(chip, "revision", chip_info.revision);
-    cJSON_AddNumberToObject(chip, "cores", chip_info.cores);
+    json_writer_key(&json, "chip");
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "model", CONFIG_IDF_TARGET);
+    json_writer_kv_uint(&json, "revision", chip_info.revision);
+    json_writer_kv_uint(&json, "cores", chip_info.cores);
     
     // Features
-    cJSON *features = cJSON_CreateArray();
+    json_writer_key(&json, "features");
+    json_writer_array_begin(&json);
     if (chip_info.features & CHIP_FEATURE_WIFI_BGN) {
-        cJSON_AddItemToArray(features, cJSON_CreateString("WiFi"));
+        json_writer_string(&json, "WiFi");
     }
     if (chip_info.features & CHIP_FEATURE_BT) {
-        cJSON_AddItemToArray(features, cJSON_CreateString("Bluetooth Classic"));
+        json_writer_string(&json, "Bluetooth Classic");
     }
     if (chip_info.features & CHIP_FEATURE_BLE) {
-        cJSON_AddItemToArray(features, cJSON_CreateString("Bluetooth LE"));
+        json_writer_string(&json, "Bluetooth LE");
     }
-    cJSON_AddItemToObject(chip, "features", features);
+    json_writer_array_end(&json);
+    json_writer_object_end(&json);
     
     // Memory info
-    cJSON *memory = cJSON_CreateObject();
-    cJSON_AddNumberToObject(memory, "free_heap", esp_get_free_heap_size());
-    cJSON_AddNumberToObject(memory, "min_free_heap", esp_get_minimum_free_heap_size());
+    json_writer_key(&json, "memory");
+    json_writer_object_begin(&json);
+    json_writer_kv_uint(&json, "free_heap", esp_get_free_heap_size());
+    json_writer_kv_uint(&json, "min_free_heap", esp_get_minimum_free_heap_size());
+    json_writer_object_end(&json);
     
     // MAC addresses
-    cJSON *mac_addresses = cJSON_CreateObject();
+    json_writer_key(&json, "mac_addresses");
+    json_writer_object_begin(&json);
     uint8_t mac[6];
-    char mac_str[18];
-    
     if (esp_read_mac(mac, ESP_MAC_WIFI_STA) == ESP_OK) {
-        snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-        cJSON_AddStringToObject(mac_addresses, "wifi_sta", mac_str);
+        json_writer_key(&json, "wifi_sta");
+        json_writer_mac(&json, mac);
     }
+    json_writer_object_end(&json);
     
-    // Add all components to main JSON
-    cJSON_AddItemToObject(json, "chip", chip);
-    cJSON_AddItemToObject(json, "memory", memory);
-    cJSON_AddItemToObject(json, "mac_addresses", mac_addresses);
-    cJSON_AddStringToObject(json, "idf_version", esp_get_idf_version());
-    cJSON_AddNumberToObject(json, "timestamp", esp_timer_get_time() / 1000);
+    json_writer_kv_string(&json, "idf_version", esp_get_idf_version());
+    json_writer_kv_int(&json, "timestamp", esp_timer_get_time() / 1000);
+    json_writer_object_end(&json);
     
-    return cJSON_Print(json);
+    return json_writer_finish(&json);
 }
 
 esp_err_t mqtt_manager_send_device_info(void)
@@ -334,15 +606,14 @@ esp_err_t mqtt_manager_send_device_info(void)
         return ESP_FAIL;
     }
     
-    char *json_string = create_device_info_json();
-    if (json_string == NULL) {
+    char payload[MQTT_LARGE_PAYLOAD_SIZE];
+    int len = create_device_info_json(payload, sizeof(payload));
+    if (len < 0) {
         ESP_LOGE(TAG, "Failed to create device info JSON");
         return ESP_FAIL;
     }
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_DEVICE_INFO, json_string, 0, MQTT_QOS_1, 0);
-    
-    free(json_string);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_DEVICE_INFO, payload, len, MQTT_QOS_1, 0);
     
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish device info");
@@ -353,19 +624,24 @@ esp_err_t mqtt_manager_send_device_info(void)
     return ESP_OK;
 }
 
-static char* create_ping_result_json(const char* ip_address, bool success, uint32_t response_time)
+static int create_ping_result_json(char* buffer, size_t size, const char* ip_address, bool success,
+                                   uint32_t response_time_us)
 {
-    cJSON *json = cJSON_CreateObject();
-    
-    cJSON_AddStringToObject(json, "target_ip", ip_address);
-    cJSON_AddBoolToObject(json, "success", success);
-    cJSON_AddNumberToObject(json, "response_time_ms", response_time);
-    cJSON_AddNumberToObject(json, "timestamp", esp_timer_get_time() / 1000);
-    
-    return cJSON_Print(json);
+    json_writer_t json;
+    json_writer_init(&json, buffer, size);
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "target_ip", ip_address);
+    json_writer_kv_bool(&json, "success", success);
+    json_writer_key(&json, "response_time_ms");
+    json_writer_fixed(&json, response_time_us, 3);
+    json_writer_kv_uint(&json, "response_time_us", response_time_us);
+    json_writer_kv_int(&json, "timestamp", esp_timer_get_time() / 1000);
+    json_writer_object_end(&json);
+    
+    return json_writer_finish(&json);
 }
 
-esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, uint32_t response_time)
+esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, uint32_t response_time_us)
 {
     if (!mqtt_connected) {
         return ESP_FAIL; // Silently fail if not connected to avoid spam
@@ -376,15 +652,14 @@ esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, ui
         return ESP_ERR_INVALID_ARG;
     }
     
-    char *json_string = create_ping_result_json(ip_address, success, response_time);
-    if (json_string == NULL) {
+    char payload[MQTT_SMALL_PAYLOAD_SIZE];
+    int len = create_ping_result_json(payload, sizeof(payload), ip_address, success, response_time_us);
+    if (len < 0) {
         ESP_LOGE(TAG, "Failed to create ping result JSON");
         return ESP_FAIL;
     }
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_PING_RESULTS, json_string, 0, MQTT_QOS_0, 0);
-    
-    free(json_string);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_PING_RESULTS, payload, len, MQTT_QOS_0, 0);
     
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish ping result");
@@ -394,19 +669,244 @@ esp_err_t mqtt_manager_send_ping_result(const char* ip_address, bool success, ui
     return ESP_OK;
 }
 
-esp_err_t mqtt_manager_publish(const char* topic, const char* data, mqtt_qos_t qos, bool retain)
+esp_err_t mqtt_manager_queue_ping_result(device_handle_t handle, const char* name, const char* ip_address,
+                                         bool success, uint32_t response_time_us)
 {
+    if (!ping_batch_mutex) {
+        return ESP_FAIL;
+    }
+    
+    if (name == NULL || ip_address == NULL) {
+        ESP_LOGE(TAG, "Name or IP address is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(ping_batch_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take ping batch mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    // Delta mode: drop results that repeat what subscribers already know
+    ping_delta_entry_t* delta = ping_delta_lookup(handle);
+    bool state_changed = !delta || !delta->published || delta->is_online != success;
+    bool rtt_moved = false;
+    if (delta && !state_changed && success) {
+        uint32_t last = delta->response_time_us;
+        uint32_t diff = response_time_us > last ? response_time_us - last : last - response_time_us;
+        rtt_moved = diff > delta_rtt_threshold_us;
+    }
+    
+    if (delta && (state_changed || rtt_moved)) {
+        delta->published = true;
+        delta->is_online = success;
+        delta->response_time_us = response_time_us;
+    }
+    
+    if (delta_mode && !state_changed && !rtt_moved) {
+        xSemaphoreGive(ping_batch_mutex);
+        return ESP_OK;
+    }
+    
+    // Individual results are stale by the time the broker is back, the
+    // debounced device status is queued by the WoL manager
     if (!mqtt_connected) {
-        ESP_LOGW(TAG, "MQTT not connected, cannot publish message");
+        xSemaphoreGive(ping_batch_mutex);
+        return ESP_OK;
+    }
+    
+    ping_batch_entry_t* entry = &ping_batch[ping_batch_count++];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    strncpy(entry->ip_address, ip_address, sizeof(entry->ip_address) - 1);
+    entry->success = success;
+    entry->response_time_us = response_time_us;
+    entry->timestamp_ms = esp_timer_get_time() / 1000;
+    
+    bool full = (ping_batch_count >= MQTT_PING_BATCH_SIZE);
+    bool first = (ping_batch_count == 1);
+    xSemaphoreGive(ping_batch_mutex);
+    
+    if (full) {
+        return mqtt_manager_flush_ping_results();
+    }
+    
+    // The window starts with the first result of a batch. In low-power mode
+    // the end of the wake closes it, see mqtt_manager_flush_window().
+    if (first && !low_power) {
+        esp_timer_stop(ping_batch_timer);
+        esp_timer_start_once(ping_batch_timer, (uint64_t)MQTT_PING_BATCH_WINDOW_MS * 1000);
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t mqtt_manager_flush_ping_results(void)
+{
+    if (!ping_batch_mutex) {
+        return ESP_FAIL;
+    }
+    
+    if (xSemaphoreTake(ping_batch_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take ping batch mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    if (ping_batch_count == 0) {
+        xSemaphoreGive(ping_batch_mutex);
+        return ESP_OK;
+    }
+    
+    // ping_batch_payload is only touched with ping_batch_mutex held
+    json_writer_t json;
+    json_writer_init(&json, ping_batch_payload, sizeof(ping_batch_payload));
+    json_writer_object_begin(&json);
+    json_writer_key(&json, "results");
+    json_writer_array_begin(&json);
+    
+    for (int i = 0; i < ping_batch_count; i++) {
+        json_writer_object_begin(&json);
+        json_writer_kv_string(&json, "name", ping_batch[i].name);
+        json_writer_kv_string(&json, "target_ip", ping_batch[i].ip_address);
+        json_writer_kv_bool(&json, "success", ping_batch[i].success);
+        json_writer_kv_uint(&json, "response_time_us", ping_batch[i].response_time_us);
+        json_writer_kv_int(&json, "timestamp", ping_batch[i].timestamp_ms);
+        json_writer_object_end(&json);
+    }
+    
+    int count = ping_batch_count;
+    ping_batch_count = 0;
+    esp_timer_stop(ping_batch_timer);
+    
+    json_writer_array_end(&json);
+    json_writer_kv_int(&json, "count", count);
+    json_writer_kv_int(&json, "timestamp", esp_timer_get_time() / 1000);
+    json_writer_object_end(&json);
+    
+    // Enqueue rather than publish: the MQTT task does the TLS write, so
+    // neither the ping result task nor the timer task blocks on the network.
+    // The outbox keeps its own copy, the buffer is free again afterwards.
+    int len = json_writer_finish(&json);
+    int msg_id = -1;
+    if (len >= 0 && mqtt_connected) {
+        msg_id = esp_mqtt_client_enqueue(mqtt_client, MQTT_TOPIC_PING_RESULTS, ping_batch_payload, len,
+                                         MQTT_QOS_0, 0, true);
+    }
+    xSemaphoreGive(ping_batch_mutex);
+    
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to create ping batch JSON");
         return ESP_FAIL;
     }
     
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Failed to publish batch of %d ping results", count);
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGD(TAG, "Published batch of %d ping results", count);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_manager_flush_window(void)
+{
+    esp_err_t ret = mqtt_manager_flush_ping_results();
+    
+    // Metrics ride along with the first wake after each interval
+    if (low_power && MQTT_METRICS_INTERVAL_MS > 0 && mqtt_connected && metrics_mutex &&
+        xSemaphoreTake(metrics_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        bool due = esp_timer_get_time() - metrics_last_us >= (int64_t)MQTT_METRICS_INTERVAL_MS * 1000;
+        xSemaphoreGive(metrics_mutex);
+        if (due) {
+            mqtt_manager_publish_metrics();
+        }
+    }
+    
+    return ret;
+}
+
+void mqtt_manager_set_low_power(bool enabled)
+{
+    low_power = enabled;
+    
+    // Hand the periodic metrics over between the timer and the wake windows
+    if (metrics_timer && mqtt_connected && MQTT_METRICS_INTERVAL_MS > 0) {
+        esp_timer_stop(metrics_timer);
+        if (!enabled) {
+            esp_timer_start_periodic(metrics_timer, (uint64_t)MQTT_METRICS_INTERVAL_MS * 1000);
+        }
+    }
+    if (enabled && ping_batch_timer) {
+        esp_timer_stop(ping_batch_timer);
+    }
+    ESP_LOGI(TAG, "Low-power output %s", enabled ? "enabled" : "disabled");
+}
+
+static void ping_batch_timer_callback(void* arg)
+{
+    mqtt_manager_flush_ping_results();
+}
+
+static void metrics_timer_callback(void* arg)
+{
+    mqtt_manager_publish_metrics();
+}
+
+void mqtt_manager_set_delta_mode(bool enabled, uint32_t rtt_threshold_us)
+{
+    delta_mode = enabled;
+    delta_rtt_threshold_us = rtt_threshold_us;
+    ESP_LOGI(TAG, "Ping delta mode %s (RTT threshold %" PRIu32 " us)",
+             enabled ? "enabled" : "disabled", rtt_threshold_us);
+}
+
+bool mqtt_manager_is_delta_mode(void)
+{
+    return delta_mode;
+}
+
+// Called with ping_batch_mutex held, NULL when the table is full
+static ping_delta_entry_t* ping_delta_lookup(device_handle_t handle)
+{
+    int slot = device_registry_slot(handle);
+    if (slot < 0) {
+        return NULL;
+    }
+    
+    // A device that reuses the slot starts with nothing published
+    ping_delta_entry_t* entry = &ping_delta[slot];
+    if (entry->handle != handle) {
+        memset(entry, 0, sizeof(*entry));
+        entry->handle = handle;
+    }
+    return entry;
+}
+
+static void ping_delta_reset(void)
+{
+    if (!ping_batch_mutex || xSemaphoreTake(ping_batch_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return;
+    }
+    
+    for (int i = 0; i < PING_MAX_TARGETS; i++) {
+        ping_delta[i].published = false;
+    }
+    xSemaphoreGive(ping_batch_mutex);
+}
+
+esp_err_t mqtt_manager_publish(const char* topic, const char* data, mqtt_qos_t qos, bool retain)
+{
     if (topic == NULL || data == NULL) {
         ESP_LOGE(TAG, "Topic or data is NULL");
         return ESP_ERR_INVALID_ARG;
     }
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, 0, qos, retain ? 1 : 0);
+    // Retained messages are state, only the latest one per topic is worth keeping
+    int len = strlen(data);
+    if (offline_pending(retain, len)) {
+        return queue_offline(topic, data, len, qos, retain, retain);
+    }
+    
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, len, qos, retain ? 1 : 0);
     
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish message to topic: %s", topic);
@@ -442,10 +942,14 @@ esp_err_t mqtt_manager_subscribe(const char* topic, mqtt_qos_t qos)
 
 esp_err_t mqtt_publish(const char* topic, const char* message)
 {
-    if (!mqtt_connected || !mqtt_client || !topic || !message) {
+    if (!topic || !message) {
         return ESP_FAIL;
     }
     
+    if (offline_pending(false, 0)) {
+        return queue_offline(topic, message, strlen(message), MQTT_QOS_1, false, false);
+    }
+    
     int msg_id = esp_mqtt_client_publish(mqtt_client, topic, message, 0, MQTT_QOS_1, 0);
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish to topic: %s", topic);
@@ -456,38 +960,49 @@ esp_err_t mqtt_publish(const char* topic, const char* message)
     return ESP_OK;
 }
 
+esp_err_t mqtt_manager_register_route(const char* filter, mqtt_qos_t qos, mqtt_route_handler_t handler,
+                                      void* user_data)
+{
+    esp_err_t ret = mqtt_router_add(filter, qos, handler, user_data);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // Otherwise subscribed with the other routes on connect
+    if (mqtt_connected) {
+        return mqtt_manager_subscribe(filter, qos);
+    }
+    return ESP_OK;
+}
+
 esp_err_t mqtt_subscribe_wol_commands(void)
 {
     if (!mqtt_connected || !mqtt_client) {
         return ESP_FAIL;
     }
     
-    // Subscribe to WoL commands for all devices
-    esp_err_t ret = ESP_OK;
+    esp_mqtt_topic_t topics[MQTT_ROUTER_MAX_ROUTES];
+    int route_count = mqtt_router_get_route_count();
     
-    // Subscribe to general WoL commands: esp32/wol/+/command
-    int msg_id = esp_mqtt_client_subscribe(mqtt_client, "esp32/wol/+/command", MQTT_QOS_1);
-    if (msg_id < 0) {
-        ESP_LOGE(TAG, "Failed to subscribe to WoL commands");
-        ret = ESP_FAIL;
+    if (route_count == 0) {
+        return ESP_OK;
     }
     
-    // Subscribe to device control commands: esp32/device/+/control
-    msg_id = esp_mqtt_client_subscribe(mqtt_client, "esp32/device/+/control", MQTT_QOS_1);
-    if (msg_id < 0) {
-        ESP_LOGE(TAG, "Failed to subscribe to device control commands");
-        ret = ESP_FAIL;
+    for (int i = 0; i < route_count; i++) {
+        const mqtt_route_t* route = mqtt_router_get_route(i);
+        topics[i].filter = route->filter;
+        topics[i].qos = route->qos;
     }
     
-    // Subscribe to general system commands
-    msg_id = esp_mqtt_client_subscribe(mqtt_client, "esp32/system/command", MQTT_QOS_1);
+    // One SUBSCRIBE packet and one round trip for all filters
+    int msg_id = esp_mqtt_client_subscribe_multiple(mqtt_client, topics, route_count);
     if (msg_id < 0) {
-        ESP_LOGE(TAG, "Failed to subscribe to system commands");
-        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Failed to subscribe to %d routed topics", route_count);
+        return ESP_FAIL;
     }
     
-    ESP_LOGI(TAG, "Subscribed to WoL command topics");
-    return ret;
+    ESP_LOGI(TAG, "Subscribed to %d routed topics, msg_id=%d", route_count, msg_id);
+    return ESP_OK;
 }
 
 esp_err_t mqtt_handle_wol_command(const char* topic, const char* data, int data_len)
@@ -496,106 +1011,458 @@ esp_err_t mqtt_handle_wol_command(const char* topic, const char* data, int data_
         return ESP_ERR_INVALID_ARG;
     }
     
-    ESP_LOGI(TAG, "Processing WoL command - Topic: %s, Data: %s", topic, data);
+    return mqtt_router_dispatch(topic, strlen(topic), data, data_len);
+}
+
+// Command topics handled by the firmware itself, registered once
+static esp_err_t register_builtin_routes(void)
+{
+    static bool registered = false;
+    if (registered) {
+        return ESP_OK;
+    }
     
-    // Parse WoL commands: esp32/wol/{device_name}/command
-    if (strncmp(topic, "esp32/wol/", 10) == 0) {
-        const char* device_start = topic + 10;
-        const char* command_start = strstr(device_start, "/command");
-        
-        if (command_start) {
-            // Extract device name
-            int device_name_len = command_start - device_start;
-            if (device_name_len > 0 && device_name_len < 32) {
-                char device_name[32];
-                strncpy(device_name, device_start, device_name_len);
-                device_name[device_name_len] = '\0';
-                  ESP_LOGI(TAG, "WoL command for device: %s, command: %s", device_name, data);
-                
-                // Forward to WoL manager
-                return wol_handle_mqtt_command(device_name, data);
-            }
-        }
+    // esp32/wol/{device_name}/command and esp32/device/{device_name}/control
+    esp_err_t ret = mqtt_router_add("esp32/wol/+/command", MQTT_QOS_1, wol_command_route, "WoL");
+    if (ret == ESP_OK) {
+        ret = mqtt_router_add("esp32/device/+/control", MQTT_QOS_1, wol_command_route, "Device control");
+    }
+    if (ret == ESP_OK) {
+        ret = mqtt_router_add("esp32/wol/group/+/command", MQTT_QOS_1, wol_group_command_route, NULL);
+    }
+    if (ret == ESP_OK) {
+        ret = mqtt_router_add("esp32/system/command", MQTT_QOS_1, system_command_route, NULL);
+    }
+    if (ret == ESP_OK) {
+        ret = mqtt_router_add("esp32/system/devices/set", MQTT_QOS_1, system_devices_route, NULL);
     }
     
-    // Parse device control commands: esp32/device/{device_name}/control
-    else if (strncmp(topic, "esp32/device/", 13) == 0) {
-        const char* device_start = topic + 13;
-        const char* control_start = strstr(device_start, "/control");
-        
-        if (control_start) {
-            // Extract device name
-            int device_name_len = control_start - device_start;
-            if (device_name_len > 0 && device_name_len < 32) {
-                char device_name[32];
-                strncpy(device_name, device_start, device_name_len);
-                device_name[device_name_len] = '\0';
-                  ESP_LOGI(TAG, "Device control command for: %s, command: %s", device_name, data);
-                
-                // Forward to WoL manager
-                return wol_handle_mqtt_command(device_name, data);
-            }
-        }
+    registered = (ret == ESP_OK);
+    return ret;
+}
+
+static esp_err_t wol_command_route(const mqtt_slice_t* captures, int capture_count,
+                                   const char* data, int data_len, void* user_data)
+{
+    char command[16];
+    mqtt_slice_t payload = { data, data_len };
+    
+    if (capture_count < 1 || captures[0].len == 0) {
+        ESP_LOGW(TAG, "Invalid device name in command topic");
+        return ESP_ERR_INVALID_ARG;
     }
     
-    // Parse system commands: esp32/system/command
-    else if (strcmp(topic, "esp32/system/command") == 0) {
-        if (strcmp(data, "list_devices") == 0) {
-            return mqtt_publish_devices_summary();
-        } else if (strcmp(data, "status") == 0) {
-            return mqtt_manager_send_status("System running");
-        }
+    // Hash lookup straight on the topic slice, the manager works by handle
+    device_handle_t handle = device_registry_find_n(captures[0].ptr, captures[0].len);
+    if (handle == DEVICE_HANDLE_INVALID) {
+        ESP_LOGW(TAG, "Unknown device in command topic: %.*s", captures[0].len, captures[0].ptr);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!mqtt_slice_copy(&payload, command, sizeof(command))) {
+        ESP_LOGW(TAG, "Invalid command for device %.*s", captures[0].len, captures[0].ptr);
+        return ESP_ERR_INVALID_ARG;
     }
     
-    return ESP_OK;
+    ESP_LOGI(TAG, "%s command for device: %.*s, command: %s", (const char*)user_data,
+             captures[0].len, captures[0].ptr, command);
+    
+    // Forward to WoL manager
+    return wol_handle_mqtt_command(handle, command);
 }
 
-esp_err_t mqtt_publish_device_status(const char* device_name, bool is_online, const char* ip_address)
+static esp_err_t wol_group_command_route(const mqtt_slice_t* captures, int capture_count,
+                                         const char* data, int data_len, void* user_data)
 {
-    if (!device_name || !ip_address) {
+    char command[16];
+    mqtt_slice_t payload = { data, data_len };
+    
+    if (capture_count < 1 || captures[0].len == 0) {
+        ESP_LOGW(TAG, "Invalid group name in command topic");
         return ESP_ERR_INVALID_ARG;
     }
     
-    char topic[64];
-    char message[256];
+    // One message fans out to every member, staggered by the WoL manager
+    int group = wol_find_group(captures[0].ptr, captures[0].len);
+    if (group == WOL_GROUP_INVALID) {
+        ESP_LOGW(TAG, "Unknown group in command topic: %.*s", captures[0].len, captures[0].ptr);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!mqtt_slice_copy(&payload, command, sizeof(command))) {
+        ESP_LOGW(TAG, "Invalid command for group %.*s", captures[0].len, captures[0].ptr);
+        return ESP_ERR_INVALID_ARG;
+    }
     
-    snprintf(topic, sizeof(topic), "esp32/device/%s/status", device_name);
-    snprintf(message, sizeof(message), 
-             "{\"device\":\"%s\",\"status\":\"%s\",\"ip\":\"%s\",\"timestamp\":%lu}",
-             device_name, is_online ? "online" : "offline", ip_address,
-             (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS / 1000));
+    ESP_LOGI(TAG, "Group command for %.*s: %s", captures[0].len, captures[0].ptr, command);
+    return wol_handle_group_command(group, command);
+}
+
+static esp_err_t system_command_route(const mqtt_slice_t* captures, int capture_count,
+                                      const char* data, int data_len, void* user_data)
+{
+    mqtt_slice_t command = { data, data_len };
+    
+    if (mqtt_slice_equals(&command, "list_devices")) {
+        return mqtt_publish_devices_summary();
+    } else if (mqtt_slice_equals(&command, "status")) {
+        return mqtt_manager_send_status("System running");
+    } else if (mqtt_slice_equals(&command, "connect_stats")) {
+        return mqtt_manager_publish_connect_stats();
+    } else if (mqtt_slice_equals(&command, "metrics")) {
+        return mqtt_manager_publish_metrics();
+    } else if (mqtt_slice_equals(&command, "latency")) {
+        return mqtt_publish_latency_summary();
+    }
     
-    return mqtt_publish(topic, message);
+    ESP_LOGW(TAG, "Unknown system command: %.*s", data_len, data);
+    return ESP_ERR_INVALID_ARG;
 }
 
-esp_err_t mqtt_publish_devices_summary(void)
+static esp_err_t system_devices_route(const mqtt_slice_t* captures, int capture_count,
+                                      const char* data, int data_len, void* user_data)
+{
+    // Many device records per message, acknowledged once by the WoL manager
+    return wol_provision_devices(data, data_len);
+}
+
+esp_err_t mqtt_manager_publish_connect_stats(void)
+{
+    if (!mqtt_connected || !mqtt_client) {
+        return ESP_FAIL;
+    }
+    
+    char payload[MQTT_DIAG_PAYLOAD_SIZE];
+    json_writer_t json;
+    json_writer_init(&json, payload, sizeof(payload));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "broker", MQTT_BROKER_HOST);
+    json_writer_kv_string(&json, "ca", "crt_bundle");
+    json_writer_key(&json, "connect");
+    mqtt_connect_stats_write_json(&json);
+    
+    wifi_manager_stats_t wifi;
+    wifi_manager_get_stats(&wifi);
+    json_writer_key(&json, "wifi");
+    json_writer_object_begin(&json);
+    json_writer_kv_uint(&json, "initial_ms", wifi.initial_connect_ms);
+    json_writer_kv_uint(&json, "reconnects", wifi.reconnect_count);
+    json_writer_kv_uint(&json, "last_reconnect_ms", wifi.last_reconnect_ms);
+    json_writer_kv_uint(&json, "max_reconnect_ms", wifi.max_reconnect_ms);
+    json_writer_kv_uint(&json, "failed_attempts", wifi.retry_attempts);
+    json_writer_kv_bool(&json, "fast_connect", wifi.fast_connect);
+    json_writer_object_end(&json);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+    
+    int len = json_writer_finish(&json);
+    if (len < 0) {
+        ESP_LOGE(TAG, "Connect stats do not fit");
+        return ESP_FAIL;
+    }
+    
+    // Diagnostics describe the latest state only, they are not worth queueing
+    int msg_id = esp_mqtt_client_enqueue(mqtt_client, MQTT_TOPIC_CONNECT_STATS, payload, len,
+                                         MQTT_QOS_0, 1, true);
+    return msg_id < 0 ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t mqtt_manager_publish_metrics(void)
 {
-    int device_count;
-    const wol_device_t* devices = wol_get_all_devices(&device_count);
+    if (!mqtt_connected || !mqtt_client || !metrics_mutex) {
+        return ESP_FAIL;
+    }
+    if (xSemaphoreTake(metrics_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    // The periodic timer fires a little late at worst, so only requests in
+    // between are dropped
+    int64_t now_us = esp_timer_get_time();
+    if (metrics_last_us != 0 && now_us - metrics_last_us < (int64_t)MQTT_METRICS_MIN_INTERVAL_MS * 1000) {
+        xSemaphoreGive(metrics_mutex);
+        ESP_LOGD(TAG, "Metrics requested too soon, skipped");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    char* payload = malloc(MQTT_METRICS_PAYLOAD_SIZE);
+    if (!payload) {
+        xSemaphoreGive(metrics_mutex);
+        return ESP_ERR_NO_MEM;
+    }
     
-    if (!devices) {
+    json_writer_t json;
+    json_writer_init(&json, payload, MQTT_METRICS_PAYLOAD_SIZE);
+    json_writer_object_begin(&json);
+    json_writer_kv_uint(&json, "uptime_s", now_us / 1000000);
+    json_writer_kv_uint(&json, "interval_ms", metrics_last_us ? (now_us - metrics_last_us) / 1000 : now_us / 1000);
+    system_metrics_write_json(&json);
+    json_writer_key(&json, "mqtt");
+    json_writer_object_begin(&json);
+    json_writer_kv_int(&json, "outbox_bytes", esp_mqtt_client_get_outbox_size(mqtt_client));
+    json_writer_kv_int(&json, "offline_queued", mqtt_offline_queue_count());
+    json_writer_kv_int(&json, "ping_batch", ping_batch_count);
+    json_writer_object_end(&json);
+    ping_result_queue_stats_t results;
+    ping_manager_get_result_queue_stats(&results);
+    json_writer_key(&json, "ping_results");
+    json_writer_object_begin(&json);
+    json_writer_kv_uint(&json, "queued", results.queued);
+    json_writer_kv_uint(&json, "peak", results.peak);
+    json_writer_kv_uint(&json, "dropped", results.dropped);
+    json_writer_object_end(&json);
+    // Share of the interval spent probing and reporting, in 1/1000
+    ping_wake_stats_t wake;
+    ping_manager_get_wake_stats(&wake);
+    uint32_t interval_ms = (uint32_t)((metrics_last_us ? now_us - metrics_last_us : now_us) / 1000);
+    uint32_t awake_ms = wake.awake_ms - metrics_last_wake.awake_ms;
+    if (awake_ms > interval_ms) {
+        awake_ms = interval_ms;  // The two clocks are read a moment apart
+    }
+    json_writer_key(&json, "power");
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "mode", low_power ? "save" : "normal");
+    json_writer_kv_uint(&json, "wake_slot_ms", wake.slot_ms);
+    json_writer_kv_uint(&json, "wakes", wake.wakes - metrics_last_wake.wakes);
+    json_writer_kv_uint(&json, "awake_permille",
+                        interval_ms ? (uint32_t)((uint64_t)awake_ms * 1000 / interval_ms) : 0);
+    json_writer_object_end(&json);
+    json_writer_object_end(&json);
+    metrics_last_us = now_us;
+    metrics_last_wake = wake;
+    xSemaphoreGive(metrics_mutex);
+    
+    int len = json_writer_finish(&json);
+    if (len < 0) {
+        ESP_LOGE(TAG, "Metrics do not fit");
+        free(payload);
         return ESP_FAIL;
     }
     
-    // Create JSON summary
-    char message[1024];
-    int offset = snprintf(message, sizeof(message), "{\"devices\":[");
+    // A metrics sample is only worth sending while current
+    int msg_id = esp_mqtt_client_enqueue(mqtt_client, MQTT_TOPIC_METRICS, payload, len, MQTT_QOS_0, 0, true);
+    free(payload);
+    return msg_id < 0 ? ESP_FAIL : ESP_OK;
+}
+
+// The client is usable again: record the attempt and report the timings
+static void connect_attempt_ready(void)
+{
+    if (!mqtt_connect_stats_complete()) {
+        return;
+    }
+    
+    const mqtt_connect_stage_stats_t* total = mqtt_connect_stats_get(MQTT_CONNECT_STAGE_TOTAL);
+    ESP_LOGI(TAG, "Connect took %" PRIu32 " ms (dns %" PRIu32 " ms, connack %" PRIu32 " ms)",
+             total->last_ms, mqtt_connect_stats_get(MQTT_CONNECT_STAGE_DNS)->last_ms,
+             mqtt_connect_stats_get(MQTT_CONNECT_STAGE_CONNACK)->last_ms);
+    mqtt_manager_publish_connect_stats();
+}
+
+// Resolving here times DNS on its own; the client's lookup right after is
+// then answered from the lwIP cache and the CONNACK stage only covers
+// TCP, TLS and the MQTT CONNECT exchange
+static void resolve_broker(void)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo* result = NULL;
+    
+    int err = getaddrinfo(MQTT_BROKER_HOST, NULL, &hints, &result);
+    if (err != 0 || result == NULL) {
+        ESP_LOGW(TAG, "DNS lookup for %s failed: %d", MQTT_BROKER_HOST, err);
+        return;
+    }
+    freeaddrinfo(result);
+}
+
+int mqtt_manager_get_offline_count(void)
+{
+    return mqtt_offline_queue_count();
+}
+
+// While connected, state keeps going through the queue until it has drained,
+// so it cannot overtake older queued state on the same topic. Events, and
+// state too large for a queue slot, are sent right away.
+static bool offline_pending(bool coalesce, int len)
+{
+    if (!mqtt_connected || !mqtt_client) {
+        return true;
+    }
+    return coalesce && len <= MQTT_OFFLINE_PAYLOAD_SIZE && mqtt_offline_queue_count() > 0;
+}
+
+static esp_err_t queue_offline(const char* topic, const char* payload, int len, int qos, bool retain,
+                               bool coalesce)
+{
+    esp_err_t ret = mqtt_offline_queue_push(topic, payload, len, qos, retain, coalesce);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Could not queue message for %s: %s", topic, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    // Connected but still draining: make sure the drain keeps running
+    if (mqtt_connected && offline_drain_timer && !esp_timer_is_active(offline_drain_timer)) {
+        esp_timer_start_periodic(offline_drain_timer, (uint64_t)MQTT_OFFLINE_DRAIN_INTERVAL_MS * 1000);
+    }
+    return ESP_OK;
+}
+
+// Called with the offline queue locked; enqueue only copies into the outbox
+static esp_err_t offline_send(const mqtt_offline_msg_t* msg)
+{
+    int msg_id = esp_mqtt_client_enqueue(mqtt_client, msg->topic, msg->payload, msg->payload_len,
+                                         msg->qos, msg->retain ? 1 : 0, true);
+    return msg_id < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static void offline_drain_timer_callback(void* arg)
+{
+    if (!mqtt_connected) {
+        esp_timer_stop(offline_drain_timer);
+        return;
+    }
+    
+    mqtt_offline_queue_drain(MQTT_OFFLINE_DRAIN_BATCH, offline_send);
     
-    for (int i = 0; i < device_count && offset < sizeof(message) - 100; i++) {
-        if (i > 0) {
-            offset += snprintf(message + offset, sizeof(message) - offset, ",");
+    if (mqtt_offline_queue_count() == 0) {
+        esp_timer_stop(offline_drain_timer);
+        if (mqtt_offline_queue_dropped() > 0) {
+            ESP_LOGW(TAG, "Offline queue drained, %" PRIu32 " messages were dropped while disconnected",
+                     mqtt_offline_queue_dropped());
+        } else {
+            ESP_LOGI(TAG, "Offline queue drained");
         }
+    }
+}
+
+esp_err_t mqtt_publish_devices_summary(void)
+{
+    static uint32_t summary_id = 0;
+    int device_count = wol_get_device_count();
+    
+    // One page per MQTT_SUMMARY_PAGE_SIZE devices, an empty list still gets one page
+    int page_total = (device_count + MQTT_SUMMARY_PAGE_SIZE - 1) / MQTT_SUMMARY_PAGE_SIZE;
+    if (page_total == 0) {
+        page_total = 1;
+    }
+    uint32_t id = ++summary_id;
+    unsigned long timestamp = (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    esp_err_t ret = ESP_OK;
+    device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID);
+    
+    for (int page = 0; page < page_total; page++) {
+        char topic[48];
+        char payload[MQTT_LARGE_PAYLOAD_SIZE];
+        
+        snprintf(topic, sizeof(topic), "esp32/system/devices/page/%d", page + 1);
+        
+        json_writer_t json;
+        json_writer_init(&json, payload, sizeof(payload));
+        json_writer_object_begin(&json);
+        json_writer_kv_uint(&json, "id", id);
+        json_writer_kv_int(&json, "seq", page + 1);
+        json_writer_kv_int(&json, "seq_total", page_total);
+        json_writer_key(&json, "devices");
+        json_writer_array_begin(&json);
+        
+        // Each page picks up where the previous one stopped
+        for (int n = 0; n < MQTT_SUMMARY_PAGE_SIZE && handle != DEVICE_HANDLE_INVALID;
+             handle = wol_next_device(handle)) {
+            const wol_device_t* device = wol_get_device_by_handle(handle);
+            device_registry_entry_t entry;
+            if (!device || device_registry_get(handle, &entry) != ESP_OK) {
+                continue;
+            }
+            json_writer_object_begin(&json);
+            json_writer_kv_string(&json, "name", entry.name);
+            json_writer_kv_string(&json, "ip", entry.ip_address);
+            json_writer_kv_string(&json, "status", wol_get_status_string(device->status));
+            json_writer_kv_bool(&json, "enabled", device->enabled);
+            json_writer_object_end(&json);
+            n++;
+        }
+        
+        json_writer_array_end(&json);
+        json_writer_kv_int(&json, "total", device_count);
+        json_writer_kv_uint(&json, "timestamp", timestamp);
+        json_writer_object_end(&json);
         
-        offset += snprintf(message + offset, sizeof(message) - offset,
-                          "{\"name\":\"%s\",\"ip\":\"%s\",\"status\":\"%s\",\"enabled\":%s}",
-                          devices[i].name, devices[i].ip_address,
-                          wol_get_status_string(devices[i].status),
-                          devices[i].enabled ? "true" : "false");
+        if (json_writer_finish(&json) < 0) {
+            ESP_LOGE(TAG, "Devices summary page %d does not fit, skipped", page + 1);
+            ret = ESP_FAIL;
+            continue;
+        }
+        
+        if (mqtt_publish(topic, payload) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
     }
     
-    snprintf(message + offset, sizeof(message) - offset, 
-             "],\"total\":%d,\"timestamp\":%lu}", 
-             device_count, (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS / 1000));
+    ESP_LOGI(TAG, "Devices summary %" PRIu32 " published: %d devices in %d pages", id, device_count, page_total);
+    return ret;
+}
+
+esp_err_t mqtt_publish_latency_summary(void)
+{
+    static uint32_t summary_id = 0;
+    int target_count = ping_manager_get_target_count();
+    
+    int page_total = (target_count + MQTT_LATENCY_PAGE_SIZE - 1) / MQTT_LATENCY_PAGE_SIZE;
+    if (page_total == 0) {
+        page_total = 1;
+    }
+    uint32_t id = ++summary_id;
+    unsigned long timestamp = (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    esp_err_t ret = ESP_OK;
+    device_handle_t handle = device_registry_next(DEVICE_HANDLE_INVALID, DEVICE_OWNER_PING);
+    
+    for (int page = 0; page < page_total; page++) {
+        char topic[64];
+        char payload[MQTT_LARGE_PAYLOAD_SIZE];
+        
+        snprintf(topic, sizeof(topic), MQTT_TOPIC_LATENCY "/page/%d", page + 1);
+        
+        json_writer_t json;
+        json_writer_init(&json, payload, sizeof(payload));
+        json_writer_object_begin(&json);
+        json_writer_kv_uint(&json, "id", id);
+        json_writer_kv_int(&json, "seq", page + 1);
+        json_writer_kv_int(&json, "seq_total", page_total);
+        json_writer_key(&json, "targets");
+        json_writer_array_begin(&json);
+        
+        for (int n = 0; n < MQTT_LATENCY_PAGE_SIZE && handle != DEVICE_HANDLE_INVALID;
+             handle = device_registry_next(handle, DEVICE_OWNER_PING)) {
+            probe_stats_summary_t stats;
+            char name[DEVICE_NAME_SIZE];
+            if (device_registry_copy_name(handle, name, sizeof(name)) != ESP_OK ||
+                ping_manager_get_latency_stats(handle, &stats) != ESP_OK) {
+                continue;
+            }
+            json_writer_object_begin(&json);
+            json_writer_kv_string(&json, "name", name);
+            probe_stats_write_json(&json, &stats);
+            json_writer_object_end(&json);
+            n++;
+        }
+        
+        json_writer_array_end(&json);
+        json_writer_kv_int(&json, "total", target_count);
+        json_writer_kv_uint(&json, "timestamp", timestamp);
+        json_writer_object_end(&json);
+        
+        if (json_writer_finish(&json) < 0) {
+            ESP_LOGE(TAG, "Latency summary page %d does not fit, skipped", page + 1);
+            ret = ESP_FAIL;
+            continue;
+        }
+        
+        if (mqtt_publish(topic, payload) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+    }
     
-    return mqtt_publish("esp32/system/devices", message);
+    ESP_LOGI(TAG, "Latency summary %" PRIu32 " published: %d targets in %d pages", id, target_count, page_total);
+    return ret;
 }
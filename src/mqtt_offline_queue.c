@@ -0,0 +1,116 @@
+#include "mqtt_offline_queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "mqtt_offline";
+
+// Ring of pending messages; head is the oldest, all fields guarded by queue_mutex
+static mqtt_offline_msg_t queue[MQTT_OFFLINE_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static uint32_t queue_dropped = 0;
+static SemaphoreHandle_t queue_mutex = NULL;
+
+esp_err_t mqtt_offline_queue_init(void) {
+    if (queue_mutex) {
+        return ESP_OK;
+    }
+
+    queue_mutex = xSemaphoreCreateMutex();
+    if (!queue_mutex) {
+        ESP_LOGE(TAG, "Failed to create offline queue mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    queue_head = 0;
+    queue_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_offline_queue_push(const char* topic, const char* payload, int len, int qos, bool retain,
+                                  bool coalesce) {
+    if (!topic || !payload || len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(topic) >= MQTT_OFFLINE_TOPIC_SIZE || len > MQTT_OFFLINE_PAYLOAD_SIZE) {
+        ESP_LOGW(TAG, "Message on %s too large to queue (%d bytes)", topic, len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!queue_mutex || xSemaphoreTake(queue_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    mqtt_offline_msg_t* msg = NULL;
+
+    if (coalesce) {
+        for (int i = 0; i < queue_count; i++) {
+            mqtt_offline_msg_t* queued = &queue[(queue_head + i) % MQTT_OFFLINE_QUEUE_SIZE];
+            if (queued->coalesce && strcmp(queued->topic, topic) == 0) {
+                msg = queued;
+                break;
+            }
+        }
+    }
+
+    if (!msg) {
+        if (queue_count == MQTT_OFFLINE_QUEUE_SIZE) {
+            // Drop the oldest message, recent state is worth more
+            queue_head = (queue_head + 1) % MQTT_OFFLINE_QUEUE_SIZE;
+            queue_count--;
+            queue_dropped++;
+        }
+        msg = &queue[(queue_head + queue_count) % MQTT_OFFLINE_QUEUE_SIZE];
+        queue_count++;
+        strcpy(msg->topic, topic);
+    }
+
+    memcpy(msg->payload, payload, len);
+    msg->payload_len = (uint16_t)len;
+    msg->qos = (uint8_t)qos;
+    msg->retain = retain;
+    msg->coalesce = coalesce;
+    msg->queued_ms = esp_timer_get_time() / 1000;
+
+    int count = queue_count;
+    xSemaphoreGive(queue_mutex);
+
+    ESP_LOGD(TAG, "Queued %s (%d pending)", topic, count);
+    return ESP_OK;
+}
+
+int mqtt_offline_queue_drain(int max_count, mqtt_offline_send_t send) {
+    if (!send || !queue_mutex || xSemaphoreTake(queue_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return 0;
+    }
+
+    // The callback only enqueues into the client outbox, so holding the
+    // mutex keeps a concurrent push from rewriting the message being sent
+    int sent = 0;
+    while (sent < max_count && queue_count > 0) {
+        if (send(&queue[queue_head]) != ESP_OK) {
+            break;
+        }
+        queue_head = (queue_head + 1) % MQTT_OFFLINE_QUEUE_SIZE;
+        queue_count--;
+        sent++;
+    }
+
+    int remaining = queue_count;
+    xSemaphoreGive(queue_mutex);
+
+    if (sent > 0) {
+        ESP_LOGD(TAG, "Sent %d queued messages, %d left", sent, remaining);
+    }
+    return sent;
+}
+
+int mqtt_offline_queue_count(void) {
+    return __atomic_load_n(&queue_count, __ATOMIC_RELAXED);
+}
+
+uint32_t mqtt_offline_queue_dropped(void) {
+    return __atomic_load_n(&queue_dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,185 @@
+#include "mqtt_router.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "mqtt_router";
+
+// Route table; entries are written before route_count is published, so the
+// MQTT task can dispatch while routes are still being registered
+static mqtt_route_t routes[MQTT_ROUTER_MAX_ROUTES];
+static int route_count = 0;
+
+// Forward declarations
+static bool route_matches(const mqtt_route_t* route, const mqtt_slice_t* levels, int level_count,
+                          bool levels_truncated, const char* topic_end,
+                          mqtt_slice_t* captures, int* capture_count);
+
+esp_err_t mqtt_router_add(const char* filter, int qos, mqtt_route_handler_t handler, void* user_data) {
+    if (!filter || !handler || strlen(filter) >= MQTT_ROUTER_FILTER_LEN) {
+        ESP_LOGE(TAG, "Invalid route");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int count = __atomic_load_n(&route_count, __ATOMIC_ACQUIRE);
+    if (count >= MQTT_ROUTER_MAX_ROUTES) {
+        ESP_LOGE(TAG, "Route table full, cannot add '%s'", filter);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mqtt_route_t* route = &routes[count];
+    memset(route, 0, sizeof(*route));
+    strncpy(route->filter, filter, sizeof(route->filter) - 1);
+    route->qos = qos;
+    route->handler = handler;
+    route->user_data = user_data;
+
+    // Split the filter into levels once, dispatch only compares them
+    int captures = 0;
+    const char* start = route->filter;
+    while (true) {
+        const char* end = strchr(start, '/');
+        int len = end ? (int)(end - start) : (int)strlen(start);
+
+        if (len == 1 && start[0] == '#') {
+            if (end) {
+                ESP_LOGE(TAG, "'#' must be the last level in '%s'", filter);
+                return ESP_ERR_INVALID_ARG;
+            }
+            route->multi_level = true;
+            captures++;
+            break;
+        }
+        if (memchr(start, '#', len) || (memchr(start, '+', len) && len != 1)) {
+            ESP_LOGE(TAG, "Malformed wildcard in '%s'", filter);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (route->level_count >= MQTT_ROUTER_MAX_LEVELS) {
+            ESP_LOGE(TAG, "Too many levels in '%s'", filter);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (len == 1 && start[0] == '+') {
+            captures++;
+        }
+
+        route->level_offset[route->level_count] = (uint8_t)(start - route->filter);
+        route->level_len[route->level_count] = (uint8_t)len;
+        route->level_count++;
+
+        if (!end) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    if (captures > MQTT_ROUTER_MAX_CAPTURES) {
+        ESP_LOGE(TAG, "Too many wildcards in '%s'", filter);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    __atomic_store_n(&route_count, count + 1, __ATOMIC_RELEASE);
+    ESP_LOGD(TAG, "Route %d: %s", count, route->filter);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_router_dispatch(const char* topic, int topic_len, const char* data, int data_len) {
+    if (!topic || topic_len <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Split the topic once for all routes
+    mqtt_slice_t levels[MQTT_ROUTER_MAX_LEVELS];
+    int level_count = 0;
+    bool truncated = false;
+    const char* topic_end = topic + topic_len;
+    const char* start = topic;
+
+    while (true) {
+        const char* end = memchr(start, '/', topic_end - start);
+        if (level_count >= MQTT_ROUTER_MAX_LEVELS) {
+            // Deeper than any literal filter, only '#' routes can still match
+            truncated = true;
+            break;
+        }
+        levels[level_count].ptr = start;
+        levels[level_count].len = end ? (int)(end - start) : (int)(topic_end - start);
+        level_count++;
+        if (!end) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    int count = __atomic_load_n(&route_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        mqtt_slice_t captures[MQTT_ROUTER_MAX_CAPTURES];
+        int capture_count = 0;
+        if (route_matches(&routes[i], levels, level_count, truncated, topic_end, captures, &capture_count)) {
+            return routes[i].handler(captures, capture_count, data, data_len, routes[i].user_data);
+        }
+    }
+
+    ESP_LOGD(TAG, "No route for %.*s", topic_len, topic);
+    return ESP_ERR_NOT_FOUND;
+}
+
+const mqtt_route_t* mqtt_router_get_route(int index) {
+    if (index < 0 || index >= __atomic_load_n(&route_count, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &routes[index];
+}
+
+int mqtt_router_get_route_count(void) {
+    return __atomic_load_n(&route_count, __ATOMIC_ACQUIRE);
+}
+
+bool mqtt_slice_equals(const mqtt_slice_t* slice, const char* text) {
+    size_t len = strlen(text);
+    return slice->len == (int)len && memcmp(slice->ptr, text, len) == 0;
+}
+
+bool mqtt_slice_copy(const mqtt_slice_t* slice, char* buffer, size_t size) {
+    if (slice->len <= 0 || (size_t)slice->len >= size) {
+        buffer[0] = '\0';
+        return false;
+    }
+    memcpy(buffer, slice->ptr, slice->len);
+    buffer[slice->len] = '\0';
+    return true;
+}
+
+// Private functions
+static bool route_matches(const mqtt_route_t* route, const mqtt_slice_t* levels, int level_count,
+                          bool levels_truncated, const char* topic_end,
+                          mqtt_slice_t* captures, int* capture_count) {
+    if (route->multi_level) {
+        // '#' also matches the parent level itself ("a/#" matches "a")
+        if (level_count < route->level_count) {
+            return false;
+        }
+    } else if (levels_truncated || level_count != route->level_count) {
+        return false;
+    }
+
+    for (int l = 0; l < route->level_count; l++) {
+        const char* token = route->filter + route->level_offset[l];
+        int token_len = route->level_len[l];
+
+        if (token_len == 1 && token[0] == '+') {
+            captures[(*capture_count)++] = levels[l];
+        } else if (levels[l].len != token_len || memcmp(levels[l].ptr, token, token_len) != 0) {
+            return false;
+        }
+    }
+
+    if (route->multi_level) {
+        mqtt_slice_t rest = { topic_end, 0 };
+        if (level_count > route->level_count) {
+            rest.ptr = levels[route->level_count].ptr;
+            rest.len = (int)(topic_end - rest.ptr);
+        }
+        captures[(*capture_count)++] = rest;
+    }
+
+    return true;
+}
@@ -1,32 +1,124 @@
 #include "ping_manager.h"
+#include "ping_probe.h"
+#include "ping_result_ring.h"
+#include "probe_stats.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
-#include "lwip/sockets.h"
-#include "lwip/netdb.h"
 #include <string.h>
-#include <sys/time.h>
-#include <fcntl.h>
-#include <errno.h>
+#include <inttypes.h>
 
 static const char *TAG = "ping_manager";
 
-// Global state
-static ping_target_t targets[PING_MAX_TARGETS];
+// Hot per-target state as a struct of arrays indexed by registry slot: the
+// scheduler and the probe slots only scan these. Unused slots have an invalid handle.
+#define TARGET_ENABLED          0x01
+#define TARGET_ONLINE           0x02
+#define TARGET_PROBING          0x04   // In a probe slot, out of the heap
+
+static device_handle_t target_handle[PING_MAX_TARGETS];
+static int64_t target_deadline_us[PING_MAX_TARGETS];     // Next scheduled probe (esp_timer time)
+static uint8_t target_flags[PING_MAX_TARGETS];           // TARGET_* bits
+static uint32_t target_success[PING_MAX_TARGETS];        // Total successful probes
+static uint32_t target_fail[PING_MAX_TARGETS];           // Total failed probes
+static uint32_t target_rtt_us[PING_MAX_TARGETS];         // Round-trip time of the last success
+
+// Rolling RTT and success rate statistics, updated by commit_probe()
+static probe_stats_t target_latency[PING_MAX_TARGETS];
+
+// Probe settings and interval state, only read when a target is due or reconfigured
+typedef struct {
+    uint32_t interval_ms;            // Base (shortest) probe interval
+    uint32_t max_interval_ms;        // Longest interval reached by backoff
+    uint32_t current_interval_ms;    // Interval in effect, doubles while the state is unchanged
+    uint32_t fast_interval_ms;       // Interval during the fast probing window
+    uint32_t timeout_ms;             // Probe timeout
+    uint32_t last_probe_ms;          // Start of the last probe, low 32 bits of ms since boot
+    uint32_t last_success_s;         // Last successful probe, seconds since boot (0 if none)
+    int64_t fast_until_us;           // End of the fast probing window (esp_timer time, 0 if none)
+    uint16_t ports[PING_MAX_PORTS];  // TCP/UDP ports raced per probe
+    uint16_t revision;               // Bumped when the target is re-added, invalidates probes in flight
+    uint8_t port_count;              // Number of valid entries in ports
+    uint8_t strategy;                // ping_strategy_t
+    uint8_t mac_address[6];          // Expected MAC for ARP presence (all zero: not checked)
+} target_config_t;
+
+static target_config_t targets[PING_MAX_TARGETS];
 static int target_count = 0;
 static bool is_running = false;
+static bool is_paused = false;
 static TaskHandle_t ping_task_handle = NULL;
+static TaskHandle_t result_task_handle = NULL;
 static SemaphoreHandle_t targets_mutex = NULL;
 static ping_result_callback_t result_callback = NULL;
 static void* callback_user_data = NULL;
 
+// Deadline scheduler: min-heap of target slots ordered by target_deadline_us.
+// Rebuilt by ping_task whenever the target table changes (schedule_dirty).
+static uint16_t schedule_heap[PING_MAX_TARGETS];
+static int schedule_size = 0;
+static bool schedule_dirty = true;
+
+// Snapshot of a due target, probed and reported without holding targets_mutex
+typedef struct {
+    char name[DEVICE_NAME_SIZE];     // Target name at snapshot time
+    device_handle_t handle;          // Registry handle at snapshot time
+    uint16_t revision;               // Target revision at snapshot time
+    uint16_t index;                  // Target slot
+    bool status_changed;             // Set by commit_probe()
+} sweep_entry_t;
+
+// Probe slots, only touched by ping_task (entries and probes share indices).
+// Bounded by PING_SWEEP_MAX, targets due beyond that wait for a free slot.
+static sweep_entry_t sweep[PING_SWEEP_MAX];
+static ping_probe_t sweep_probes[PING_SWEEP_MAX];
+
+// Results on their way from ping_task (producer) to ping_results (consumer)
+static ping_result_ring_t result_ring;
+
+// Wake slot and accounting, see ping_manager_set_wake_slot()
+static uint32_t wake_slot_ms = 0;                       // Written with targets_mutex held
+static ping_wake_done_callback_t wake_done_callback = NULL;
+static void* wake_done_user_data = NULL;
+static ping_config_callback_t config_callback = NULL;
+static void* config_user_data = NULL;
+static atomic_uint wake_count;                          // Wakes ended, written by ping_task
+// Awake time is the union of ping_task's wakes and the wake done callbacks,
+// which may overlap. Kept with targets_mutex held and read up to the present.
+static uint8_t awake_sources = 0;                       // Of the two, how many are awake now
+static int64_t awake_since_us = 0;                      // Start of the current awake stretch
+static uint64_t awake_us = 0;                           // Ended awake stretches, summed
+
 // Forward declarations
 static void ping_task(void* parameters);
-static bool check_host_alive(const char* ip_address, uint32_t timeout_ms);
+static void result_task(void* parameters);
+static int64_t refill_sweep(ping_probe_t* probes, int capacity, void* ctx);
+static void commit_probe(int slot, uint64_t current_time);
 static int find_target_by_name(const char* name);
-static uint64_t get_timestamp_ms(void);
+static void reset_targets(void);
+static bool probe_config_valid(const ping_probe_config_t* config);
+static bool probe_config_matches(const target_config_t* target, const ping_probe_config_t* config);
+static void init_target(int index, device_handle_t handle);
+static void apply_probe_config(target_config_t* target, const ping_probe_config_t* config);
+static const char* strategy_name(ping_strategy_t strategy);
+static uint32_t effective_interval(const target_config_t* target, int64_t now_us);
+static int64_t last_probe_us(const target_config_t* target, int64_t now_us);
+static void adapt_interval(int index, bool status_changed, int64_t now_us);
+static void pull_in_deadline(int index, int64_t now_us);
+static int64_t align_deadline(const target_config_t* target, int64_t deadline_us, int64_t now_us);
+static void end_wake(void);
+static void run_wake_done(void);
+static void awake_begin(int64_t now_us);
+static void awake_end(int64_t now_us);
+static esp_err_t snapshot_target(int index, ping_target_t* target_out);
+static void schedule_rebuild(void);
+static void schedule_push(int index);
+static int schedule_pop(void);
+static void schedule_sift_down(int pos);
+static void wake_ping_task(void);
+static void notify_config_changed(device_handle_t handle);
 
 esp_err_t ping_manager_init(ping_result_callback_t callback, void* user_data) {
     ESP_LOGI(TAG, "Initializing ping manager");
@@ -37,8 +129,13 @@ esp_err_t ping_manager_init(ping_result_callback_t callback, void* user_data) {
     }
     
     // Initialize state
-    memset(targets, 0, sizeof(targets));
-    target_count = 0;
+    reset_targets();
+    // A deinit may have deleted ping_task in the middle of a run
+    memset(sweep_probes, 0, sizeof(sweep_probes));
+    ping_result_ring_reset(&result_ring);
+    atomic_store(&wake_count, 0);
+    awake_sources = 0;
+    awake_us = 0;
     result_callback = callback;
     callback_user_data = user_data;
     
@@ -49,23 +146,49 @@ esp_err_t ping_manager_init(ping_result_callback_t callback, void* user_data) {
         return ESP_ERR_NO_MEM;
     }
     
+    // Must be set before the task starts, it exits as soon as this is false
+    is_running = true;
+    
+    // Result task first, ping_task notifies it as probes finish
+    BaseType_t result = xTaskCreatePinnedToCore(
+        result_task,
+        "ping_results",
+        PING_RESULT_TASK_STACK,
+        NULL,
+        PING_RESULT_TASK_PRIORITY,
+        &result_task_handle,
+        PING_RESULT_TASK_CORE
+    );
+    
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create ping result task");
+        is_running = false;
+        vSemaphoreDelete(targets_mutex);
+        targets_mutex = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    
     // Create ping task
-    BaseType_t result = xTaskCreate(
+    result = xTaskCreatePinnedToCore(
         ping_task,
         "ping_task",
         4096,
         NULL,
-        5,
-        &ping_task_handle
+        PING_TASK_PRIORITY,
+        &ping_task_handle,
+        PING_TASK_CORE
     );
     
     if (result != pdPASS) {
         ESP_LOGE(TAG, "Failed to create ping task");
+        is_running = false;
+        vTaskDelete(result_task_handle);
+        result_task_handle = NULL;
         vSemaphoreDelete(targets_mutex);
+        targets_mutex = NULL;
         return ESP_ERR_NO_MEM;
     }
     
-    is_running = true;
     ESP_LOGI(TAG, "Ping manager initialized successfully");
     return ESP_OK;
 }
@@ -79,11 +202,15 @@ void ping_manager_deinit(void) {
     
     is_running = false;
     
-    // Delete task
+    // Delete tasks
     if (ping_task_handle != NULL) {
         vTaskDelete(ping_task_handle);
         ping_task_handle = NULL;
     }
+    if (result_task_handle != NULL) {
+        vTaskDelete(result_task_handle);
+        result_task_handle = NULL;
+    }
     
     // Delete mutex
     if (targets_mutex != NULL) {
@@ -91,62 +218,78 @@ void ping_manager_deinit(void) {
         targets_mutex = NULL;
     }
     
-    // Clear state
-    memset(targets, 0, sizeof(targets));
-    target_count = 0;
+    // Drop our registry references and clear state
+    for (int i = 0; i < PING_MAX_TARGETS; i++) {
+        if (target_handle[i] != DEVICE_HANDLE_INVALID) {
+            device_registry_release(target_handle[i], DEVICE_OWNER_PING);
+        }
+    }
+    reset_targets();
+    schedule_size = 0;
+    schedule_dirty = true;
     result_callback = NULL;
     callback_user_data = NULL;
+    wake_slot_ms = 0;
+    wake_done_callback = NULL;
+    wake_done_user_data = NULL;
+    config_callback = NULL;
+    config_user_data = NULL;
     
     ESP_LOGI(TAG, "Ping manager deinitialized");
 }
 
-int ping_manager_add_device(const char* name, const char* ip_address) {
-    if (!name || !ip_address) {
+device_handle_t ping_manager_add_device(const char* name, const char* ip_address) {
+    return ping_manager_add_device_ex(name, ip_address, NULL);
+}
+
+device_handle_t ping_manager_add_device_ex(const char* name, const char* ip_address, const ping_probe_config_t* config) {
+    if (!name || !ip_address || (config && !probe_config_valid(config))) {
         ESP_LOGE(TAG, "Invalid parameters");
-        return -1;
+        return DEVICE_HANDLE_INVALID;
     }
     
     if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take mutex");
-        return -1;
+        return DEVICE_HANDLE_INVALID;
     }
     
-    // Check if target already exists
-    int existing_index = find_target_by_name(name);
-    if (existing_index >= 0) {
-        ESP_LOGW(TAG, "Device '%s' already exists, updating IP address", name);
-        strncpy(targets[existing_index].ip_address, ip_address, sizeof(targets[existing_index].ip_address) - 1);
+    // The registry keeps the address, an existing device keeps its handle
+    device_handle_t handle;
+    if (device_registry_add(name, ip_address, NULL, DEVICE_OWNER_PING, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register device '%s'", name);
         xSemaphoreGive(targets_mutex);
-        return existing_index;
+        return DEVICE_HANDLE_INVALID;
     }
     
-    // Check if we have space
-    if (target_count >= PING_MAX_TARGETS) {
-        ESP_LOGE(TAG, "Maximum number of targets reached");
+    int index = DEVICE_HANDLE_SLOT(handle);
+    target_config_t* target = &targets[index];
+    
+    // Check if target already exists
+    if (target_handle[index] == handle) {
+        ESP_LOGW(TAG, "Device '%s' already exists, updating IP address", name);
+        if (config) {
+            apply_probe_config(target, config);
+        }
+        target->revision++;
+        target_deadline_us[index] = 0;
+        schedule_dirty = true;
         xSemaphoreGive(targets_mutex);
-        return -1;
+        wake_ping_task();
+        return handle;
     }
     
-    // Add new target
-    int index = target_count++;
-    ping_target_t* target = &targets[index];
-    
-    strncpy(target->name, name, sizeof(target->name) - 1);
-    strncpy(target->ip_address, ip_address, sizeof(target->ip_address) - 1);
-    target->interval_ms = PING_DEFAULT_INTERVAL;
-    target->timeout_ms = PING_DEFAULT_TIMEOUT;
-    target->count = PING_DEFAULT_COUNT;
-    target->enabled = true;
-    target->is_online = false;
-    target->success_count = 0;
-    target->fail_count = 0;
-    target->last_ping_time = 0;
-    target->last_success_time = 0;
+    // Add new target in the slot of its registry entry
+    init_target(index, handle);
+    if (config) {
+        apply_probe_config(target, config);
+    }
+    schedule_dirty = true;
     
     xSemaphoreGive(targets_mutex);
+    wake_ping_task();
     
-    ESP_LOGI(TAG, "Added device '%s' at IP '%s' (index %d)", name, ip_address, index);
-    return index;
+    ESP_LOGI(TAG, "Added device '%s' at IP '%s' (slot %d)", name, ip_address, index);
+    return handle;
 }
 
 esp_err_t ping_manager_remove_device(const char* name) {
@@ -167,20 +310,113 @@ esp_err_t ping_manager_remove_device(const char* name) {
         return ESP_ERR_NOT_FOUND;
     }
     
-    // Shift remaining targets down
-    for (int i = index; i < target_count - 1; i++) {
-        targets[i] = targets[i + 1];
-    }
-    
+    // Slots are stable, only this one is cleared
+    device_handle_t handle = target_handle[index];
+    target_handle[index] = DEVICE_HANDLE_INVALID;
+    target_flags[index] = 0;
+    targets[index].revision++;
     target_count--;
-    memset(&targets[target_count], 0, sizeof(ping_target_t));
+    schedule_dirty = true;
     
+    device_registry_release(handle, DEVICE_OWNER_PING);
     xSemaphoreGive(targets_mutex);
+    wake_ping_task();
     
     ESP_LOGI(TAG, "Removed device '%s'", name);
     return ESP_OK;
 }
 
+esp_err_t ping_manager_attach_devices(const device_handle_t* handles, const ping_probe_config_t* configs,
+                                      int count, bool* changed_out) {
+    if (!handles || count < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; configs && i < count; i++) {
+        if (handles[i] != DEVICE_HANDLE_INVALID && !probe_config_valid(&configs[i])) {
+            ESP_LOGE(TAG, "Invalid probe configuration for entry %d", i);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int added = 0;
+    int updated = 0;
+    for (int i = 0; i < count; i++) {
+        int index = device_registry_slot(handles[i]);
+        bool changed = false;
+        if (index >= 0 && target_handle[index] != handles[i]) {
+            init_target(index, handles[i]);
+            if (configs) {
+                apply_probe_config(&targets[index], &configs[i]);
+            }
+            changed = true;
+            added++;
+        } else if (index >= 0 && configs && !probe_config_matches(&targets[index], &configs[i])) {
+            apply_probe_config(&targets[index], &configs[i]);
+            targets[index].revision++;
+            target_deadline_us[index] = 0;
+            changed = true;
+            updated++;
+        }
+        if (changed_out) {
+            changed_out[i] = changed;
+        }
+    }
+    if (added + updated > 0) {
+        schedule_dirty = true;
+    }
+    
+    xSemaphoreGive(targets_mutex);
+    if (added + updated > 0) {
+        wake_ping_task();
+        ESP_LOGI(TAG, "Attached %d devices, reconfigured %d (%d targets)", added, updated, target_count);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ping_manager_detach_devices(const device_handle_t* handles, int count) {
+    if (!handles || count < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    // Handles may already be stale in the registry, so match them against
+    // the table directly
+    int removed = 0;
+    for (int i = 0; i < count; i++) {
+        if (handles[i] == DEVICE_HANDLE_INVALID) {
+            continue;
+        }
+        int index = DEVICE_HANDLE_SLOT(handles[i]);
+        if (index >= PING_MAX_TARGETS || target_handle[index] != handles[i]) {
+            continue;
+        }
+        target_handle[index] = DEVICE_HANDLE_INVALID;
+        target_flags[index] = 0;
+        targets[index].revision++;
+        target_count--;
+        removed++;
+    }
+    if (removed > 0) {
+        schedule_dirty = true;
+    }
+    
+    xSemaphoreGive(targets_mutex);
+    if (removed > 0) {
+        wake_ping_task();
+        ESP_LOGI(TAG, "Detached %d devices (%d targets)", removed, target_count);
+    }
+    return ESP_OK;
+}
+
 esp_err_t ping_manager_set_device_enabled(const char* name, bool enabled) {
     if (!name) {
         ESP_LOGE(TAG, "Invalid parameter");
@@ -199,28 +435,207 @@ esp_err_t ping_manager_set_device_enabled(const char* name, bool enabled) {
         return ESP_ERR_NOT_FOUND;
     }
     
-    targets[index].enabled = enabled;
+    if (enabled) {
+        target_flags[index] |= TARGET_ENABLED;
+    } else {
+        target_flags[index] &= ~TARGET_ENABLED;
+    }
+    target_deadline_us[index] = 0;
+    schedule_dirty = true;
     xSemaphoreGive(targets_mutex);
+    wake_ping_task();
     
     ESP_LOGI(TAG, "Device '%s' %s", name, enabled ? "enabled" : "disabled");
     return ESP_OK;
 }
 
-const ping_target_t* ping_manager_get_device(const char* name) {
-    if (!name) {
-        return NULL;
+esp_err_t ping_manager_set_device_interval(const char* name, uint32_t interval_ms) {
+    if (!name || interval_ms < PING_MIN_INTERVAL) {
+        ESP_LOGE(TAG, "Invalid parameter");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = find_target_by_name(name);
+    if (index < 0) {
+        ESP_LOGW(TAG, "Device '%s' not found", name);
+        xSemaphoreGive(targets_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    target_config_t* target = &targets[index];
+    target->interval_ms = interval_ms;
+    target->current_interval_ms = interval_ms;
+    if (target->max_interval_ms < interval_ms) {
+        target->max_interval_ms = interval_ms;
+    }
+    pull_in_deadline(index, esp_timer_get_time());
+    device_handle_t handle = target_handle[index];
+    xSemaphoreGive(targets_mutex);
+    wake_ping_task();
+    notify_config_changed(handle);
+    
+    ESP_LOGI(TAG, "Device '%s' interval set to %" PRIu32 " ms", name, interval_ms);
+    return ESP_OK;
+}
+
+esp_err_t ping_manager_set_device_interval_bounds(const char* name, uint32_t min_interval_ms,
+                                                  uint32_t max_interval_ms) {
+    if (!name || min_interval_ms < PING_MIN_INTERVAL || max_interval_ms < min_interval_ms) {
+        ESP_LOGE(TAG, "Invalid parameter");
+        return ESP_ERR_INVALID_ARG;
     }
     
     if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take mutex");
-        return NULL;
+        return ESP_ERR_TIMEOUT;
     }
     
     int index = find_target_by_name(name);
-    ping_target_t* result = (index >= 0) ? &targets[index] : NULL;
+    if (index < 0) {
+        ESP_LOGW(TAG, "Device '%s' not found", name);
+        xSemaphoreGive(targets_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    target_config_t* target = &targets[index];
+    target->interval_ms = min_interval_ms;
+    target->max_interval_ms = max_interval_ms;
+    target->current_interval_ms = min_interval_ms;
+    pull_in_deadline(index, esp_timer_get_time());
+    device_handle_t handle = target_handle[index];
+    xSemaphoreGive(targets_mutex);
+    wake_ping_task();
+    notify_config_changed(handle);
+    
+    ESP_LOGI(TAG, "Device '%s' interval bounds set to %" PRIu32 "-%" PRIu32 " ms",
+             name, min_interval_ms, max_interval_ms);
+    return ESP_OK;
+}
+
+esp_err_t ping_manager_expedite_device(const char* name, uint32_t interval_ms, uint32_t duration_ms) {
+    if (!name || interval_ms < PING_MIN_INTERVAL) {
+        ESP_LOGE(TAG, "Invalid parameter");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = find_target_by_name(name);
+    if (index < 0) {
+        ESP_LOGW(TAG, "Device '%s' not found", name);
+        xSemaphoreGive(targets_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    target_config_t* target = &targets[index];
+    int64_t now_us = esp_timer_get_time();
+    target->fast_interval_ms = interval_ms;
+    target->fast_until_us = now_us + (int64_t)duration_ms * 1000;
+    pull_in_deadline(index, now_us);
+    xSemaphoreGive(targets_mutex);
+    wake_ping_task();
+    
+    ESP_LOGI(TAG, "Device '%s' fast probing every %" PRIu32 " ms for %" PRIu32 " ms",
+             name, interval_ms, duration_ms);
+    return ESP_OK;
+}
+
+esp_err_t ping_manager_set_device_strategy(const char* name, ping_strategy_t strategy) {
+    if (!name || strategy > PING_STRATEGY_ARP) {
+        ESP_LOGE(TAG, "Invalid parameter");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = find_target_by_name(name);
+    if (index < 0) {
+        ESP_LOGW(TAG, "Device '%s' not found", name);
+        xSemaphoreGive(targets_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    bool needs_ports = (strategy == PING_STRATEGY_TCP || strategy == PING_STRATEGY_UDP);
+    if (needs_ports && targets[index].port_count == 0) {
+        ESP_LOGW(TAG, "Device '%s' has no ports for this strategy", name);
+        xSemaphoreGive(targets_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    targets[index].strategy = strategy;
+    device_handle_t handle = target_handle[index];
+    xSemaphoreGive(targets_mutex);
+    notify_config_changed(handle);
+    
+    ESP_LOGI(TAG, "Device '%s' probe strategy set to %s", name, strategy_name(strategy));
+    return ESP_OK;
+}
+
+esp_err_t ping_manager_get_device(const char* name, ping_target_t* target_out) {
+    if (!name || !target_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = find_target_by_name(name);
+    esp_err_t ret = (index >= 0) ? snapshot_target(index, target_out) : ESP_ERR_NOT_FOUND;
+    
+    xSemaphoreGive(targets_mutex);
+    return ret;
+}
+
+esp_err_t ping_manager_get_device_by_handle(device_handle_t handle, ping_target_t* target_out) {
+    if (!target_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = device_registry_slot(handle);
+    esp_err_t ret = (index >= 0 && target_handle[index] == handle) ?
+                    snapshot_target(index, target_out) : ESP_ERR_NOT_FOUND;
+    
+    xSemaphoreGive(targets_mutex);
+    return ret;
+}
+
+esp_err_t ping_manager_get_latency_stats(device_handle_t handle, probe_stats_summary_t* summary_out) {
+    if (!summary_out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    int index = device_registry_slot(handle);
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if (index >= 0 && target_handle[index] == handle) {
+        probe_stats_summarize(&target_latency[index], summary_out);
+        ret = ESP_OK;
+    }
     
     xSemaphoreGive(targets_mutex);
-    return result;
+    return ret;
 }
 
 int ping_manager_get_target_count(void) {
@@ -231,171 +646,677 @@ bool ping_manager_is_running(void) {
     return is_running;
 }
 
+void ping_manager_get_result_queue_stats(ping_result_queue_stats_t* stats_out) {
+    if (!stats_out) {
+        return;
+    }
+    stats_out->queued = ping_result_ring_count(&result_ring);
+    stats_out->peak = atomic_load_explicit(&result_ring.peak, memory_order_relaxed);
+    stats_out->dropped = atomic_load_explicit(&result_ring.dropped, memory_order_relaxed);
+}
+
+esp_err_t ping_manager_set_wake_slot(uint32_t slot_ms) {
+    if (slot_ms != 0 && slot_ms < PING_MIN_INTERVAL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!targets_mutex) {
+        wake_slot_ms = slot_ms;
+        return ESP_OK;
+    }
+    if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    wake_slot_ms = slot_ms;
+    // Move the pending deadlines onto the slot grid right away, targets
+    // already due are still probed now
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < PING_MAX_TARGETS; i++) {
+        if (target_handle[i] != DEVICE_HANDLE_INVALID && target_deadline_us[i] > now_us) {
+            target_deadline_us[i] = align_deadline(&targets[i], target_deadline_us[i], now_us);
+        }
+    }
+    schedule_dirty = true;
+    xSemaphoreGive(targets_mutex);
+    
+    ESP_LOGI(TAG, "Wake slot set to %" PRIu32 " ms", slot_ms);
+    wake_ping_task();
+    return ESP_OK;
+}
+
+void ping_manager_set_wake_done_callback(ping_wake_done_callback_t callback, void* user_data) {
+    wake_done_callback = callback;
+    wake_done_user_data = user_data;
+}
+
+void ping_manager_set_config_callback(ping_config_callback_t callback, void* user_data) {
+    config_callback = callback;
+    config_user_data = user_data;
+}
+
+void ping_manager_get_wake_stats(ping_wake_stats_t* stats_out) {
+    if (!stats_out) {
+        return;
+    }
+    stats_out->slot_ms = wake_slot_ms;
+    stats_out->wakes = atomic_load_explicit(&wake_count, memory_order_relaxed);
+    stats_out->awake_ms = 0;
+    if (!targets_mutex) {
+        return;
+    }
+    
+    // A wake in progress counts up to now, so a sample never gets a whole wake at once
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
+    uint64_t total_us = awake_us;
+    if (awake_sources > 0) {
+        total_us += (uint64_t)(esp_timer_get_time() - awake_since_us);
+    }
+    xSemaphoreGive(targets_mutex);
+    stats_out->awake_ms = (uint32_t)(total_us / 1000);
+}
+
+void ping_manager_set_paused(bool paused) {
+    if (!targets_mutex) {
+        // Not started yet, ping_task reads the flag when it runs
+        is_paused = paused;
+        return;
+    }
+    // Wait as long as it takes: a dropped resume would leave ping_task
+    // asleep with nothing left to wake it
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
+    
+    if (is_paused && !paused) {
+        // Probe everything as soon as the network is back
+        int64_t now_us = esp_timer_get_time();
+        for (int i = 0; i < PING_MAX_TARGETS; i++) {
+            target_deadline_us[i] = now_us;
+        }
+        schedule_dirty = true;
+    }
+    bool changed = (is_paused != paused);
+    is_paused = paused;
+    xSemaphoreGive(targets_mutex);
+    
+    if (changed) {
+        ESP_LOGI(TAG, "Probing %s", paused ? "paused" : "resumed");
+        wake_ping_task();
+    }
+}
+
 // Private functions
 static void ping_task(void* parameters) {
     ESP_LOGI(TAG, "Ping task started");
+    bool awake = false;              // Probed since the last sleep
     
     while (is_running) {
-        uint64_t current_time = get_timestamp_ms();
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_deadline_us = -1;
         
-        if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            for (int i = 0; i < target_count; i++) {
-                ping_target_t* target = &targets[i];
-                
-                if (!target->enabled) {
-                    continue;
-                }
-                
-                // Check if it's time to ping this target
-                if (current_time - target->last_ping_time >= target->interval_ms) {
-                    target->last_ping_time = current_time;
-                    
-                    // Perform ping check
-                    uint64_t start_time = get_timestamp_ms();
-                    bool success = check_host_alive(target->ip_address, target->timeout_ms);
-                    uint64_t end_time = get_timestamp_ms();
-                    uint32_t response_time = (uint32_t)(end_time - start_time);
-                    
-                    // Update statistics
-                    bool status_changed = (target->is_online != success);
-                    target->is_online = success;
-                    
-                    if (success) {
-                        target->success_count++;
-                        target->last_success_time = current_time;
-                    } else {
-                        target->fail_count++;
-                    }
-                    
-                    // Log status changes
-                    if (status_changed) {
-                        ESP_LOGI(TAG, "Device '%s' (%s) status changed: %s",
-                                target->name, target->ip_address,
-                                success ? "ONLINE" : "OFFLINE");
-                    }
-                    
-                    // Call callback if provided
-                    if (result_callback) {
-                        result_callback(target->name, target->ip_address, success, response_time, callback_user_data);
-                    }
-                }
-            }
+        if (xSemaphoreTake(targets_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+            continue;
+        }
+        if (is_paused) {
+            // Nothing is due until ping_manager_set_paused() wakes us
             xSemaphoreGive(targets_mutex);
+            if (awake) {
+                end_wake();
+                awake = false;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (schedule_dirty) {
+            schedule_rebuild();
+        }
+        if (schedule_size > 0) {
+            next_deadline_us = target_deadline_us[schedule_heap[0]];
+        }
+        bool due = (next_deadline_us >= 0 && next_deadline_us <= now_us);
+        if (due && !awake) {
+            awake = true;
+            awake_begin(now_us);
+        }
+        xSemaphoreGive(targets_mutex);
+        
+        if (due) {
+            // Probe the due targets and those falling due meanwhile, no lock
+            // held; returns once nothing is in flight
+            ping_probe_run(sweep_probes, PING_SWEEP_MAX, refill_sweep, NULL);
+            continue;
         }
         
-        // Wait before next iteration
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Check every second
+        // Sleep until the next deadline, or until the target table changes
+        TickType_t wait_ticks = portMAX_DELAY;
+        if (next_deadline_us >= 0) {
+            int64_t wait_us = next_deadline_us - esp_timer_get_time();
+            int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+            wait_ticks = wait_us > 0 ? (TickType_t)((wait_us + tick_us - 1) / tick_us) : 0;
+        }
+        if (wait_ticks > 0) {
+            if (awake) {
+                end_wake();
+                awake = false;
+            }
+            ulTaskNotifyTake(pdTRUE, wait_ticks);
+        }
     }
     
     ESP_LOGI(TAG, "Ping task ended");
     vTaskDelete(NULL);
 }
 
-static bool check_host_alive(const char* ip_address, uint32_t timeout_ms) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        return false;
-    }
-    
-    // Set socket timeout
-    struct timeval timeout;
-    timeout.tv_sec = timeout_ms / 1000;
-    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+// Consumer side of result_ring, runs next to the MQTT client so the callback's
+// publishes and TLS writes stay off the probing core
+static void result_task(void* parameters) {
+    uint32_t dropped_reported = 0;
+    uint32_t wakes_done = 0;
     
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (is_running) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        // Results of the wakes counted here were pushed before the count, the
+        // drain below reports all of them
+        uint32_t wakes_ended = atomic_load_explicit(&wake_count, memory_order_acquire);
+        
+        ping_result_t report;
+        while (ping_result_ring_pop(&result_ring, &report)) {
+            char ip_address[DEVICE_IP_SIZE];
+            device_registry_format_ip(report.ipv4, ip_address, sizeof(ip_address));
+            
+            if (report.status_changed) {
+                ESP_LOGI(TAG, "Device '%s' (%s) status changed: %s",
+                        report.name, ip_address,
+                        report.success ? "ONLINE" : "OFFLINE");
+            }
+            
+            if (result_callback) {
+                result_callback(report.handle, report.name, ip_address, report.success,
+                                report.response_time_us, callback_user_data);
+            }
+        }
+        
+        uint32_t dropped = atomic_load_explicit(&result_ring.dropped, memory_order_relaxed);
+        if (dropped != dropped_reported) {
+            ESP_LOGW(TAG, "%" PRIu32 " ping results dropped, the result callback cannot keep up",
+                     dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+        
+        if (wakes_ended != wakes_done) {
+            wakes_done = wakes_ended;
+            run_wake_done();
+        }
+    }
     
-    // Set non-blocking mode
-    int flags = fcntl(sock, F_GETFL, 0);
-    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    vTaskDelete(NULL);
+}
+
+// ping_probe_run() hook on ping_task: commits finished probes and hands
+// their results to ping_results, then starts due targets in the free slots
+static int64_t refill_sweep(ping_probe_t* probes, int capacity, void* ctx) {
+    int64_t now_us = esp_timer_get_time();
+    uint64_t current_time = (uint64_t)(now_us / 1000);
+    int finished = 0;
+    int free_slots = 0;
     
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(80); // Try HTTP port first
+    // Finished slots are only emptied here, so wait as long as it takes
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
     
-    if (inet_pton(AF_INET, ip_address, &addr.sin_addr) <= 0) {
-        close(sock);
-        return false;
+    for (int n = 0; n < capacity; n++) {
+        if (probes[n].state != PING_PROBE_DONE) {
+            continue;
+        }
+        commit_probe(n, current_time);
+        
+        // Nothing here waits on the callback
+        sweep_entry_t* entry = &sweep[n];
+        ping_result_t report = {
+            .handle = entry->handle,
+            .ipv4 = probes[n].ipv4,
+            .response_time_us = probes[n].response_time_us,
+            .success = probes[n].success,
+            .status_changed = entry->status_changed,
+        };
+        memcpy(report.name, entry->name, sizeof(report.name));
+        ping_result_ring_push(&result_ring, &report);
+        probes[n].state = PING_PROBE_FREE;
+        finished++;
     }
     
-    // Attempt connection
-    int result = connect(sock, (struct sockaddr*)&addr, sizeof(addr));
-    bool is_alive = false;
+    if (schedule_dirty) {
+        schedule_rebuild();
+    }
     
-    if (result == 0) {
-        // Connected immediately
-        is_alive = true;
-    } else if (errno == EINPROGRESS) {
-        // Connection in progress, wait for completion
-        fd_set write_fds;
-        FD_ZERO(&write_fds);
-        FD_SET(sock, &write_fds);
-        
-        struct timeval select_timeout;
-        select_timeout.tv_sec = timeout_ms / 1000;
-        select_timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    // Snapshot every due target into a free slot; it leaves the heap until
+    // its result is committed, so a target never has two probes in flight
+    for (int n = 0; n < capacity; n++) {
+        if (probes[n].state != PING_PROBE_FREE) {
+            continue;
+        }
         
-        int select_result = select(sock + 1, NULL, &write_fds, NULL, &select_timeout);
-        if (select_result > 0 && FD_ISSET(sock, &write_fds)) {
-            int error = 0;
-            socklen_t len = sizeof(error);
-            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
-                is_alive = true;
+        int index = -1;
+        sweep_entry_t* entry = &sweep[n];
+        while (index < 0 && !is_paused && schedule_size > 0 &&
+               target_deadline_us[schedule_heap[0]] <= now_us) {
+            index = schedule_pop();
+            memset(entry, 0, sizeof(*entry));
+            if (device_registry_copy_name(target_handle[index], entry->name, sizeof(entry->name)) != ESP_OK) {
+                schedule_dirty = true;
+                index = -1;
             }
         }
+        if (index < 0) {
+            free_slots++;
+            continue;
+        }
+        
+        target_config_t* target = &targets[index];
+        ping_probe_t* probe = &probes[n];
+        memset(probe, 0, sizeof(*probe));
+        // The address is a single word and needs no registry lock
+        uint32_t ipv4 = device_registry_ipv4(target_handle[index]);
+        
+        target->last_probe_ms = (uint32_t)current_time;
+        target_deadline_us[index] = align_deadline(target,
+            now_us + (int64_t)effective_interval(target, now_us) * 1000, now_us);
+        target_flags[index] |= TARGET_PROBING;
+        
+        entry->handle = target_handle[index];
+        entry->revision = target->revision;
+        entry->index = index;
+        probe->ipv4 = ipv4;
+        probe->timeout_ms = target->timeout_ms;
+        // A woken host that does not answer yet is re-probed at the fast
+        // interval, not once per timeout
+        if (target->fast_until_us > now_us && target->fast_interval_ms < probe->timeout_ms) {
+            probe->timeout_ms = target->fast_interval_ms;
+        }
+        probe->strategy = target->strategy;
+        memcpy(probe->ports, target->ports, sizeof(probe->ports));
+        probe->port_count = target->port_count;
+        memcpy(probe->mac_address, target->mac_address, sizeof(probe->mac_address));
+        probe->state = PING_PROBE_QUEUED;
     }
     
-    close(sock);
+    int64_t next_due_us = INT64_MAX;
+    if (free_slots > 0 && !is_paused && schedule_size > 0) {
+        next_due_us = target_deadline_us[schedule_heap[0]];
+    }
+    xSemaphoreGive(targets_mutex);
     
-    // If HTTP port failed, try SSH port (22) as backup
-    if (!is_alive) {
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock >= 0) {
-            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-            flags = fcntl(sock, F_GETFL, 0);
-            fcntl(sock, F_SETFL, flags | O_NONBLOCK);
-            
-            addr.sin_port = htons(22); // SSH port
-            result = connect(sock, (struct sockaddr*)&addr, sizeof(addr));
-            
-            if (result == 0) {
-                is_alive = true;            } else if (errno == EINPROGRESS) {
-                fd_set write_fds;
-                FD_ZERO(&write_fds);
-                FD_SET(sock, &write_fds);
-                
-                struct timeval ssh_timeout;
-                ssh_timeout.tv_sec = timeout_ms / 1000;
-                ssh_timeout.tv_usec = (timeout_ms % 1000) * 1000;
-                
-                if (select(sock + 1, NULL, &write_fds, NULL, &ssh_timeout) > 0 && FD_ISSET(sock, &write_fds)) {
-                    int error = 0;
-                    socklen_t len = sizeof(error);
-                    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
-                        is_alive = true;
-                    }
-                }
-            }
-            close(sock);
-        }
+    if (finished > 0) {
+        xTaskNotifyGive(result_task_handle);
+    }
+    return next_due_us;
+}
+
+// Called with targets_mutex held: fold a finished probe into its target
+static void commit_probe(int slot, uint64_t current_time) {
+    sweep_entry_t* entry = &sweep[slot];
+    ping_probe_t* probe = &sweep_probes[slot];
+    
+    // Targets may have been removed or re-added while probing
+    int index = entry->index;
+    if (target_handle[index] != entry->handle || targets[index].revision != entry->revision) {
+        entry->status_changed = false;
+        return;
+    }
+    target_flags[index] &= ~TARGET_PROBING;
+    
+    // Update statistics
+    bool success = probe->success;
+    bool was_online = (target_flags[index] & TARGET_ONLINE) != 0;
+    entry->status_changed = (was_online != success);
+    
+    if (success) {
+        target_flags[index] |= TARGET_ONLINE;
+        target_success[index]++;
+        target_rtt_us[index] = probe->response_time_us;
+        targets[index].last_success_s = (uint32_t)(current_time / 1000);
+    } else {
+        target_flags[index] &= ~TARGET_ONLINE;
+        target_fail[index]++;
     }
+    probe_stats_record(&target_latency[index], success, probe->response_time_us, (uint32_t)current_time);
     
-    return is_alive;
+    adapt_interval(index, entry->status_changed, (int64_t)current_time * 1000);
+    
+    // Back in the heap with its new deadline
+    if (!schedule_dirty && (target_flags[index] & TARGET_ENABLED)) {
+        schedule_push(index);
+    }
+}
+
+static bool probe_config_valid(const ping_probe_config_t* config) {
+    if (config->strategy > PING_STRATEGY_ARP) {
+        return false;
+    }
+    if (config->port_count > PING_MAX_PORTS) {
+        return false;
+    }
+    bool needs_ports = (config->strategy == PING_STRATEGY_TCP || config->strategy == PING_STRATEGY_UDP);
+    if (needs_ports && config->port_count == 0) {
+        return false;
+    }
+    uint32_t interval_ms = config->interval_ms ? config->interval_ms : PING_DEFAULT_INTERVAL;
+    if (interval_ms < PING_MIN_INTERVAL) {
+        return false;
+    }
+    return config->max_interval_ms == 0 || config->max_interval_ms >= interval_ms;
+}
+
+// Called with targets_mutex held, config already validated
+static void apply_probe_config(target_config_t* target, const ping_probe_config_t* config) {
+    target->strategy = config->strategy;
+    if (config->port_count > 0) {
+        memset(target->ports, 0, sizeof(target->ports));
+        memcpy(target->ports, config->ports, config->port_count * sizeof(config->ports[0]));
+        target->port_count = config->port_count;
+    }
+    memcpy(target->mac_address, config->mac_address, sizeof(target->mac_address));
+    target->interval_ms = config->interval_ms ? config->interval_ms : PING_DEFAULT_INTERVAL;
+    target->max_interval_ms = config->max_interval_ms ? config->max_interval_ms : PING_DEFAULT_MAX_INTERVAL;
+    if (target->max_interval_ms < target->interval_ms) {
+        target->max_interval_ms = target->interval_ms;
+    }
+    target->current_interval_ms = target->interval_ms;
+    target->timeout_ms = config->timeout_ms ? config->timeout_ms : PING_DEFAULT_TIMEOUT;
 }
 
+// Called with targets_mutex held, config already validated
+static bool probe_config_matches(const target_config_t* target, const ping_probe_config_t* config) {
+    uint32_t interval_ms = config->interval_ms ? config->interval_ms : PING_DEFAULT_INTERVAL;
+    uint32_t max_interval_ms = config->max_interval_ms ? config->max_interval_ms : PING_DEFAULT_MAX_INTERVAL;
+    if (max_interval_ms < interval_ms) {
+        max_interval_ms = interval_ms;
+    }
+    if (target->strategy != config->strategy ||
+        target->interval_ms != interval_ms ||
+        target->max_interval_ms != max_interval_ms ||
+        target->timeout_ms != (config->timeout_ms ? config->timeout_ms : PING_DEFAULT_TIMEOUT) ||
+        memcmp(target->mac_address, config->mac_address, sizeof(target->mac_address)) != 0) {
+        return false;
+    }
+    return config->port_count == 0 ||
+           (target->port_count == config->port_count &&
+            memcmp(target->ports, config->ports, config->port_count * sizeof(config->ports[0])) == 0);
+}
+
+// Called with targets_mutex held: a fresh target with the default settings
+static void init_target(int index, device_handle_t handle) {
+    target_config_t* target = &targets[index];
+    uint16_t revision = target->revision + 1;
+    memset(target, 0, sizeof(*target));
+    target_count++;
+    target_handle[index] = handle;
+    target->revision = revision;
+    target->interval_ms = PING_DEFAULT_INTERVAL;
+    target->max_interval_ms = PING_DEFAULT_MAX_INTERVAL;
+    target->current_interval_ms = PING_DEFAULT_INTERVAL;
+    target->fast_interval_ms = 0;
+    target->fast_until_us = 0;
+    target->timeout_ms = PING_DEFAULT_TIMEOUT;
+    target->strategy = PING_STRATEGY_TCP;
+    target->ports[0] = 80;
+    target->ports[1] = 22;
+    target->port_count = 2;
+    target->last_probe_ms = 0;
+    target->last_success_s = 0;
+    target_flags[index] = TARGET_ENABLED;
+    target_success[index] = 0;
+    target_fail[index] = 0;
+    target_rtt_us[index] = 0;
+    target_deadline_us[index] = 0;
+    probe_stats_reset(&target_latency[index]);
+}
+
+static const char* strategy_name(ping_strategy_t strategy) {
+    switch (strategy) {
+        case PING_STRATEGY_ICMP: return "ICMP";
+        case PING_STRATEGY_UDP:  return "UDP";
+        case PING_STRATEGY_ARP:  return "ARP";
+        default:                 return "TCP";
+    }
+}
+
+// Called with targets_mutex held
+static uint32_t effective_interval(const target_config_t* target, int64_t now_us) {
+    if (target->fast_until_us > now_us && target->fast_interval_ms < target->current_interval_ms) {
+        return target->fast_interval_ms;
+    }
+    return target->current_interval_ms;
+}
+
+// Called with targets_mutex held: move a deadline to the nearest slot
+// boundary after now. Nearest rather than next, as a wake starts a little
+// after its boundary and rounding up would add a slot to every interval.
+// A target in its fast window keeps its exact deadline, a wake in progress
+// should not wait for the next slot.
+static int64_t align_deadline(const target_config_t* target, int64_t deadline_us, int64_t now_us) {
+    if (wake_slot_ms == 0 || target->fast_until_us > now_us) {
+        return deadline_us;
+    }
+    int64_t slot_us = (int64_t)wake_slot_ms * 1000;
+    int64_t aligned_us = (deadline_us + slot_us / 2) / slot_us * slot_us;
+    if (aligned_us <= now_us) {
+        aligned_us += ((now_us - aligned_us) / slot_us + 1) * slot_us;
+    }
+    return aligned_us;
+}
+
+// ping_task side: the last sweep of the wake is on the ring, count the wake
+// and let ping_results run the wake done callback after reporting it
+static void end_wake(void) {
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
+    awake_end(esp_timer_get_time());
+    xSemaphoreGive(targets_mutex);
+    atomic_fetch_add_explicit(&wake_count, 1, memory_order_release);
+    xTaskNotifyGive(result_task_handle);
+}
+
+// ping_results side, after the results of one or more ended wakes. The time
+// spent in the callback counts as awake as well, once where it overlaps
+// ping_task's next wake.
+static void run_wake_done(void) {
+    if (!wake_done_callback) {
+        return;
+    }
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
+    awake_begin(esp_timer_get_time());
+    xSemaphoreGive(targets_mutex);
+    
+    wake_done_callback(wake_done_user_data);
+    
+    xSemaphoreTake(targets_mutex, portMAX_DELAY);
+    awake_end(esp_timer_get_time());
+    xSemaphoreGive(targets_mutex);
+}
+
+// Called with targets_mutex held
+static void awake_begin(int64_t now_us) {
+    if (awake_sources++ == 0) {
+        awake_since_us = now_us;
+    }
+}
+
+// Called with targets_mutex held
+static void awake_end(int64_t now_us) {
+    if (--awake_sources == 0) {
+        awake_us += (uint64_t)(now_us - awake_since_us);
+    }
+}
+
+// Called with targets_mutex held: start of the last probe in esp_timer time.
+// last_probe_ms only keeps the low 32 bits, the difference is exact for
+// gaps below 49 days.
+static int64_t last_probe_us(const target_config_t* target, int64_t now_us) {
+    uint32_t elapsed_ms = (uint32_t)(now_us / 1000) - target->last_probe_ms;
+    return now_us - (int64_t)elapsed_ms * 1000;
+}
+
+// Called with targets_mutex held, after each probe result
+static void adapt_interval(int index, bool status_changed, int64_t now_us) {
+    target_config_t* target = &targets[index];
+    if (status_changed) {
+        // State flipped: the wake completed or the host went away, back to the base rate
+        target->current_interval_ms = target->interval_ms;
+        target->fast_until_us = 0;
+    } else if (target->current_interval_ms < target->max_interval_ms) {
+        uint32_t doubled = target->current_interval_ms * 2;
+        target->current_interval_ms = doubled < target->max_interval_ms ? doubled : target->max_interval_ms;
+    }
+    
+    // The deadline was armed before the result was known, re-arm it from the probe start
+    int64_t deadline_us = align_deadline(target,
+        last_probe_us(target, now_us) + (int64_t)effective_interval(target, now_us) * 1000, now_us);
+    if (deadline_us != target_deadline_us[index]) {
+        target_deadline_us[index] = deadline_us;
+        schedule_dirty = true;
+    }
+}
+
+// Called with targets_mutex held: bring the deadline forward if the interval got shorter
+static void pull_in_deadline(int index, int64_t now_us) {
+    const target_config_t* target = &targets[index];
+    int64_t deadline_us = align_deadline(target,
+        last_probe_us(target, now_us) + (int64_t)effective_interval(target, now_us) * 1000, now_us);
+    if (deadline_us < target_deadline_us[index]) {
+        target_deadline_us[index] = deadline_us;
+        schedule_dirty = true;
+    }
+}
+
+// Called with targets_mutex held
+static esp_err_t snapshot_target(int index, ping_target_t* target_out) {
+    const target_config_t* target = &targets[index];
+    int64_t now_us = esp_timer_get_time();
+    
+    memset(target_out, 0, sizeof(*target_out));
+    target_out->handle = target_handle[index];
+    target_out->ipv4 = device_registry_ipv4(target_handle[index]);
+    target_out->interval_ms = target->interval_ms;
+    target_out->max_interval_ms = target->max_interval_ms;
+    target_out->current_interval_ms = target->current_interval_ms;
+    target_out->fast_interval_ms = target->fast_interval_ms;
+    target_out->timeout_ms = target->timeout_ms;
+    target_out->strategy = (ping_strategy_t)target->strategy;
+    memcpy(target_out->ports, target->ports, sizeof(target_out->ports));
+    target_out->port_count = target->port_count;
+    memcpy(target_out->mac_address, target->mac_address, sizeof(target_out->mac_address));
+    target_out->enabled = (target_flags[index] & TARGET_ENABLED) != 0;
+    target_out->is_online = (target_flags[index] & TARGET_ONLINE) != 0;
+    target_out->success_count = target_success[index];
+    target_out->fail_count = target_fail[index];
+    target_out->last_rtt_us = target_rtt_us[index];
+    if (target_success[index] + target_fail[index] > 0) {
+        target_out->last_ping_time = (uint64_t)(last_probe_us(target, now_us) / 1000);
+    }
+    target_out->last_success_time = (uint64_t)target->last_success_s * 1000;
+    target_out->next_probe_us = target_deadline_us[index];
+    target_out->fast_until_us = target->fast_until_us;
+    return ESP_OK;
+}
+
+// Called with targets_mutex held
 static int find_target_by_name(const char* name) {
-    for (int i = 0; i < target_count; i++) {
-        if (strcmp(targets[i].name, name) == 0) {
-            return i;
+    device_handle_t handle = device_registry_find(name);
+    int index = device_registry_slot(handle);
+    if (index < 0 || target_handle[index] != handle) {
+        return -1;
+    }
+    return index;
+}
+
+static void reset_targets(void) {
+    memset(targets, 0, sizeof(targets));
+    memset(target_deadline_us, 0, sizeof(target_deadline_us));
+    memset(target_flags, 0, sizeof(target_flags));
+    memset(target_success, 0, sizeof(target_success));
+    memset(target_fail, 0, sizeof(target_fail));
+    memset(target_rtt_us, 0, sizeof(target_rtt_us));
+    memset(target_latency, 0, sizeof(target_latency));
+    for (int i = 0; i < PING_MAX_TARGETS; i++) {
+        target_handle[i] = DEVICE_HANDLE_INVALID;
+    }
+    target_count = 0;
+}
+
+static bool schedule_before(int a, int b) {
+    return target_deadline_us[a] < target_deadline_us[b];
+}
+
+static void schedule_sift_down(int pos) {
+    while (true) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        
+        if (left < schedule_size && schedule_before(schedule_heap[left], schedule_heap[smallest])) {
+            smallest = left;
         }
+        if (right < schedule_size && schedule_before(schedule_heap[right], schedule_heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        
+        uint16_t tmp = schedule_heap[pos];
+        schedule_heap[pos] = schedule_heap[smallest];
+        schedule_heap[smallest] = tmp;
+        pos = smallest;
     }
-    return -1;
 }
 
-static uint64_t get_timestamp_ms(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
-}
\ No newline at end of file
+static void schedule_push(int index) {
+    int pos = schedule_size++;
+    schedule_heap[pos] = (uint16_t)index;
+    
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!schedule_before(schedule_heap[pos], schedule_heap[parent])) {
+            break;
+        }
+        uint16_t tmp = schedule_heap[pos];
+        schedule_heap[pos] = schedule_heap[parent];
+        schedule_heap[parent] = tmp;
+        pos = parent;
+    }
+}
+
+static int schedule_pop(void) {
+    int top = schedule_heap[0];
+    schedule_heap[0] = schedule_heap[--schedule_size];
+    schedule_sift_down(0);
+    return top;
+}
+
+// Called with targets_mutex held
+static void schedule_rebuild(void) {
+    schedule_size = 0;
+    for (int i = 0; i < PING_MAX_TARGETS; i++) {
+        if (target_handle[i] != DEVICE_HANDLE_INVALID &&
+            (target_flags[i] & (TARGET_ENABLED | TARGET_PROBING)) == TARGET_ENABLED) {
+            schedule_heap[schedule_size++] = (uint16_t)i;
+        }
+    }
+    for (int pos = schedule_size / 2 - 1; pos >= 0; pos--) {
+        schedule_sift_down(pos);
+    }
+    schedule_dirty = false;
+}
+
+static void wake_ping_task(void) {
+    if (ping_task_handle != NULL) {
+        xTaskNotifyGive(ping_task_handle);
+    }
+}
+
+// Called without targets_mutex, after a setter changed saved settings
+static void notify_config_changed(device_handle_t handle) {
+    if (config_callback) {
+        config_callback(handle, config_user_data);
+    }
+}
@@ -0,0 +1,575 @@
+#include "ping_probe.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "lwip/icmp.h"
+#include "lwip/ip4.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/etharp.h"
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+static const char *TAG = "ping_probe";
+
+// ICMP echo identifier for this engine; replies with another id belong to someone else
+#define ICMP_ECHO_ID            0xE5A1
+
+// A cached ARP entry only proves presence once a reply to this sweep's
+// request refilled it, so the entry is dropped before each request. lwIP can
+// only remove a dynamic entry by first turning it into a static one; without
+// static entry support ARP targets are pinged instead.
+#if defined(ETHARP_SUPPORT_STATIC_ENTRIES) && ETHARP_SUPPORT_STATIC_ENTRIES
+#define ARP_PROBES_SUPPORTED    1
+#else
+#define ARP_PROBES_SUPPORTED    0
+#endif
+
+// Shared raw socket for ICMP echo, opened on first use. Every echo request
+// gets the next sequence number, so late replies to a slot's previous probe
+// never match the one running in it now.
+static int icmp_sock = -1;
+static uint16_t icmp_seq_next = 0;
+
+// Shared state for a pass over the ARP probes, run in the lwIP thread
+typedef struct {
+    ping_probe_t* probes;
+    int count;
+    esp_netif_t* netif;              // Station interface the targets live on
+    bool send_requests;              // Send ARP requests (true) or read the cache (false)
+} arp_pass_t;
+
+// One in-flight TCP connect or UDP request
+typedef struct {
+    int sock;                        // Non-blocking socket
+    int probe;                       // Index into the probes array
+    int64_t deadline_us;             // Absolute esp_timer deadline
+    bool udp;                        // Waits for a datagram instead of a connect
+} probe_socket_t;
+
+// Forward declarations
+static void start_port_probe(ping_probe_t* probes, int index, probe_socket_t* active, int* active_count);
+static int open_connect(const struct sockaddr_in* addr, bool udp, bool* connected);
+static int probe_socket_count(const ping_probe_t* probe);
+static void icmp_send_burst(ping_probe_t* probes, int count);
+static void icmp_collect_replies(ping_probe_t* probes, int count);
+static void arp_send_requests(ping_probe_t* probes, int count);
+static void arp_poll_cache(ping_probe_t* probes, int count);
+static esp_err_t arp_pass(void* ctx);
+#if ARP_PROBES_SUPPORTED
+static void arp_flush_entry(struct netif* netif, const ip4_addr_t* ip);
+#endif
+static void start_probe(ping_probe_t* probe);
+static void mark_success(ping_probe_t* probe, int64_t now_us);
+
+void ping_probe_run(ping_probe_t* probes, int capacity, ping_probe_refill_t refill, void* ctx) {
+    probe_socket_t active[PING_PROBE_MAX_SOCKETS];
+    int active_count = 0;
+
+    while (true) {
+        // Hand back finished probes and take in the ones that fell due
+        int64_t next_due_us = refill(probes, capacity, ctx);
+
+        // ARP targets go first since off-subnet ones fall back to ICMP,
+        // then all new ICMP targets get their echo request right away
+        arp_send_requests(probes, capacity);
+        icmp_send_burst(probes, capacity);
+
+        // Start as many TCP/UDP probes as the socket budget allows, in slot order
+        for (int i = 0; i < capacity; i++) {
+            if (probes[i].state != PING_PROBE_QUEUED) {
+                continue;
+            }
+            if (active_count + probe_socket_count(&probes[i]) > PING_PROBE_MAX_SOCKETS) {
+                break;
+            }
+            start_port_probe(probes, i, active, &active_count);
+        }
+
+        // Probes that ended without waiting go straight back to the hook
+        bool busy = false;
+        bool finished = false;
+        bool arp_pending = false;
+        bool icmp_pending = false;
+        for (int i = 0; i < capacity; i++) {
+            ping_probe_t* probe = &probes[i];
+            if (probe->state == PING_PROBE_RUNNING && probe->pending == 0) {
+                probe->state = PING_PROBE_DONE;
+            }
+            busy |= (probe->state != PING_PROBE_FREE);
+            finished |= (probe->state == PING_PROBE_DONE);
+            if (probe->state == PING_PROBE_RUNNING && probe->pending) {
+                arp_pending |= (probe->strategy == PING_STRATEGY_ARP);
+                icmp_pending |= (probe->strategy == PING_STRATEGY_ICMP);
+            }
+        }
+        if (!busy) {
+            return;
+        }
+        if (finished) {
+            continue;
+        }
+
+        // Wait on every open socket until the nearest deadline, the next
+        // probe falling due or the next refill, whichever comes first
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        int64_t now_us = esp_timer_get_time();
+        int64_t nearest_us = now_us + PING_PROBE_REFILL_MS * 1000;
+        if (next_due_us < nearest_us) {
+            nearest_us = next_due_us;
+        }
+
+        for (int s = 0; s < active_count; s++) {
+            FD_SET(active[s].sock, active[s].udp ? &read_fds : &write_fds);
+            if (active[s].sock > max_fd) {
+                max_fd = active[s].sock;
+            }
+            if (active[s].deadline_us < nearest_us) {
+                nearest_us = active[s].deadline_us;
+            }
+        }
+
+        if (icmp_pending) {
+            FD_SET(icmp_sock, &read_fds);
+            if (icmp_sock > max_fd) {
+                max_fd = icmp_sock;
+            }
+        }
+        for (int i = 0; i < capacity; i++) {
+            if (probes[i].state == PING_PROBE_RUNNING && probes[i].pending &&
+                probes[i].strategy == PING_STRATEGY_ICMP && probes[i].deadline_us < nearest_us) {
+                nearest_us = probes[i].deadline_us;
+            }
+        }
+
+        if (arp_pending) {
+            // ARP replies only show up in the cache, wake up to poll it
+            int64_t poll_us = now_us + PING_PROBE_ARP_POLL_MS * 1000;
+            if (poll_us < nearest_us) {
+                nearest_us = poll_us;
+            }
+        }
+
+        int64_t wait_us = nearest_us > now_us ? nearest_us - now_us : 0;
+        int ready = 0;
+
+        if (max_fd >= 0) {
+            struct timeval select_timeout;
+            select_timeout.tv_sec = wait_us / 1000000;
+            select_timeout.tv_usec = wait_us % 1000000;
+
+            ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &select_timeout);
+            if (ready < 0) {
+                ESP_LOGW(TAG, "select() failed: errno %d", errno);
+                FD_ZERO(&read_fds);
+                FD_ZERO(&write_fds);
+            }
+        } else if (wait_us > 0) {
+            // Only ARP probes outstanding, nothing to select() on
+            TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+            vTaskDelay(ticks > 0 ? ticks : 1);
+        }
+        now_us = esp_timer_get_time();
+
+        // Read the ARP cache, then expire the probes that ran out of time
+        if (arp_pending) {
+            arp_poll_cache(probes, capacity);
+            for (int i = 0; i < capacity; i++) {
+                if (probes[i].state == PING_PROBE_RUNNING && probes[i].strategy == PING_STRATEGY_ARP &&
+                    probes[i].pending && now_us >= probes[i].deadline_us) {
+                    probes[i].pending = 0;
+                }
+            }
+        }
+
+        // Match echo replies, then expire the ones that ran out of time
+        if (icmp_pending) {
+            if (ready > 0 && FD_ISSET(icmp_sock, &read_fds)) {
+                icmp_collect_replies(probes, capacity);
+            }
+            for (int i = 0; i < capacity; i++) {
+                if (probes[i].state == PING_PROBE_RUNNING && probes[i].strategy == PING_STRATEGY_ICMP &&
+                    probes[i].pending && (ready < 0 || now_us >= probes[i].deadline_us)) {
+                    probes[i].pending = 0;
+                }
+            }
+        }
+
+        // Collect completed connects and UDP replies
+        for (int s = 0; s < active_count; s++) {
+            if (ready <= 0) {
+                break;
+            }
+            
+            if (active[s].udp && FD_ISSET(active[s].sock, &read_fds)) {
+                uint8_t reply[16];
+                if (recv(active[s].sock, reply, sizeof(reply), MSG_DONTWAIT) >= 0) {
+                    mark_success(&probes[active[s].probe], now_us);
+                }
+                active[s].deadline_us = 0;
+            } else if (!active[s].udp && FD_ISSET(active[s].sock, &write_fds)) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (getsockopt(active[s].sock, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                    mark_success(&probes[active[s].probe], now_us);
+                }
+                // Answered either way, this socket is done
+                active[s].deadline_us = 0;
+            }
+        }
+
+        // Reap finished, expired and no longer needed sockets
+        for (int s = 0; s < active_count; ) {
+            ping_probe_t* probe = &probes[active[s].probe];
+            if (probe->success || ready < 0 || now_us >= active[s].deadline_us) {
+                close(active[s].sock);
+                probe->pending--;
+                active[s] = active[--active_count];
+            } else {
+                s++;
+            }
+        }
+    }
+}
+
+// Private functions
+static int probe_socket_count(const ping_probe_t* probe) {
+    return probe->port_count < PING_PROBE_MAX_SOCKETS ? probe->port_count : PING_PROBE_MAX_SOCKETS;
+}
+
+static void start_port_probe(ping_probe_t* probes, int index, probe_socket_t* active, int* active_count) {
+    ping_probe_t* probe = &probes[index];
+    bool udp = (probe->strategy == PING_STRATEGY_UDP);
+    int port_count = probe_socket_count(probe);
+    start_probe(probe);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = probe->ipv4;
+
+    if (probe->ipv4 == 0) {
+        ESP_LOGW(TAG, "Probe without an IP address");
+        return;
+    }
+
+    int64_t deadline_us = probe->start_us + (int64_t)probe->timeout_ms * 1000;
+
+    // One socket per port, the first one to answer wins
+    for (int p = 0; p < port_count && !probe->success; p++) {
+        addr.sin_port = htons(probe->ports[p]);
+
+        bool connected = false;
+        int sock = open_connect(&addr, udp, &connected);
+        if (sock < 0) {
+            continue;
+        }
+
+        if (connected) {
+            // Connected immediately
+            mark_success(probe, esp_timer_get_time());
+            close(sock);
+            continue;
+        }
+
+        active[*active_count].sock = sock;
+        active[*active_count].probe = index;
+        active[*active_count].deadline_us = deadline_us;
+        active[*active_count].udp = udp;
+        (*active_count)++;
+        probe->pending++;
+    }
+}
+
+static int open_connect(const struct sockaddr_in* addr, bool udp, bool* connected) {
+    int sock = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (sock < 0) {
+        ESP_LOGW(TAG, "Failed to create socket: errno %d", errno);
+        return -1;
+    }
+
+    // Set non-blocking mode
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    int result = connect(sock, (const struct sockaddr*)addr, sizeof(*addr));
+    if (udp) {
+        // UDP connect only fixes the peer; the probe is a one-byte datagram
+        static const uint8_t request = '\n';
+        if (result == 0 && send(sock, &request, sizeof(request), 0) >= 0) {
+            *connected = false;
+            return sock;
+        }
+        close(sock);
+        return -1;
+    }
+
+    if (result == 0) {
+        *connected = true;
+        return sock;
+    }
+
+    if (errno == EINPROGRESS) {
+        *connected = false;
+        return sock;
+    }
+
+    close(sock);
+    return -1;
+}
+
+static void icmp_send_burst(ping_probe_t* probes, int count) {
+    for (int i = 0; i < count; i++) {
+        ping_probe_t* probe = &probes[i];
+        if (probe->state != PING_PROBE_QUEUED || probe->strategy != PING_STRATEGY_ICMP) {
+            continue;
+        }
+        start_probe(probe);
+
+        if (icmp_sock < 0) {
+            icmp_sock = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+            if (icmp_sock < 0) {
+                ESP_LOGE(TAG, "Failed to create ICMP socket: errno %d", errno);
+                continue;
+            }
+            int flags = fcntl(icmp_sock, F_GETFL, 0);
+            fcntl(icmp_sock, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = probe->ipv4;
+        if (probe->ipv4 == 0) {
+            ESP_LOGW(TAG, "Probe without an IP address");
+            continue;
+        }
+
+        uint8_t packet[PING_PROBE_ICMP_SIZE];
+        struct icmp_echo_hdr* echo = (struct icmp_echo_hdr*)packet;
+        memset(packet, 0, sizeof(packet));
+        ICMPH_TYPE_SET(echo, ICMP_ECHO);
+        ICMPH_CODE_SET(echo, 0);
+        echo->id = htons(ICMP_ECHO_ID);
+        probe->icmp_seq = icmp_seq_next++;
+        echo->seqno = htons(probe->icmp_seq);
+        for (int b = sizeof(*echo); b < sizeof(packet); b++) {
+            packet[b] = (uint8_t)('a' + b % 26);
+        }
+        echo->chksum = inet_chksum(packet, sizeof(packet));
+
+        probe->deadline_us = probe->start_us + (int64_t)probe->timeout_ms * 1000;
+
+        if (sendto(icmp_sock, packet, sizeof(packet), 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            char ip_address[DEVICE_IP_SIZE];
+            device_registry_format_ip(probe->ipv4, ip_address, sizeof(ip_address));
+            ESP_LOGW(TAG, "Failed to send echo request to %s: errno %d", ip_address, errno);
+            continue;
+        }
+
+        probe->pending = 1;
+    }
+}
+
+static void icmp_collect_replies(ping_probe_t* probes, int count) {
+    uint8_t buffer[64];
+
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(icmp_sock, buffer, sizeof(buffer), MSG_DONTWAIT,
+                           (struct sockaddr*)&from, &from_len);
+        if (len <= 0) {
+            break;
+        }
+
+        // Raw IPv4 sockets deliver the IP header in front of the ICMP message
+        struct ip_hdr* iphdr = (struct ip_hdr*)buffer;
+        int header_len = IPH_HL(iphdr) * 4;
+        if (len < header_len + (int)sizeof(struct icmp_echo_hdr)) {
+            continue;
+        }
+
+        struct icmp_echo_hdr* echo = (struct icmp_echo_hdr*)(buffer + header_len);
+        if (ICMPH_TYPE(echo) != ICMP_ER || ntohs(echo->id) != ICMP_ECHO_ID) {
+            continue;
+        }
+
+        uint16_t seq = ntohs(echo->seqno);
+        for (int i = 0; i < count; i++) {
+            ping_probe_t* probe = &probes[i];
+            if (probe->state == PING_PROBE_RUNNING && probe->strategy == PING_STRATEGY_ICMP &&
+                probe->pending && probe->icmp_seq == seq && probe->ipv4 == from.sin_addr.s_addr) {
+                mark_success(probe, esp_timer_get_time());
+                probe->pending = 0;
+                break;
+            }
+        }
+    }
+}
+
+static void arp_send_requests(ping_probe_t* probes, int count) {
+    arp_pass_t pass = {
+        .probes = probes,
+        .count = count,
+        .netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"),
+        .send_requests = true,
+    };
+
+    esp_netif_ip_info_t ip_info;
+    memset(&ip_info, 0, sizeof(ip_info));
+    if (pass.netif) {
+        esp_netif_get_ip_info(pass.netif, &ip_info);
+    }
+
+    int requested = 0;
+    for (int i = 0; i < count; i++) {
+        ping_probe_t* probe = &probes[i];
+        if (probe->state != PING_PROBE_QUEUED || probe->strategy != PING_STRATEGY_ARP) {
+            continue;
+        }
+
+        if (probe->ipv4 == 0) {
+            ESP_LOGW(TAG, "Probe without an IP address");
+            start_probe(probe);
+            continue;
+        }
+
+        // ARP only reaches the local subnet, anything else is pinged instead
+        if (!ARP_PROBES_SUPPORTED || ip_info.ip.addr == 0 ||
+            ((probe->ipv4 ^ ip_info.ip.addr) & ip_info.netmask.addr) != 0) {
+            char ip_address[DEVICE_IP_SIZE];
+            device_registry_format_ip(probe->ipv4, ip_address, sizeof(ip_address));
+            ESP_LOGD(TAG, "%s cannot be probed with ARP, using ICMP", ip_address);
+            probe->strategy = PING_STRATEGY_ICMP;
+            continue;
+        }
+
+        probe->pending = 1;
+        requested++;
+    }
+
+    if (requested == 0) {
+        return;
+    }
+    if (esp_netif_tcpip_exec(arp_pass, &pass) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send ARP requests");
+    }
+
+    // Started either way, unanswered requests time out
+    for (int i = 0; i < count; i++) {
+        ping_probe_t* probe = &probes[i];
+        if (probe->state == PING_PROBE_QUEUED && probe->strategy == PING_STRATEGY_ARP && probe->pending) {
+            start_probe(probe);
+            probe->deadline_us = probe->start_us + (int64_t)probe->timeout_ms * 1000;
+            probe->pending = 1;
+        }
+    }
+}
+
+static void arp_poll_cache(ping_probe_t* probes, int count) {
+    arp_pass_t pass = {
+        .probes = probes,
+        .count = count,
+        .netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"),
+        .send_requests = false,
+    };
+
+    if (pass.netif) {
+        esp_netif_tcpip_exec(arp_pass, &pass);
+    }
+}
+
+// Runs in the lwIP thread: etharp_* must not race the stack
+static esp_err_t arp_pass(void* ctx) {
+    arp_pass_t* pass = (arp_pass_t*)ctx;
+    struct netif* netif = esp_netif_get_netif_impl(pass->netif);
+    if (!netif) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    static const uint8_t any_mac[6] = {0};
+
+    for (int i = 0; i < pass->count; i++) {
+        ping_probe_t* probe = &pass->probes[i];
+        // Requests go to the probes being started, the cache is read for the running ones
+        ping_probe_state_t state = pass->send_requests ? PING_PROBE_QUEUED : PING_PROBE_RUNNING;
+        if (probe->state != state || probe->strategy != PING_STRATEGY_ARP || !probe->pending) {
+            continue;
+        }
+
+        ip4_addr_t ip;
+        ip4_addr_set_u32(&ip, probe->ipv4);
+
+        if (pass->send_requests) {
+#if ARP_PROBES_SUPPORTED
+            arp_flush_entry(netif, &ip);
+#endif
+            etharp_request(netif, &ip);
+            continue;
+        }
+
+        struct eth_addr* eth = NULL;
+        const ip4_addr_t* cached_ip = NULL;
+        if (etharp_find_addr(netif, &ip, &eth, &cached_ip) < 0 || !eth) {
+            continue;
+        }
+
+        // A different MAC means the address now belongs to another host
+        if (memcmp(probe->mac_address, any_mac, sizeof(any_mac)) == 0 ||
+            memcmp(probe->mac_address, eth->addr, sizeof(probe->mac_address)) == 0) {
+            // The time to the cache poll that saw the reply is not a round trip
+            probe->success = true;
+            probe->response_time_us = 0;
+        } else {
+            char ip_address[DEVICE_IP_SIZE];
+            device_registry_format_ip(probe->ipv4, ip_address, sizeof(ip_address));
+            ESP_LOGW(TAG, "%s answered from unexpected MAC %02x:%02x:%02x:%02x:%02x:%02x",
+                     ip_address, eth->addr[0], eth->addr[1], eth->addr[2],
+                     eth->addr[3], eth->addr[4], eth->addr[5]);
+        }
+        probe->pending = 0;
+    }
+
+    return ESP_OK;
+}
+
+#if ARP_PROBES_SUPPORTED
+// Runs in the lwIP thread: drop a resolved entry, so only a reply to the
+// request that follows resolves it again
+static void arp_flush_entry(struct netif* netif, const ip4_addr_t* ip) {
+    struct eth_addr* eth = NULL;
+    const ip4_addr_t* cached_ip = NULL;
+    if (etharp_find_addr(netif, ip, &eth, &cached_ip) < 0 || !eth) {
+        return;
+    }
+    struct eth_addr mac = *eth;
+    if (etharp_add_static_entry(ip, &mac) == ERR_OK) {
+        etharp_remove_static_entry(ip);
+    }
+}
+#endif
+
+static void start_probe(ping_probe_t* probe) {
+    probe->state = PING_PROBE_RUNNING;
+    probe->success = false;
+    probe->response_time_us = 0;
+    probe->pending = 0;
+    probe->start_us = esp_timer_get_time();
+}
+
+static void mark_success(ping_probe_t* probe, int64_t now_us) {
+    if (probe->success) {
+        return;
+    }
+
+    probe->success = true;
+    probe->response_time_us = (uint32_t)(now_us - probe->start_us);
+}
@@ -0,0 +1,52 @@
+#include "ping_result_ring.h"
+#include <string.h>
+
+#define RING_MASK               (PING_RESULT_RING_SIZE - 1)
+
+void ping_result_ring_reset(ping_result_ring_t* ring) {
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
+    atomic_store(&ring->peak, 0);
+    atomic_store(&ring->dropped, 0);
+}
+
+bool ping_result_ring_push(ping_result_ring_t* ring, const ping_result_t* result) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    // Indices run freely and wrap together, their difference is the fill level
+    unsigned queued = tail - head;
+    if (queued >= PING_RESULT_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    memcpy(&ring->entries[tail & RING_MASK], result, sizeof(*result));
+    // The entry is visible to the consumer before the new tail is
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    if (queued + 1 > atomic_load_explicit(&ring->peak, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->peak, queued + 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool ping_result_ring_pop(ping_result_ring_t* ring, ping_result_t* result_out) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(result_out, &ring->entries[head & RING_MASK], sizeof(*result_out));
+    // The slot is only reused by the producer after the copy above
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+uint32_t ping_result_ring_count(const ping_result_ring_t* ring) {
+    // Head first: the tail read after it cannot be behind it
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return tail - head;
+}
@@ -0,0 +1,125 @@
+#include "probe_stats.h"
+#include <string.h>
+#include <math.h>
+
+#define RATE_ONE                65535
+
+static const uint32_t bucket_limits_us[PROBE_STATS_BUCKETS - 1] = {
+    500, 1000, 2000, 3000, 5000, 7500, 10000, 15000, 20000, 30000, 50000, 75000, 100000, 250000,
+    PROBE_STATS_RTT_MAX_US
+};
+
+// Time constants of the success rate windows
+static const float window_tau_ms[PROBE_STATS_WINDOW_COUNT] = {
+    60000.0f, 900000.0f, 3600000.0f
+};
+
+void probe_stats_reset(probe_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void probe_stats_record(probe_stats_t* stats, bool success, uint32_t rtt_us, uint32_t now_ms) {
+    uint16_t sample = success ? RATE_ONE : 0;
+
+    if (stats->probes == 0) {
+        for (int w = 0; w < PROBE_STATS_WINDOW_COUNT; w++) {
+            stats->success_rate[w] = sample;
+        }
+    } else {
+        // Weight of the new sample grows with the time since the previous one
+        uint32_t elapsed_ms = now_ms - stats->last_sample_ms;
+        for (int w = 0; w < PROBE_STATS_WINDOW_COUNT; w++) {
+            float weight = 1.0f - expf(-(float)elapsed_ms / window_tau_ms[w]);
+            float rate = stats->success_rate[w] + ((float)sample - stats->success_rate[w]) * weight;
+            stats->success_rate[w] = (uint16_t)(rate + 0.5f);
+        }
+    }
+    stats->last_sample_ms = now_ms;
+    if (stats->probes < UINT32_MAX) {
+        stats->probes++;
+    }
+
+    // ARP presence has no RTT
+    if (!success || rtt_us == 0) {
+        return;
+    }
+
+    // Percentiles should follow the target's current path (a reboot, a sleep
+    // state, a route change), and halving also keeps the 16-bit counts bounded
+    if (stats->samples >= PROBE_STATS_WINDOW) {
+        uint32_t kept = 0;
+        for (int b = 0; b < PROBE_STATS_BUCKETS; b++) {
+            stats->buckets[b] /= 2;
+            kept += stats->buckets[b];
+        }
+        stats->samples = kept;
+    }
+
+    int bucket = 0;
+    while (bucket < PROBE_STATS_BUCKETS - 1 && rtt_us > bucket_limits_us[bucket]) {
+        bucket++;
+    }
+    stats->buckets[bucket]++;
+    stats->samples++;
+
+    // RFC 3550: J += (|D| - J) / 16, kept scaled by 16 to avoid losing the remainder
+    if (stats->last_rtt_us > 0) {
+        uint32_t delta = rtt_us > stats->last_rtt_us ? rtt_us - stats->last_rtt_us : stats->last_rtt_us - rtt_us;
+        stats->jitter_x16 += delta - ((stats->jitter_x16 + 8) >> 4);
+    }
+    stats->last_rtt_us = rtt_us > 0 ? rtt_us : 1;
+}
+
+uint32_t probe_stats_percentile(const probe_stats_t* stats, uint32_t permille) {
+    if (stats->samples == 0) {
+        return 0;
+    }
+
+    // 1-based rank of the requested sample
+    uint32_t rank = ((uint32_t)stats->samples * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint32_t below = 0;
+    for (int b = 0; b < PROBE_STATS_BUCKETS - 1; b++) {
+        uint32_t count = stats->buckets[b];
+        if (below + count >= rank) {
+            uint32_t lower = b > 0 ? bucket_limits_us[b - 1] : 0;
+            uint32_t width = bucket_limits_us[b] - lower;
+            return lower + (uint32_t)((uint64_t)width * (rank - below) / count);
+        }
+        below += count;
+    }
+    return PROBE_STATS_RTT_MAX_US;
+}
+
+void probe_stats_summarize(const probe_stats_t* stats, probe_stats_summary_t* summary_out) {
+    memset(summary_out, 0, sizeof(*summary_out));
+    summary_out->probes = stats->probes;
+    summary_out->samples = stats->samples;
+    summary_out->p50_us = probe_stats_percentile(stats, 500);
+    summary_out->p95_us = probe_stats_percentile(stats, 950);
+    summary_out->p99_us = probe_stats_percentile(stats, 990);
+    summary_out->jitter_us = (stats->jitter_x16 + 8) >> 4;
+    for (int w = 0; w < PROBE_STATS_WINDOW_COUNT; w++) {
+        summary_out->success_permille[w] = (uint16_t)(((uint32_t)stats->success_rate[w] * 1000 + RATE_ONE / 2) / RATE_ONE);
+    }
+}
+
+void probe_stats_write_json(json_writer_t* json, const probe_stats_summary_t* summary) {
+    json_writer_kv_uint(json, "probes", summary->probes);
+    json_writer_kv_uint(json, "n", summary->samples);
+    if (summary->samples > 0) {
+        json_writer_kv_uint(json, "p50_us", summary->p50_us);
+        json_writer_kv_uint(json, "p95_us", summary->p95_us);
+        json_writer_kv_uint(json, "p99_us", summary->p99_us);
+        json_writer_kv_uint(json, "jitter_us", summary->jitter_us);
+    }
+    json_writer_key(json, "success");
+    json_writer_array_begin(json);
+    for (int w = 0; w < PROBE_STATS_WINDOW_COUNT; w++) {
+        json_writer_fixed(json, summary->success_permille[w], 1);
+    }
+    json_writer_array_end(json);
+}
@@ -0,0 +1,158 @@
+#include "system_metrics.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "lwip/opt.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+
+// Tasks reported by name, ones that do not exist (yet) are skipped
+static const char* const tracked_tasks[] = {
+    "main", "ping_task", "ping_results", "mqtt_task", "wol_wake", "tiT", "esp_timer", "wifi"
+};
+
+#define TRACKED_TASK_COUNT (sizeof(tracked_tasks) / sizeof(tracked_tasks[0]))
+
+// Heaps reported, by capability
+static const struct {
+    const char* name;
+    uint32_t caps;
+} tracked_heaps[] = {
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "dma", MALLOC_CAP_DMA },
+    { "spiram", MALLOC_CAP_SPIRAM },
+};
+
+#if configGENERATE_RUN_TIME_STATS
+// Run time counters at the previous call, the percentages cover the interval in between
+static configRUN_TIME_COUNTER_TYPE last_task_runtime[TRACKED_TASK_COUNT];
+static configRUN_TIME_COUNTER_TYPE last_idle_runtime[portNUM_PROCESSORS];
+static configRUN_TIME_COUNTER_TYPE last_total_runtime = 0;
+#endif
+
+// Forward declarations
+static void write_tasks(json_writer_t* json);
+static void write_heaps(json_writer_t* json);
+static void write_lwip(json_writer_t* json);
+
+void system_metrics_write_json(json_writer_t* json) {
+    write_tasks(json);
+    write_heaps(json);
+    write_lwip(json);
+}
+
+#if configGENERATE_RUN_TIME_STATS
+// Share of elapsed run time in tenths of a percent. Unsigned differences
+// survive the counters wrapping; a re-created task reads as fully busy once.
+static int64_t runtime_permille(configRUN_TIME_COUNTER_TYPE now, configRUN_TIME_COUNTER_TYPE* last,
+                                configRUN_TIME_COUNTER_TYPE elapsed) {
+    configRUN_TIME_COUNTER_TYPE delta = now - *last;
+    *last = now;
+    if (elapsed == 0) {
+        return 0;
+    }
+    int64_t permille = (int64_t)((uint64_t)delta * 1000 / elapsed);
+    return permille > 1000 ? 1000 : permille;
+}
+#endif
+
+static void write_tasks(json_writer_t* json) {
+#if configGENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE total = portGET_RUN_TIME_COUNTER_VALUE();
+    configRUN_TIME_COUNTER_TYPE elapsed = total - last_total_runtime;
+    last_total_runtime = total;
+
+    json_writer_key(json, "cpu");
+    json_writer_array_begin(json);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        int64_t idle_permille = runtime_permille(ulTaskGetRunTimeCounter(idle), &last_idle_runtime[core], elapsed);
+        json_writer_fixed(json, 1000 - idle_permille, 1);
+    }
+    json_writer_array_end(json);
+#endif
+
+    json_writer_key(json, "tasks");
+    json_writer_object_begin(json);
+    for (size_t i = 0; i < TRACKED_TASK_COUNT; i++) {
+        TaskHandle_t task = xTaskGetHandle(tracked_tasks[i]);
+        if (!task) {
+            continue;
+        }
+        json_writer_key(json, tracked_tasks[i]);
+        json_writer_object_begin(json);
+#if configGENERATE_RUN_TIME_STATS
+        json_writer_key(json, "cpu");
+        json_writer_fixed(json, runtime_permille(ulTaskGetRunTimeCounter(task), &last_task_runtime[i], elapsed), 1);
+#endif
+        // ESP-IDF reports the high-water mark in bytes
+        json_writer_kv_uint(json, "stack", uxTaskGetStackHighWaterMark(task));
+        json_writer_object_end(json);
+    }
+    json_writer_object_end(json);
+}
+
+static void write_heaps(json_writer_t* json) {
+    json_writer_key(json, "heap");
+    json_writer_object_begin(json);
+    for (size_t i = 0; i < sizeof(tracked_heaps) / sizeof(tracked_heaps[0]); i++) {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, tracked_heaps[i].caps);
+        size_t total = info.total_free_bytes + info.total_allocated_bytes;
+        if (total == 0) {
+            continue;
+        }
+        json_writer_key(json, tracked_heaps[i].name);
+        json_writer_object_begin(json);
+        json_writer_kv_uint(json, "free", info.total_free_bytes);
+        json_writer_kv_uint(json, "min", info.minimum_free_bytes);
+        json_writer_kv_uint(json, "largest", info.largest_free_block);
+        json_writer_kv_uint(json, "frag", info.total_free_bytes > 0 ?
+                            100 - (uint64_t)info.largest_free_block * 100 / info.total_free_bytes : 0);
+        json_writer_object_end(json);
+    }
+    json_writer_object_end(json);
+}
+
+#if LWIP_STATS && MEMP_STATS
+static void write_pool(json_writer_t* json, const char* key, const struct stats_mem* pool) {
+    if (!pool) {
+        return;
+    }
+    json_writer_key(json, key);
+    json_writer_object_begin(json);
+    json_writer_kv_uint(json, "used", pool->used);
+    json_writer_kv_uint(json, "max", pool->max);
+    json_writer_kv_uint(json, "err", pool->err);
+    json_writer_object_end(json);
+}
+#endif
+
+static void write_lwip(json_writer_t* json) {
+    // A descriptor is open when fcntl() accepts it; lwIP numbers its sockets
+    // from LWIP_SOCKET_OFFSET
+    int sockets = 0;
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+        if (lwip_fcntl(fd, F_GETFL, 0) >= 0) {
+            sockets++;
+        }
+    }
+
+    json_writer_key(json, "lwip");
+    json_writer_object_begin(json);
+    json_writer_kv_int(json, "sockets", sockets);
+    json_writer_kv_int(json, "max_sockets", CONFIG_LWIP_MAX_SOCKETS);
+#if LWIP_STATS && MEMP_STATS
+    write_pool(json, "pbuf", lwip_stats.memp[MEMP_PBUF]);
+#if LWIP_TCP
+    write_pool(json, "tcp_pcb", lwip_stats.memp[MEMP_TCP_PCB]);
+    write_pool(json, "tcp_seg", lwip_stats.memp[MEMP_TCP_SEG]);
+#endif
+#if LWIP_UDP
+    write_pool(json, "udp_pcb", lwip_stats.memp[MEMP_UDP_PCB]);
+#endif
+#endif
+    json_writer_object_end(json);
+}
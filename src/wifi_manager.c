@@ -3,16 +3,57 @@
 #include "esp_wifi.h"
 #include "esp_netif.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_mac.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include <string.h>
+#include <inttypes.h>
 
 static const char *TAG = "WIFI_MANAGER";
 
+// Last good access point, kept in NVS for the fast-connect path
+#define WIFI_NVS_NAMESPACE     "wifi_mgr"
+#define WIFI_NVS_KEY_AP        "last_ap"
+#define WIFI_AP_CACHE_VERSION  1
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];                   // SSID the entry belongs to
+} wifi_ap_cache_t;
+
 // FreeRTOS event group to signal when we are connected
 static EventGroupHandle_t s_wifi_event_group = NULL;
 static int s_retry_num = 0;
 static bool s_initialized = false;
+static wifi_connection_callback_t s_connection_callback = NULL;
+static esp_netif_t* s_sta_netif = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+
+static wifi_ap_cache_t s_ap_cache;
+static bool s_ap_cache_valid = false;
+static bool s_fast_connect = false;   // Current config targets the cached BSSID and channel
+
+// Reconnect timing, only touched from the event loop task
+static int64_t s_start_us = 0;
+static int64_t s_link_lost_us = 0;    // When the last connection was lost, 0 while connected
+static bool s_ever_connected = false;
+static wifi_manager_stats_t s_stats;
+
+// Forward declarations
+static void apply_sta_config(bool fast_connect);
+static void load_ap_cache(void);
+static void save_ap_cache(void);
+static void schedule_reconnect(void);
+static void retry_timer_callback(void* arg);
+#ifdef WIFI_STATIC_IP
+static void apply_static_ip(void);
+#endif
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data)
@@ -20,42 +61,108 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < WIFI_RETRY_COUNT) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
+        bool was_connected = (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) != 0;
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        if (was_connected) {
+            s_link_lost_us = esp_timer_get_time();
+            s_retry_num = 0;
+            if (s_connection_callback) {
+                s_connection_callback(false);
+            }
+
+            // Most drops are the same AP coming back, try it directly first
+            if (s_ap_cache_valid && !s_fast_connect) {
+                apply_sta_config(true);
+            }
+        }
+
+        s_retry_num++;
+        s_stats.retry_attempts++;
+
+        // The cached AP may have moved channel or been replaced, scan normally instead
+        if (s_fast_connect && s_retry_num >= WIFI_FAST_CONNECT_TRIES) {
+            ESP_LOGW(TAG, "Fast connect to cached AP failed, falling back to a full scan");
+            apply_sta_config(false);
+        }
+
+        // Tells a blocking wifi_manager_init() to give up; retries carry on regardless
+        if (s_retry_num == WIFI_RETRY_COUNT) {
             xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
         }
+
         ESP_LOGI(TAG, "connect to the AP fail");
+        schedule_reconnect();
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
                  WIFI_SSID, WIFI_PASSWORD);
+
+        int64_t now = esp_timer_get_time();
+        if (!s_ever_connected) {
+            s_stats.initial_connect_ms = (uint32_t)((now - s_start_us) / 1000);
+            ESP_LOGI(TAG, "Connected in %" PRIu32 " ms (%s)", s_stats.initial_connect_ms,
+                     s_fast_connect ? "fast connect" : "scan");
+        } else if (s_link_lost_us > 0) {
+            uint32_t elapsed_ms = (uint32_t)((now - s_link_lost_us) / 1000);
+            s_stats.reconnect_count++;
+            s_stats.last_reconnect_ms = elapsed_ms;
+            if (elapsed_ms > s_stats.max_reconnect_ms) {
+                s_stats.max_reconnect_ms = elapsed_ms;
+            }
+            ESP_LOGI(TAG, "Reconnected in %" PRIu32 " ms after %d attempts (%s)", elapsed_ms, s_retry_num,
+                     s_fast_connect ? "fast connect" : "scan");
+        }
+        s_stats.fast_connect = s_fast_connect;
+        s_ever_connected = true;
+        s_link_lost_us = 0;
         s_retry_num = 0;
+
+        save_ap_cache();
+
+        xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        if (s_connection_callback) {
+            s_connection_callback(true);
+        }
     }
 }
 
-esp_err_t wifi_manager_init(void)
+void wifi_manager_set_connection_callback(wifi_connection_callback_t callback)
+{
+    s_connection_callback = callback;
+}
+
+esp_err_t wifi_manager_start(void)
 {
     if (s_initialized) {
         ESP_LOGW(TAG, "WiFi manager already initialized");
         return ESP_OK;
     }
 
-    esp_err_t ret = ESP_OK;
-    
     s_wifi_event_group = xEventGroupCreate();
     if (s_wifi_event_group == NULL) {
         ESP_LOGE(TAG, "Failed to create event group");
         return ESP_FAIL;
     }
 
+    const esp_timer_create_args_t retry_timer_args = {
+        .callback = retry_timer_callback,
+        .name = "wifi_retry",
+    };
+    if (esp_timer_create(&retry_timer_args, &s_retry_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create retry timer");
+        vEventGroupDelete(s_wifi_event_group);
+        s_wifi_event_group = NULL;
+        return ESP_FAIL;
+    }
+
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
+#ifdef WIFI_STATIC_IP
+    apply_static_ip();
+#endif
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -73,23 +180,26 @@ esp_err_t wifi_manager_init(void)
                                                         NULL,
                                                         &instance_got_ip));
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASSWORD,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-        },
-    };
-    
+    load_ap_cache();
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    apply_sta_config(s_ap_cache_valid);
+
+    s_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_POWER_SAVE));
 
+    s_initialized = true;
     ESP_LOGI(TAG, "wifi_init_sta finished.");
+    return ESP_OK;
+}
+
+esp_err_t wifi_manager_init(void)
+{
+    esp_err_t ret = wifi_manager_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
@@ -101,7 +211,6 @@ esp_err_t wifi_manager_init(void)
      * happened. */
     if (bits & WIFI_CONNECTED_BIT) {
         ESP_LOGI(TAG, "connected to ap SSID:%s password:%s", WIFI_SSID, WIFI_PASSWORD);
-        s_initialized = true;
         ret = ESP_OK;    } else if (bits & WIFI_FAIL_BIT) {
         ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s", WIFI_SSID, WIFI_PASSWORD);
         ret = ESP_FAIL;
@@ -118,13 +227,38 @@ bool wifi_manager_is_connected(void)
     if (!s_initialized || s_wifi_event_group == NULL) {
         return false;
     }
-    
+
     EventBits_t bits = xEventGroupGetBits(s_wifi_event_group);
     return (bits & WIFI_CONNECTED_BIT) != 0;
 }
 
+uint32_t wifi_manager_get_broadcast_ipv4(void)
+{
+    if (!wifi_manager_is_connected() || s_sta_netif == NULL) {
+        return 0;
+    }
+
+    esp_netif_ip_info_t ip_info;
+    if (esp_netif_get_ip_info(s_sta_netif, &ip_info) != ESP_OK || ip_info.netmask.addr == 0) {
+        return 0;
+    }
+    return ip_info.ip.addr | ~ip_info.netmask.addr;
+}
+
+void wifi_manager_get_stats(wifi_manager_stats_t* stats)
+{
+    if (stats) {
+        *stats = s_stats;
+    }
+}
+
 void wifi_manager_deinit(void)
 {
+    if (s_retry_timer) {
+        esp_timer_stop(s_retry_timer);
+        esp_timer_delete(s_retry_timer);
+        s_retry_timer = NULL;
+    }
     if (s_wifi_event_group) {
         vEventGroupDelete(s_wifi_event_group);
         s_wifi_event_group = NULL;
@@ -132,3 +266,134 @@ void wifi_manager_deinit(void)
     s_initialized = false;
     ESP_LOGI(TAG, "WiFi manager deinitialized");
 }
+
+// Private functions
+static void apply_sta_config(bool fast_connect)
+{
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASSWORD,
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .listen_interval = WIFI_LISTEN_INTERVAL,
+            .pmf_cfg = {
+                .capable = true,
+                .required = false
+            },
+        },
+    };
+
+    // Known BSSID and channel: associate directly, no scan across channels
+    if (fast_connect) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_ap_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = s_ap_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        ESP_LOGI(TAG, "Fast connect to " MACSTR " on channel %d", MAC2STR(s_ap_cache.bssid), s_ap_cache.channel);
+    }
+
+    s_fast_connect = fast_connect;
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+}
+
+static void load_ap_cache(void)
+{
+    nvs_handle_t handle;
+    s_ap_cache_valid = false;
+
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+
+    size_t size = sizeof(s_ap_cache);
+    esp_err_t ret = nvs_get_blob(handle, WIFI_NVS_KEY_AP, &s_ap_cache, &size);
+    nvs_close(handle);
+
+    // An entry for another network (SSID changed in secrets.h) is useless
+    s_ap_cache_valid = (ret == ESP_OK && size == sizeof(s_ap_cache) &&
+                        s_ap_cache.version == WIFI_AP_CACHE_VERSION &&
+                        s_ap_cache.channel != 0 &&
+                        strncmp(s_ap_cache.ssid, WIFI_SSID, sizeof(s_ap_cache.ssid)) == 0);
+}
+
+static void save_ap_cache(void)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    // Only write when the AP changed, flash writes are not free
+    if (s_ap_cache_valid && s_ap_cache.channel == ap.primary &&
+        memcmp(s_ap_cache.bssid, ap.bssid, sizeof(ap.bssid)) == 0) {
+        return;
+    }
+
+    memset(&s_ap_cache, 0, sizeof(s_ap_cache));
+    s_ap_cache.version = WIFI_AP_CACHE_VERSION;
+    s_ap_cache.channel = ap.primary;
+    memcpy(s_ap_cache.bssid, ap.bssid, sizeof(ap.bssid));
+    strncpy(s_ap_cache.ssid, WIFI_SSID, sizeof(s_ap_cache.ssid) - 1);
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot open NVS, AP not cached");
+        return;
+    }
+    esp_err_t ret = nvs_set_blob(handle, WIFI_NVS_KEY_AP, &s_ap_cache, sizeof(s_ap_cache));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    s_ap_cache_valid = (ret == ESP_OK);
+    if (s_ap_cache_valid) {
+        ESP_LOGI(TAG, "Cached AP " MACSTR " on channel %d", MAC2STR(ap.bssid), ap.primary);
+    }
+}
+
+// Jittered exponential backoff, never gives up
+static void schedule_reconnect(void)
+{
+    int shift = s_retry_num > 1 ? s_retry_num - 1 : 0;
+    uint32_t delay_ms = WIFI_RECONNECT_MAX_MS;
+    if (shift < 16 && ((uint32_t)WIFI_RECONNECT_MIN_MS << shift) < WIFI_RECONNECT_MAX_MS) {
+        delay_ms = (uint32_t)WIFI_RECONNECT_MIN_MS << shift;
+    }
+
+    // Between half and all of the step, so devices behind one AP don't retry in lockstep
+    delay_ms = delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+
+    ESP_LOGI(TAG, "retry to connect to the AP in %" PRIu32 " ms (attempt %d)", delay_ms, s_retry_num);
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+static void retry_timer_callback(void* arg)
+{
+    esp_wifi_connect();
+}
+
+#ifdef WIFI_STATIC_IP
+static void apply_static_ip(void)
+{
+    esp_netif_ip_info_t ip_info = { 0 };
+    ip_info.ip.addr = esp_ip4addr_aton(WIFI_STATIC_IP);
+    ip_info.gw.addr = esp_ip4addr_aton(WIFI_STATIC_GATEWAY);
+    ip_info.netmask.addr = esp_ip4addr_aton(WIFI_STATIC_NETMASK);
+
+    // No DHCP round trips: the IP is usable as soon as the link is up
+    esp_netif_dhcpc_stop(s_sta_netif);
+    if (esp_netif_set_ip_info(s_sta_netif, &ip_info) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set static IP %s, using DHCP", WIFI_STATIC_IP);
+        esp_netif_dhcpc_start(s_sta_netif);
+        return;
+    }
+
+    esp_netif_dns_info_t dns = { 0 };
+    dns.ip.u_addr.ip4.addr = esp_ip4addr_aton(WIFI_STATIC_DNS);
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    ESP_LOGI(TAG, "Using static IP %s", WIFI_STATIC_IP);
+}
+#endif
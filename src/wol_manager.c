@@ -8,11 +8,20 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "string.h"
-#include "cJSON.h"
+#include <stdlib.h>
+#include "nvs.h"
+#include "esp_crc.h"
+#include "json_writer.h"
+#include "wifi_manager.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <ctype.h>
 
 static const char *TAG = "WOL_MANAGER";
 
-// Device list storage
+// Device list storage, indexed by registry slot (unused slots have an invalid handle)
 static wol_device_t devices[MAX_DEVICES];
 static int device_count = 0;
 static bool initialized = false;
@@ -20,6 +29,137 @@ static bool initialized = false;
 // Mutex for thread safety
 static SemaphoreHandle_t device_mutex = NULL;
 
+// Magic packet of the last MAC sent and the broadcast socket, both kept
+// across wakes and guarded by send_mutex
+static uint8_t magic_packet[WOL_PACKET_SIZE];
+static uint8_t magic_packet_mac[6];
+static bool magic_packet_valid = false;
+static int wol_socket = -1;
+static SemaphoreHandle_t send_mutex = NULL;
+
+// Device groups and the group wake queue, guarded by device_mutex
+typedef struct {
+    char name[DEVICE_NAME_SIZE];    // Empty for an unused entry
+    bool waking;                    // A group wake is in progress
+    uint16_t unresolved;            // Members of the wake without a final result
+    uint32_t started_ms;            // When the wake was requested
+    uint32_t deadline_ms;           // Members still unresolved here are reported as pending
+} wol_group_t;
+
+static wol_group_t groups[WOL_MAX_GROUPS];
+static device_handle_t wake_queue[MAX_DEVICES];   // Each device is queued at most once
+static int wake_queue_head = 0;
+static int wake_queue_count = 0;
+static TaskHandle_t wake_task_handle = NULL;
+
+// Pending save of the device table, guarded by device_mutex
+static bool config_dirty = false;
+static uint32_t config_dirty_since_ms = 0;      // First edit since the last save
+static uint32_t config_changed_ms = 0;          // Latest edit
+static uint32_t saved_config_crc = 0;           // CRC and size of the blob in NVS, to skip rewrites
+static size_t saved_config_size = 0;
+
+// Saved device table: a header, the group names by index, then one record
+// per device followed by its name and description (not NUL terminated)
+typedef struct __attribute__((packed)) {
+    uint32_t magic;                 // WOL_CONFIG_MAGIC
+    uint16_t version;               // WOL_CONFIG_VERSION
+    uint16_t device_count;
+    uint16_t group_count;           // Group name slots that follow, unused ones are empty
+    uint16_t reserved;
+    uint32_t crc;                   // CRC32 of everything after the header
+} wol_config_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t ipv4;                  // Network byte order
+    uint8_t mac_address[6];
+    uint16_t wol_port;
+    uint16_t groups;
+    uint8_t enabled;
+    uint8_t name_len;
+    uint8_t description_len;
+    // Version 2; version 1 records end here and are probed with ICMP
+    uint8_t strategy;               // ping_strategy_t
+    uint8_t port_count;
+    uint16_t ports[PING_MAX_PORTS];
+    // Version 3; earlier records use the default intervals
+    uint32_t interval_ms;
+    uint32_t max_interval_ms;
+} wol_config_record_t;
+
+#define WOL_CONFIG_RECORD_V1_SIZE   offsetof(wol_config_record_t, strategy)
+#define WOL_CONFIG_RECORD_V2_SIZE   offsetof(wol_config_record_t, interval_ms)
+
+// One device of a provisioning batch or of the saved table, applied by
+// apply_device_records()
+typedef struct {
+    char name[DEVICE_NAME_SIZE];
+    char description[DEVICE_DESCRIPTION_SIZE];
+    bool has_description;           // Otherwise an existing description is kept
+    bool remove;
+    bool enabled;                   // Restored tables only
+    uint16_t groups;                // Restored tables only
+    uint32_t ipv4;                  // Network byte order
+    uint8_t mac_address[6];
+    uint16_t wol_port;
+    ping_probe_config_t probe;
+} device_record_t;
+
+// Why a provisioning line was rejected
+typedef struct {
+    int line;
+    const char* error;
+} provision_error_t;
+
+// What esp32/device/<name>/status reports, copied out under device_mutex
+// so the publish runs without it
+typedef struct {
+    device_status_t status;
+    bool enabled;
+    uint32_t last_ping_time;
+} device_status_snapshot_t;
+
+// Forward declarations
+static void wol_monitor_device(const char* name, const char* ip_address, const uint8_t* mac_address);
+static wol_device_t* device_for_handle(device_handle_t handle);
+static device_status_t debounced_status(const wol_device_t* device, uint32_t now_ms);
+static void prepare_magic_packet(const uint8_t* mac_address);
+static esp_err_t send_magic_packet(uint32_t dest_ipv4, uint16_t port);
+static int send_wake_burst(const uint8_t* mac_address, uint16_t port);
+static void publish_wake_result(device_handle_t handle, bool woke, uint32_t elapsed_ms);
+static void snapshot_device_status(const wol_device_t* device, device_status_snapshot_t* snapshot);
+static esp_err_t publish_device_status(device_handle_t handle, const device_status_snapshot_t* snapshot,
+                                       bool with_enabled);
+static esp_err_t wake_device(device_handle_t handle, bool announce, int* sent_out);
+static void wol_wake_task(void* arg);
+static void wake_group_member(device_handle_t handle);
+static void resolve_group_member(wol_device_t* device, wol_wake_result_t result, uint32_t elapsed_ms);
+static void finish_group_wake(int group);
+static esp_err_t publish_group_status(int group);
+static int find_group_locked(const char* group, int len);
+static uint32_t uptime_ms(void);
+static void config_changed(void);
+static void ping_config_changed(device_handle_t handle, void* user_data);
+static esp_err_t load_saved_config(void);
+static uint8_t* encode_config_locked(size_t* size_out);
+static const uint8_t* next_config_record(const uint8_t* pos, const uint8_t* end, size_t record_size,
+                                         wol_config_record_t* record);
+static int clear_device_locked(wol_device_t* device);
+static esp_err_t apply_device_records(const device_record_t* records, int count, bool restore, uint8_t* outcomes);
+static const char* parse_device_line(const char* line, int len, device_record_t* record);
+static bool parse_mac(const mqtt_slice_t* text, uint8_t* mac_address);
+static bool parse_port(const mqtt_slice_t* text, uint16_t* port);
+static bool parse_probe(const mqtt_slice_t* text, ping_probe_config_t* probe);
+static void publish_provision_ack(const device_record_t* records, const uint8_t* outcomes, int count,
+                                  esp_err_t result, const provision_error_t* errors, int error_count);
+
+#if WOL_STATUS_WINDOW < 1 || WOL_STATUS_WINDOW > 16
+#error "WOL_STATUS_WINDOW must be between 1 and 16"
+#endif
+#if WOL_STATUS_OFFLINE_THRESHOLD > WOL_STATUS_WINDOW || WOL_STATUS_ONLINE_THRESHOLD > WOL_STATUS_WINDOW
+#error "WoL status thresholds cannot exceed WOL_STATUS_WINDOW"
+#endif
+
 esp_err_t wol_manager_init(void)
 {
     if (initialized) {
@@ -29,17 +169,32 @@ esp_err_t wol_manager_init(void)
 
     // Create mutex for thread safety
     device_mutex = xSemaphoreCreateMutex();
-    if (device_mutex == NULL) {
+    send_mutex = xSemaphoreCreateMutex();
+    if (device_mutex == NULL || send_mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create device mutex");
         return ESP_FAIL;
     }
 
     // Clear device list
     memset(devices, 0, sizeof(devices));
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        devices[i].handle = DEVICE_HANDLE_INVALID;
+        devices[i].wake_group = WOL_GROUP_INVALID;
+    }
     device_count = 0;
+    memset(groups, 0, sizeof(groups));
+
+    // Group wakes are sent from their own task, spaced by WOL_GROUP_STAGGER_MS.
+    // It publishes wake results, so it runs on the MQTT side with ping_results.
+    if (xTaskCreatePinnedToCore(wol_wake_task, "wol_wake", 4096, NULL, 4, &wake_task_handle,
+                                PING_RESULT_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create wake task");
+        return ESP_ERR_NO_MEM;
+    }
 
     // Load device configuration
     wol_load_device_config();
+    ping_manager_set_config_callback(ping_config_changed, NULL);
 
     initialized = true;
     ESP_LOGI(TAG, "WoL manager initialized with %d devices", device_count);
@@ -58,41 +213,41 @@ esp_err_t wol_add_device(const char* name, const char* ip_address,
         return ESP_ERR_TIMEOUT;
     }
 
-    // Check if device already exists
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            xSemaphoreGive(device_mutex);
-            ESP_LOGW(TAG, "Device %s already exists, updating", name);
-            // Update existing device
-            strncpy(devices[i].ip_address, ip_address, sizeof(devices[i].ip_address) - 1);
-            memcpy(devices[i].mac_address, mac_address, 6);
-            if (description) {
-                strncpy(devices[i].description, description, sizeof(devices[i].description) - 1);
-            }
-            return ESP_OK;
-        }
+    // Name, address and MAC are kept by the registry, an existing device keeps its handle
+    device_handle_t handle;
+    esp_err_t ret = device_registry_add(name, ip_address, mac_address, DEVICE_OWNER_WOL, &handle);
+    if (ret != ESP_OK) {
+        xSemaphoreGive(device_mutex);
+        ESP_LOGE(TAG, "Device list full or invalid, cannot add %s", name);
+        return ret;
     }
 
-    // Check if we have space for new device
-    if (device_count >= MAX_DEVICES) {
+    wol_device_t* device = &devices[DEVICE_HANDLE_SLOT(handle)];
+
+    // Check if device already exists
+    if (device->handle == handle) {
+        ESP_LOGW(TAG, "Device %s already exists, updating", name);
+        if (description) {
+            device_registry_set_description(handle, description);
+        }
+        config_changed();
         xSemaphoreGive(device_mutex);
-        ESP_LOGE(TAG, "Device list full, cannot add %s", name);
-        return ESP_ERR_NO_MEM;
+        wol_monitor_device(name, ip_address, mac_address);
+        return ESP_OK;
     }
 
     // Add new device
-    wol_device_t* device = &devices[device_count];
-    strncpy(device->name, name, sizeof(device->name) - 1);
-    strncpy(device->ip_address, ip_address, sizeof(device->ip_address) - 1);
-    memcpy(device->mac_address, mac_address, 6);
-    if (description) {
-        strncpy(device->description, description, sizeof(device->description) - 1);
-    }
+    memset(device, 0, sizeof(*device));
+    device->handle = handle;
+    device_registry_set_description(handle, description);
     device->status = DEVICE_STATUS_UNKNOWN;
+    device->wake_group = WOL_GROUP_INVALID;
     device->last_ping_time = 0;
-    device->enabled = true;    device->wol_port = 9; // Default WoL port
+    device->enabled = true;
+    device->wol_port = 9; // Default WoL port
     
     device_count++;
+    config_changed();
     
     xSemaphoreGive(device_mutex);
     
@@ -102,7 +257,7 @@ esp_err_t wol_add_device(const char* name, const char* ip_address,
              mac_address[3], mac_address[4], mac_address[5]);
     
     // Automatically add to ping monitoring
-    ping_manager_add_device(name, ip_address);
+    wol_monitor_device(name, ip_address, mac_address);
     
     return ESP_OK;
 }
@@ -118,26 +273,28 @@ esp_err_t wol_remove_device(const char* name)
     }
 
     // Find device
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            // Shift remaining devices
-            for (int j = i; j < device_count - 1; j++) {
-                devices[j] = devices[j + 1];
-            }
-            device_count--;
-              xSemaphoreGive(device_mutex);
-            
-            // Remove from ping monitoring
-            ping_manager_remove_device(name);
-            
-            ESP_LOGI(TAG, "Removed device: %s", name);
-            return ESP_OK;
-        }
+    wol_device_t* device = device_for_handle(device_registry_find(name));
+    if (!device) {
+        xSemaphoreGive(device_mutex);
+        ESP_LOGW(TAG, "Device not found: %s", name);
+        return ESP_ERR_NOT_FOUND;
     }
 
+    device_handle_t handle = device->handle;
+    int done_group = clear_device_locked(device);
+    config_changed();
     xSemaphoreGive(device_mutex);
-    ESP_LOGW(TAG, "Device not found: %s", name);
-    return ESP_ERR_NOT_FOUND;
+
+    if (done_group != WOL_GROUP_INVALID) {
+        finish_group_wake(done_group);
+    }
+
+    // Remove from ping monitoring, the registry entry goes with the last reference
+    ping_manager_remove_device(name);
+    device_registry_release(handle, DEVICE_OWNER_WOL);
+
+    ESP_LOGI(TAG, "Removed device: %s", name);
+    return ESP_OK;
 }
 
 esp_err_t wol_send_packet(const uint8_t* mac_address, const char* broadcast_ip)
@@ -146,65 +303,24 @@ esp_err_t wol_send_packet(const uint8_t* mac_address, const char* broadcast_ip)
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Create WoL magic packet
-    uint8_t wol_packet[102];
-    int packet_index = 0;
-
-    // Fill first 6 bytes with 0xFF
-    for (int i = 0; i < 6; i++) {
-        wol_packet[packet_index++] = 0xFF;
-    }
-
-    // Repeat MAC address 16 times
-    for (int i = 0; i < 16; i++) {
-        for (int j = 0; j < 6; j++) {
-            wol_packet[packet_index++] = mac_address[j];
-        }
-    }
-
-    // Create UDP socket
-    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock < 0) {
-        ESP_LOGE(TAG, "Failed to create socket");
-        return ESP_FAIL;
-    }
-
-    // Enable broadcast
-    int broadcast_enable = 1;
-    if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable)) < 0) {
-        ESP_LOGE(TAG, "Failed to enable broadcast");
-        close(sock);
-        return ESP_FAIL;
+    uint32_t dest_ipv4 = htonl(INADDR_BROADCAST);
+    if (broadcast_ip && inet_pton(AF_INET, broadcast_ip, &dest_ipv4) <= 0) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Set destination address
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(9); // WoL port
-    
-    if (broadcast_ip) {
-        inet_pton(AF_INET, broadcast_ip, &dest_addr.sin_addr);
-    } else {
-        dest_addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    if (xSemaphoreTake(send_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
     }
+    prepare_magic_packet(mac_address);
+    esp_err_t ret = send_magic_packet(dest_ipv4, 9);
+    xSemaphoreGive(send_mutex);
 
-    // Send packet
-    int bytes_sent = sendto(sock, wol_packet, sizeof(wol_packet), 0, 
-                           (struct sockaddr*)&dest_addr, sizeof(dest_addr));
-    
-    close(sock);
-
-    if (bytes_sent < 0) {
-        ESP_LOGE(TAG, "Failed to send WoL packet");
-        return ESP_FAIL;
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "WoL packet sent to %02x:%02x:%02x:%02x:%02x:%02x",
+                 mac_address[0], mac_address[1], mac_address[2],
+                 mac_address[3], mac_address[4], mac_address[5]);
     }
-
-    ESP_LOGI(TAG, "WoL packet sent (%d bytes) to %02x:%02x:%02x:%02x:%02x:%02x", 
-             bytes_sent,
-             mac_address[0], mac_address[1], mac_address[2], 
-             mac_address[3], mac_address[4], mac_address[5]);
-    
-    return ESP_OK;
+    return ret;
 }
 
 esp_err_t wol_wake_device(const char* name)
@@ -213,101 +329,65 @@ esp_err_t wol_wake_device(const char* name)
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        return ESP_ERR_TIMEOUT;
+    device_handle_t handle = device_registry_find(name);
+    if (handle == DEVICE_HANDLE_INVALID) {
+        ESP_LOGE(TAG, "Device not found: %s", name);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    // Find device
-    wol_device_t* device = NULL;
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            device = &devices[i];
-            break;
-        }
+    return wake_device(handle, true, NULL);
+}
+
+esp_err_t wol_update_device_status(device_handle_t handle, bool is_online)
+{
+    // Wakes reset the history and removals reuse the slot from other tasks,
+    // so the history is updated under the mutex
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
     }
 
+    wol_device_t* device = device_for_handle(handle);
     if (!device) {
         xSemaphoreGive(device_mutex);
-        ESP_LOGE(TAG, "Device not found: %s", name);
         return ESP_ERR_NOT_FOUND;
     }
 
-    if (!device->enabled) {
-        xSemaphoreGive(device_mutex);
-        ESP_LOGW(TAG, "Device %s is disabled", name);
-        return ESP_ERR_INVALID_STATE;
+    uint32_t now_ms = uptime_ms();
+    device->history = (device->history << 1) | (is_online ? 1 : 0);
+    if (device->history_len < WOL_STATUS_WINDOW) {
+        device->history_len++;
     }
-
-    // Update device status to waking
-    device->status = DEVICE_STATUS_WAKING;
-
-    // Get device info for WoL
-    uint8_t mac[6];
-    memcpy(mac, device->mac_address, 6);
-    
-    xSemaphoreGive(device_mutex);
-
-    // Send WoL packet
-    esp_err_t result = wol_send_packet(mac, NULL);
-    
-    if (result == ESP_OK) {
-        ESP_LOGI(TAG, "Wake-on-LAN sent to device: %s", name);
-        
-        // Publish MQTT status
-        char topic[64];
-        char message[128];
-        snprintf(topic, sizeof(topic), "esp32/wol/%s/status", name);
-        snprintf(message, sizeof(message), "{\"device\":\"%s\",\"action\":\"wake_sent\",\"timestamp\":%lu}", 
-                 name, (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS / 1000));
-        mqtt_publish(topic, message);
+    if (is_online) {
+        device->last_ping_time = xTaskGetTickCount() * portTICK_PERIOD_MS / 1000;
     }
-    
-    return result;
-}
 
-esp_err_t wol_update_device_status(const char* name, bool is_online)
-{
-    if (!name) {
-        return ESP_ERR_INVALID_ARG;
+    device_status_t old_status = device->status;
+    device_status_t new_status = debounced_status(device, now_ms);
+    uint32_t since_wake_ms = now_ms - device->wake_time_ms;
+    device_status_snapshot_t snapshot;
+    if (old_status != new_status) {
+        device->status = new_status;
+        snapshot_device_status(device, &snapshot);
     }
+    
+    xSemaphoreGive(device_mutex);
 
-    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        return ESP_ERR_TIMEOUT;
+    if (old_status == new_status) {
+        return ESP_OK;
     }
 
-    // Find device
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            device_status_t old_status = devices[i].status;
-            devices[i].status = is_online ? DEVICE_STATUS_ONLINE : DEVICE_STATUS_OFFLINE;
-            
-            if (is_online) {
-                devices[i].last_ping_time = xTaskGetTickCount() * portTICK_PERIOD_MS / 1000;
-            }
+    // Log status change and publish it
+    char name[DEVICE_NAME_SIZE];
+    device_registry_copy_name(handle, name, sizeof(name));
+    ESP_LOGI(TAG, "Device %s status changed: %s -> %s", name,
+             wol_get_status_string(old_status), wol_get_status_string(new_status));
+    publish_device_status(handle, &snapshot, false);
 
-            // Log status change
-            if (old_status != devices[i].status) {
-                ESP_LOGI(TAG, "Device %s status changed: %s -> %s", 
-                         name, wol_get_status_string(old_status), wol_get_status_string(devices[i].status));
-                
-                // Publish MQTT status update
-                char topic[64];
-                char message[256];
-                snprintf(topic, sizeof(topic), "esp32/device/%s/status", name);
-                snprintf(message, sizeof(message), 
-                         "{\"device\":\"%s\",\"status\":\"%s\",\"ip\":\"%s\",\"timestamp\":%lu}", 
-                         name, wol_get_status_string(devices[i].status), 
-                         devices[i].ip_address, devices[i].last_ping_time);
-                mqtt_publish(topic, message);
-            }
-            
-            xSemaphoreGive(device_mutex);
-            return ESP_OK;
-        }
+    // A wake that ended either way, report how long it took
+    if (old_status == DEVICE_STATUS_WAKING && new_status != DEVICE_STATUS_WAKING) {
+        publish_wake_result(handle, new_status == DEVICE_STATUS_ONLINE, since_wake_ms);
     }
-
-    xSemaphoreGive(device_mutex);
-    return ESP_ERR_NOT_FOUND;
+    return ESP_OK;
 }
 
 const wol_device_t* wol_get_device(const char* name)
@@ -316,21 +396,22 @@ const wol_device_t* wol_get_device(const char* name)
         return NULL;
     }
 
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            return &devices[i];
-        }
-    }
-    
-    return NULL;
+    return device_for_handle(device_registry_find(name));
 }
 
-const wol_device_t* wol_get_all_devices(int* device_count_out)
+const wol_device_t* wol_get_device_by_handle(device_handle_t handle)
 {
-    if (device_count_out) {
-        *device_count_out = device_count;
-    }
-    return devices;
+    return device_for_handle(handle);
+}
+
+device_handle_t wol_next_device(device_handle_t after)
+{
+    return device_registry_next(after, DEVICE_OWNER_WOL);
+}
+
+int wol_get_device_count(void)
+{
+    return device_count;
 }
 
 esp_err_t wol_set_device_enabled(const char* name, bool enabled)
@@ -343,17 +424,17 @@ esp_err_t wol_set_device_enabled(const char* name, bool enabled)
         return ESP_ERR_TIMEOUT;
     }
 
-    for (int i = 0; i < device_count; i++) {
-        if (strcmp(devices[i].name, name) == 0) {
-            devices[i].enabled = enabled;
-            xSemaphoreGive(device_mutex);
-            ESP_LOGI(TAG, "Device %s %s", name, enabled ? "enabled" : "disabled");
-            return ESP_OK;
-        }
+    wol_device_t* device = device_for_handle(device_registry_find(name));
+    if (!device) {
+        xSemaphoreGive(device_mutex);
+        return ESP_ERR_NOT_FOUND;
     }
 
+    device->enabled = enabled;
+    config_changed();
     xSemaphoreGive(device_mutex);
-    return ESP_ERR_NOT_FOUND;
+    ESP_LOGI(TAG, "Device %s %s", name, enabled ? "enabled" : "disabled");
+    return ESP_OK;
 }
 
 const char* wol_get_status_string(device_status_t status)
@@ -366,32 +447,33 @@ const char* wol_get_status_string(device_status_t status)
     }
 }
 
-esp_err_t wol_handle_mqtt_command(const char* device_name, const char* command)
+esp_err_t wol_handle_mqtt_command(device_handle_t handle, const char* command)
 {
-    if (!device_name || !command) {
+    if (!command) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    char device_name[DEVICE_NAME_SIZE];
+    if (device_registry_copy_name(handle, device_name, sizeof(device_name)) != ESP_OK ||
+        !device_for_handle(handle)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
     ESP_LOGI(TAG, "MQTT WoL command: %s -> %s", device_name, command);
 
     if (strcmp(command, "on") == 0 || strcmp(command, "wake") == 0) {
         return wol_wake_device(device_name);
     } else if (strcmp(command, "status") == 0) {
-        const wol_device_t* device = wol_get_device(device_name);
+        if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        const wol_device_t* device = device_for_handle(handle);
+        device_status_snapshot_t snapshot;
         if (device) {
-            char topic[64];
-            char message[256];
-            snprintf(topic, sizeof(topic), "esp32/device/%s/status", device_name);
-            snprintf(message, sizeof(message), 
-                     "{\"device\":\"%s\",\"status\":\"%s\",\"ip\":\"%s\",\"enabled\":%s,\"timestamp\":%lu}", 
-                     device->name, wol_get_status_string(device->status), 
-                     device->ip_address, device->enabled ? "true" : "false",
-                     device->last_ping_time);
-            mqtt_publish(topic, message);
-            return ESP_OK;
-        } else {
-            return ESP_ERR_NOT_FOUND;
+            snapshot_device_status(device, &snapshot);
         }
+        xSemaphoreGive(device_mutex);
+        return device ? publish_device_status(handle, &snapshot, true) : ESP_ERR_NOT_FOUND;
     } else if (strcmp(command, "enable") == 0) {
         return wol_set_device_enabled(device_name, true);
     } else if (strcmp(command, "disable") == 0) {
@@ -402,26 +484,1584 @@ esp_err_t wol_handle_mqtt_command(const char* device_name, const char* command)
     return ESP_ERR_INVALID_ARG;
 }
 
-// Default device configuration
-esp_err_t wol_load_device_config(void)
+esp_err_t wol_add_device_to_group(const char* name, const char* group)
 {
-    ESP_LOGI(TAG, "Loading default device configuration");
-    
-    // Example devices - you can modify these or load from NVS/file
-    uint8_t mac1[] = {0xC0, 0x18, 0x50, 0xAC, 0xE1, 0xA5};
-    uint8_t mac2[] = {0x00, 0x50, 0x56, 0xAB, 0xCD, 0xEF};
-    //uint8_t mac3[] = {0x08, 0x00, 0x27, 0x12, 0x34, 0x56};
-    
-    wol_add_device("server1", "192.168.0.111", mac1, "Main Server");
-    wol_add_device("desktop1", "192.168.0.112", mac2, "Development Desktop");
-    wol_add_device("nas1", "192.168.0.2", mac1, "Network Attached Storage");
-    
+    if (!name || !group || group[0] == '\0' || strlen(group) >= DEVICE_NAME_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    wol_device_t* device = device_for_handle(device_registry_find(name));
+    if (!device) {
+        xSemaphoreGive(device_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int index = find_group_locked(group, strlen(group));
+    if (index == WOL_GROUP_INVALID) {
+        for (int i = 0; i < WOL_MAX_GROUPS; i++) {
+            if (groups[i].name[0] == '\0') {
+                memset(&groups[i], 0, sizeof(groups[i]));
+                strcpy(groups[i].name, group);
+                index = i;
+                break;
+            }
+        }
+    }
+    if (index == WOL_GROUP_INVALID) {
+        xSemaphoreGive(device_mutex);
+        ESP_LOGE(TAG, "Too many groups, cannot add %s to %s", name, group);
+        return ESP_ERR_NO_MEM;
+    }
+
+    device->groups |= 1u << index;
+    config_changed();
+    xSemaphoreGive(device_mutex);
+
+    ESP_LOGI(TAG, "Device %s added to group %s", name, group);
     return ESP_OK;
 }
 
-esp_err_t wol_save_device_config(void)
+esp_err_t wol_remove_device_from_group(const char* name, const char* group)
+{
+    if (!name || !group) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    wol_device_t* device = device_for_handle(device_registry_find(name));
+    int index = find_group_locked(group, strlen(group));
+    if (!device || index == WOL_GROUP_INVALID || !(device->groups & (1u << index))) {
+        xSemaphoreGive(device_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    device->groups &= ~(1u << index);
+    config_changed();
+
+    // Drop the group with its last member, unless a wake of it is still reporting
+    bool empty = !groups[index].waking;
+    for (int i = 0; i < MAX_DEVICES && empty; i++) {
+        if (devices[i].handle != DEVICE_HANDLE_INVALID && (devices[i].groups & (1u << index))) {
+            empty = false;
+        }
+    }
+    if (empty) {
+        groups[index].name[0] = '\0';
+    }
+
+    xSemaphoreGive(device_mutex);
+    return ESP_OK;
+}
+
+int wol_find_group(const char* group, int len)
+{
+    if (!group || len <= 0 || len >= DEVICE_NAME_SIZE) {
+        return WOL_GROUP_INVALID;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return WOL_GROUP_INVALID;
+    }
+    int index = find_group_locked(group, len);
+    xSemaphoreGive(device_mutex);
+    return index;
+}
+
+esp_err_t wol_wake_group(int group)
 {
-    // TODO: Implement saving to NVS or file system
-    ESP_LOGI(TAG, "Device configuration saved (placeholder)");
+    if (group < 0 || group >= WOL_MAX_GROUPS) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    wol_group_t* entry = &groups[group];
+    if (entry->name[0] == '\0') {
+        xSemaphoreGive(device_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (entry->waking) {
+        xSemaphoreGive(device_mutex);
+        ESP_LOGW(TAG, "Group %s is already being woken", entry->name);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Queue the enabled members; disabled ones are reported as skipped, and
+    // members busy in another group wake are left to that one
+    int queued = 0;
+    int skipped = 0;
+    for (device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID); handle != DEVICE_HANDLE_INVALID;
+         handle = wol_next_device(handle)) {
+        wol_device_t* device = device_for_handle(handle);
+        if (!device || !(device->groups & (1u << group)) || device->wake_group != WOL_GROUP_INVALID ||
+            wake_queue_count >= MAX_DEVICES) {
+            continue;
+        }
+        device->wake_group = group;
+        device->wake_elapsed_ms = 0;
+        if (!device->enabled) {
+            device->wake_result = WOL_WAKE_RESULT_SKIPPED;
+            skipped++;
+            continue;
+        }
+        device->wake_result = WOL_WAKE_RESULT_QUEUED;
+        wake_queue[(wake_queue_head + wake_queue_count) % MAX_DEVICES] = handle;
+        wake_queue_count++;
+        queued++;
+    }
+
+    entry->waking = true;
+    entry->unresolved = queued;
+    entry->started_ms = uptime_ms();
+    // Last member sent, its wake timed out, and one backed-off probe interval to notice
+    entry->deadline_ms = entry->started_ms + (uint32_t)queued * WOL_GROUP_STAGGER_MS +
+                         WOL_WAKE_TIMEOUT_MS + PING_DEFAULT_MAX_INTERVAL;
+
+    char name[DEVICE_NAME_SIZE];
+    strcpy(name, entry->name);
+    xSemaphoreGive(device_mutex);
+
+    ESP_LOGI(TAG, "Waking group %s: %d members, %d skipped, %d ms apart", name, queued, skipped,
+             WOL_GROUP_STAGGER_MS);
+    xTaskNotifyGive(wake_task_handle);
+
+    char topic[80];
+    snprintf(topic, sizeof(topic), "esp32/wol/group/%s/status", name);
+
+    char message[192];
+    json_writer_t json;
+    json_writer_init(&json, message, sizeof(message));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "group", name);
+    json_writer_kv_string(&json, "action", "wake_started");
+    json_writer_kv_int(&json, "members", queued);
+    json_writer_kv_int(&json, "skipped", skipped);
+    json_writer_kv_uint(&json, "stagger_ms", WOL_GROUP_STAGGER_MS);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+    if (json_writer_finish(&json) >= 0) {
+        mqtt_publish(topic, message);
+    }
+
+    if (queued == 0) {
+        finish_group_wake(group);
+    }
     return ESP_OK;
 }
+
+esp_err_t wol_handle_group_command(int group, const char* command)
+{
+    if (!command) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (strcmp(command, "on") == 0 || strcmp(command, "wake") == 0) {
+        return wol_wake_group(group);
+    } else if (strcmp(command, "status") == 0) {
+        return publish_group_status(group);
+    }
+
+    ESP_LOGW(TAG, "Unknown group command: %s", command);
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t wol_provision_devices(const char* data, int len)
+{
+    if (!data || len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Count the records first so the batch is allocated once
+    int count = 0;
+    for (int start = 0; start < len; ) {
+        const char* end = memchr(data + start, '\n', len - start);
+        int line_len = end ? end - (data + start) : len - start;
+        while (line_len > 0 && isspace((unsigned char)data[start])) {
+            start++;
+            line_len--;
+        }
+        if (line_len > 0 && data[start] != '#') {
+            count++;
+        }
+        start += line_len + 1;
+    }
+
+    provision_error_t errors[WOL_PROVISION_MAX_ERRORS];
+    int error_count = 0;
+    if (count == 0 || count > MAX_DEVICES) {
+        errors[0].line = 0;
+        errors[0].error = count == 0 ? "no records" : "too many records";
+        publish_provision_ack(NULL, NULL, 0, ESP_ERR_INVALID_ARG, errors, 1);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    device_record_t* records = calloc(count, sizeof(*records));
+    uint8_t* outcomes = malloc(count);
+    if (!records || !outcomes) {
+        free(records);
+        free(outcomes);
+        publish_provision_ack(NULL, NULL, 0, ESP_ERR_NO_MEM, NULL, 0);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Check every line before anything is applied
+    int parsed = 0;
+    int line = 0;
+    for (int start = 0; start < len; ) {
+        const char* end = memchr(data + start, '\n', len - start);
+        int line_len = end ? end - (data + start) : len - start;
+        const char* text = data + start;
+        start += line_len + 1;
+        line++;
+        while (line_len > 0 && isspace((unsigned char)text[0])) {
+            text++;
+            line_len--;
+        }
+        if (line_len == 0 || text[0] == '#') {
+            continue;
+        }
+
+        const char* error = parse_device_line(text, line_len, &records[parsed]);
+        for (int i = 0; !error && i < parsed; i++) {
+            if (strcmp(records[i].name, records[parsed].name) == 0) {
+                error = "duplicate device";
+            }
+        }
+        if (error) {
+            if (error_count < WOL_PROVISION_MAX_ERRORS) {
+                errors[error_count].line = line;
+                errors[error_count].error = error;
+            }
+            error_count++;
+            continue;
+        }
+        parsed++;
+    }
+
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+    if (error_count == 0) {
+        ret = apply_device_records(records, parsed, false, outcomes);
+    }
+    publish_provision_ack(records, outcomes, parsed, ret, errors, error_count);
+
+    free(records);
+    free(outcomes);
+    return ret;
+}
+
+// Returns the device stored for a handle, NULL if it is stale or not ours
+static wol_device_t* device_for_handle(device_handle_t handle)
+{
+    int slot = device_registry_slot(handle);
+    if (slot < 0 || devices[slot].handle != handle) {
+        return NULL;
+    }
+    return &devices[slot];
+}
+
+// Status the probe history calls for, given the current one
+static device_status_t debounced_status(const wol_device_t* device, uint32_t now_ms)
+{
+    uint16_t recent = device->history & ((1u << device->history_len) - 1);
+    int successes = __builtin_popcount(recent);
+    int failures = device->history_len - successes;
+
+    switch (device->status) {
+        case DEVICE_STATUS_ONLINE:
+            return failures >= WOL_STATUS_OFFLINE_THRESHOLD ? DEVICE_STATUS_OFFLINE : DEVICE_STATUS_ONLINE;
+        case DEVICE_STATUS_OFFLINE:
+            return successes >= WOL_STATUS_ONLINE_THRESHOLD ? DEVICE_STATUS_ONLINE : DEVICE_STATUS_OFFLINE;
+        case DEVICE_STATUS_WAKING:
+            // A booting host answers nothing for a while, give it WOL_WAKE_TIMEOUT_MS
+            if (successes > 0) {
+                return DEVICE_STATUS_ONLINE;
+            }
+            if (now_ms - device->wake_time_ms >= WOL_WAKE_TIMEOUT_MS && failures >= WOL_STATUS_OFFLINE_THRESHOLD) {
+                return DEVICE_STATUS_OFFLINE;
+            }
+            return DEVICE_STATUS_WAKING;
+        default:
+            // Nothing reported yet, any reply proves the host is up
+            if (successes > 0) {
+                return DEVICE_STATUS_ONLINE;
+            }
+            return failures >= WOL_STATUS_OFFLINE_THRESHOLD ? DEVICE_STATUS_OFFLINE : DEVICE_STATUS_UNKNOWN;
+    }
+}
+
+// Called with send_mutex held; the packet is only rebuilt when the MAC changes
+static void prepare_magic_packet(const uint8_t* mac_address)
+{
+    if (magic_packet_valid && memcmp(magic_packet_mac, mac_address, 6) == 0) {
+        return;
+    }
+
+    memset(magic_packet, 0xFF, 6);
+    for (int i = 0; i < 16; i++) {
+        memcpy(&magic_packet[6 + i * 6], mac_address, 6);
+    }
+    memcpy(magic_packet_mac, mac_address, 6);
+    magic_packet_valid = true;
+}
+
+// Called with send_mutex held; the socket is opened on first use and
+// reopened on the next send after an error
+static esp_err_t send_magic_packet(uint32_t dest_ipv4, uint16_t port)
+{
+    if (wol_socket < 0) {
+        wol_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (wol_socket < 0) {
+            ESP_LOGE(TAG, "Failed to create socket");
+            return ESP_FAIL;
+        }
+
+        int broadcast_enable = 1;
+        if (setsockopt(wol_socket, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable)) < 0) {
+            ESP_LOGE(TAG, "Failed to enable broadcast");
+            close(wol_socket);
+            wol_socket = -1;
+            return ESP_FAIL;
+        }
+    }
+
+    struct sockaddr_in dest_addr = { 0 };
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+    dest_addr.sin_addr.s_addr = dest_ipv4;
+
+    if (sendto(wol_socket, magic_packet, sizeof(magic_packet), 0,
+               (struct sockaddr*)&dest_addr, sizeof(dest_addr)) < 0) {
+        ESP_LOGW(TAG, "Failed to send WoL packet: errno %d", errno);
+        close(wol_socket);
+        wol_socket = -1;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Send WOL_BURST_COUNT rounds to the subnet-directed and the limited
+// broadcast, returns the number of packets sent
+static int send_wake_burst(const uint8_t* mac_address, uint16_t port)
+{
+    uint32_t destinations[2] = { wifi_manager_get_broadcast_ipv4(), htonl(INADDR_BROADCAST) };
+    int sent = 0;
+
+    if (xSemaphoreTake(send_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return 0;
+    }
+
+    prepare_magic_packet(mac_address);
+    for (int round = 0; round < WOL_BURST_COUNT; round++) {
+        if (round > 0 && WOL_BURST_INTERVAL_MS > 0) {
+            vTaskDelay(pdMS_TO_TICKS(WOL_BURST_INTERVAL_MS));
+        }
+        for (int i = 0; i < 2; i++) {
+            // No subnet broadcast while disconnected, and none twice on a /0 or /32
+            if (destinations[i] == 0 || (i == 1 && destinations[1] == destinations[0])) {
+                continue;
+            }
+            if (send_magic_packet(destinations[i], port) == ESP_OK) {
+                sent++;
+            }
+        }
+    }
+
+    xSemaphoreGive(send_mutex);
+    return sent;
+}
+
+// Result of a wake on esp32/wol/<name>/status, or into the group wake the
+// device is part of
+static void publish_wake_result(device_handle_t handle, bool woke, uint32_t elapsed_ms)
+{
+    char name[DEVICE_NAME_SIZE];
+    if (device_registry_copy_name(handle, name, sizeof(name)) != ESP_OK) {
+        return;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        wol_device_t* device = device_for_handle(handle);
+        int group = device ? device->wake_group : WOL_GROUP_INVALID;
+        if (group != WOL_GROUP_INVALID) {
+            resolve_group_member(device, woke ? WOL_WAKE_RESULT_WOKE : WOL_WAKE_RESULT_TIMEOUT, elapsed_ms);
+            bool group_done = groups[group].unresolved == 0;
+            xSemaphoreGive(device_mutex);
+            ESP_LOGI(TAG, "Group member %s %s after %" PRIu32 " ms", name, woke ? "woke" : "timed out", elapsed_ms);
+            if (group_done) {
+                finish_group_wake(group);
+            }
+            return;
+        }
+        xSemaphoreGive(device_mutex);
+    }
+
+    if (woke) {
+        ESP_LOGI(TAG, "Device %s woke after %" PRIu32 " ms", name, elapsed_ms);
+    } else {
+        ESP_LOGW(TAG, "Device %s did not wake within %" PRIu32 " ms", name, elapsed_ms);
+    }
+
+    char topic[64];
+    char message[160];
+    snprintf(topic, sizeof(topic), "esp32/wol/%s/status", name);
+
+    json_writer_t json;
+    json_writer_init(&json, message, sizeof(message));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "device", name);
+    json_writer_kv_string(&json, "action", woke ? "woke" : "wake_timeout");
+    json_writer_kv_uint(&json, woke ? "latency_ms" : "waited_ms", elapsed_ms);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+    if (json_writer_finish(&json) >= 0) {
+        mqtt_publish(topic, message);
+    }
+}
+
+// Send the wake burst to a device and start verifying it; announce publishes
+// wake_sent on esp32/wol/<name>/status, group wakes report in aggregate instead
+static esp_err_t wake_device(device_handle_t handle, bool announce, int* sent_out)
+{
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Find device
+    wol_device_t* device = device_for_handle(handle);
+    device_registry_entry_t entry;
+    if (!device || device_registry_get(handle, &entry) != ESP_OK) {
+        xSemaphoreGive(device_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (!device->enabled) {
+        xSemaphoreGive(device_mutex);
+        ESP_LOGW(TAG, "Device %s is disabled", entry.name);
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint16_t port = device->wol_port;
+    
+    xSemaphoreGive(device_mutex);
+
+    // Single broadcasts get lost often enough over WiFi-to-wired bridges, send a burst
+    int sent = send_wake_burst(entry.mac_address, port);
+    if (sent_out) {
+        *sent_out = sent;
+    }
+    if (sent == 0) {
+        ESP_LOGE(TAG, "Failed to send Wake-on-LAN to device: %s", entry.name);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Wake-on-LAN sent to device: %s (%d packets, port %u)", entry.name, sent, port);
+
+    // Update device status to waking, failures from before the wake no longer count
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        device = device_for_handle(handle);
+        bool was_waking = true;
+        device_status_snapshot_t snapshot;
+        if (device) {
+            was_waking = (device->status == DEVICE_STATUS_WAKING);
+            device->status = DEVICE_STATUS_WAKING;
+            device->wake_time_ms = uptime_ms();
+            device->history = 0;
+            device->history_len = 0;
+            snapshot_device_status(device, &snapshot);
+        }
+        xSemaphoreGive(device_mutex);
+        if (!was_waking) {
+            publish_device_status(handle, &snapshot, false);
+        }
+    }
+
+    // Watch closely for the boot to complete instead of waiting out the backoff
+    ping_manager_expedite_device(entry.name, PING_FAST_INTERVAL, WOL_WAKE_TIMEOUT_MS);
+
+    if (!announce) {
+        return ESP_OK;
+    }
+
+    // Publish MQTT status
+    char topic[64];
+    char message[160];
+    snprintf(topic, sizeof(topic), "esp32/wol/%s/status", entry.name);
+
+    json_writer_t json;
+    json_writer_init(&json, message, sizeof(message));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "device", entry.name);
+    json_writer_kv_string(&json, "action", "wake_sent");
+    json_writer_kv_int(&json, "packets", sent);
+    json_writer_kv_uint(&json, "port", port);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+    if (json_writer_finish(&json) >= 0) {
+        mqtt_publish(topic, message);
+    }
+    
+    return ESP_OK;
+}
+
+// Sends queued group wakes, never two within WOL_GROUP_STAGGER_MS, closes
+// group wakes whose deadline passed with members still unresolved, and
+// writes the device table once edits have settled
+static void wol_wake_task(void* arg)
+{
+    TickType_t last_wake = 0;
+    bool woke_before = false;
+
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        device_handle_t handle = DEVICE_HANDLE_INVALID;
+        uint32_t expired = 0;
+
+        if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            continue;
+        }
+
+        if (wake_queue_count > 0) {
+            TickType_t since = xTaskGetTickCount() - last_wake;
+            if (woke_before && since < pdMS_TO_TICKS(WOL_GROUP_STAGGER_MS)) {
+                wait = pdMS_TO_TICKS(WOL_GROUP_STAGGER_MS) - since;
+            } else {
+                handle = wake_queue[wake_queue_head];
+                wake_queue_head = (wake_queue_head + 1) % MAX_DEVICES;
+                wake_queue_count--;
+            }
+        }
+
+        uint32_t now_ms = uptime_ms();
+        bool save_due = false;
+        if (config_dirty) {
+            int32_t quiet_ms = (int32_t)(config_changed_ms + WOL_CONFIG_SAVE_DELAY_MS - now_ms);
+            int32_t cap_ms = (int32_t)(config_dirty_since_ms + WOL_CONFIG_SAVE_MAX_DELAY_MS - now_ms);
+            int32_t remaining_ms = quiet_ms < cap_ms ? quiet_ms : cap_ms;
+            if (remaining_ms <= 0) {
+                save_due = true;
+            } else if (pdMS_TO_TICKS(remaining_ms) < wait) {
+                wait = pdMS_TO_TICKS(remaining_ms) + 1;
+            }
+        }
+
+        for (int i = 0; i < WOL_MAX_GROUPS; i++) {
+            if (!groups[i].waking) {
+                continue;
+            }
+            int32_t remaining_ms = (int32_t)(groups[i].deadline_ms - now_ms);
+            if (remaining_ms <= 0) {
+                expired |= 1u << i;
+            } else if (pdMS_TO_TICKS(remaining_ms) < wait) {
+                wait = pdMS_TO_TICKS(remaining_ms) + 1;
+            }
+        }
+
+        xSemaphoreGive(device_mutex);
+
+        if (handle != DEVICE_HANDLE_INVALID) {
+            wake_group_member(handle);
+            last_wake = xTaskGetTickCount();
+            woke_before = true;
+            continue;
+        }
+        if (save_due) {
+            wol_save_device_config();
+            continue;
+        }
+        for (int i = 0; i < WOL_MAX_GROUPS; i++) {
+            if (expired & (1u << i)) {
+                finish_group_wake(i);
+            }
+        }
+        if (expired == 0) {
+            // Woken early by wol_wake_group() when new members are queued
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
+    }
+}
+
+// Wake one queued member and record the outcome if the wake did not start
+static void wake_group_member(device_handle_t handle)
+{
+    bool group_done = false;
+    int group = WOL_GROUP_INVALID;
+
+    // The group wake may have ended while the member waited for its turn
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return;
+    }
+    wol_device_t* device = device_for_handle(handle);
+    bool queued = device && device->wake_result == WOL_WAKE_RESULT_QUEUED;
+    xSemaphoreGive(device_mutex);
+    if (!queued) {
+        return;
+    }
+
+    esp_err_t ret = wake_device(handle, false, NULL);
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return;
+    }
+    device = device_for_handle(handle);
+    if (device && device->wake_group != WOL_GROUP_INVALID && device->wake_result == WOL_WAKE_RESULT_QUEUED) {
+        group = device->wake_group;
+        if (ret == ESP_OK) {
+            // Resolved later by publish_wake_result()
+            device->wake_result = WOL_WAKE_RESULT_SENT;
+        } else {
+            resolve_group_member(device, ret == ESP_ERR_INVALID_STATE ? WOL_WAKE_RESULT_SKIPPED : WOL_WAKE_RESULT_FAILED, 0);
+            group_done = groups[group].unresolved == 0;
+        }
+    }
+    xSemaphoreGive(device_mutex);
+
+    if (group_done) {
+        finish_group_wake(group);
+    }
+}
+
+// Called with device_mutex held
+static void resolve_group_member(wol_device_t* device, wol_wake_result_t result, uint32_t elapsed_ms)
+{
+    if (device->wake_result != WOL_WAKE_RESULT_QUEUED && device->wake_result != WOL_WAKE_RESULT_SENT) {
+        return;
+    }
+    device->wake_result = result;
+    device->wake_elapsed_ms = elapsed_ms;
+    if (groups[device->wake_group].unresolved > 0) {
+        groups[device->wake_group].unresolved--;
+    }
+}
+
+// Publish the per-member results of a group wake as one message and end it
+static void finish_group_wake(int group)
+{
+    static const char* const result_names[] = {
+        [WOL_WAKE_RESULT_NONE] = "none",
+        [WOL_WAKE_RESULT_QUEUED] = "pending",
+        [WOL_WAKE_RESULT_SENT] = "pending",
+        [WOL_WAKE_RESULT_WOKE] = "woke",
+        [WOL_WAKE_RESULT_TIMEOUT] = "wake_timeout",
+        [WOL_WAKE_RESULT_FAILED] = "failed",
+        [WOL_WAKE_RESULT_SKIPPED] = "skipped",
+    };
+
+    // Sized for the longest member entry, the group can hold every device
+    size_t size = 256 + (size_t)device_count * (DEVICE_NAME_SIZE + 64);
+    char* message = malloc(size);
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        free(message);
+        return;
+    }
+
+    wol_group_t* entry = &groups[group];
+    if (!entry->waking) {
+        xSemaphoreGive(device_mutex);
+        free(message);
+        return;
+    }
+
+    int counts[sizeof(result_names) / sizeof(result_names[0])] = { 0 };
+    json_writer_t json;
+    json_writer_init(&json, message, message ? size : 0);
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "group", entry->name);
+    json_writer_kv_string(&json, "action", "wake_complete");
+    json_writer_key(&json, "members");
+    json_writer_array_begin(&json);
+    for (device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID); handle != DEVICE_HANDLE_INVALID;
+         handle = wol_next_device(handle)) {
+        wol_device_t* device = device_for_handle(handle);
+        if (!device || device->wake_group != group) {
+            continue;
+        }
+        // The device holds its registry reference, the name is only empty if the registry is busy
+        char name[DEVICE_NAME_SIZE];
+        device_registry_copy_name(handle, name, sizeof(name));
+        json_writer_object_begin(&json);
+        json_writer_kv_string(&json, "device", name);
+        json_writer_kv_string(&json, "result", result_names[device->wake_result]);
+        if (device->wake_result == WOL_WAKE_RESULT_WOKE) {
+            json_writer_kv_uint(&json, "latency_ms", device->wake_elapsed_ms);
+        } else if (device->wake_result == WOL_WAKE_RESULT_TIMEOUT) {
+            json_writer_kv_uint(&json, "waited_ms", device->wake_elapsed_ms);
+        }
+        json_writer_object_end(&json);
+        counts[device->wake_result]++;
+        device->wake_group = WOL_GROUP_INVALID;
+        device->wake_result = WOL_WAKE_RESULT_NONE;
+    }
+    json_writer_array_end(&json);
+    json_writer_kv_int(&json, "woke", counts[WOL_WAKE_RESULT_WOKE]);
+    json_writer_kv_int(&json, "timeout", counts[WOL_WAKE_RESULT_TIMEOUT]);
+    json_writer_kv_int(&json, "failed", counts[WOL_WAKE_RESULT_FAILED]);
+    json_writer_kv_int(&json, "skipped", counts[WOL_WAKE_RESULT_SKIPPED]);
+    json_writer_kv_int(&json, "pending", counts[WOL_WAKE_RESULT_QUEUED] + counts[WOL_WAKE_RESULT_SENT]);
+    json_writer_kv_uint(&json, "duration_ms", uptime_ms() - entry->started_ms);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+
+    char name[DEVICE_NAME_SIZE];
+    strcpy(name, entry->name);
+    entry->waking = false;
+    entry->unresolved = 0;
+    xSemaphoreGive(device_mutex);
+
+    ESP_LOGI(TAG, "Group wake of %s complete: %d woke, %d timed out, %d failed", name,
+             counts[WOL_WAKE_RESULT_WOKE], counts[WOL_WAKE_RESULT_TIMEOUT], counts[WOL_WAKE_RESULT_FAILED]);
+
+    char topic[80];
+    snprintf(topic, sizeof(topic), "esp32/wol/group/%s/status", name);
+    if (json_writer_finish(&json) >= 0) {
+        mqtt_publish(topic, message);
+    } else {
+        ESP_LOGE(TAG, "Group wake result for %s could not be built", name);
+    }
+    free(message);
+}
+
+// Current status of every group member on esp32/wol/group/<group>/status
+static esp_err_t publish_group_status(int group)
+{
+    if (group < 0 || group >= WOL_MAX_GROUPS) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t size = 192 + (size_t)device_count * (DEVICE_NAME_SIZE + 32);
+    char* message = malloc(size);
+    if (!message) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        free(message);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (groups[group].name[0] == '\0') {
+        xSemaphoreGive(device_mutex);
+        free(message);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    json_writer_t json;
+    json_writer_init(&json, message, size);
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "group", groups[group].name);
+    json_writer_kv_bool(&json, "waking", groups[group].waking);
+    json_writer_key(&json, "members");
+    json_writer_array_begin(&json);
+    for (device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID); handle != DEVICE_HANDLE_INVALID;
+         handle = wol_next_device(handle)) {
+        const wol_device_t* device = device_for_handle(handle);
+        if (!device || !(device->groups & (1u << group))) {
+            continue;
+        }
+        char name[DEVICE_NAME_SIZE];
+        if (device_registry_copy_name(handle, name, sizeof(name)) != ESP_OK) {
+            continue;
+        }
+        json_writer_object_begin(&json);
+        json_writer_kv_string(&json, "device", name);
+        json_writer_kv_string(&json, "status", wol_get_status_string(device->status));
+        json_writer_kv_bool(&json, "enabled", device->enabled);
+        json_writer_object_end(&json);
+    }
+    json_writer_array_end(&json);
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+
+    char topic[80];
+    snprintf(topic, sizeof(topic), "esp32/wol/group/%s/status", groups[group].name);
+    xSemaphoreGive(device_mutex);
+
+    esp_err_t ret = json_writer_finish(&json) >= 0 ? mqtt_publish(topic, message) : ESP_FAIL;
+    free(message);
+    return ret;
+}
+
+// Called with device_mutex held
+static int find_group_locked(const char* group, int len)
+{
+    for (int i = 0; i < WOL_MAX_GROUPS; i++) {
+        if (groups[i].name[0] != '\0' && strncmp(groups[i].name, group, len) == 0 && groups[i].name[len] == '\0') {
+            return i;
+        }
+    }
+    return WOL_GROUP_INVALID;
+}
+
+static uint32_t uptime_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Called with device_mutex held
+static void snapshot_device_status(const wol_device_t* device, device_status_snapshot_t* snapshot)
+{
+    snapshot->status = device->status;
+    snapshot->enabled = device->enabled;
+    snapshot->last_ping_time = device->last_ping_time;
+}
+
+// Called without device_mutex: the only writer of esp32/device/<name>/status,
+// retained so late subscribers get the debounced status
+static esp_err_t publish_device_status(device_handle_t handle, const device_status_snapshot_t* snapshot,
+                                       bool with_enabled)
+{
+    device_registry_entry_t entry;
+    if (device_registry_get(handle, &entry) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char topic[64];
+    char message[256];
+    snprintf(topic, sizeof(topic), "esp32/device/%s/status", entry.name);
+    
+    json_writer_t json;
+    json_writer_init(&json, message, sizeof(message));
+    json_writer_object_begin(&json);
+    json_writer_kv_string(&json, "device", entry.name);
+    json_writer_kv_string(&json, "status", wol_get_status_string(snapshot->status));
+    json_writer_kv_string(&json, "ip", entry.ip_address);
+    if (with_enabled) {
+        json_writer_kv_bool(&json, "enabled", snapshot->enabled);
+    }
+    json_writer_kv_uint(&json, "timestamp", snapshot->last_ping_time);
+    json_writer_object_end(&json);
+    if (json_writer_finish(&json) < 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    return mqtt_manager_publish(topic, message, MQTT_QOS_1, true);
+}
+
+// Called with device_mutex held: frees the slot of a device, returns the
+// group whose wake this completed, WOL_GROUP_INVALID if none
+static int clear_device_locked(wol_device_t* device)
+{
+    // A group wake waiting for this device no longer does
+    int wake_group = device->wake_group;
+    if (wake_group != WOL_GROUP_INVALID) {
+        resolve_group_member(device, WOL_WAKE_RESULT_SKIPPED, 0);
+    }
+    bool group_done = wake_group != WOL_GROUP_INVALID && groups[wake_group].unresolved == 0;
+
+    // Slots are stable, only this one is cleared
+    memset(device, 0, sizeof(*device));
+    device->handle = DEVICE_HANDLE_INVALID;
+    device->wake_group = WOL_GROUP_INVALID;
+    device_count--;
+    return group_done ? wake_group : WOL_GROUP_INVALID;
+}
+
+// Apply a batch of devices with one registry transaction, one pass over the
+// device table under device_mutex and one ping target update. outcomes gets
+// a device_registry_outcome_t per record. A restore (saved table at boot)
+// also sets enabled and groups, and does not schedule a save.
+static esp_err_t apply_device_records(const device_record_t* records, int count, bool restore, uint8_t* outcomes)
+{
+    device_registry_change_t* changes = malloc(count * sizeof(*changes));
+    device_handle_t* handles = malloc(2 * count * sizeof(*handles));
+    ping_probe_config_t* probes = malloc(count * sizeof(*probes));
+    bool* probe_changed = malloc(count * sizeof(*probe_changed));
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (!changes || !handles || !probes || !probe_changed) {
+        goto done;
+    }
+
+    for (int i = 0; i < count; i++) {
+        changes[i] = (device_registry_change_t) {
+            .name = records[i].name,
+            .ipv4 = records[i].ipv4,
+            .mac_address = records[i].mac_address,
+            .description = records[i].has_description ? records[i].description : NULL,
+            .remove = records[i].remove,
+        };
+        probes[i] = records[i].probe;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ret = ESP_ERR_TIMEOUT;
+        goto done;
+    }
+
+    // WoL and ping references are taken and dropped together
+    ret = device_registry_apply(changes, count, DEVICE_OWNER_WOL | DEVICE_OWNER_PING, handles, outcomes);
+    if (ret != ESP_OK) {
+        xSemaphoreGive(device_mutex);
+        goto done;
+    }
+
+    uint32_t done_groups = 0;
+    for (int i = 0; i < count; i++) {
+        const device_record_t* record = &records[i];
+        if (handles[i] == DEVICE_HANDLE_INVALID) {
+            continue;
+        }
+        wol_device_t* device = &devices[DEVICE_HANDLE_SLOT(handles[i])];
+
+        if (record->remove) {
+            if (device->handle == handles[i]) {
+                int done_group = clear_device_locked(device);
+                if (done_group != WOL_GROUP_INVALID) {
+                    done_groups |= 1u << done_group;
+                }
+            }
+            continue;
+        }
+
+        if (device->handle != handles[i]) {
+            memset(device, 0, sizeof(*device));
+            device->handle = handles[i];
+            device->status = DEVICE_STATUS_UNKNOWN;
+            device->wake_group = WOL_GROUP_INVALID;
+            device->enabled = true;
+            device_count++;
+            outcomes[i] = DEVICE_REGISTRY_ADDED;
+        } else if (device->wol_port != record->wol_port) {
+            outcomes[i] = DEVICE_REGISTRY_UPDATED;
+        }
+        device->wol_port = record->wol_port;
+        if (restore) {
+            device->enabled = record->enabled;
+            device->groups = record->groups;
+        }
+    }
+    if (!restore) {
+        config_changed();
+    }
+    xSemaphoreGive(device_mutex);
+
+    for (int group = 0; group < WOL_MAX_GROUPS; group++) {
+        if (done_groups & (1u << group)) {
+            finish_group_wake(group);
+        }
+    }
+
+    // Ping targets take their own lock, once for the removals and once for the rest
+    device_handle_t* ping_handles = handles + count;
+    for (int i = 0; i < count; i++) {
+        ping_handles[i] = records[i].remove ? handles[i] : DEVICE_HANDLE_INVALID;
+    }
+    ping_manager_detach_devices(ping_handles, count);
+    for (int i = 0; i < count; i++) {
+        ping_handles[i] = records[i].remove ? DEVICE_HANDLE_INVALID : handles[i];
+    }
+    ret = ping_manager_attach_devices(ping_handles, probes, count, probe_changed);
+    for (int i = 0; ret == ESP_OK && i < count; i++) {
+        if (probe_changed[i] && outcomes[i] == DEVICE_REGISTRY_UNCHANGED) {
+            outcomes[i] = DEVICE_REGISTRY_UPDATED;
+        }
+    }
+
+done:
+    free(changes);
+    free(handles);
+    free(probes);
+    free(probe_changed);
+    return ret;
+}
+
+// Parse one provisioning line (see wol_provision_devices()), returns NULL
+// on success or what is wrong with it
+static const char* parse_device_line(const char* line, int len, device_record_t* record)
+{
+    mqtt_slice_t fields[6];
+    int field_count = 0;
+
+    memset(record, 0, sizeof(*record));
+    if (line[0] == '-') {
+        record->remove = true;
+        line++;
+        len--;
+    }
+
+    // Up to six comma separated fields, the description keeps any further commas
+    const char* pos = line;
+    const char* end = line + len;
+    while (field_count < 6) {
+        const char* comma = field_count < 5 ? memchr(pos, ',', end - pos) : NULL;
+        const char* field_end = comma ? comma : end;
+        fields[field_count].ptr = pos;
+        fields[field_count].len = field_end - pos;
+        while (fields[field_count].len > 0 && isspace((unsigned char)fields[field_count].ptr[0])) {
+            fields[field_count].ptr++;
+            fields[field_count].len--;
+        }
+        while (fields[field_count].len > 0 &&
+               isspace((unsigned char)fields[field_count].ptr[fields[field_count].len - 1])) {
+            fields[field_count].len--;
+        }
+        field_count++;
+        if (!comma) {
+            break;
+        }
+        pos = comma + 1;
+    }
+
+    // Names end up in MQTT topics, so no wildcards or separators
+    const mqtt_slice_t* name = &fields[0];
+    if (name->len == 0 || name->len >= DEVICE_NAME_SIZE) {
+        return "invalid name";
+    }
+    for (int i = 0; i < name->len; i++) {
+        if (name->ptr[i] == '/' || name->ptr[i] == '+' || name->ptr[i] == '#' || isspace((unsigned char)name->ptr[i])) {
+            return "invalid name";
+        }
+    }
+    memcpy(record->name, name->ptr, name->len);
+
+    if (record->remove) {
+        return field_count == 1 ? NULL : "unexpected fields after removal";
+    }
+    if (field_count < 3) {
+        return "missing IP address or MAC";
+    }
+
+    char ip_address[DEVICE_IP_SIZE];
+    if (!mqtt_slice_copy(&fields[1], ip_address, sizeof(ip_address)) ||
+        inet_pton(AF_INET, ip_address, &record->ipv4) <= 0 || record->ipv4 == 0) {
+        return "invalid IP address";
+    }
+    if (!parse_mac(&fields[2], record->mac_address)) {
+        return "invalid MAC";
+    }
+
+    record->wol_port = 9; // Default WoL port
+    if (field_count > 3 && fields[3].len > 0 && !parse_port(&fields[3], &record->wol_port)) {
+        return "invalid port";
+    }
+
+    record->probe.strategy = PING_STRATEGY_ICMP;
+    if (field_count > 4 && fields[4].len > 0 && !parse_probe(&fields[4], &record->probe)) {
+        return "invalid strategy";
+    }
+    memcpy(record->probe.mac_address, record->mac_address, sizeof(record->probe.mac_address));
+
+    if (field_count > 5) {
+        int description_len = fields[5].len < DEVICE_DESCRIPTION_SIZE ? fields[5].len : DEVICE_DESCRIPTION_SIZE - 1;
+        memcpy(record->description, fields[5].ptr, description_len);
+        record->has_description = true;
+    }
+    return NULL;
+}
+
+// "aa:bb:cc:dd:ee:ff", '-' also accepted as separator
+static bool parse_mac(const mqtt_slice_t* text, uint8_t* mac_address)
+{
+    if (text->len != 17) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        const char* pair = text->ptr + i * 3;
+        if (!isxdigit((unsigned char)pair[0]) || !isxdigit((unsigned char)pair[1]) ||
+            (i < 5 && pair[2] != ':' && pair[2] != '-')) {
+            return false;
+        }
+        int high = isdigit((unsigned char)pair[0]) ? pair[0] - '0' : tolower((unsigned char)pair[0]) - 'a' + 10;
+        int low = isdigit((unsigned char)pair[1]) ? pair[1] - '0' : tolower((unsigned char)pair[1]) - 'a' + 10;
+        mac_address[i] = (uint8_t)((high << 4) | low);
+    }
+    return true;
+}
+
+static bool parse_port(const mqtt_slice_t* text, uint16_t* port)
+{
+    if (text->len == 0 || text->len > 5) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < text->len; i++) {
+        if (!isdigit((unsigned char)text->ptr[i])) {
+            return false;
+        }
+        value = value * 10 + (text->ptr[i] - '0');
+    }
+    if (value == 0 || value > 65535) {
+        return false;
+    }
+    *port = (uint16_t)value;
+    return true;
+}
+
+// "arp", "icmp", "tcp[:port/port...]" or "udp:port[/port...]"
+static bool parse_probe(const mqtt_slice_t* text, ping_probe_config_t* probe)
+{
+    const char* colon = memchr(text->ptr, ':', text->len);
+    mqtt_slice_t strategy = { text->ptr, colon ? colon - text->ptr : text->len };
+
+    if (mqtt_slice_equals(&strategy, "arp")) {
+        probe->strategy = PING_STRATEGY_ARP;
+    } else if (mqtt_slice_equals(&strategy, "icmp")) {
+        probe->strategy = PING_STRATEGY_ICMP;
+    } else if (mqtt_slice_equals(&strategy, "tcp")) {
+        probe->strategy = PING_STRATEGY_TCP;
+    } else if (mqtt_slice_equals(&strategy, "udp")) {
+        probe->strategy = PING_STRATEGY_UDP;
+    } else {
+        return false;
+    }
+
+    bool uses_ports = probe->strategy == PING_STRATEGY_TCP || probe->strategy == PING_STRATEGY_UDP;
+    if (!colon) {
+        if (probe->strategy == PING_STRATEGY_UDP) {
+            return false;
+        }
+        if (probe->strategy == PING_STRATEGY_TCP) {
+            probe->ports[0] = 80;
+            probe->ports[1] = 22;
+            probe->port_count = 2;
+        }
+        return true;
+    }
+    if (!uses_ports) {
+        return false;
+    }
+
+    const char* pos = colon + 1;
+    const char* end = text->ptr + text->len;
+    while (pos <= end) {
+        const char* slash = memchr(pos, '/', end - pos);
+        mqtt_slice_t port = { pos, (slash ? slash : end) - pos };
+        if (probe->port_count >= PING_MAX_PORTS || !parse_port(&port, &probe->ports[probe->port_count])) {
+            return false;
+        }
+        probe->port_count++;
+        if (!slash) {
+            break;
+        }
+        pos = slash + 1;
+    }
+    return true;
+}
+
+// One acknowledgement per provisioning message on WOL_PROVISION_ACK_TOPIC
+static void publish_provision_ack(const device_record_t* records, const uint8_t* outcomes, int count,
+                                  esp_err_t result, const provision_error_t* errors, int error_count)
+{
+    static const struct {
+        const char* key;
+        uint8_t outcome;
+    } lists[] = {
+        { "added", DEVICE_REGISTRY_ADDED },
+        { "updated", DEVICE_REGISTRY_UPDATED },
+        { "removed", DEVICE_REGISTRY_REMOVED },
+        { "missing", DEVICE_REGISTRY_MISSING },
+    };
+
+    // Sized for every name listed once
+    size_t size = 256 + (size_t)count * (DEVICE_NAME_SIZE + 3) + WOL_PROVISION_MAX_ERRORS * 64;
+    char* message = malloc(size);
+    if (!message) {
+        ESP_LOGE(TAG, "Cannot allocate provisioning acknowledgement");
+        return;
+    }
+
+    int totals[DEVICE_REGISTRY_MISSING + 1] = { 0 };
+    json_writer_t json;
+    json_writer_init(&json, message, size);
+    json_writer_object_begin(&json);
+    if (error_count > 0) {
+        json_writer_kv_string(&json, "result", "rejected");
+        json_writer_key(&json, "errors");
+        json_writer_array_begin(&json);
+        for (int i = 0; i < error_count && i < WOL_PROVISION_MAX_ERRORS; i++) {
+            json_writer_object_begin(&json);
+            json_writer_kv_int(&json, "line", errors[i].line);
+            json_writer_kv_string(&json, "error", errors[i].error);
+            json_writer_object_end(&json);
+        }
+        json_writer_array_end(&json);
+        json_writer_kv_int(&json, "error_count", error_count);
+    } else if (result != ESP_OK) {
+        json_writer_kv_string(&json, "result", "failed");
+        json_writer_kv_string(&json, "error", esp_err_to_name(result));
+        json_writer_kv_int(&json, "records", count);
+    } else {
+        json_writer_kv_string(&json, "result", "applied");
+        for (size_t l = 0; l < sizeof(lists) / sizeof(lists[0]); l++) {
+            json_writer_key(&json, lists[l].key);
+            json_writer_array_begin(&json);
+            for (int i = 0; i < count; i++) {
+                if (outcomes[i] == lists[l].outcome) {
+                    json_writer_string(&json, records[i].name);
+                }
+            }
+            json_writer_array_end(&json);
+        }
+        for (int i = 0; i < count; i++) {
+            totals[outcomes[i]]++;
+        }
+        json_writer_kv_int(&json, "unchanged", totals[DEVICE_REGISTRY_UNCHANGED]);
+        json_writer_kv_int(&json, "devices", device_count);
+    }
+    json_writer_kv_uint(&json, "timestamp", xTaskGetTickCount() * portTICK_PERIOD_MS / 1000);
+    json_writer_object_end(&json);
+
+    if (error_count > 0) {
+        ESP_LOGW(TAG, "Provisioning rejected, %d bad lines (first: line %d, %s)",
+                 error_count, errors[0].line, errors[0].error);
+    } else if (result != ESP_OK) {
+        ESP_LOGE(TAG, "Provisioning of %d records failed: %s", count, esp_err_to_name(result));
+    } else {
+        ESP_LOGI(TAG, "Provisioned %d records: %d added, %d updated, %d removed, %d unchanged",
+                 count, totals[DEVICE_REGISTRY_ADDED], totals[DEVICE_REGISTRY_UPDATED],
+                 totals[DEVICE_REGISTRY_REMOVED], totals[DEVICE_REGISTRY_UNCHANGED]);
+    }
+
+    if (json_writer_finish(&json) >= 0) {
+        mqtt_publish(WOL_PROVISION_ACK_TOPIC, message);
+    } else {
+        ESP_LOGE(TAG, "Provisioning acknowledgement could not be built");
+    }
+    free(message);
+}
+
+static void wol_monitor_device(const char* name, const char* ip_address, const uint8_t* mac_address)
+{
+    ping_probe_config_t config = {
+        .strategy = PING_STRATEGY_ICMP,
+    };
+    memcpy(config.mac_address, mac_address, sizeof(config.mac_address));
+
+    ping_manager_add_device_ex(name, ip_address, &config);
+}
+
+esp_err_t wol_load_device_config(void)
+{
+    if (load_saved_config() == ESP_OK) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Loading default device configuration");
+    
+    // Example devices, saved to NVS on first boot - you can modify these
+    uint8_t mac1[] = {0xC0, 0x18, 0x50, 0xAC, 0xE1, 0xA5};
+    uint8_t mac2[] = {0x00, 0x50, 0x56, 0xAB, 0xCD, 0xEF};
+    //uint8_t mac3[] = {0x08, 0x00, 0x27, 0x12, 0x34, 0x56};
+    
+    wol_add_device("server1", "192.168.0.111", mac1, "Main Server");
+    wol_add_device("desktop1", "192.168.0.112", mac2, "Development Desktop");
+    wol_add_device("nas1", "192.168.0.2", mac1, "Network Attached Storage");
+
+    // Woken together with esp32/wol/group/servers/command
+    wol_add_device_to_group("server1", "servers");
+    wol_add_device_to_group("nas1", "servers");
+    
+    return ESP_OK;
+}
+
+esp_err_t wol_save_device_config(void)
+{
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    size_t size = 0;
+    uint8_t* blob = encode_config_locked(&size);
+    config_dirty = false;
+    xSemaphoreGive(device_mutex);
+
+    if (!blob) {
+        ESP_LOGE(TAG, "Cannot allocate device configuration blob");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Edits that cancelled out leave the blob as it is in flash
+    uint32_t crc = ((const wol_config_header_t*)blob)->crc;
+    if (size == saved_config_size && crc == saved_config_crc) {
+        free(blob);
+        ESP_LOGD(TAG, "Device configuration unchanged, not written");
+        return ESP_OK;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(WOL_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, WOL_CONFIG_NVS_KEY, blob, size);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    free(blob);
+
+    if (ret != ESP_OK) {
+        // Try again after another quiet period
+        ESP_LOGE(TAG, "Failed to save device configuration: %s", esp_err_to_name(ret));
+        if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+            config_changed();
+            xSemaphoreGive(device_mutex);
+        }
+        return ret;
+    }
+
+    saved_config_size = size;
+    saved_config_crc = crc;
+    ESP_LOGI(TAG, "Device configuration saved (%d devices, %u bytes)", device_count, (unsigned)size);
+    return ESP_OK;
+}
+
+// Called with device_mutex held (or before the wol task runs)
+static void config_changed(void)
+{
+    uint32_t now_ms = uptime_ms();
+    if (!config_dirty) {
+        config_dirty = true;
+        config_dirty_since_ms = now_ms;
+    }
+    config_changed_ms = now_ms;
+    if (wake_task_handle) {
+        xTaskNotifyGive(wake_task_handle);
+    }
+}
+
+// Interval bounds and strategy are set on ping_manager directly, but saved
+// with the device table
+static void ping_config_changed(device_handle_t handle, void* user_data)
+{
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGW(TAG, "Device table busy, probe settings not scheduled for saving");
+        return;
+    }
+    config_changed();
+    xSemaphoreGive(device_mutex);
+}
+
+// Restore the device table from the NVS blob with one read; nothing is
+// applied unless the whole blob checks out
+static esp_err_t load_saved_config(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(WOL_CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t size = 0;
+    uint8_t* blob = NULL;
+    esp_err_t ret = nvs_get_blob(handle, WOL_CONFIG_NVS_KEY, NULL, &size);
+    if (ret == ESP_OK && size >= sizeof(wol_config_header_t)) {
+        blob = malloc(size);
+        ret = blob ? nvs_get_blob(handle, WOL_CONFIG_NVS_KEY, blob, &size) : ESP_ERR_NO_MEM;
+    } else if (ret == ESP_OK) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    nvs_close(handle);
+    if (ret != ESP_OK) {
+        free(blob);
+        return ret;
+    }
+
+    wol_config_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t* pos = blob + sizeof(header);
+    const uint8_t* end = blob + size;
+    size_t groups_size = (size_t)header.group_count * DEVICE_NAME_SIZE;
+
+    if (header.magic != WOL_CONFIG_MAGIC || header.version < 1 || header.version > WOL_CONFIG_VERSION) {
+        ESP_LOGW(TAG, "Saved device configuration has format %u, expected %u, ignored",
+                 header.version, WOL_CONFIG_VERSION);
+        free(blob);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (esp_crc32_le(0, pos, end - pos) != header.crc || header.group_count > WOL_MAX_GROUPS ||
+        header.device_count > MAX_DEVICES || groups_size > (size_t)(end - pos)) {
+        ESP_LOGW(TAG, "Saved device configuration is corrupt, ignored");
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Check every record before touching the tables
+    size_t record_size = header.version == 1 ? WOL_CONFIG_RECORD_V1_SIZE :
+                         header.version == 2 ? WOL_CONFIG_RECORD_V2_SIZE : sizeof(wol_config_record_t);
+    wol_config_record_t record;
+    const uint8_t* records_start = pos + groups_size;
+    pos = records_start;
+    for (int i = 0; i < header.device_count && pos; i++) {
+        pos = next_config_record(pos, end, record_size, &record);
+    }
+    if (!pos) {
+        ESP_LOGW(TAG, "Saved device configuration is truncated, ignored");
+        free(blob);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int count = header.device_count;
+    device_record_t* records = calloc(count ? count : 1, sizeof(*records));
+    uint8_t* outcomes = malloc(count ? count : 1);
+    if (!records || !outcomes) {
+        free(records);
+        free(outcomes);
+        free(blob);
+        return ESP_ERR_NO_MEM;
+    }
+
+    pos = records_start;
+    for (int i = 0; i < count; i++) {
+        const uint8_t* strings = pos + record_size;
+        pos = next_config_record(pos, end, record_size, &record);
+
+        device_record_t* device = &records[i];
+        memcpy(device->name, strings, record.name_len);
+        memcpy(device->description, strings + record.name_len, record.description_len);
+        device->has_description = true;
+        device->enabled = record.enabled != 0;
+        device->groups = record.groups & ((1u << header.group_count) - 1);
+        device->ipv4 = record.ipv4;
+        memcpy(device->mac_address, record.mac_address, sizeof(device->mac_address));
+        device->wol_port = record.wol_port;
+        device->probe.strategy = (ping_strategy_t)record.strategy;
+        device->probe.port_count = record.port_count;
+        memcpy(device->probe.ports, record.ports, sizeof(device->probe.ports));
+        device->probe.interval_ms = record.interval_ms;
+        device->probe.max_interval_ms = record.max_interval_ms;
+        memcpy(device->probe.mac_address, record.mac_address, sizeof(device->probe.mac_address));
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        free(records);
+        free(outcomes);
+        free(blob);
+        return ESP_ERR_TIMEOUT;
+    }
+    for (int i = 0; i < header.group_count; i++) {
+        memcpy(groups[i].name, blob + sizeof(header) + i * DEVICE_NAME_SIZE, DEVICE_NAME_SIZE);
+        groups[i].name[DEVICE_NAME_SIZE - 1] = '\0';
+    }
+    xSemaphoreGive(device_mutex);
+    free(blob);
+
+    // Same path as bulk provisioning: one registry transaction, one ping update
+    ret = apply_device_records(records, count, true, outcomes);
+    free(records);
+    free(outcomes);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Saved device configuration could not be applied: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (xSemaphoreTake(device_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        saved_config_size = size;
+        saved_config_crc = header.crc;
+        if (header.version != WOL_CONFIG_VERSION) {
+            // Rewritten in the current format once things settle
+            config_changed();
+        }
+        xSemaphoreGive(device_mutex);
+    }
+
+    ESP_LOGI(TAG, "Loaded %d devices and %u groups from NVS (%u bytes, format %u)",
+             count, header.group_count, (unsigned)size, header.version);
+    return ESP_OK;
+}
+
+// Called with device_mutex held; returns a malloc'd blob for the current
+// tables, NULL if out of memory
+static uint8_t* encode_config_locked(size_t* size_out)
+{
+    int group_count = 0;
+    for (int i = 0; i < WOL_MAX_GROUPS; i++) {
+        if (groups[i].name[0] != '\0') {
+            group_count = i + 1;
+        }
+    }
+
+    size_t capacity = sizeof(wol_config_header_t) + (size_t)group_count * DEVICE_NAME_SIZE +
+                      (size_t)device_count * (sizeof(wol_config_record_t) + DEVICE_NAME_SIZE + DEVICE_DESCRIPTION_SIZE);
+    uint8_t* blob = malloc(capacity);
+    if (!blob) {
+        return NULL;
+    }
+
+    uint8_t* pos = blob + sizeof(wol_config_header_t);
+    for (int i = 0; i < group_count; i++) {
+        memcpy(pos, groups[i].name, DEVICE_NAME_SIZE);
+        pos += DEVICE_NAME_SIZE;
+    }
+
+    int written = 0;
+    for (device_handle_t handle = wol_next_device(DEVICE_HANDLE_INVALID);
+         handle != DEVICE_HANDLE_INVALID && written < device_count; handle = wol_next_device(handle)) {
+        const wol_device_t* device = device_for_handle(handle);
+        device_registry_entry_t entry;
+        if (!device || device_registry_get(handle, &entry) != ESP_OK) {
+            continue;
+        }
+
+        wol_config_record_t record = {
+            .ipv4 = entry.ipv4,
+            .wol_port = device->wol_port,
+            .groups = device->groups,
+            .enabled = device->enabled,
+            .name_len = strlen(entry.name),
+            .description_len = strlen(entry.description),
+            .strategy = PING_STRATEGY_ICMP,
+        };
+        memcpy(record.mac_address, entry.mac_address, sizeof(record.mac_address));
+
+        // Probe settings belong to the ping target
+        ping_target_t target;
+        if (ping_manager_get_device_by_handle(handle, &target) == ESP_OK) {
+            record.strategy = target.strategy;
+            record.port_count = target.port_count;
+            memcpy(record.ports, target.ports, sizeof(record.ports));
+            record.interval_ms = target.interval_ms;
+            record.max_interval_ms = target.max_interval_ms;
+        }
+
+        memcpy(pos, &record, sizeof(record));
+        pos += sizeof(record);
+        memcpy(pos, entry.name, record.name_len);
+        pos += record.name_len;
+        memcpy(pos, entry.description, record.description_len);
+        pos += record.description_len;
+        written++;
+    }
+
+    wol_config_header_t header = {
+        .magic = WOL_CONFIG_MAGIC,
+        .version = WOL_CONFIG_VERSION,
+        .device_count = written,
+        .group_count = group_count,
+    };
+    header.crc = esp_crc32_le(0, blob + sizeof(header), pos - (blob + sizeof(header)));
+    memcpy(blob, &header, sizeof(header));
+
+    *size_out = pos - blob;
+    return blob;
+}
+
+// Decode the record at pos, record_size bytes for the blob's format version.
+// Returns the position after its strings or NULL if it does not fit or is malformed.
+static const uint8_t* next_config_record(const uint8_t* pos, const uint8_t* end, size_t record_size,
+                                         wol_config_record_t* record)
+{
+    if ((size_t)(end - pos) < record_size) {
+        return NULL;
+    }
+    memset(record, 0, sizeof(*record));
+    record->strategy = PING_STRATEGY_ICMP;
+    memcpy(record, pos, record_size);
+    pos += record_size;
+
+    bool needs_ports = record->strategy == PING_STRATEGY_TCP || record->strategy == PING_STRATEGY_UDP;
+    if (record->strategy > PING_STRATEGY_ARP || record->port_count > PING_MAX_PORTS ||
+        (needs_ports && record->port_count == 0)) {
+        return NULL;
+    }
+    if ((record->interval_ms && record->interval_ms < PING_MIN_INTERVAL) ||
+        (record->max_interval_ms && record->max_interval_ms < record->interval_ms)) {
+        return NULL;
+    }
+    if (record->name_len == 0 || record->name_len >= DEVICE_NAME_SIZE ||
+        record->description_len >= DEVICE_DESCRIPTION_SIZE ||
+        (size_t)(end - pos) < (size_t)record->name_len + record->description_len) {
+        return NULL;
+    }
+    return pos + record->name_len + record->description_len;
+}
@@ -0,0 +1,771 @@
+// Probe and publish benchmark: runs the ping, WoL and MQTT managers against
+// the simulated network and broker and reports what one sweep costs.
+//
+//   probe_bench [--targets N] [--strategy tcp|icmp|udp|arp|mix] [--latency-ms X]
+//               [--jitter-ms X] [--loss PCT] [--offline PCT] [--interval-ms N]
+//               [--interval-spread PCT] [--adaptive] [--no-delta] [--wake-slot-ms N] [--duration-s N] [--broker-latency-ms X]
+//               [--payload-iterations N] [--seed N] [--json] [--verbose]
+//
+// See test/host/README.md for what each figure means.
+
+#include "device_registry.h"
+#include "ping_manager.h"
+#include "ping_probe.h"
+#include "ping_result_ring.h"
+#include "wol_manager.h"
+#include "mqtt_manager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_shim.h"
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *TAG = "bench";
+
+#define BENCH_MAX_TOPICS            24
+#define BENCH_TOPIC_SIZE            64
+#define BENCH_WAKE_TARGETS          4
+
+typedef struct {
+    int targets;
+    const char* strategy;
+    double latency_ms;
+    double jitter_ms;
+    double loss_pct;
+    double offline_pct;
+    uint32_t interval_ms;
+    double interval_spread_pct;
+    bool adaptive;
+    bool delta;
+    uint32_t wake_slot_ms;
+    int duration_s;
+    double broker_latency_ms;
+    int payload_iterations;
+    uint32_t seed;
+    bool json;
+    esp_log_level_t log_level;
+} bench_options_t;
+
+// Messages written to the broker, per topic with device names and page numbers folded into "+"
+typedef struct {
+    char topic[BENCH_TOPIC_SIZE];
+    uint64_t messages;
+    uint64_t bytes;
+} topic_stats_t;
+
+// Sweep timing, filled by the ping_probe_run() wrapper on ping_task
+typedef struct {
+    uint64_t sweeps;
+    uint64_t probes;
+    uint64_t successes;
+    uint64_t duration_us_total;
+    uint64_t duration_us_min;
+    uint64_t duration_us_max;
+    uint64_t late_samples;           // Probes of a target seen before, at a fixed interval
+    uint64_t late_us_total;          // How much later than one interval after the previous probe they started
+    uint64_t late_us_max;
+} sweep_stats_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t duration_us_total;
+    uint64_t duration_us_max;
+} callback_stats_t;
+
+// One payload builder timed in the payload phase
+typedef struct {
+    const char* name;
+    int calls;
+    int failures;
+    uint64_t duration_us_total;
+    uint64_t duration_us_max;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t allocs;
+} payload_stats_t;
+
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static topic_stats_t topics[BENCH_MAX_TOPICS];
+static int topic_count = 0;
+static sweep_stats_t sweep_stats;
+static callback_stats_t callback_stats;
+static int64_t last_start_us[DEVICE_REGISTRY_MAX_DEVICES];
+static int64_t fixed_interval_us = 0;  // 0 unless all targets share one exact interval, lateness is not measured
+
+// Lock names in mutex creation order of the init calls below; wol and mqtt create several each
+static const struct {
+    const char* created_as;
+    const char* reported_as;
+} lock_names[] = {
+    { "wol", "wol_devices" },
+    { "wol#2", "wol_send" },
+    { "mqtt", "mqtt_ping_batch" },
+    { "mqtt#2", "mqtt_offline_queue" },
+    { "mqtt#3", "mqtt_metrics" },
+};
+
+// Timed pass-through, linked in with -Wl,--wrap=ping_probe_run. A sweep
+// is one run of the engine, from the first due target until nothing is in
+// flight; probes are counted as the refill hook admits and collects them.
+void __real_ping_probe_run(ping_probe_t* probes, int capacity, ping_probe_refill_t refill, void* ctx);
+
+typedef struct {
+    ping_probe_refill_t refill;
+    void* ctx;
+} bench_refill_t;
+
+static int64_t bench_refill(ping_probe_t* probes, int capacity, void* ctx) {
+    bench_refill_t* real = (bench_refill_t*)ctx;
+
+    int successes = 0;
+    bool was_free[PING_SWEEP_MAX];
+    for (int i = 0; i < capacity; i++) {
+        successes += (probes[i].state == PING_PROBE_DONE && probes[i].success) ? 1 : 0;
+        was_free[i] = (probes[i].state == PING_PROBE_FREE || probes[i].state == PING_PROBE_DONE);
+    }
+    int64_t next_due_us = real->refill(probes, capacity, real->ctx);
+    int64_t start_us = esp_timer_get_time();
+
+    pthread_mutex_lock(&bench_lock);
+    sweep_stats.successes += successes;
+    for (int i = 0; i < capacity; i++) {
+        if (!was_free[i] || probes[i].state != PING_PROBE_QUEUED) {
+            continue;
+        }
+        sweep_stats.probes++;
+
+        // Every target is probed once per interval; a late start is time ping_task spent elsewhere
+        uint32_t host = ntohl(probes[i].ipv4);
+        int index = (int)((host >> 8 & 0xFF) - 1) * 250 + (int)(host & 0xFF) - 1;
+        if (fixed_interval_us == 0 || index < 0 || index >= DEVICE_REGISTRY_MAX_DEVICES) {
+            continue;
+        }
+        if (last_start_us[index] > 0) {
+            int64_t late_us = start_us - last_start_us[index] - fixed_interval_us;
+            late_us = late_us > 0 ? late_us : 0;
+            sweep_stats.late_samples++;
+            sweep_stats.late_us_total += late_us;
+            if ((uint64_t)late_us > sweep_stats.late_us_max) {
+                sweep_stats.late_us_max = late_us;
+            }
+        }
+        last_start_us[index] = start_us;
+    }
+    pthread_mutex_unlock(&bench_lock);
+    return next_due_us;
+}
+
+void __wrap_ping_probe_run(ping_probe_t* probes, int capacity, ping_probe_refill_t refill, void* ctx) {
+    bench_refill_t real = { refill, ctx };
+    int64_t start_us = esp_timer_get_time();
+    __real_ping_probe_run(probes, capacity, bench_refill, &real);
+    uint64_t duration_us = (uint64_t)(esp_timer_get_time() - start_us);
+
+    pthread_mutex_lock(&bench_lock);
+    sweep_stats.sweeps++;
+    sweep_stats.duration_us_total += duration_us;
+    if (sweep_stats.sweeps == 1 || duration_us < sweep_stats.duration_us_min) {
+        sweep_stats.duration_us_min = duration_us;
+    }
+    if (duration_us > sweep_stats.duration_us_max) {
+        sweep_stats.duration_us_max = duration_us;
+    }
+    pthread_mutex_unlock(&bench_lock);
+}
+
+// Same work as ping_result_handler() in main.c, minus the log line
+static void ping_result_handler(device_handle_t handle, const char* name, const char* ip_address, bool success,
+                                uint32_t response_time_us, void* user_data) {
+    int64_t start_us = esp_timer_get_time();
+    wol_update_device_status(handle, success);
+    mqtt_manager_queue_ping_result(handle, name, ip_address, success, response_time_us);
+    uint64_t duration_us = (uint64_t)(esp_timer_get_time() - start_us);
+
+    pthread_mutex_lock(&bench_lock);
+    callback_stats.calls++;
+    callback_stats.duration_us_total += duration_us;
+    if (duration_us > callback_stats.duration_us_max) {
+        callback_stats.duration_us_max = duration_us;
+    }
+    pthread_mutex_unlock(&bench_lock);
+}
+
+// The main.c wake done callback with CONFIG_POWER_SAVE_MODE
+static void wake_done_handler(void* user_data) {
+    mqtt_manager_flush_window();
+}
+
+// "esp32/device/t012/status" -> "esp32/device/+/status", "…/page/3" -> "…/page/+"
+static void normalize_topic(const char* topic, int topic_len, char* out, size_t size) {
+    size_t used = 0;
+    int pos = 0;
+    while (pos < topic_len && used + 1 < size) {
+        int end = pos;
+        while (end < topic_len && topic[end] != '/') {
+            end++;
+        }
+        const char* segment = topic + pos;
+        int len = end - pos;
+        bool digits = len > 0;
+        for (int i = (len > 1 && segment[0] == 't') ? 1 : 0; i < len; i++) {
+            digits = digits && segment[i] >= '0' && segment[i] <= '9';
+        }
+        if (used > 0 && used + 1 < size) {
+            out[used++] = '/';
+        }
+        if (digits) {
+            segment = "+";
+            len = 1;
+        }
+        for (int i = 0; i < len && used + 1 < size; i++) {
+            out[used++] = segment[i];
+        }
+        pos = end + 1;
+    }
+    out[used] = '\0';
+}
+
+static void broker_tap(const char* topic, int topic_len, int payload_len, int qos, void* arg) {
+    char key[BENCH_TOPIC_SIZE];
+    normalize_topic(topic, topic_len, key, sizeof(key));
+
+    pthread_mutex_lock(&bench_lock);
+    topic_stats_t* entry = NULL;
+    for (int i = 0; i < topic_count && !entry; i++) {
+        if (strcmp(topics[i].topic, key) == 0) {
+            entry = &topics[i];
+        }
+    }
+    if (!entry && topic_count < BENCH_MAX_TOPICS) {
+        entry = &topics[topic_count++];
+        snprintf(entry->topic, sizeof(entry->topic), "%s", key);
+    }
+    if (entry) {
+        entry->messages++;
+        entry->bytes += topic_len + payload_len;
+    }
+    pthread_mutex_unlock(&bench_lock);
+}
+
+static uint32_t target_ipv4(int index) {
+    return htonl(0xC0A80000u | (uint32_t)(1 + index / 250) << 8 | (uint32_t)(1 + index % 250));
+}
+
+static const char* target_strategy(const bench_options_t* options, int index) {
+    static const char* const mix[] = { "arp", "icmp", "tcp:80", "udp:7" };
+    if (strcmp(options->strategy, "mix") == 0) {
+        return mix[index % 4];
+    }
+    if (strcmp(options->strategy, "tcp") == 0) {
+        return "tcp:80";
+    }
+    if (strcmp(options->strategy, "udp") == 0) {
+        return "udp:7";
+    }
+    return options->strategy;
+}
+
+// Hosts for every target, the first offline_pct percent of them offline
+static int setup_network(const bench_options_t* options) {
+    sim_net_init(htonl(0xC0A80001u), htonl(0xFFFF0000u), options->seed);
+    int offline = (int)(options->targets * options->offline_pct / 100.0 + 0.5);
+    for (int i = 0; i < options->targets; i++) {
+        sim_host_t host = {
+            .ipv4 = target_ipv4(i),
+            .mac = { 0x02, 0x00, 0x00, 0x00, (uint8_t)(i >> 8), (uint8_t)i },
+            .online = i >= offline,
+            .latency_us = (uint32_t)(options->latency_ms * 1000),
+            .jitter_us = (uint32_t)(options->jitter_ms * 1000),
+            .loss_permille = (uint16_t)(options->loss_pct * 10),
+            .open_ports = { 80, 7 },
+            .port_count = 2,
+        };
+        if (sim_net_add_host(&host) != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot simulate more than %d hosts", SIM_NET_MAX_HOSTS);
+            return -1;
+        }
+    }
+    return offline;
+}
+
+// One provisioning message: drop the firmware's default devices, add every target
+static esp_err_t provision_targets(const bench_options_t* options) {
+    size_t size = 64 + (size_t)options->targets * 64;
+    char* payload = malloc(size);
+    if (!payload) {
+        return ESP_ERR_NO_MEM;
+    }
+    int len = snprintf(payload, size, "-server1\n-desktop1\n-nas1\n");
+    for (int i = 0; i < options->targets; i++) {
+        char ip_address[DEVICE_IP_SIZE];
+        device_registry_format_ip(target_ipv4(i), ip_address, sizeof(ip_address));
+        len += snprintf(payload + len, size - len, "t%03d,%s,02:00:00:00:%02x:%02x,9,%s\n",
+                        i, ip_address, (i >> 8) & 0xFF, i & 0xFF, target_strategy(options, i));
+    }
+    esp_err_t ret = wol_provision_devices(payload, len);
+    free(payload);
+    return ret;
+}
+
+static void time_payload(payload_stats_t* stats, esp_err_t (*build)(void)) {
+    sim_broker_stats_t before_broker;
+    host_alloc_stats_t before_alloc;
+    sim_broker_flush(5000);
+    sim_broker_get_stats(&before_broker);
+    host_alloc_get_stats(&before_alloc);
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = build();
+    uint64_t duration_us = (uint64_t)(esp_timer_get_time() - start_us);
+
+    sim_broker_flush(5000);
+    sim_broker_stats_t after_broker;
+    host_alloc_stats_t after_alloc;
+    sim_broker_get_stats(&after_broker);
+    host_alloc_get_stats(&after_alloc);
+
+    stats->calls++;
+    stats->failures += ret != ESP_OK ? 1 : 0;
+    stats->duration_us_total += duration_us;
+    if (duration_us > stats->duration_us_max) {
+        stats->duration_us_max = duration_us;
+    }
+    stats->messages += after_broker.delivered - before_broker.delivered;
+    stats->bytes += after_broker.bytes - before_broker.bytes;
+    stats->allocs += after_alloc.allocs - before_alloc.allocs;
+}
+
+static const char* reported_lock_name(const char* name) {
+    for (size_t i = 0; i < sizeof(lock_names) / sizeof(lock_names[0]); i++) {
+        if (strcmp(lock_names[i].created_as, name) == 0) {
+            return lock_names[i].reported_as;
+        }
+    }
+    return name;
+}
+
+static double per(uint64_t value, uint64_t count) {
+    return count > 0 ? (double)value / count : 0.0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --targets N              simulated targets (64, at most %d)\n"
+            "  --strategy S             tcp, icmp, udp, arp or mix (mix)\n"
+            "  --latency-ms X           round-trip time (5)\n"
+            "  --jitter-ms X            RTT spread, uniform +- X (2)\n"
+            "  --loss PCT               requests or replies lost (1)\n"
+            "  --offline PCT            targets that never answer (10)\n"
+            "  --interval-ms N          probe interval, fixed unless --adaptive (1000)\n"
+            "  --interval-spread PCT    target intervals spread from N to N + PCT%% (0)\n"
+            "  --adaptive               keep the firmware's interval backoff\n"
+            "  --no-delta               publish every ping result, not only changes\n"
+            "  --wake-slot-ms N         low-power mode: shared probe wakes every N ms, output at their end\n"
+            "  --duration-s N           length of the probing phase (10)\n"
+            "  --broker-latency-ms X    wire time per MQTT message (2)\n"
+            "  --payload-iterations N   calls per payload builder (10)\n"
+            "  --seed N                 loss and jitter seed (1)\n"
+            "  --json                   one JSON object instead of the table\n"
+            "  --verbose                firmware logs at INFO instead of WARN\n",
+            program, DEVICE_REGISTRY_MAX_DEVICES);
+}
+
+static int parse_options(int argc, char** argv, bench_options_t* options) {
+    static const struct option long_options[] = {
+        { "targets", required_argument, NULL, 't' },
+        { "strategy", required_argument, NULL, 's' },
+        { "latency-ms", required_argument, NULL, 'l' },
+        { "jitter-ms", required_argument, NULL, 'j' },
+        { "loss", required_argument, NULL, 'L' },
+        { "offline", required_argument, NULL, 'o' },
+        { "interval-ms", required_argument, NULL, 'i' },
+        { "interval-spread", required_argument, NULL, 'I' },
+        { "adaptive", no_argument, NULL, 'a' },
+        { "no-delta", no_argument, NULL, 'D' },
+        { "wake-slot-ms", required_argument, NULL, 'w' },
+        { "duration-s", required_argument, NULL, 'd' },
+        { "broker-latency-ms", required_argument, NULL, 'b' },
+        { "payload-iterations", required_argument, NULL, 'p' },
+        { "seed", required_argument, NULL, 'S' },
+        { "json", no_argument, NULL, 'J' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+            case 't': options->targets = atoi(optarg); break;
+            case 's': options->strategy = optarg; break;
+            case 'l': options->latency_ms = atof(optarg); break;
+            case 'j': options->jitter_ms = atof(optarg); break;
+            case 'L': options->loss_pct = atof(optarg); break;
+            case 'o': options->offline_pct = atof(optarg); break;
+            case 'i': options->interval_ms = (uint32_t)atoi(optarg); break;
+            case 'I': options->interval_spread_pct = atof(optarg); break;
+            case 'a': options->adaptive = true; break;
+            case 'D': options->delta = false; break;
+            case 'w': options->wake_slot_ms = (uint32_t)atoi(optarg); break;
+            case 'd': options->duration_s = atoi(optarg); break;
+            case 'b': options->broker_latency_ms = atof(optarg); break;
+            case 'p': options->payload_iterations = atoi(optarg); break;
+            case 'S': options->seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'J': options->json = true; break;
+            case 'v': options->log_level = ESP_LOG_INFO; break;
+            default: usage(argv[0]); return -1;
+        }
+    }
+
+    static const char* const strategies[] = { "tcp", "icmp", "udp", "arp", "mix" };
+    bool known = false;
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+        known = known || strcmp(options->strategy, strategies[i]) == 0;
+    }
+    if (!known || options->targets < 1 || options->targets > DEVICE_REGISTRY_MAX_DEVICES ||
+        options->interval_ms < PING_MIN_INTERVAL || (options->wake_slot_ms != 0 && options->wake_slot_ms < PING_MIN_INTERVAL) ||
+        options->duration_s < 1 || options->payload_iterations < 0 ||
+        options->loss_pct < 0 || options->loss_pct > 100 || options->offline_pct < 0 || options->offline_pct > 100 ||
+        options->interval_spread_pct < 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bench_options_t options = {
+        .targets = 64,
+        .strategy = "mix",
+        .latency_ms = 5,
+        .jitter_ms = 2,
+        .loss_pct = 1,
+        .offline_pct = 10,
+        .interval_ms = 1000,
+        .delta = true,
+        .duration_s = 10,
+        .broker_latency_ms = 2,
+        .payload_iterations = 10,
+        .seed = 1,
+        .log_level = ESP_LOG_WARN,
+    };
+    if (parse_options(argc, argv, &options) != 0) {
+        return 2;
+    }
+
+    host_rtos_init();
+    esp_log_level_set("*", options.log_level);
+    int offline = setup_network(&options);
+    if (offline < 0) {
+        return 1;
+    }
+    sim_broker_set_write_delay_us((uint32_t)(options.broker_latency_ms * 1000));
+    sim_broker_set_tap(broker_tap, NULL);
+
+    // Same order as app_main(), each init names the mutexes it creates
+    host_rtos_set_lock_name("registry");
+    esp_err_t ret = device_registry_init();
+    host_rtos_set_lock_name("ping_targets");
+    if (ret == ESP_OK) {
+        ret = ping_manager_init(ping_result_handler, NULL);
+    }
+    ping_manager_set_paused(true);
+    host_rtos_set_lock_name("wol");
+    if (ret == ESP_OK) {
+        ret = wol_manager_init();
+    }
+    host_rtos_set_lock_name("mqtt");
+    if (ret == ESP_OK) {
+        ret = mqtt_manager_init(NULL);
+    }
+    host_rtos_set_lock_name(NULL);
+    if (ret != ESP_OK) {
+        fprintf(stderr, "Initialization failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    if (!sim_broker_wait_connected(5000)) {
+        fprintf(stderr, "Broker connection did not come up\n");
+        return 1;
+    }
+    mqtt_manager_set_delta_mode(options.delta, MQTT_PING_DELTA_RTT_US);
+    // Same calls as app_main() with CONFIG_POWER_SAVE_MODE
+    if (options.wake_slot_ms > 0) {
+        ping_manager_set_wake_slot(options.wake_slot_ms);
+        ping_manager_set_wake_done_callback(wake_done_handler, NULL);
+        mqtt_manager_set_low_power(true);
+    }
+
+    int64_t provision_start_us = esp_timer_get_time();
+    ret = provision_targets(&options);
+    uint64_t provision_us = (uint64_t)(esp_timer_get_time() - provision_start_us);
+    if (ret != ESP_OK) {
+        fprintf(stderr, "Provisioning failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    if (!options.adaptive) {
+        // A wake slot moves every probe onto the slot grid, lateness would only measure that
+        bool exact = options.wake_slot_ms == 0 && options.interval_spread_pct == 0;
+        fixed_interval_us = exact ? (int64_t)options.interval_ms * 1000 : 0;
+        for (int i = 0; i < options.targets; i++) {
+            char name[DEVICE_NAME_SIZE];
+            snprintf(name, sizeof(name), "t%03d", i);
+            uint32_t interval_ms = options.interval_ms +
+                                   (uint32_t)(options.interval_ms * options.interval_spread_pct / 100 * i / options.targets);
+            ping_manager_set_device_interval_bounds(name, interval_ms, interval_ms);
+        }
+    }
+
+    // Probing phase: counters start from zero so setup does not count
+    sim_broker_flush(5000);
+    pthread_mutex_lock(&bench_lock);
+    memset(&sweep_stats, 0, sizeof(sweep_stats));
+    memset(last_start_us, 0, sizeof(last_start_us));
+    memset(&callback_stats, 0, sizeof(callback_stats));
+    memset(topics, 0, sizeof(topics));
+    topic_count = 0;
+    pthread_mutex_unlock(&bench_lock);
+    sim_broker_reset_stats();
+    sim_net_reset_stats();
+    host_rtos_reset_lock_stats();
+    host_alloc_stats_t alloc_before;
+    host_alloc_get_stats(&alloc_before);
+    uint64_t errors_before, warnings_before;
+    host_log_get_counts(&errors_before, &warnings_before);
+    ping_wake_stats_t wake_before;
+    ping_manager_get_wake_stats(&wake_before);
+
+    int64_t run_start_us = esp_timer_get_time();
+    ping_manager_set_paused(false);
+    vTaskDelay(pdMS_TO_TICKS(options.duration_s * 1000));
+    ping_manager_set_paused(true);
+    sim_broker_flush(5000);
+    ping_wake_stats_t wake_after;
+    ping_manager_get_wake_stats(&wake_after);
+    uint64_t run_us = (uint64_t)(esp_timer_get_time() - run_start_us);
+    uint32_t awake_ms = wake_after.awake_ms - wake_before.awake_ms;
+    // The wake in flight at the pause is counted once it ends, up to a probe timeout later
+    vTaskDelay(pdMS_TO_TICKS(PING_DEFAULT_TIMEOUT + 100));
+    ping_manager_get_wake_stats(&wake_after);
+    uint32_t probe_wakes = wake_after.wakes - wake_before.wakes;
+
+    host_alloc_stats_t alloc_after;
+    host_alloc_get_stats(&alloc_after);
+    uint64_t errors_after, warnings_after;
+    host_log_get_counts(&errors_after, &warnings_after);
+    sim_broker_stats_t broker;
+    sim_broker_get_stats(&broker);
+    sim_net_stats_t net;
+    sim_net_get_stats(&net);
+    host_lock_stats_t locks[HOST_MAX_LOCKS];
+    int lock_count = host_rtos_get_lock_stats(locks, HOST_MAX_LOCKS);
+
+    pthread_mutex_lock(&bench_lock);
+    sweep_stats_t sweeps = sweep_stats;
+    callback_stats_t callbacks = callback_stats;
+    topic_stats_t run_topics[BENCH_MAX_TOPICS];
+    int run_topic_count = topic_count;
+    memcpy(run_topics, topics, sizeof(run_topics));
+    pthread_mutex_unlock(&bench_lock);
+
+    // Payload phase: the builders run on the calling thread, probing is paused
+    payload_stats_t payloads[] = {
+        { .name = "devices_summary" },
+        { .name = "latency_summary" },
+        { .name = "metrics" },
+    };
+    for (int n = 0; n < options.payload_iterations; n++) {
+        time_payload(&payloads[0], mqtt_publish_devices_summary);
+        time_payload(&payloads[1], mqtt_publish_latency_summary);
+    }
+    // Rate limited to one call per MQTT_METRICS_MIN_INTERVAL_MS
+    if (options.payload_iterations > 0) {
+        time_payload(&payloads[2], mqtt_manager_publish_metrics);
+    }
+
+    // Wake path: WoL commands through the broker for a few offline targets
+    sim_net_stats_t net_before_wake;
+    sim_net_get_stats(&net_before_wake);
+    int wakes = offline < BENCH_WAKE_TARGETS ? offline : BENCH_WAKE_TARGETS;
+    for (int i = 0; i < wakes; i++) {
+        char topic[64];
+        snprintf(topic, sizeof(topic), "esp32/wol/t%03d/command", i);
+        sim_broker_inject(topic, "wake", -1);
+    }
+    sim_broker_flush(5000);
+    vTaskDelay(pdMS_TO_TICKS(WOL_BURST_COUNT * WOL_BURST_INTERVAL_MS + 200));
+    sim_net_stats_t net_after_wake;
+    sim_net_get_stats(&net_after_wake);
+    uint64_t magic_packets = net_after_wake.magic_packets - net_before_wake.magic_packets;
+
+    host_nvs_stats_t nvs;
+    host_nvs_get_stats(&nvs);
+    ping_result_queue_stats_t results;
+    ping_manager_get_result_queue_stats(&results);
+
+    double run_s = run_us / 1e6;
+    uint64_t allocs = alloc_after.allocs - alloc_before.allocs;
+    uint64_t frees = alloc_after.frees - alloc_before.frees;
+
+    if (options.json) {
+        printf("{\"config\":{\"targets\":%d,\"strategy\":\"%s\",\"latency_ms\":%.3f,\"jitter_ms\":%.3f,"
+               "\"loss_pct\":%.2f,\"offline_pct\":%.2f,\"interval_ms\":%u,\"interval_spread_pct\":%.1f,"
+               "\"adaptive\":%s,\"delta\":%s,\"wake_slot_ms\":%u,\"duration_s\":%d,\"broker_latency_ms\":%.3f,"
+               "\"seed\":%u,\"sweep_max\":%d,\"max_sockets\":%d},",
+               options.targets, options.strategy, options.latency_ms, options.jitter_ms, options.loss_pct,
+               options.offline_pct, (unsigned)options.interval_ms, options.interval_spread_pct,
+               options.adaptive ? "true" : "false", options.delta ? "true" : "false", (unsigned)options.wake_slot_ms,
+               options.duration_s, options.broker_latency_ms, (unsigned)options.seed, PING_SWEEP_MAX, PING_PROBE_MAX_SOCKETS);
+        printf("\"provision_us\":%llu,\"run_s\":%.3f,", (unsigned long long)provision_us, run_s);
+        printf("\"sweeps\":{\"count\":%llu,\"probes\":%llu,\"successes\":%llu,\"probes_per_s\":%.1f,"
+               "\"avg_size\":%.1f,\"min_us\":%llu,\"avg_us\":%.0f,\"max_us\":%llu},",
+               (unsigned long long)sweeps.sweeps, (unsigned long long)sweeps.probes,
+               (unsigned long long)sweeps.successes, per(sweeps.probes, 1) / run_s,
+               per(sweeps.probes, sweeps.sweeps), (unsigned long long)sweeps.duration_us_min,
+               per(sweeps.duration_us_total, sweeps.sweeps), (unsigned long long)sweeps.duration_us_max);
+        printf("\"late_start\":{\"probes\":%llu,\"avg_us\":%.0f,\"max_us\":%llu},",
+               (unsigned long long)sweeps.late_samples, per(sweeps.late_us_total, sweeps.late_samples),
+               (unsigned long long)sweeps.late_us_max);
+        printf("\"callback\":{\"calls\":%llu,\"avg_us\":%.1f,\"max_us\":%llu,\"queue_peak\":%u,\"dropped\":%u},",
+               (unsigned long long)callbacks.calls, per(callbacks.duration_us_total, callbacks.calls),
+               (unsigned long long)callbacks.duration_us_max, (unsigned)results.peak, (unsigned)results.dropped);
+        printf("\"power\":{\"wakes\":%u,\"awake_ms\":%u,\"awake_pct\":%.2f},",
+               (unsigned)probe_wakes, (unsigned)awake_ms,
+               per(awake_ms, run_us / 1000) * 100);
+        printf("\"mqtt\":{\"messages\":%llu,\"bytes\":%llu,\"publish_calls\":%llu,\"enqueue_calls\":%llu,"
+               "\"publish_wait_us\":%.1f,\"outbox_peak_bytes\":%zu,\"topics\":[",
+               (unsigned long long)broker.delivered, (unsigned long long)broker.bytes,
+               (unsigned long long)broker.publishes, (unsigned long long)broker.enqueued,
+               per(broker.publish_wait_ns, broker.publishes) / 1000.0, broker.outbox_peak_bytes);
+        for (int i = 0; i < run_topic_count; i++) {
+            printf("%s{\"topic\":\"%s\",\"messages\":%llu,\"bytes\":%llu}", i > 0 ? "," : "", run_topics[i].topic,
+                   (unsigned long long)run_topics[i].messages, (unsigned long long)run_topics[i].bytes);
+        }
+        printf("]},");
+        printf("\"heap\":{\"allocs\":%llu,\"frees\":%llu,\"allocs_per_sweep\":%.2f,\"bytes\":%llu,"
+               "\"peak_bytes\":%llu},",
+               (unsigned long long)allocs, (unsigned long long)frees, per(allocs, sweeps.sweeps),
+               (unsigned long long)(alloc_after.bytes - alloc_before.bytes),
+               (unsigned long long)alloc_after.peak_bytes);
+        printf("\"locks\":[");
+        for (int i = 0; i < lock_count; i++) {
+            printf("%s{\"name\":\"%s\",\"takes\":%llu,\"contended\":%llu,\"timeouts\":%llu,\"hold_avg_us\":%.2f,"
+                   "\"hold_max_us\":%.1f,\"wait_total_us\":%.1f,\"wait_max_us\":%.1f}",
+                   i > 0 ? "," : "", reported_lock_name(locks[i].name), (unsigned long long)locks[i].takes,
+                   (unsigned long long)locks[i].contended, (unsigned long long)locks[i].timeouts,
+                   per(locks[i].hold_ns_total, locks[i].takes) / 1000.0, locks[i].hold_ns_max / 1000.0,
+                   locks[i].wait_ns_total / 1000.0, locks[i].wait_ns_max / 1000.0);
+        }
+        printf("],");
+        printf("\"net\":{\"tcp_connects\":%llu,\"udp_requests\":%llu,\"icmp_requests\":%llu,\"arp_requests\":%llu,"
+               "\"replies\":%llu,\"selects\":%llu,\"socket_failures\":%llu,\"sockets_max\":%d},",
+               (unsigned long long)net.tcp_connects, (unsigned long long)net.udp_requests,
+               (unsigned long long)net.icmp_requests, (unsigned long long)net.arp_requests,
+               (unsigned long long)net.replies, (unsigned long long)net.selects,
+               (unsigned long long)net.socket_failures, net.sockets_max);
+        printf("\"payloads\":[");
+        for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+            payload_stats_t* p = &payloads[i];
+            printf("%s{\"name\":\"%s\",\"calls\":%d,\"failures\":%d,\"avg_us\":%.1f,\"max_us\":%llu,"
+                   "\"messages\":%.1f,\"bytes\":%.1f,\"allocs\":%.1f}",
+                   i > 0 ? "," : "", p->name, p->calls, p->failures, per(p->duration_us_total, p->calls),
+                   (unsigned long long)p->duration_us_max, per(p->messages, p->calls), per(p->bytes, p->calls),
+                   per(p->allocs, p->calls));
+        }
+        printf("],");
+        printf("\"wake\":{\"commands\":%d,\"magic_packets\":%llu},", wakes, (unsigned long long)magic_packets);
+        printf("\"nvs\":{\"commits\":%llu,\"bytes_written\":%llu},", (unsigned long long)nvs.commits,
+               (unsigned long long)nvs.bytes_written);
+        printf("\"log\":{\"errors\":%llu,\"warnings\":%llu}}\n", (unsigned long long)(errors_after - errors_before),
+               (unsigned long long)(warnings_after - warnings_before));
+    } else {
+        printf("probe_bench: %d targets (%s), RTT %.1f +- %.1f ms, %.1f%% loss, %d offline, interval %u ms%s\n",
+               options.targets, options.strategy, options.latency_ms, options.jitter_ms, options.loss_pct, offline,
+               (unsigned)options.interval_ms, options.adaptive ? " (adaptive)" : "");
+        printf("  sweep max %d targets, %d sockets; broker %.1f ms per message; %s results\n\n",
+               PING_SWEEP_MAX, PING_PROBE_MAX_SOCKETS, options.broker_latency_ms,
+               options.delta ? "delta" : "all");
+
+        printf("Provisioning     %8.1f ms\n", provision_us / 1000.0);
+        printf("Probing phase    %8.2f s\n\n", run_s);
+
+        printf("Sweeps           %8llu   avg %.1f targets\n", (unsigned long long)sweeps.sweeps,
+               per(sweeps.probes, sweeps.sweeps));
+        printf("  duration       min %.1f  avg %.1f  max %.1f ms\n", sweeps.duration_us_min / 1000.0,
+               per(sweeps.duration_us_total, sweeps.sweeps) / 1000.0, sweeps.duration_us_max / 1000.0);
+        printf("  probes         %llu (%llu answered), %.1f/s\n", (unsigned long long)sweeps.probes,
+               (unsigned long long)sweeps.successes, sweeps.probes / run_s);
+        if (sweeps.late_samples > 0) {
+            printf("  late start     avg %.1f  max %.1f ms after the interval\n",
+                   per(sweeps.late_us_total, sweeps.late_samples) / 1000.0, sweeps.late_us_max / 1000.0);
+        }
+        printf("  result callback avg %.1f  max %llu us, queue peak %u of %d, %u dropped\n\n",
+               per(callbacks.duration_us_total, callbacks.calls), (unsigned long long)callbacks.duration_us_max,
+               (unsigned)results.peak, PING_RESULT_RING_SIZE, (unsigned)results.dropped);
+
+        printf("Power            %u wakes, awake %.1f%% of the phase (%.0f ms per wake)",
+               (unsigned)probe_wakes, per(awake_ms, run_us / 1000) * 100, per(awake_ms, probe_wakes));
+        if (options.wake_slot_ms > 0) {
+            printf(", wake slot %u ms", (unsigned)options.wake_slot_ms);
+        }
+        printf("\n\n");
+
+        printf("MQTT             %llu messages, %llu bytes (%llu publish, %llu enqueue)\n",
+               (unsigned long long)broker.delivered, (unsigned long long)broker.bytes,
+               (unsigned long long)broker.publishes, (unsigned long long)broker.enqueued);
+        printf("  publish wait   avg %.1f us, outbox peak %zu bytes\n",
+               per(broker.publish_wait_ns, broker.publishes) / 1000.0, broker.outbox_peak_bytes);
+        for (int i = 0; i < run_topic_count; i++) {
+            printf("  %-36s %6llu msgs %9llu bytes\n", run_topics[i].topic,
+                   (unsigned long long)run_topics[i].messages, (unsigned long long)run_topics[i].bytes);
+        }
+
+        printf("\nHeap             %llu allocs, %llu frees, %.2f allocs/sweep, peak %llu bytes live\n\n",
+               (unsigned long long)allocs, (unsigned long long)frees, per(allocs, sweeps.sweeps),
+               (unsigned long long)alloc_after.peak_bytes);
+
+        printf("%-20s %9s %9s %8s %12s %12s %12s\n", "Lock", "takes", "contended", "timeouts", "hold avg us",
+               "hold max us", "wait max us");
+        for (int i = 0; i < lock_count; i++) {
+            printf("%-20s %9llu %9llu %8llu %12.2f %12.1f %12.1f\n", reported_lock_name(locks[i].name),
+                   (unsigned long long)locks[i].takes, (unsigned long long)locks[i].contended,
+                   (unsigned long long)locks[i].timeouts, per(locks[i].hold_ns_total, locks[i].takes) / 1000.0,
+                   locks[i].hold_ns_max / 1000.0, locks[i].wait_ns_max / 1000.0);
+        }
+
+        printf("\nNetwork          %llu TCP, %llu UDP, %llu ICMP, %llu ARP requests, %llu replies\n",
+               (unsigned long long)net.tcp_connects, (unsigned long long)net.udp_requests,
+               (unsigned long long)net.icmp_requests, (unsigned long long)net.arp_requests,
+               (unsigned long long)net.replies);
+        printf("  select() calls %llu, sockets peak %d of %d, refused %llu\n\n", (unsigned long long)net.selects,
+               net.sockets_max, CONFIG_LWIP_MAX_SOCKETS, (unsigned long long)net.socket_failures);
+
+        printf("%-20s %6s %10s %10s %9s %10s %8s\n", "Payload", "calls", "avg us", "max us", "msgs", "bytes",
+               "allocs");
+        for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+            payload_stats_t* p = &payloads[i];
+            printf("%-20s %6d %10.1f %10llu %9.1f %10.1f %8.1f%s\n", p->name, p->calls,
+                   per(p->duration_us_total, p->calls), (unsigned long long)p->duration_us_max,
+                   per(p->messages, p->calls), per(p->bytes, p->calls), per(p->allocs, p->calls),
+                   p->failures > 0 ? "  (failures)" : "");
+        }
+
+        printf("\nWake             %d commands, %llu magic packets\n", wakes, (unsigned long long)magic_packets);
+        printf("NVS              %llu commits, %llu bytes written\n", (unsigned long long)nvs.commits,
+               (unsigned long long)nvs.bytes_written);
+        printf("Log              %llu errors, %llu warnings during probing\n",
+               (unsigned long long)(errors_after - errors_before),
+               (unsigned long long)(warnings_after - warnings_before));
+    }
+    fflush(stdout);
+
+    // Threads are still running; leave without tearing the managers down
+    _exit(sweeps.probes > 0 ? 0 : 1);
+}
@@ -0,0 +1,76 @@
+// Allocation counters, linked in with -Wl,--wrap=malloc,--wrap=free,...
+
+#include "host_shim.h"
+#include "shim_private.h"
+#include <malloc.h>
+#include <stdlib.h>
+
+void* __real_realloc(void* ptr, size_t size);
+
+static host_alloc_stats_t counters;
+
+static void count_alloc(void* ptr, size_t requested) {
+    if (!ptr) {
+        return;
+    }
+    __atomic_add_fetch(&counters.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters.bytes, requested, __ATOMIC_RELAXED);
+    uint64_t live = __atomic_add_fetch(&counters.live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&counters.peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&counters.peak_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void count_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    __atomic_add_fetch(&counters.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&counters.live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    count_alloc(ptr, size);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    void* ptr = __real_calloc(n, size);
+    count_alloc(ptr, n * size);
+    return ptr;
+}
+
+void __wrap_free(void* ptr) {
+    count_free(ptr);
+    __real_free(ptr);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return __wrap_malloc(size);
+    }
+    if (size == 0) {
+        __wrap_free(ptr);
+        return NULL;
+    }
+    size_t old_usable = malloc_usable_size(ptr);
+    void* moved = __real_realloc(ptr, size);
+    if (moved) {
+        __atomic_add_fetch(&counters.reallocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counters.bytes, size, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&counters.live_bytes, old_usable, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counters.live_bytes, malloc_usable_size(moved), __ATOMIC_RELAXED);
+    }
+    return moved;
+}
+
+void host_alloc_get_stats(host_alloc_stats_t* stats_out) {
+    stats_out->allocs = __atomic_load_n(&counters.allocs, __ATOMIC_RELAXED);
+    stats_out->frees = __atomic_load_n(&counters.frees, __ATOMIC_RELAXED);
+    stats_out->reallocs = __atomic_load_n(&counters.reallocs, __ATOMIC_RELAXED);
+    stats_out->bytes = __atomic_load_n(&counters.bytes, __ATOMIC_RELAXED);
+    stats_out->live_bytes = __atomic_load_n(&counters.live_bytes, __ATOMIC_RELAXED);
+    stats_out->peak_bytes = __atomic_load_n(&counters.peak_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_ESP_CHIP_INFO_H
+#define HOST_ESP_CHIP_INFO_H
+
+#include <stdint.h>
+
+typedef enum {
+    CHIP_ESP32 = 1,
+} esp_chip_model_t;
+
+#define CHIP_FEATURE_EMB_FLASH      (1 << 0)
+#define CHIP_FEATURE_WIFI_BGN       (1 << 1)
+#define CHIP_FEATURE_BLE            (1 << 4)
+#define CHIP_FEATURE_BT             (1 << 5)
+
+typedef struct {
+    esp_chip_model_t model;
+    uint32_t features;
+    uint16_t revision;
+    uint8_t cores;
+} esp_chip_info_t;
+
+// Reports a dual-core ESP32 with WiFi, BT and BLE
+void esp_chip_info(esp_chip_info_t* out_info);
+
+#endif // HOST_ESP_CHIP_INFO_H
@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_CRC_H
+#define HOST_ESP_CRC_H
+
+#include <stdint.h>
+
+// Little-endian CRC32 with the ROM's conventions: esp_crc32_le(0, ...) is the zlib crc32
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#endif // HOST_ESP_CRC_H
@@ -0,0 +1,176 @@
+// Logging, error names, heap and chip queries
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_chip_info.h"
+#include "esp_mac.h"
+#include "esp_crc.h"
+#include "esp_crt_bundle.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_shim.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+// Nominal internal heap of an ESP32 after WiFi and lwIP are up; the free
+// figures are this minus what the harness process has live
+#define HOST_NOMINAL_HEAP           (200 * 1024)
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+static uint64_t log_errors = 0;
+static uint64_t log_warnings = 0;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t min_free_heap = HOST_NOMINAL_HEAP;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    // Per-tag levels are not needed by the harness, every tag follows "*"
+    log_level = level;
+}
+
+void host_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level == ESP_LOG_ERROR) {
+        __atomic_add_fetch(&log_errors, 1, __ATOMIC_RELAXED);
+    } else if (level == ESP_LOG_WARN) {
+        __atomic_add_fetch(&log_warnings, 1, __ATOMIC_RELAXED);
+    }
+    if (level > log_level) {
+        return;
+    }
+
+    static const char letters[] = "NEWIDV";
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&log_lock);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&log_lock);
+    va_end(args);
+}
+
+void host_log_get_counts(uint64_t* errors_out, uint64_t* warnings_out) {
+    if (errors_out) {
+        *errors_out = __atomic_load_n(&log_errors, __ATOMIC_RELAXED);
+    }
+    if (warnings_out) {
+        *warnings_out = __atomic_load_n(&log_warnings, __ATOMIC_RELAXED);
+    }
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void host_esp_error_check_failed(esp_err_t rc, const char* file, int line, const char* expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nexpression: %s\n",
+            rc, esp_err_to_name(rc), file, line, expression);
+    abort();
+}
+
+// Heap
+
+static size_t free_heap(void) {
+    host_alloc_stats_t stats;
+    host_alloc_get_stats(&stats);
+    size_t free_bytes = stats.live_bytes < HOST_NOMINAL_HEAP ? HOST_NOMINAL_HEAP - stats.live_bytes : 0;
+    if (free_bytes < min_free_heap) {
+        min_free_heap = free_bytes;
+    }
+    return free_bytes;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? NULL : malloc(size);
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? NULL : calloc(n, size);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+void heap_caps_get_info(multi_heap_info_t* info, uint32_t caps) {
+    memset(info, 0, sizeof(*info));
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return;
+    }
+    // One unfragmented region: there is no allocator layout to inspect on host
+    info->total_free_bytes = free_heap();
+    info->total_allocated_bytes = HOST_NOMINAL_HEAP - info->total_free_bytes;
+    info->largest_free_block = info->total_free_bytes;
+    info->minimum_free_bytes = min_free_heap;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : free_heap();
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return (uint32_t)free_heap();
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    free_heap();
+    return (uint32_t)min_free_heap;
+}
+
+const char* esp_get_idf_version(void) {
+    return "host";
+}
+
+void esp_chip_info(esp_chip_info_t* out_info) {
+    memset(out_info, 0, sizeof(*out_info));
+    out_info->model = CHIP_ESP32;
+    out_info->features = CHIP_FEATURE_WIFI_BGN | CHIP_FEATURE_BT | CHIP_FEATURE_BLE;
+    out_info->revision = 300;
+    out_info->cores = portNUM_PROCESSORS;
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type) {
+    static const uint8_t base[6] = { 0x02, 0x00, 0x00, 0xE5, 0x32, 0x00 };
+    memcpy(mac, base, sizeof(base));
+    mac[5] += (uint8_t)type;
+    return ESP_OK;
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+esp_err_t esp_crt_bundle_attach(void* conf) {
+    return ESP_OK;
+}
@@ -0,0 +1,29 @@
+#ifndef HOST_ESP_NETIF_H
+#define HOST_ESP_NETIF_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    uint32_t addr;                   // Network byte order
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef esp_err_t (*esp_netif_callback_fn)(void* ctx);
+
+// "WIFI_STA_DEF" is the simulated station, on the subnet given to sim_net_init()
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char* if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info);
+void* esp_netif_get_netif_impl(esp_netif_t* esp_netif);
+
+// Runs fn under the simulated stack lock, standing in for the lwIP thread
+esp_err_t esp_netif_tcpip_exec(esp_netif_callback_fn fn, void* ctx);
+
+#endif // HOST_ESP_NETIF_H
@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+// Heap figures are derived from the allocation counters (see host_shim.h)
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+const char* esp_get_idf_version(void);
+
+#endif // HOST_ESP_SYSTEM_H
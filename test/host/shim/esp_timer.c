@@ -0,0 +1,195 @@
+// esp_timer on one dispatcher thread, named "esp_timer" like the IDF task
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "shim_private.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#define HOST_MAX_TIMERS             32
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    bool used;
+    bool armed;
+    int64_t due_us;                  // Next expiry, esp_timer_get_time() based
+    uint64_t period_us;              // 0 for one-shot
+};
+
+static struct esp_timer timers[HOST_MAX_TIMERS];
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static pthread_cond_t idle_cond;     // Signalled after each callback, for esp_timer_delete()
+static struct esp_timer* running = NULL;
+static bool dispatcher_started = false;
+
+int64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void host_sleep_until_ns(int64_t deadline_ns) {
+    struct timespec ts = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+int64_t esp_timer_get_time(void) {
+    static int64_t epoch_ns = 0;
+    int64_t now_ns = host_now_ns();
+    int64_t expected = 0;
+    __atomic_compare_exchange_n(&epoch_ns, &expected, now_ns, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    return (now_ns - __atomic_load_n(&epoch_ns, __ATOMIC_RELAXED)) / 1000;
+}
+
+static void dispatcher_task(void* arg) {
+    pthread_mutex_lock(&timer_lock);
+    while (true) {
+        struct esp_timer* next = NULL;
+        for (int i = 0; i < HOST_MAX_TIMERS; i++) {
+            if (timers[i].used && timers[i].armed && (!next || timers[i].due_us < next->due_us)) {
+                next = &timers[i];
+            }
+        }
+
+        if (!next) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (next->due_us > now_us) {
+            int64_t deadline_ns = host_now_ns() + (next->due_us - now_us) * 1000;
+            struct timespec ts = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &ts);
+            continue;
+        }
+
+        // Periodic timers keep their phase; missed periods are skipped, not queued
+        if (next->period_us > 0) {
+            next->due_us += next->period_us;
+            if (next->due_us <= now_us) {
+                next->due_us = now_us + next->period_us;
+            }
+        } else {
+            next->armed = false;
+        }
+
+        esp_timer_cb_t callback = next->callback;
+        void* callback_arg = next->arg;
+        running = next;
+        pthread_mutex_unlock(&timer_lock);
+        callback(callback_arg);
+        pthread_mutex_lock(&timer_lock);
+        running = NULL;
+        pthread_cond_broadcast(&idle_cond);
+    }
+}
+
+static void start_dispatcher(void) {
+    if (dispatcher_started) {
+        return;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_cond_init(&idle_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    dispatcher_started = true;
+    xTaskCreate(dispatcher_task, "esp_timer", 3584, NULL, 22, NULL);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&timer_lock);
+    start_dispatcher();
+    struct esp_timer* timer = NULL;
+    for (int i = 0; i < HOST_MAX_TIMERS; i++) {
+        if (!timers[i].used) {
+            timer = &timers[i];
+            break;
+        }
+    }
+    if (timer) {
+        memset(timer, 0, sizeof(*timer));
+        timer->callback = create_args->callback;
+        timer->arg = create_args->arg;
+        timer->name = create_args->name;
+        timer->used = true;
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    *out_handle = timer;
+    return timer ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    if (!timer->armed) {
+        timer->armed = true;
+        timer->due_us = esp_timer_get_time() + (int64_t)timeout_us;
+        timer->period_us = period_us;
+        pthread_cond_signal(&timer_cond);
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return ret;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return arm(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    esp_err_t ret = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    pthread_mutex_unlock(&timer_lock);
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer_lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // A callback in flight still uses the timer; a callback deleting its own timer does not wait
+    while (running == timer && xTaskGetCurrentTaskHandle() != xTaskGetHandle("esp_timer")) {
+        pthread_cond_wait(&idle_cond, &timer_lock);
+    }
+    timer->used = false;
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&timer_lock);
+    bool active = timer && timer->armed;
+    pthread_mutex_unlock(&timer_lock);
+    return active;
+}
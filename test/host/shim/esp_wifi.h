@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+// The WiFi manager is replaced by host/shim/wifi_manager_host.c, which needs
+// none of the driver API
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_system.h"
+#include <stdint.h>
+
+#endif // HOST_ESP_WIFI_H
@@ -0,0 +1,391 @@
+// FreeRTOS tasks, notifications and mutexes on POSIX threads
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_private.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_MAX_TASKS              32
+#define TASK_NAME_SIZE              16
+
+struct host_task {
+    char name[TASK_NAME_SIZE];
+    pthread_t thread;
+    bool used;
+    bool idle;                       // Idle sentinel of a core, not a thread
+    uint32_t stack_depth;
+    TaskFunction_t code;
+    void* parameters;
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notify_cond;
+    uint32_t notify_count;
+};
+
+struct host_mutex {
+    pthread_mutex_t lock;
+    bool used;
+    int64_t taken_ns;                // When the current holder got it
+    host_lock_stats_t stats;
+};
+
+// Tables are fixed so creating a task or mutex never shows up in the allocation counters
+static struct host_task tasks[HOST_MAX_TASKS];
+static struct host_task idle_tasks[portNUM_PROCESSORS];
+static struct host_mutex mutexes[HOST_MAX_LOCKS];
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct host_task* current_task = NULL;
+static __thread char next_lock_name[HOST_LOCK_NAME_SIZE];
+
+// Runs a task function, then releases its slot if the function returns
+static void* task_entry(void* arg) {
+    struct host_task* task = (struct host_task*)arg;
+    current_task = task;
+    pthread_setname_np(pthread_self(), task->name);
+    task->code(task->parameters);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static struct host_task* alloc_task(const char* name, uint32_t stack_depth) {
+    pthread_mutex_lock(&table_lock);
+    struct host_task* task = NULL;
+    for (int i = 0; i < HOST_MAX_TASKS; i++) {
+        if (!tasks[i].used) {
+            task = &tasks[i];
+            break;
+        }
+    }
+    if (task) {
+        memset(task, 0, sizeof(*task));
+        snprintf(task->name, sizeof(task->name), "%s", name ? name : "task");
+        task->used = true;
+        task->stack_depth = stack_depth;
+        pthread_mutex_init(&task->notify_lock, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&task->notify_cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&table_lock);
+    return task;
+}
+
+static void free_task(struct host_task* task) {
+    pthread_mutex_lock(&table_lock);
+    task->used = false;
+    pthread_mutex_unlock(&table_lock);
+}
+
+// Absolute CLOCK_MONOTONIC deadline ticks from now
+static struct timespec deadline_after(TickType_t ticks) {
+    int64_t deadline_ns = host_now_ns() + (int64_t)ticks * portTICK_PERIOD_MS * 1000000LL;
+    struct timespec ts = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+    return ts;
+}
+
+void host_rtos_init(void) {
+    if (current_task) {
+        return;
+    }
+    struct host_task* task = alloc_task("main", 3584);
+    task->thread = pthread_self();
+    current_task = task;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        snprintf(idle_tasks[core].name, TASK_NAME_SIZE, "IDLE%d", core);
+        idle_tasks[core].idle = true;
+    }
+    esp_timer_get_time();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id) {
+    struct host_task* task = alloc_task(name, stack_depth);
+    if (!task) {
+        return pdFAIL;
+    }
+    task->code = task_code;
+    task->parameters = parameters;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (core_id != tskNO_AFFINITY) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((int)(core_id % (cpus > 0 ? cpus : 1)), &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+
+    // Published before the thread runs, it may notify itself or be looked up at once
+    if (created_task) {
+        *created_task = task;
+    }
+    int err = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free_task(task);
+        if (created_task) {
+            *created_task = NULL;
+        }
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task) {
+    return xTaskCreatePinnedToCore(task_code, name, stack_depth, parameters, priority, created_task,
+                                   tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        struct host_task* self = current_task;
+        if (self) {
+            free_task(self);
+        }
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+    free_task(task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    struct timespec deadline = deadline_after(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct host_task* task = current_task;
+    if (!task) {
+        return 0;
+    }
+
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    pthread_mutex_lock(&task->notify_lock);
+    while (task->notify_count == 0 && ticks_to_wait > 0) {
+        int err = ticks_to_wait == portMAX_DELAY ?
+            pthread_cond_wait(&task->notify_cond, &task->notify_lock) :
+            pthread_cond_timedwait(&task->notify_cond, &task->notify_lock, &deadline);
+        if (err == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notify_count;
+    if (value > 0) {
+        task->notify_count = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->notify_lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (!task || task->idle) {
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&task->notify_lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->notify_cond);
+    pthread_mutex_unlock(&task->notify_lock);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current_task;
+}
+
+TaskHandle_t xTaskGetHandle(const char* name) {
+    TaskHandle_t found = NULL;
+    pthread_mutex_lock(&table_lock);
+    for (int i = 0; i < HOST_MAX_TASKS && !found; i++) {
+        if (tasks[i].used && strcmp(tasks[i].name, name) == 0) {
+            found = &tasks[i];
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    return found;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    task = task ? task : current_task;
+    return task ? task->name : NULL;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Thread stacks are not painted on host, report the configured size
+    task = task ? task : current_task;
+    return task ? task->stack_depth : 0;
+}
+
+static uint64_t clock_us(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+configRUN_TIME_COUNTER_TYPE ulTaskGetRunTimeCounter(TaskHandle_t task) {
+    task = task ? task : current_task;
+    if (!task) {
+        return 0;
+    }
+    if (task->idle) {
+        int64_t wall_us = esp_timer_get_time();
+        int64_t busy_us = (int64_t)(clock_us(CLOCK_PROCESS_CPUTIME_ID) / portNUM_PROCESSORS);
+        return (configRUN_TIME_COUNTER_TYPE)(wall_us > busy_us ? wall_us - busy_us : 0);
+    }
+    clockid_t clock;
+    if (pthread_getcpuclockid(task->thread, &clock) != 0) {
+        return 0;
+    }
+    return (configRUN_TIME_COUNTER_TYPE)clock_us(clock);
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core_id) {
+    if (core_id < 0 || core_id >= portNUM_PROCESSORS) {
+        return NULL;
+    }
+    return &idle_tasks[core_id];
+}
+
+// Mutexes
+
+void host_rtos_set_lock_name(const char* name) {
+    snprintf(next_lock_name, sizeof(next_lock_name), "%s", name ? name : "");
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    const char* base = next_lock_name[0] ? next_lock_name : "mutex";
+    struct host_mutex* mutex = NULL;
+
+    pthread_mutex_lock(&table_lock);
+    int duplicates = 0;
+    for (int i = 0; i < HOST_MAX_LOCKS; i++) {
+        if (!mutexes[i].used) {
+            if (!mutex) {
+                mutex = &mutexes[i];
+            }
+            continue;
+        }
+        if (strncmp(mutexes[i].stats.name, base, strlen(base)) == 0 &&
+            (mutexes[i].stats.name[strlen(base)] == '\0' || mutexes[i].stats.name[strlen(base)] == '#')) {
+            duplicates++;
+        }
+    }
+    if (mutex) {
+        memset(mutex, 0, sizeof(*mutex));
+        pthread_mutex_init(&mutex->lock, NULL);
+        if (duplicates > 0) {
+            snprintf(mutex->stats.name, sizeof(mutex->stats.name), "%.26s#%u", base, (unsigned)(duplicates + 1) % 100);
+        } else {
+            snprintf(mutex->stats.name, sizeof(mutex->stats.name), "%s", base);
+        }
+        mutex->used = true;
+    }
+    pthread_mutex_unlock(&table_lock);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait) {
+    if (pthread_mutex_trylock(&mutex->lock) != 0) {
+        if (ticks_to_wait == 0) {
+            __atomic_add_fetch(&mutex->stats.timeouts, 1, __ATOMIC_RELAXED);
+            return pdFALSE;
+        }
+
+        int64_t wait_start_ns = host_now_ns();
+        int err;
+        if (ticks_to_wait == portMAX_DELAY) {
+            err = pthread_mutex_lock(&mutex->lock);
+        } else {
+            int64_t deadline_ns = wait_start_ns + (int64_t)ticks_to_wait * portTICK_PERIOD_MS * 1000000LL;
+            struct timespec deadline = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+            err = pthread_mutex_clocklock(&mutex->lock, CLOCK_MONOTONIC, &deadline);
+        }
+        if (err != 0) {
+            __atomic_add_fetch(&mutex->stats.timeouts, 1, __ATOMIC_RELAXED);
+            return pdFALSE;
+        }
+
+        // Counted while holding the mutex, so no other taker races these fields
+        uint64_t waited_ns = (uint64_t)(host_now_ns() - wait_start_ns);
+        mutex->stats.contended++;
+        mutex->stats.wait_ns_total += waited_ns;
+        if (waited_ns > mutex->stats.wait_ns_max) {
+            mutex->stats.wait_ns_max = waited_ns;
+        }
+    }
+    mutex->stats.takes++;
+    mutex->taken_ns = host_now_ns();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    uint64_t held_ns = (uint64_t)(host_now_ns() - mutex->taken_ns);
+    mutex->stats.hold_ns_total += held_ns;
+    if (held_ns > mutex->stats.hold_ns_max) {
+        mutex->stats.hold_ns_max = held_ns;
+    }
+    return pthread_mutex_unlock(&mutex->lock) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+    if (!mutex) {
+        return;
+    }
+    pthread_mutex_lock(&table_lock);
+    pthread_mutex_destroy(&mutex->lock);
+    mutex->used = false;
+    pthread_mutex_unlock(&table_lock);
+}
+
+int host_rtos_get_lock_stats(host_lock_stats_t* stats_out, int max) {
+    int count = 0;
+    pthread_mutex_lock(&table_lock);
+    for (int i = 0; i < HOST_MAX_LOCKS && count < max; i++) {
+        if (mutexes[i].used) {
+            stats_out[count++] = mutexes[i].stats;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    return count;
+}
+
+void host_rtos_reset_lock_stats(void) {
+    pthread_mutex_lock(&table_lock);
+    for (int i = 0; i < HOST_MAX_LOCKS; i++) {
+        if (!mutexes[i].used) {
+            continue;
+        }
+        // Each mutex is reset under itself so a holder's give stays consistent
+        pthread_mutex_lock(&mutexes[i].lock);
+        char name[HOST_LOCK_NAME_SIZE];
+        memcpy(name, mutexes[i].stats.name, sizeof(name));
+        memset(&mutexes[i].stats, 0, sizeof(mutexes[i].stats));
+        memcpy(mutexes[i].stats.name, name, sizeof(name));
+        pthread_mutex_unlock(&mutexes[i].lock);
+    }
+    pthread_mutex_unlock(&table_lock);
+}
@@ -0,0 +1,55 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// FreeRTOS kernel API on POSIX threads, just enough for the firmware modules.
+// Tasks are threads, mutexes are pthread mutexes that keep hold and wait
+// statistics (see host_shim.h), ticks follow CONFIG_FREERTOS_HZ in real time.
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+#define portMAX_DELAY               ((TickType_t)0xffffffffUL)
+
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS          ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define configMAX_PRIORITIES        25
+
+#ifdef CONFIG_FREERTOS_UNICORE
+#define portNUM_PROCESSORS          1
+#else
+#define portNUM_PROCESSORS          2
+#endif
+#define tskNO_AFFINITY              ((BaseType_t)0x7FFFFFFF)
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS 1
+#else
+#define configGENERATE_RUN_TIME_STATS 0
+#endif
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#define portGET_RUN_TIME_COUNTER_VALUE() ((configRUN_TIME_COUNTER_TYPE)esp_timer_get_time())
+int64_t esp_timer_get_time(void);
+
+#ifndef BIT0
+#define BIT0                        (1UL << 0)
+#define BIT1                        (1UL << 1)
+#define BIT2                        (1UL << 2)
+#define BIT3                        (1UL << 3)
+#define BIT4                        (1UL << 4)
+#define BIT5                        (1UL << 5)
+#define BIT6                        (1UL << 6)
+#define BIT7                        (1UL << 7)
+#endif
+
+#endif // HOST_FREERTOS_H
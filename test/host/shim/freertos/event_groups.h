@@ -0,0 +1,11 @@
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H
+#define HOST_FREERTOS_EVENT_GROUPS_H
+
+// Types only: the modules that use event groups (wifi_manager, main) are not
+// part of the harness, but wifi_manager.h pulls this header in
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#endif // HOST_FREERTOS_EVENT_GROUPS_H
@@ -0,0 +1,16 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"     // Through queue.h on the target
+
+typedef struct host_mutex* SemaphoreHandle_t;
+
+// Mutexes only; each one records its takes, contention and hold times under
+// the name given to host_rtos_set_lock_name() before it was created
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+
+#endif // HOST_FREERTOS_SEMPHR_H
@@ -0,0 +1,38 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+// Stack depth is in bytes, as in ESP-IDF; it is only reported back, threads
+// get the default pthread stack. The priority is ignored.
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created_task);
+
+// Pins the thread to host CPU core_id modulo the CPU count, tskNO_AFFINITY leaves it free
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name, uint32_t stack_depth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id);
+
+// NULL ends the calling task; another task is cancelled at its next delay or wait
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetHandle(const char* name);
+char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+// Thread CPU time in microseconds, on the same clock as portGET_RUN_TIME_COUNTER_VALUE()
+configRUN_TIME_COUNTER_TYPE ulTaskGetRunTimeCounter(TaskHandle_t task);
+
+// Idle time per core is the wall time not spent by the process, spread over the cores
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core_id);
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,221 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+// Harness-side API of the host shims: configures the simulated network and
+// broker, and reads back the counters the shims keep. Firmware code never
+// includes this header.
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- FreeRTOS ----
+
+#define HOST_LOCK_NAME_SIZE         32
+#define HOST_MAX_LOCKS              32
+
+// Counters of one mutex, since it was created or last reset
+typedef struct {
+    char name[HOST_LOCK_NAME_SIZE];
+    uint64_t takes;                  // Successful xSemaphoreTake() calls
+    uint64_t contended;              // Takes that found the mutex held
+    uint64_t timeouts;               // Takes that gave up
+    uint64_t hold_ns_total;          // Time between take and give, summed
+    uint64_t hold_ns_max;
+    uint64_t wait_ns_total;          // Time spent blocked in contended takes
+    uint64_t wait_ns_max;
+} host_lock_stats_t;
+
+/**
+ * @brief Register the calling thread as the "main" task
+ *
+ * Call first thing in main(), before anything creates a task or timer.
+ */
+void host_rtos_init(void);
+
+/**
+ * @brief Name the next mutex created by the calling thread
+ *
+ * The firmware creates its mutexes inside its init functions, so the harness
+ * names them by calling this right before each init. Unnamed mutexes are
+ * reported as "mutex". A name that is already taken gets a "#2" suffix.
+ *
+ * @param name Lock name, NULL to return to "mutex"
+ */
+void host_rtos_set_lock_name(const char* name);
+
+/**
+ * @brief Copy the counters of every live mutex, in creation order
+ * @param stats_out Receives up to max entries
+ * @param max Capacity of stats_out
+ * @return Number of entries written
+ */
+int host_rtos_get_lock_stats(host_lock_stats_t* stats_out, int max);
+
+/**
+ * @brief Zero the counters of every mutex (names are kept)
+ */
+void host_rtos_reset_lock_stats(void);
+
+// ---- Heap ----
+
+// Counters of the malloc family as called from firmware and harness code
+// (libc's internal allocations are not seen). The shims allocate their own
+// bookkeeping outside these counters.
+typedef struct {
+    uint64_t allocs;                 // malloc, calloc and realloc(NULL, n) calls that succeeded
+    uint64_t frees;                  // free and realloc(p, 0) calls with a non-NULL pointer
+    uint64_t reallocs;               // realloc calls on an existing block
+    uint64_t bytes;                  // Bytes requested, summed
+    uint64_t live_bytes;             // Usable bytes currently allocated
+    uint64_t peak_bytes;             // Highest live_bytes seen
+} host_alloc_stats_t;
+
+void host_alloc_get_stats(host_alloc_stats_t* stats_out);
+
+// ---- Logging ----
+
+/**
+ * @brief Count every error and warning logged, whatever the level filter
+ * @param errors_out Receives the ESP_LOGE count, can be NULL
+ * @param warnings_out Receives the ESP_LOGW count, can be NULL
+ */
+void host_log_get_counts(uint64_t* errors_out, uint64_t* warnings_out);
+
+// ---- NVS ----
+
+typedef struct {
+    uint64_t commits;                // nvs_commit() calls
+    uint64_t writes;                 // nvs_set_blob() calls
+    uint64_t bytes_written;          // Blob bytes passed to nvs_set_blob()
+} host_nvs_stats_t;
+
+void host_nvs_get_stats(host_nvs_stats_t* stats_out);
+
+// ---- Network ----
+
+#define SIM_NET_MAX_HOSTS           1024
+#define SIM_NET_MAX_PORTS           4
+
+// Behaviour of one simulated host
+typedef struct {
+    uint32_t ipv4;                   // Address, network byte order
+    uint8_t mac[6];                  // Answered to ARP requests
+    bool online;                     // Offline hosts answer nothing
+    uint32_t latency_us;             // One-way delay is not modelled, this is the RTT
+    uint32_t jitter_us;              // RTT is uniform in latency_us +- jitter_us
+    uint16_t loss_permille;          // Chance a request or its reply is lost
+    uint16_t open_ports[SIM_NET_MAX_PORTS]; // TCP ports that accept, UDP ports that reply;
+    uint8_t port_count;              // closed TCP ports refuse after the RTT
+} sim_host_t;
+
+typedef struct {
+    uint64_t tcp_connects;           // Non-blocking connects started
+    uint64_t udp_requests;           // Datagrams sent to a connected UDP socket
+    uint64_t icmp_requests;          // Echo requests sent
+    uint64_t arp_requests;           // etharp_request() calls
+    uint64_t replies;                // Answers due (accepts, refusals, datagrams, echo and ARP replies)
+    uint64_t magic_packets;          // Wake-on-LAN packets sent
+    uint64_t selects;                // select() calls
+    uint64_t socket_failures;        // socket() refused because CONFIG_LWIP_MAX_SOCKETS were open
+    int sockets_open;                // Sockets open now
+    int sockets_max;                 // Most sockets open at once
+} sim_net_stats_t;
+
+/**
+ * @brief Set up the simulated station interface and forget all hosts
+ * @param ipv4 Station address, network byte order
+ * @param netmask Subnet mask, network byte order
+ * @param seed Seed of the loss and jitter generator, runs with the same seed draw the same sequence
+ */
+void sim_net_init(uint32_t ipv4, uint32_t netmask, uint32_t seed);
+
+/**
+ * @brief Add a host, or replace the one with the same address
+ * @param host Host behaviour
+ * @return ESP_OK, ESP_ERR_NO_MEM when SIM_NET_MAX_HOSTS are defined
+ */
+esp_err_t sim_net_add_host(const sim_host_t* host);
+
+/**
+ * @brief Change whether a host answers
+ * @param ipv4 Address, network byte order
+ * @param online New state
+ * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown address
+ */
+esp_err_t sim_net_set_online(uint32_t ipv4, bool online);
+
+void sim_net_get_stats(sim_net_stats_t* stats_out);
+void sim_net_reset_stats(void);
+
+// ---- Broker ----
+
+typedef struct {
+    uint64_t publishes;              // esp_mqtt_client_publish() calls that reached the broker
+    uint64_t enqueued;               // esp_mqtt_client_enqueue() calls
+    uint64_t delivered;              // Messages written to the broker, both paths
+    uint64_t bytes;                  // Topic and payload bytes of delivered messages
+    uint64_t subscribes;             // Topic filters subscribed
+    uint64_t injected;               // Messages delivered to the client with sim_broker_inject()
+    uint64_t rejected;               // Publishes refused while disconnected
+    uint64_t publish_wait_ns;        // Time callers spent inside esp_mqtt_client_publish()
+    size_t outbox_peak_bytes;        // Largest outbox seen
+} sim_broker_stats_t;
+
+// Called for every message written to the broker, from the thread that wrote it
+typedef void (*sim_broker_tap_t)(const char* topic, int topic_len, int payload_len, int qos, void* arg);
+
+/**
+ * @brief Set the time one message takes on the wire
+ *
+ * esp_mqtt_client_publish() pays it on the calling thread, like a blocking
+ * TLS write; enqueued messages pay it on mqtt_task.
+ *
+ * @param delay_us Delay per message in microseconds
+ */
+void sim_broker_set_write_delay_us(uint32_t delay_us);
+
+/**
+ * @brief Set the time from esp_mqtt_client_start() to MQTT_EVENT_CONNECTED
+ * @param delay_us Delay in microseconds
+ */
+void sim_broker_set_connect_delay_us(uint32_t delay_us);
+
+void sim_broker_set_tap(sim_broker_tap_t tap, void* arg);
+
+/**
+ * @brief Wait until the client is connected and its subscriptions are acknowledged
+ * @param timeout_ms Longest wait
+ * @return true if connected in time
+ */
+bool sim_broker_wait_connected(uint32_t timeout_ms);
+
+/**
+ * @brief Deliver a message to the client as a broker publish would
+ * @param topic Topic
+ * @param data Payload
+ * @param len Payload length, -1 for strlen(data)
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without a started client
+ */
+esp_err_t sim_broker_inject(const char* topic, const char* data, int len);
+
+/**
+ * @brief Wait until mqtt_task has delivered every queued message
+ * @param timeout_ms Longest wait
+ * @return true if the outbox drained in time
+ */
+bool sim_broker_flush(uint32_t timeout_ms);
+
+void sim_broker_get_stats(sim_broker_stats_t* stats_out);
+void sim_broker_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SHIM_H
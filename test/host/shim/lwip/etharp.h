@@ -0,0 +1,36 @@
+#ifndef HOST_LWIP_ETHARP_H
+#define HOST_LWIP_ETHARP_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK 0
+
+typedef struct {
+    uint32_t addr;                   // Network byte order
+} ip4_addr_t;
+
+struct eth_addr {
+    uint8_t addr[6];
+};
+
+struct netif {
+    ip4_addr_t ip_addr;
+    ip4_addr_t netmask;
+};
+
+#define ip4_addr_set_u32(dest, src) ((dest)->addr = (src))
+#define ip4_addr_get_u32(src)       ((src)->addr)
+
+#define ETHARP_SUPPORT_STATIC_ENTRIES 1
+
+// The simulated ARP cache: a request is answered after the target's latency,
+// unless the target is offline or the reply is lost
+err_t etharp_request(struct netif* netif, const ip4_addr_t* ipaddr);
+err_t etharp_add_static_entry(const ip4_addr_t* ipaddr, struct eth_addr* ethaddr);
+err_t etharp_remove_static_entry(const ip4_addr_t* ipaddr);
+int etharp_find_addr(struct netif* netif, const ip4_addr_t* ipaddr, struct eth_addr** eth_ret,
+                     const ip4_addr_t** ip_ret);
+
+#endif // HOST_LWIP_ETHARP_H
@@ -0,0 +1,22 @@
+#ifndef HOST_LWIP_ICMP_H
+#define HOST_LWIP_ICMP_H
+
+#include <stdint.h>
+
+#define ICMP_ER                     0      // Echo reply
+#define ICMP_ECHO                   8      // Echo request
+
+struct icmp_echo_hdr {
+    uint8_t type;
+    uint8_t code;
+    uint16_t chksum;
+    uint16_t id;
+    uint16_t seqno;
+} __attribute__((packed));
+
+#define ICMPH_TYPE(hdr)             ((hdr)->type)
+#define ICMPH_CODE(hdr)             ((hdr)->code)
+#define ICMPH_TYPE_SET(hdr, t)      ((hdr)->type = (t))
+#define ICMPH_CODE_SET(hdr, c)      ((hdr)->code = (c))
+
+#endif // HOST_LWIP_ICMP_H
@@ -0,0 +1,9 @@
+#ifndef HOST_LWIP_INET_CHKSUM_H
+#define HOST_LWIP_INET_CHKSUM_H
+
+#include <stdint.h>
+
+// RFC 1071 checksum over len bytes, in network byte order
+uint16_t inet_chksum(const void* dataptr, uint16_t len);
+
+#endif // HOST_LWIP_INET_CHKSUM_H
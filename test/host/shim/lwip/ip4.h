@@ -0,0 +1,24 @@
+#ifndef HOST_LWIP_IP4_H
+#define HOST_LWIP_IP4_H
+
+#include <stdint.h>
+
+#define IP_HLEN                     20
+
+struct ip_hdr {
+    uint8_t _v_hl;
+    uint8_t _tos;
+    uint16_t _len;
+    uint16_t _id;
+    uint16_t _offset;
+    uint8_t _ttl;
+    uint8_t _proto;
+    uint16_t _chksum;
+    uint32_t src;
+    uint32_t dest;
+} __attribute__((packed));
+
+#define IPH_V(hdr)                  ((hdr)->_v_hl >> 4)
+#define IPH_HL(hdr)                 ((hdr)->_v_hl & 0x0f)
+
+#endif // HOST_LWIP_IP4_H
@@ -0,0 +1,15 @@
+#ifndef HOST_LWIP_NETDB_H
+#define HOST_LWIP_NETDB_H
+
+// Every name resolves at once to the loopback address; the fake broker never
+// connects to it
+#include "lwip/sockets.h"
+#include <netdb.h>
+
+int sim_getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res);
+void sim_freeaddrinfo(struct addrinfo* res);
+
+#define getaddrinfo(node, service, hints, res)  sim_getaddrinfo(node, service, hints, res)
+#define freeaddrinfo(res)                       sim_freeaddrinfo(res)
+
+#endif // HOST_LWIP_NETDB_H
@@ -0,0 +1,17 @@
+#ifndef HOST_LWIP_OPT_H
+#define HOST_LWIP_OPT_H
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_LWIP_STATS
+#define LWIP_STATS                  1
+#define MEMP_STATS                  1
+#else
+#define LWIP_STATS                  0
+#define MEMP_STATS                  0
+#endif
+
+#define LWIP_TCP                    1
+#define LWIP_UDP                    1
+
+#endif // HOST_LWIP_OPT_H
@@ -0,0 +1,49 @@
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+// The BSD socket calls the firmware makes are routed to the simulated network
+// in sim_net.c; the host headers only supply types and constants. Descriptors
+// are numbered like lwIP's, from LWIP_SOCKET_OFFSET, and at most
+// CONFIG_LWIP_MAX_SOCKETS are open at once (ENFILE beyond that).
+
+#include "sdkconfig.h"
+#include "freertos/semphr.h"   // lwIP's sys_arch.h brings these in on the target
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define LWIP_SOCKET_OFFSET          (64 - CONFIG_LWIP_MAX_SOCKETS)
+
+int sim_socket(int domain, int type, int protocol);
+int sim_connect(int fd, const struct sockaddr* addr, socklen_t len);
+int sim_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+ssize_t sim_send(int fd, const void* buf, size_t len, int flags);
+ssize_t sim_recv(int fd, void* buf, size_t len, int flags);
+ssize_t sim_sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* addr, socklen_t addr_len);
+ssize_t sim_recvfrom(int fd, void* buf, size_t len, int flags, struct sockaddr* addr, socklen_t* addr_len);
+int sim_close(int fd);
+int sim_fcntl(int fd, int cmd, int arg);
+int sim_setsockopt(int fd, int level, int optname, const void* optval, socklen_t optlen);
+int sim_getsockopt(int fd, int level, int optname, void* optval, socklen_t* optlen);
+
+#define socket(domain, type, protocol)          sim_socket(domain, type, protocol)
+#define connect(fd, addr, len)                  sim_connect(fd, addr, len)
+#define select(n, r, w, e, t)                   sim_select(n, r, w, e, t)
+#define send(fd, buf, len, flags)               sim_send(fd, buf, len, flags)
+#define recv(fd, buf, len, flags)               sim_recv(fd, buf, len, flags)
+#define sendto(fd, buf, len, flags, addr, alen) sim_sendto(fd, buf, len, flags, addr, alen)
+#define recvfrom(fd, buf, len, flags, addr, alen) sim_recvfrom(fd, buf, len, flags, addr, alen)
+#define close(fd)                               sim_close(fd)
+#define fcntl(fd, cmd, arg)                     sim_fcntl(fd, cmd, arg)
+#define lwip_fcntl(fd, cmd, arg)                sim_fcntl(fd, cmd, arg)
+#define setsockopt(fd, level, name, val, len)   sim_setsockopt(fd, level, name, val, len)
+#define getsockopt(fd, level, name, val, len)   sim_getsockopt(fd, level, name, val, len)
+
+#endif // HOST_LWIP_SOCKETS_H
@@ -0,0 +1,24 @@
+#ifndef HOST_LWIP_STATS_H
+#define HOST_LWIP_STATS_H
+
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+#include <stdint.h>
+
+struct stats_mem {
+    const char* name;
+    uint16_t err;
+    uint16_t avail;
+    uint16_t used;
+    uint16_t max;
+    uint16_t illegal;
+};
+
+struct stats_ {
+    struct stats_mem* memp[MEMP_MAX];
+};
+
+// PCB pools follow the simulated sockets; there are no pbufs on host
+extern struct stats_ lwip_stats;
+
+#endif // HOST_LWIP_STATS_H
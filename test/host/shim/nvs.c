@@ -0,0 +1,175 @@
+// In-memory NVS: blobs only, which is all the firmware stores
+
+#include "nvs.h"
+#include "host_shim.h"
+#include "shim_private.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+
+#define NVS_MAX_ENTRIES             32
+#define NVS_MAX_HANDLES             8
+#define NVS_KEY_SIZE                16     // 15 characters, as on the target
+
+typedef struct {
+    bool used;
+    char namespace_name[NVS_KEY_SIZE];
+    char key[NVS_KEY_SIZE];
+    void* data;
+    size_t length;
+} nvs_entry_t;
+
+typedef struct {
+    bool used;
+    bool writable;
+    char namespace_name[NVS_KEY_SIZE];
+} nvs_open_handle_t;
+
+static nvs_entry_t entries[NVS_MAX_ENTRIES];
+static nvs_open_handle_t handles[NVS_MAX_HANDLES];
+static host_nvs_stats_t nvs_stats;
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static nvs_open_handle_t* get_handle(nvs_handle_t handle) {
+    if (handle == 0 || handle > NVS_MAX_HANDLES || !handles[handle - 1].used) {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static nvs_entry_t* find_entry(const char* namespace_name, const char* key) {
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].namespace_name, namespace_name) == 0 &&
+            (!key || strcmp(entries[i].key, key) == 0)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    if (!name || strlen(name) >= NVS_KEY_SIZE || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    // A namespace only exists once something was written to it
+    if (open_mode == NVS_READONLY && !find_entry(name, NULL)) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        for (int i = 0; i < NVS_MAX_HANDLES; i++) {
+            if (!handles[i].used) {
+                handles[i].used = true;
+                handles[i].writable = (open_mode == NVS_READWRITE);
+                snprintf(handles[i].namespace_name, NVS_KEY_SIZE, "%s", name);
+                *out_handle = (nvs_handle_t)(i + 1);
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t* open_handle = get_handle(handle);
+    if (open_handle) {
+        open_handle->used = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = ESP_OK;
+    nvs_open_handle_t* open_handle = get_handle(handle);
+    nvs_entry_t* entry = open_handle ? find_entry(open_handle->namespace_name, key) : NULL;
+    if (!open_handle) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!entry) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (!out_value) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        *length = entry->length;
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->data, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    if (!key || strlen(key) >= NVS_KEY_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = ESP_OK;
+    nvs_open_handle_t* open_handle = get_handle(handle);
+    if (!open_handle || !open_handle->writable) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else {
+        nvs_entry_t* entry = find_entry(open_handle->namespace_name, key);
+        for (int i = 0; i < NVS_MAX_ENTRIES && !entry; i++) {
+            if (!entries[i].used) {
+                entry = &entries[i];
+                memset(entry, 0, sizeof(*entry));
+                snprintf(entry->namespace_name, NVS_KEY_SIZE, "%s", open_handle->namespace_name);
+                snprintf(entry->key, NVS_KEY_SIZE, "%s", key);
+                entry->used = true;
+            }
+        }
+        void* data = entry ? __real_malloc(length > 0 ? length : 1) : NULL;
+        if (!data) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(data, value, length);
+            __real_free(entry->data);
+            entry->data = data;
+            entry->length = length;
+            nvs_stats.writes++;
+            nvs_stats.bytes_written += length;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = ESP_OK;
+    nvs_open_handle_t* open_handle = get_handle(handle);
+    nvs_entry_t* entry = open_handle ? find_entry(open_handle->namespace_name, key) : NULL;
+    if (!open_handle || !open_handle->writable) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!entry) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        __real_free(entry->data);
+        entry->used = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t ret = get_handle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    if (ret == ESP_OK) {
+        nvs_stats.commits++;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+void host_nvs_get_stats(host_nvs_stats_t* stats_out) {
+    pthread_mutex_lock(&nvs_lock);
+    *stats_out = nvs_stats;
+    pthread_mutex_unlock(&nvs_lock);
+}
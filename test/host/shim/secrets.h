@@ -0,0 +1,33 @@
+#ifndef SECRETS_H
+#define SECRETS_H
+
+// Host harness settings, used when include/secrets.h does not exist. Nothing
+// leaves the process: the broker and the network are simulated.
+
+#define WIFI_SSID          "host-sim"
+#define WIFI_PASSWORD      "host-sim"
+
+#define MQTT_BROKER_HOST   "broker.sim"
+#define MQTT_BROKER_PORT   8883
+#define MQTT_USERNAME      "bench"
+#define MQTT_PASSWORD      "bench"
+#define MQTT_CLIENT_ID     "ESP32_host_bench"
+
+#define DEVICE_NAME        "ESP32_host_bench"
+#define DEVICE_LOCATION    "host"
+
+#define MQTT_TOPIC_PREFIX  "esp32"
+
+#define MQTT_TOPIC_HELLO       MQTT_TOPIC_PREFIX "/hello"
+#define MQTT_TOPIC_STATUS      MQTT_TOPIC_PREFIX "/status"
+#define MQTT_TOPIC_DEVICE_INFO MQTT_TOPIC_PREFIX "/device_info"
+#define MQTT_TOPIC_PING_RESULTS MQTT_TOPIC_PREFIX "/ping"
+#define MQTT_TOPIC_COMMANDS    MQTT_TOPIC_PREFIX "/commands"
+
+#define MQTT_KEEPALIVE     60
+#define MQTT_TIMEOUT_MS    10000
+#define WIFI_RETRY_COUNT   10
+
+#define MQTT_BROKER_URI    "mqtts://" MQTT_BROKER_HOST ":8883"
+
+#endif // SECRETS_H
@@ -0,0 +1,21 @@
+#ifndef HOST_SHIM_PRIVATE_H
+#define HOST_SHIM_PRIVATE_H
+
+// Shared by the shim sources only
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The shims allocate their own bookkeeping with the linker's --wrap escape
+// hatch, so only firmware and harness allocations are counted
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void __real_free(void* ptr);
+
+// CLOCK_MONOTONIC in nanoseconds
+int64_t host_now_ns(void);
+
+// Sleep until an absolute host_now_ns() time
+void host_sleep_until_ns(int64_t deadline_ns);
+
+#endif // HOST_SHIM_PRIVATE_H
@@ -0,0 +1,516 @@
+// esp-mqtt client talking to an in-process fake broker.
+//
+// esp_mqtt_client_start() spawns "mqtt_task", which connects after the
+// configured delay and then runs the event handler and the outbox the way
+// esp-mqtt does. Every message written to the broker costs the configured
+// write delay: on the caller for esp_mqtt_client_publish(), on mqtt_task for
+// esp_mqtt_client_enqueue(). The broker accepts every subscription and
+// acknowledges QoS 1 messages at once.
+
+#include "mqtt_client.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "host_shim.h"
+#include "shim_private.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct sim_message {
+    struct sim_message* next;
+    esp_mqtt_event_id_t event_id;    // Event to dispatch, or MQTT_EVENT_ANY for an outbox message
+    int msg_id;
+    int qos;
+    int topic_len;
+    int data_len;
+    char* topic;                     // Both in the same allocation as the message
+    char* data;
+} sim_message_t;
+
+typedef struct {
+    sim_message_t* head;
+    sim_message_t* tail;
+} sim_queue_t;
+
+struct esp_mqtt_client {
+    esp_event_handler_t handler;
+    void* handler_arg;
+    SemaphoreHandle_t api_lock;      // Serializes writes to the broker, like the esp-mqtt client lock
+    pthread_mutex_t lock;            // Guards everything below
+    pthread_cond_t cond;
+    sim_queue_t events;
+    sim_queue_t outbox;
+    size_t outbox_bytes;
+    bool running;
+    bool connected;
+    bool ready;                      // CONNECTED handled and every SUBACK dispatched
+    bool stopped;                    // mqtt_task has exited
+    int pending_subacks;
+    int busy;                        // Messages being written or dispatched right now
+    int next_msg_id;
+    int sock;                        // Simulated socket held while connected
+};
+
+static esp_mqtt_client_handle_t active_client = NULL;
+static sim_broker_stats_t broker_stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t write_delay_us = 1000;
+static uint32_t connect_delay_us = 50000;
+static sim_broker_tap_t broker_tap = NULL;
+static void* broker_tap_arg = NULL;
+
+static sim_message_t* new_message(esp_mqtt_event_id_t event_id, const char* topic, int topic_len,
+                                  const char* data, int data_len) {
+    sim_message_t* msg = __real_malloc(sizeof(*msg) + topic_len + 1 + data_len + 1);
+    if (!msg) {
+        return NULL;
+    }
+    memset(msg, 0, sizeof(*msg));
+    msg->event_id = event_id;
+    msg->topic = (char*)(msg + 1);
+    msg->data = msg->topic + topic_len + 1;
+    msg->topic_len = topic_len;
+    msg->data_len = data_len;
+    if (topic_len > 0) {
+        memcpy(msg->topic, topic, topic_len);
+    }
+    msg->topic[topic_len] = '\0';
+    if (data_len > 0) {
+        memcpy(msg->data, data, data_len);
+    }
+    msg->data[data_len] = '\0';
+    return msg;
+}
+
+static void push(sim_queue_t* queue, sim_message_t* msg) {
+    msg->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = msg;
+    } else {
+        queue->head = msg;
+    }
+    queue->tail = msg;
+}
+
+static sim_message_t* pop(sim_queue_t* queue) {
+    sim_message_t* msg = queue->head;
+    if (msg) {
+        queue->head = msg->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+    }
+    return msg;
+}
+
+static void free_queue(sim_queue_t* queue) {
+    sim_message_t* msg;
+    while ((msg = pop(queue)) != NULL) {
+        __real_free(msg);
+    }
+}
+
+// Under client->lock
+static int next_msg_id(esp_mqtt_client_handle_t client) {
+    client->next_msg_id = client->next_msg_id % 65535 + 1;
+    return client->next_msg_id;
+}
+
+// Under client->lock
+static void queue_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, int msg_id,
+                        const char* topic, int topic_len, const char* data, int data_len) {
+    sim_message_t* msg = new_message(event_id, topic, topic_len, data, data_len);
+    if (msg) {
+        msg->msg_id = msg_id;
+        push(&client->events, msg);
+        pthread_cond_broadcast(&client->cond);
+    }
+}
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, const sim_message_t* msg) {
+    esp_mqtt_error_codes_t error = { 0 };
+    esp_mqtt_event_t event = {
+        .event_id = event_id,
+        .client = client,
+        .error_handle = &error,
+    };
+    if (msg) {
+        event.msg_id = msg->msg_id;
+        if (event_id == MQTT_EVENT_DATA) {
+            event.topic = msg->topic;
+            event.topic_len = msg->topic_len;
+            event.data = msg->data;
+            event.data_len = msg->data_len;
+            event.total_data_len = msg->data_len;
+        }
+    }
+    if (client->handler) {
+        client->handler(client->handler_arg, "MQTT_EVENTS", event_id, &event);
+    }
+}
+
+// Writes one message to the broker, paying the wire time; under api_lock
+static void deliver(const char* topic, int topic_len, int data_len, int qos) {
+    if (write_delay_us > 0) {
+        host_sleep_until_ns(host_now_ns() + (int64_t)write_delay_us * 1000);
+    }
+    pthread_mutex_lock(&stats_lock);
+    broker_stats.delivered++;
+    broker_stats.bytes += topic_len + data_len;
+    sim_broker_tap_t tap = broker_tap;
+    void* tap_arg = broker_tap_arg;
+    pthread_mutex_unlock(&stats_lock);
+    if (tap) {
+        tap(topic, topic_len, data_len, qos, tap_arg);
+    }
+}
+
+static void mqtt_task(void* arg) {
+    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)arg;
+
+    dispatch(client, MQTT_EVENT_BEFORE_CONNECT, NULL);
+    host_sleep_until_ns(host_now_ns() + (int64_t)connect_delay_us * 1000);
+
+    pthread_mutex_lock(&client->lock);
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    client->connected = true;
+    pthread_mutex_unlock(&client->lock);
+    dispatch(client, MQTT_EVENT_CONNECTED, NULL);
+
+    pthread_mutex_lock(&client->lock);
+    client->ready = true;
+    while (client->running) {
+        sim_message_t* msg = pop(&client->events);
+        if (msg) {
+            client->busy++;
+            pthread_mutex_unlock(&client->lock);
+            dispatch(client, msg->event_id, msg);
+            pthread_mutex_lock(&client->lock);
+            if (msg->event_id == MQTT_EVENT_SUBSCRIBED) {
+                client->pending_subacks--;
+            }
+            client->busy--;
+            __real_free(msg);
+            pthread_cond_broadcast(&client->cond);
+            continue;
+        }
+
+        msg = pop(&client->outbox);
+        if (msg) {
+            client->busy++;
+            pthread_mutex_unlock(&client->lock);
+            xSemaphoreTake(client->api_lock, portMAX_DELAY);
+            deliver(msg->topic, msg->topic_len, msg->data_len, msg->qos);
+            xSemaphoreGive(client->api_lock);
+            pthread_mutex_lock(&client->lock);
+            client->outbox_bytes -= msg->topic_len + msg->data_len;
+            if (msg->qos > 0) {
+                queue_event(client, MQTT_EVENT_PUBLISHED, msg->msg_id, NULL, 0, NULL, 0);
+            }
+            client->busy--;
+            __real_free(msg);
+            pthread_cond_broadcast(&client->cond);
+            continue;
+        }
+
+        pthread_cond_wait(&client->cond, &client->lock);
+    }
+
+    if (client->sock >= 0) {
+        close(client->sock);
+        client->sock = -1;
+    }
+    client->connected = false;
+    client->ready = false;
+    client->stopped = true;
+    pthread_cond_broadcast(&client->cond);
+    pthread_mutex_unlock(&client->lock);
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config) {
+    esp_mqtt_client_handle_t client = __real_calloc(1, sizeof(*client));
+    if (!client) {
+        return NULL;
+    }
+    host_rtos_set_lock_name("mqtt_client");
+    client->api_lock = xSemaphoreCreateMutex();
+    host_rtos_set_lock_name(NULL);
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&client->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    client->stopped = true;
+    client->sock = -1;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void* event_handler_arg) {
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->lock);
+    if (client->running) {
+        pthread_mutex_unlock(&client->lock);
+        return ESP_FAIL;
+    }
+    client->running = true;
+    client->stopped = false;
+    pthread_mutex_unlock(&client->lock);
+
+    active_client = client;
+    // Core selection as in esp-mqtt's Kconfig
+#if CONFIG_MQTT_USE_CORE_1
+    BaseType_t core_id = 1;
+#elif CONFIG_MQTT_USE_CORE_0
+    BaseType_t core_id = 0;
+#else
+    BaseType_t core_id = tskNO_AFFINITY;
+#endif
+    if (xTaskCreatePinnedToCore(mqtt_task, "mqtt_task", 6144, client, 5, NULL, core_id) != pdPASS) {
+        client->running = false;
+        client->stopped = true;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&client->lock);
+    client->running = false;
+    pthread_cond_broadcast(&client->cond);
+    while (!client->stopped) {
+        pthread_cond_wait(&client->cond, &client->lock);
+    }
+    pthread_mutex_unlock(&client->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) {
+    if (!client) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_mqtt_client_stop(client);
+    if (active_client == client) {
+        active_client = NULL;
+    }
+    free_queue(&client->events);
+    free_queue(&client->outbox);
+    vSemaphoreDelete(client->api_lock);
+    pthread_mutex_destroy(&client->lock);
+    pthread_cond_destroy(&client->cond);
+    __real_free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain) {
+    if (!client || !topic) {
+        return -1;
+    }
+    if (len <= 0) {
+        len = data ? (int)strlen(data) : 0;
+    }
+
+    int64_t start_ns = host_now_ns();
+    pthread_mutex_lock(&client->lock);
+    bool connected = client->connected;
+    int msg_id = connected && qos > 0 ? next_msg_id(client) : 0;
+    pthread_mutex_unlock(&client->lock);
+    if (!connected) {
+        pthread_mutex_lock(&stats_lock);
+        broker_stats.rejected++;
+        pthread_mutex_unlock(&stats_lock);
+        return -1;
+    }
+
+    xSemaphoreTake(client->api_lock, portMAX_DELAY);
+    deliver(topic, (int)strlen(topic), len, qos);
+    xSemaphoreGive(client->api_lock);
+
+    if (qos > 0) {
+        pthread_mutex_lock(&client->lock);
+        queue_event(client, MQTT_EVENT_PUBLISHED, msg_id, NULL, 0, NULL, 0);
+        pthread_mutex_unlock(&client->lock);
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    broker_stats.publishes++;
+    broker_stats.publish_wait_ns += host_now_ns() - start_ns;
+    pthread_mutex_unlock(&stats_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char* topic, const char* data,
+                            int len, int qos, int retain, bool store) {
+    if (!client || !topic) {
+        return -1;
+    }
+    if (len <= 0) {
+        len = data ? (int)strlen(data) : 0;
+    }
+
+    sim_message_t* msg = new_message(MQTT_EVENT_ANY, topic, (int)strlen(topic), data, len);
+    if (!msg) {
+        return -1;
+    }
+    msg->qos = qos;
+
+    pthread_mutex_lock(&client->lock);
+    msg->msg_id = qos > 0 ? next_msg_id(client) : 0;
+    int msg_id = msg->msg_id;
+    push(&client->outbox, msg);
+    client->outbox_bytes += msg->topic_len + msg->data_len;
+    size_t outbox_bytes = client->outbox_bytes;
+    pthread_cond_broadcast(&client->cond);
+    pthread_mutex_unlock(&client->lock);
+
+    pthread_mutex_lock(&stats_lock);
+    broker_stats.enqueued++;
+    if (outbox_bytes > broker_stats.outbox_peak_bytes) {
+        broker_stats.outbox_peak_bytes = outbox_bytes;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos) {
+    esp_mqtt_topic_t filter = { .filter = topic, .qos = qos };
+    return esp_mqtt_client_subscribe_multiple(client, &filter, 1);
+}
+
+int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client, const esp_mqtt_topic_t* topic_list,
+                                       int size) {
+    if (!client || !topic_list || size <= 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&client->lock);
+    if (!client->connected) {
+        pthread_mutex_unlock(&client->lock);
+        return -1;
+    }
+    int msg_id = next_msg_id(client);
+    client->pending_subacks++;
+    queue_event(client, MQTT_EVENT_SUBSCRIBED, msg_id, NULL, 0, NULL, 0);
+    pthread_mutex_unlock(&client->lock);
+
+    pthread_mutex_lock(&stats_lock);
+    broker_stats.subscribes += size;
+    pthread_mutex_unlock(&stats_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+    if (!client) {
+        return 0;
+    }
+    pthread_mutex_lock(&client->lock);
+    int size = (int)client->outbox_bytes;
+    pthread_mutex_unlock(&client->lock);
+    return size;
+}
+
+// Harness API
+
+void sim_broker_set_write_delay_us(uint32_t delay_us) {
+    write_delay_us = delay_us;
+}
+
+void sim_broker_set_connect_delay_us(uint32_t delay_us) {
+    connect_delay_us = delay_us;
+}
+
+void sim_broker_set_tap(sim_broker_tap_t tap, void* arg) {
+    pthread_mutex_lock(&stats_lock);
+    broker_tap = tap;
+    broker_tap_arg = arg;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Waits until done(client) holds or the timeout passes, under client->lock
+static bool wait_for(bool (*done)(esp_mqtt_client_handle_t), uint32_t timeout_ms) {
+    esp_mqtt_client_handle_t client = active_client;
+    if (!client) {
+        return false;
+    }
+    int64_t deadline_ns = host_now_ns() + (int64_t)timeout_ms * 1000000LL;
+    struct timespec ts = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+    pthread_mutex_lock(&client->lock);
+    bool ok;
+    while (!(ok = done(client))) {
+        if (pthread_cond_timedwait(&client->cond, &client->lock, &ts) != 0) {
+            ok = done(client);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return ok;
+}
+
+static bool is_ready(esp_mqtt_client_handle_t client) {
+    return client->ready && client->pending_subacks == 0;
+}
+
+static bool is_drained(esp_mqtt_client_handle_t client) {
+    return client->outbox.head == NULL && client->events.head == NULL && client->busy == 0;
+}
+
+bool sim_broker_wait_connected(uint32_t timeout_ms) {
+    return wait_for(is_ready, timeout_ms);
+}
+
+bool sim_broker_flush(uint32_t timeout_ms) {
+    return wait_for(is_drained, timeout_ms);
+}
+
+esp_err_t sim_broker_inject(const char* topic, const char* data, int len) {
+    esp_mqtt_client_handle_t client = active_client;
+    if (!client) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len < 0) {
+        len = (int)strlen(data);
+    }
+    pthread_mutex_lock(&client->lock);
+    esp_err_t ret = client->connected ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (ret == ESP_OK) {
+        queue_event(client, MQTT_EVENT_DATA, 0, topic, (int)strlen(topic), data, len);
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    if (ret == ESP_OK) {
+        pthread_mutex_lock(&stats_lock);
+        broker_stats.injected++;
+        pthread_mutex_unlock(&stats_lock);
+    }
+    return ret;
+}
+
+void sim_broker_get_stats(sim_broker_stats_t* stats_out) {
+    pthread_mutex_lock(&stats_lock);
+    *stats_out = broker_stats;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void sim_broker_reset_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    memset(&broker_stats, 0, sizeof(broker_stats));
+    pthread_mutex_unlock(&stats_lock);
+}
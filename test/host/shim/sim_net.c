@@ -0,0 +1,733 @@
+// Simulated network: sockets, ICMP, ARP cache and the station interface.
+//
+// Nothing touches the host network. Every request is resolved when it is
+// sent: the target's loss decides whether it is answered, and its latency and
+// jitter when. select() then sleeps until the earliest answer or its timeout.
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/icmp.h"
+#include "lwip/ip4.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/etharp.h"
+#include "lwip/stats.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "host_shim.h"
+#include "shim_private.h"
+#include <pthread.h>
+#include <string.h>
+
+#define SIM_HOST_BUCKETS            2048   // Open-addressed host table, power of two
+#define SIM_ICMP_QUEUE              512    // Echo replies in flight on the raw socket
+#define SIM_ARP_CACHE               256
+#define SIM_NEVER                   INT64_MAX
+
+typedef enum {
+    SIM_SOCK_FREE = 0,
+    SIM_SOCK_TCP,
+    SIM_SOCK_UDP,
+    SIM_SOCK_RAW,
+} sim_sock_type_t;
+
+typedef struct {
+    sim_sock_type_t type;
+    int flags;                       // fcntl() flags
+    uint32_t peer_ipv4;
+    uint16_t peer_port;
+    bool connected;                  // UDP peer fixed, or TCP connect started
+    int64_t ready_us;                // TCP: connect answered; UDP: reply datagram arrives
+    int so_error;                    // TCP: result of the connect once answered
+    bool reply_pending;              // UDP: a reply datagram is on its way
+} sim_sock_t;
+
+typedef struct {
+    int64_t due_us;
+    uint32_t src_ipv4;
+    uint16_t id;
+    uint16_t seqno;
+} sim_echo_reply_t;
+
+typedef struct {
+    uint32_t ipv4;                   // 0 for a free entry
+    int64_t due_us;                  // When the pending reply shows up, SIM_NEVER if none is
+    bool stable;                     // Resolved, etharp_find_addr() returns it
+    struct eth_addr mac;
+    ip4_addr_t ip;
+} sim_arp_entry_t;
+
+static sim_host_t hosts[SIM_HOST_BUCKETS];
+static int host_count = 0;
+static sim_sock_t socks[CONFIG_LWIP_MAX_SOCKETS];
+static sim_echo_reply_t echo_replies[SIM_ICMP_QUEUE];
+static int echo_count = 0;
+static sim_arp_entry_t arp_cache[SIM_ARP_CACHE];
+static sim_net_stats_t net_stats;
+static uint32_t rng_state = 1;
+static uint32_t local_ipv4 = 0;
+static uint32_t local_netmask = 0;
+static pthread_mutex_t net_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t tcpip_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// PCB pools for system_metrics, following the open sockets
+static struct stats_mem udp_pcb_stats = { .name = "UDP_PCB", .avail = 16 };
+static struct stats_mem tcp_pcb_stats = { .name = "TCP_PCB", .avail = 16 };
+struct stats_ lwip_stats = {
+    .memp = {
+        [MEMP_UDP_PCB] = &udp_pcb_stats,
+        [MEMP_TCP_PCB] = &tcp_pcb_stats,
+    },
+};
+
+// Station interface
+struct esp_netif_obj {
+    struct netif netif;
+};
+static struct esp_netif_obj sta_netif;
+
+// xorshift32, under net_lock
+static uint32_t next_random(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+static sim_host_t* find_host(uint32_t ipv4) {
+    uint32_t slot = (ipv4 * 2654435761u) & (SIM_HOST_BUCKETS - 1);
+    for (int probe = 0; probe < SIM_HOST_BUCKETS; probe++) {
+        sim_host_t* host = &hosts[(slot + probe) & (SIM_HOST_BUCKETS - 1)];
+        if (host->ipv4 == ipv4 || host->ipv4 == 0) {
+            return host;
+        }
+    }
+    return NULL;
+}
+
+static sim_host_t* lookup_host(uint32_t ipv4) {
+    sim_host_t* host = find_host(ipv4);
+    return host && host->ipv4 == ipv4 ? host : NULL;
+}
+
+// When the answer to a request sent now arrives, SIM_NEVER if it is lost
+static int64_t answer_time_us(const sim_host_t* host, int64_t now_us) {
+    if (!host || !host->online || (uint32_t)(next_random() % 1000) < host->loss_permille) {
+        return SIM_NEVER;
+    }
+    int64_t rtt_us = host->latency_us;
+    if (host->jitter_us > 0) {
+        rtt_us += (int64_t)(next_random() % (2 * host->jitter_us + 1)) - host->jitter_us;
+    }
+    net_stats.replies++;
+    return now_us + (rtt_us > 0 ? rtt_us : 0);
+}
+
+static bool port_open(const sim_host_t* host, uint16_t port) {
+    for (int p = 0; host && p < host->port_count; p++) {
+        if (host->open_ports[p] == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static sim_sock_t* get_sock(int fd) {
+    int index = fd - LWIP_SOCKET_OFFSET;
+    if (index < 0 || index >= CONFIG_LWIP_MAX_SOCKETS || socks[index].type == SIM_SOCK_FREE) {
+        return NULL;
+    }
+    return &socks[index];
+}
+
+static void update_pcb_stats(sim_sock_type_t type, int delta) {
+    struct stats_mem* pool = type == SIM_SOCK_TCP ? &tcp_pcb_stats : type == SIM_SOCK_UDP ? &udp_pcb_stats : NULL;
+    if (!pool) {
+        return;
+    }
+    pool->used += delta;
+    if (pool->used > pool->max) {
+        pool->max = pool->used;
+    }
+}
+
+void sim_net_init(uint32_t ipv4, uint32_t netmask, uint32_t seed) {
+    pthread_mutex_lock(&net_lock);
+    memset(hosts, 0, sizeof(hosts));
+    memset(arp_cache, 0, sizeof(arp_cache));
+    host_count = 0;
+    echo_count = 0;
+    local_ipv4 = ipv4;
+    local_netmask = netmask;
+    sta_netif.netif.ip_addr.addr = ipv4;
+    sta_netif.netif.netmask.addr = netmask;
+    rng_state = seed ? seed : 1;
+    pthread_mutex_unlock(&net_lock);
+}
+
+esp_err_t sim_net_add_host(const sim_host_t* host) {
+    pthread_mutex_lock(&net_lock);
+    sim_host_t* slot = find_host(host->ipv4);
+    esp_err_t ret = ESP_OK;
+    if (!slot || (slot->ipv4 == 0 && host_count >= SIM_NET_MAX_HOSTS)) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        if (slot->ipv4 == 0) {
+            host_count++;
+        }
+        *slot = *host;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+esp_err_t sim_net_set_online(uint32_t ipv4, bool online) {
+    pthread_mutex_lock(&net_lock);
+    sim_host_t* host = lookup_host(ipv4);
+    if (host) {
+        host->online = online;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return host ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void sim_net_get_stats(sim_net_stats_t* stats_out) {
+    pthread_mutex_lock(&net_lock);
+    *stats_out = net_stats;
+    pthread_mutex_unlock(&net_lock);
+}
+
+void sim_net_reset_stats(void) {
+    pthread_mutex_lock(&net_lock);
+    int open = net_stats.sockets_open;
+    memset(&net_stats, 0, sizeof(net_stats));
+    net_stats.sockets_open = open;
+    net_stats.sockets_max = open;
+    pthread_mutex_unlock(&net_lock);
+}
+
+// Sockets
+
+int sim_socket(int domain, int type, int protocol) {
+    if (domain != AF_INET) {
+        errno = EAFNOSUPPORT;
+        return -1;
+    }
+    sim_sock_type_t sock_type = type == SOCK_STREAM ? SIM_SOCK_TCP :
+                                type == SOCK_DGRAM ? SIM_SOCK_UDP :
+                                type == SOCK_RAW && protocol == IPPROTO_ICMP ? SIM_SOCK_RAW : SIM_SOCK_FREE;
+    if (sock_type == SIM_SOCK_FREE) {
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&net_lock);
+    int fd = -1;
+    for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; i++) {
+        if (socks[i].type == SIM_SOCK_FREE) {
+            memset(&socks[i], 0, sizeof(socks[i]));
+            socks[i].type = sock_type;
+            socks[i].ready_us = SIM_NEVER;
+            fd = LWIP_SOCKET_OFFSET + i;
+            break;
+        }
+    }
+    if (fd < 0) {
+        net_stats.socket_failures++;
+        errno = ENFILE;
+    } else {
+        update_pcb_stats(sock_type, 1);
+        if (++net_stats.sockets_open > net_stats.sockets_max) {
+            net_stats.sockets_max = net_stats.sockets_open;
+        }
+    }
+    pthread_mutex_unlock(&net_lock);
+    return fd;
+}
+
+int sim_close(int fd) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    if (sock) {
+        if (sock->type == SIM_SOCK_RAW) {
+            echo_count = 0;
+        }
+        update_pcb_stats(sock->type, -1);
+        sock->type = SIM_SOCK_FREE;
+        net_stats.sockets_open--;
+    }
+    pthread_mutex_unlock(&net_lock);
+    if (!sock) {
+        errno = EBADF;
+        return -1;
+    }
+    return 0;
+}
+
+int sim_fcntl(int fd, int cmd, int arg) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    int ret = -1;
+    if (!sock) {
+        errno = EBADF;
+    } else if (cmd == F_GETFL) {
+        ret = sock->flags;
+    } else if (cmd == F_SETFL) {
+        sock->flags = arg;
+        ret = 0;
+    } else {
+        errno = EINVAL;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+int sim_setsockopt(int fd, int level, int optname, const void* optval, socklen_t optlen) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    pthread_mutex_unlock(&net_lock);
+    if (!sock) {
+        errno = EBADF;
+        return -1;
+    }
+    return 0;
+}
+
+int sim_getsockopt(int fd, int level, int optname, void* optval, socklen_t* optlen) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    int ret = -1;
+    if (!sock) {
+        errno = EBADF;
+    } else if (level == SOL_SOCKET && optname == SO_ERROR && *optlen >= sizeof(int)) {
+        int64_t now_us = esp_timer_get_time();
+        // Still in progress reads as no error, as on lwIP
+        *(int*)optval = sock->ready_us <= now_us ? sock->so_error : 0;
+        *optlen = sizeof(int);
+        ret = 0;
+    } else {
+        errno = ENOPROTOOPT;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+int sim_connect(int fd, const struct sockaddr* addr, socklen_t len) {
+    const struct sockaddr_in* in = (const struct sockaddr_in*)addr;
+    if (len < sizeof(*in) || in->sin_family != AF_INET) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    int ret = -1;
+    if (!sock || sock->type == SIM_SOCK_RAW) {
+        errno = sock ? EOPNOTSUPP : EBADF;
+    } else {
+        sock->peer_ipv4 = in->sin_addr.s_addr;
+        sock->peer_port = ntohs(in->sin_port);
+        sock->connected = true;
+        if (sock->type == SIM_SOCK_UDP) {
+            ret = 0;
+        } else {
+            // Refused and accepted connects both answer after one RTT; lost ones never do
+            sim_host_t* host = lookup_host(sock->peer_ipv4);
+            net_stats.tcp_connects++;
+            sock->ready_us = answer_time_us(host, esp_timer_get_time());
+            sock->so_error = port_open(host, sock->peer_port) ? 0 : ECONNREFUSED;
+            errno = EINPROGRESS;
+        }
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+ssize_t sim_send(int fd, const void* buf, size_t len, int flags) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    ssize_t ret = -1;
+    if (!sock) {
+        errno = EBADF;
+    } else if (sock->type != SIM_SOCK_UDP || !sock->connected) {
+        errno = ENOTCONN;
+    } else {
+        sim_host_t* host = lookup_host(sock->peer_ipv4);
+        net_stats.udp_requests++;
+        if (port_open(host, sock->peer_port)) {
+            sock->ready_us = answer_time_us(host, esp_timer_get_time());
+            sock->reply_pending = sock->ready_us != SIM_NEVER;
+        }
+        ret = (ssize_t)len;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+ssize_t sim_recv(int fd, void* buf, size_t len, int flags) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    ssize_t ret = -1;
+    if (!sock) {
+        errno = EBADF;
+    } else if (sock->type == SIM_SOCK_UDP && sock->reply_pending && sock->ready_us <= esp_timer_get_time()) {
+        sock->reply_pending = false;
+        sock->ready_us = SIM_NEVER;
+        if (len > 0) {
+            ((uint8_t*)buf)[0] = '\n';
+        }
+        ret = len > 0 ? 1 : 0;
+    } else {
+        errno = EAGAIN;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+// A Wake-on-LAN magic packet: 6 x 0xFF, then the MAC 16 times
+static bool is_magic_packet(const uint8_t* data, size_t len) {
+    if (len < 102) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ssize_t sim_sendto(int fd, const void* buf, size_t len, int flags, const struct sockaddr* addr, socklen_t addr_len) {
+    const struct sockaddr_in* in = (const struct sockaddr_in*)addr;
+    if (!in || addr_len < sizeof(*in)) {
+        return sim_send(fd, buf, len, flags);
+    }
+
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    ssize_t ret = -1;
+    int64_t now_us = esp_timer_get_time();
+    if (!sock) {
+        errno = EBADF;
+    } else if (sock->type == SIM_SOCK_RAW) {
+        const struct icmp_echo_hdr* echo = (const struct icmp_echo_hdr*)buf;
+        if (len >= sizeof(*echo) && ICMPH_TYPE(echo) == ICMP_ECHO) {
+            net_stats.icmp_requests++;
+            int64_t due_us = answer_time_us(lookup_host(in->sin_addr.s_addr), now_us);
+            if (due_us != SIM_NEVER && echo_count < SIM_ICMP_QUEUE) {
+                sim_echo_reply_t* reply = &echo_replies[echo_count++];
+                reply->due_us = due_us;
+                reply->src_ipv4 = in->sin_addr.s_addr;
+                reply->id = echo->id;
+                reply->seqno = echo->seqno;
+            }
+        }
+        ret = (ssize_t)len;
+    } else if (sock->type == SIM_SOCK_UDP) {
+        if (is_magic_packet((const uint8_t*)buf, len)) {
+            net_stats.magic_packets++;
+        }
+        ret = (ssize_t)len;
+    } else {
+        errno = EOPNOTSUPP;
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ret;
+}
+
+ssize_t sim_recvfrom(int fd, void* buf, size_t len, int flags, struct sockaddr* addr, socklen_t* addr_len) {
+    pthread_mutex_lock(&net_lock);
+    sim_sock_t* sock = get_sock(fd);
+    if (!sock || sock->type != SIM_SOCK_RAW) {
+        pthread_mutex_unlock(&net_lock);
+        return sock ? sim_recv(fd, buf, len, flags) : (errno = EBADF, -1);
+    }
+
+    // Earliest reply that is due
+    int64_t now_us = esp_timer_get_time();
+    int best = -1;
+    for (int i = 0; i < echo_count; i++) {
+        if (echo_replies[i].due_us <= now_us && (best < 0 || echo_replies[i].due_us < echo_replies[best].due_us)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        pthread_mutex_unlock(&net_lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    sim_echo_reply_t reply = echo_replies[best];
+    echo_replies[best] = echo_replies[--echo_count];
+    pthread_mutex_unlock(&net_lock);
+
+    // Raw sockets deliver the IP header in front of the ICMP message
+    uint8_t packet[IP_HLEN + sizeof(struct icmp_echo_hdr)];
+    memset(packet, 0, sizeof(packet));
+    struct ip_hdr* ip = (struct ip_hdr*)packet;
+    ip->_v_hl = 0x45;
+    ip->_proto = IPPROTO_ICMP;
+    ip->src = reply.src_ipv4;
+    ip->dest = local_ipv4;
+    struct icmp_echo_hdr* echo = (struct icmp_echo_hdr*)(packet + IP_HLEN);
+    ICMPH_TYPE_SET(echo, ICMP_ER);
+    echo->id = reply.id;
+    echo->seqno = reply.seqno;
+    echo->chksum = inet_chksum(echo, sizeof(*echo));
+
+    size_t copied = len < sizeof(packet) ? len : sizeof(packet);
+    memcpy(buf, packet, copied);
+    if (addr && addr_len && *addr_len >= sizeof(struct sockaddr_in)) {
+        struct sockaddr_in* from = (struct sockaddr_in*)addr;
+        memset(from, 0, sizeof(*from));
+        from->sin_family = AF_INET;
+        from->sin_addr.s_addr = reply.src_ipv4;
+        *addr_len = sizeof(*from);
+    }
+    return (ssize_t)copied;
+}
+
+// Whether a socket is ready for the given direction, or when it will be
+static int64_t ready_time_us(const sim_sock_t* sock, bool write) {
+    if (sock->type == SIM_SOCK_TCP) {
+        return write && sock->connected ? sock->ready_us : SIM_NEVER;
+    }
+    if (write) {
+        return 0;
+    }
+    if (sock->type == SIM_SOCK_UDP) {
+        return sock->reply_pending ? sock->ready_us : SIM_NEVER;
+    }
+    int64_t earliest = SIM_NEVER;
+    for (int i = 0; i < echo_count; i++) {
+        if (echo_replies[i].due_us < earliest) {
+            earliest = echo_replies[i].due_us;
+        }
+    }
+    return earliest;
+}
+
+int sim_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = timeout ? start_us + (int64_t)timeout->tv_sec * 1000000 + timeout->tv_usec : SIM_NEVER;
+    fd_set want_read, want_write;
+    FD_ZERO(&want_read);
+    FD_ZERO(&want_write);
+    if (readfds) {
+        want_read = *readfds;
+    }
+    if (writefds) {
+        want_write = *writefds;
+    }
+
+    pthread_mutex_lock(&net_lock);
+    net_stats.selects++;
+    pthread_mutex_unlock(&net_lock);
+
+    while (true) {
+        int ready = 0;
+        int64_t next_us = deadline_us;
+        int64_t now_us = esp_timer_get_time();
+
+        pthread_mutex_lock(&net_lock);
+        for (int fd = 0; fd < nfds; fd++) {
+            bool check_read = FD_ISSET(fd, &want_read);
+            bool check_write = FD_ISSET(fd, &want_write);
+            if (!check_read && !check_write) {
+                continue;
+            }
+            sim_sock_t* sock = get_sock(fd);
+            if (!sock) {
+                pthread_mutex_unlock(&net_lock);
+                errno = EBADF;
+                return -1;
+            }
+            for (int direction = 0; direction < 2; direction++) {
+                bool write = direction == 1;
+                if (!(write ? check_write : check_read)) {
+                    continue;
+                }
+                int64_t at_us = ready_time_us(sock, write);
+                if (at_us <= now_us) {
+                    ready++;
+                } else {
+                    FD_CLR(fd, write ? writefds : readfds);
+                    if (at_us < next_us) {
+                        next_us = at_us;
+                    }
+                }
+            }
+        }
+        pthread_mutex_unlock(&net_lock);
+
+        if (ready > 0 || now_us >= deadline_us) {
+            if (exceptfds) {
+                FD_ZERO(exceptfds);
+            }
+            return ready;
+        }
+
+        // Restore the sets and sleep until the next socket or the timeout
+        if (readfds) {
+            *readfds = want_read;
+        }
+        if (writefds) {
+            *writefds = want_write;
+        }
+        host_sleep_until_ns(host_now_ns() + (next_us - now_us) * 1000);
+    }
+}
+
+// DNS
+
+int sim_getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res) {
+    static struct sockaddr_in address;
+    static struct addrinfo result;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    memset(&result, 0, sizeof(result));
+    result.ai_family = AF_INET;
+    result.ai_socktype = hints ? hints->ai_socktype : SOCK_STREAM;
+    result.ai_addr = (struct sockaddr*)&address;
+    result.ai_addrlen = sizeof(address);
+    *res = &result;
+    return 0;
+}
+
+void sim_freeaddrinfo(struct addrinfo* res) {
+}
+
+uint16_t inet_chksum(const void* dataptr, uint16_t len) {
+    const uint8_t* data = (const uint8_t*)dataptr;
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
+
+// ARP
+
+// Called with net_lock held
+static sim_arp_entry_t* arp_entry(uint32_t ipv4) {
+    sim_arp_entry_t* entry = NULL;
+    for (int i = 0; i < SIM_ARP_CACHE && !entry; i++) {
+        if (arp_cache[i].ipv4 == ipv4) {
+            entry = &arp_cache[i];
+        }
+    }
+    for (int i = 0; i < SIM_ARP_CACHE && !entry; i++) {
+        if (arp_cache[i].ipv4 == 0) {
+            entry = &arp_cache[i];
+        }
+    }
+    if (!entry) {
+        // Cache full: evict a pseudo-random entry, like lwIP reusing its oldest
+        entry = &arp_cache[next_random() % SIM_ARP_CACHE];
+        memset(entry, 0, sizeof(*entry));
+    }
+    if (entry->ipv4 != ipv4) {
+        entry->ipv4 = ipv4;
+        entry->ip.addr = ipv4;
+        entry->due_us = SIM_NEVER;
+        entry->stable = false;
+    }
+    return entry;
+}
+
+// Like lwIP, a request leaves a resolved entry in place; only the reply
+// refreshes it, an offline host stays cached until the entry is removed
+err_t etharp_request(struct netif* netif, const ip4_addr_t* ipaddr) {
+    pthread_mutex_lock(&net_lock);
+    net_stats.arp_requests++;
+    sim_arp_entry_t* entry = arp_entry(ipaddr->addr);
+    sim_host_t* host = lookup_host(ipaddr->addr);
+    int64_t due_us = answer_time_us(host, esp_timer_get_time());
+    if (due_us != SIM_NEVER) {
+        entry->due_us = due_us;
+        memcpy(entry->mac.addr, host->mac, sizeof(entry->mac.addr));
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ERR_OK;
+}
+
+err_t etharp_add_static_entry(const ip4_addr_t* ipaddr, struct eth_addr* ethaddr) {
+    pthread_mutex_lock(&net_lock);
+    sim_arp_entry_t* entry = arp_entry(ipaddr->addr);
+    entry->mac = *ethaddr;
+    entry->stable = true;
+    entry->due_us = SIM_NEVER;
+    pthread_mutex_unlock(&net_lock);
+    return ERR_OK;
+}
+
+err_t etharp_remove_static_entry(const ip4_addr_t* ipaddr) {
+    pthread_mutex_lock(&net_lock);
+    for (int i = 0; i < SIM_ARP_CACHE; i++) {
+        if (arp_cache[i].ipv4 == ipaddr->addr) {
+            memset(&arp_cache[i], 0, sizeof(arp_cache[i]));
+        }
+    }
+    pthread_mutex_unlock(&net_lock);
+    return ERR_OK;
+}
+
+int etharp_find_addr(struct netif* netif, const ip4_addr_t* ipaddr, struct eth_addr** eth_ret,
+                     const ip4_addr_t** ip_ret) {
+    pthread_mutex_lock(&net_lock);
+    int found = -1;
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < SIM_ARP_CACHE; i++) {
+        if (arp_cache[i].ipv4 != ipaddr->addr) {
+            continue;
+        }
+        if (arp_cache[i].due_us <= now_us) {
+            arp_cache[i].stable = true;
+            arp_cache[i].due_us = SIM_NEVER;
+        }
+        if (arp_cache[i].stable) {
+            *eth_ret = &arp_cache[i].mac;
+            *ip_ret = &arp_cache[i].ip;
+            found = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&net_lock);
+    return found;
+}
+
+// Station interface
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char* if_key) {
+    return strcmp(if_key, "WIFI_STA_DEF") == 0 ? &sta_netif : NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info) {
+    if (!esp_netif || !ip_info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = local_ipv4;
+    ip_info->netmask.addr = local_netmask;
+    ip_info->gw.addr = (local_ipv4 & local_netmask) | htonl(1);
+    return ESP_OK;
+}
+
+void* esp_netif_get_netif_impl(esp_netif_t* esp_netif) {
+    return esp_netif ? &esp_netif->netif : NULL;
+}
+
+esp_err_t esp_netif_tcpip_exec(esp_netif_callback_fn fn, void* ctx) {
+    pthread_mutex_lock(&tcpip_lock);
+    esp_err_t ret = fn(ctx);
+    pthread_mutex_unlock(&tcpip_lock);
+    return ret;
+}